@@ -0,0 +1,1207 @@
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assembler.h"
+#include "binfmt.h"
+
+/*!
+ * \file assembler.c
+ * \brief Implémentation de assembler.h. Assembleur en une passe.
+ */
+
+const char *asm_section_names[] =
+{
+    "NONE",
+    "TEXT",
+    "DATA",
+};
+
+//! Taille du tampon de lecture du source
+#define READBUF_SIZE (64 * 1024)
+
+//! Nombre de mots accumulés avant une écriture dans le fichier binaire
+#define FLUSH_CHUNK 4096
+
+//! Nature d'une référence en avant
+typedef enum
+{
+    FIX_ADDRESS,    //!< Champ adresse absolue (20 bits)
+    FIX_IMMEDIATE,  //!< Champ valeur immédiate (20 bits signés)
+    FIX_OFFSET,     //!< Champ déplacement indexé (16 bits signés)
+    FIX_WORD,       //!< Mot de donnée complet
+    FIX_ALIAS,      //!< Symbole synonyme (EQU symbole)
+} Fixup_Kind;
+
+//! Référence en avant en attente de la définition d'un symbole
+typedef struct
+{
+    int _next;          //!< Référence suivante du même symbole (-1 : fin)
+    Fixup_Kind _kind;   //!< Champ à corriger
+    Asm_Section _sect;  //!< Segment contenant le mot à corriger
+    unsigned _addr;     //!< Adresse du mot, ou numéro du symbole synonyme
+    unsigned _line;     //!< Ligne de la référence (messages d'erreur)
+    bool _resolved;     //!< Référence corrigée ?
+} Fixup;
+
+//! Entrée de la table des symboles
+typedef struct
+{
+    uint32_t _hash;     //!< Valeur de hachage du nom
+    unsigned _name;     //!< Position du nom dans la table des chaînes
+    Word _value;        //!< Valeur du symbole
+    Asm_Section _sect;  //!< Section du symbole
+    bool _defined;      //!< Symbole défini ?
+    int _fixups;        //!< Première référence en suspens (-1 : aucune)
+} Symbol;
+
+//! Segment en cours de construction
+typedef struct
+{
+    Word *_words;       //!< Image du segment
+    unsigned _count;    //!< Nombre de mots produits
+    unsigned _cap;      //!< Capacité de l'image
+    unsigned _flushed;  //!< Nombre de mots déjà écrits dans le fichier
+    int *_ring;         //!< File des références en suspens (ordre d'adresse)
+    unsigned _head;     //!< Tête de la file
+    unsigned _len;      //!< Longueur de la file
+    unsigned _ringcap;  //!< Capacité de la file (puissance de 2)
+    uint32_t _crc;      //!< CRC-32 des mots déjà écrits
+} Segment;
+
+//! État de l'assembleur
+typedef struct
+{
+    // Lecture du source
+    FILE *_in;
+    const char *_name;
+    char _buf[READBUF_SIZE];
+    size_t _bufpos, _buflen;
+    bool _eof;
+    unsigned _line;
+    unsigned _errors;
+
+    // Table des symboles (adressage ouvert) et table des chaînes
+    Symbol *_symbols;
+    unsigned _nsymbols, _symcap;
+    int *_slots;
+    unsigned _nslots;
+    char *_strings;
+    unsigned _strlen, _strcap;
+
+    // Réserve de références en avant
+    Fixup *_fixups;
+    unsigned _nfixups, _fixcap;
+    int _freefix;
+    unsigned _pending;
+    int _linefix;               // référence de la ligne courante (-1 : aucune)
+    unsigned _linesym;          // et son symbole
+
+    // Segments et sections
+    Segment _seg[3];            // indexé par Asm_Section (TEXT, DATA)
+    Asm_Section _current;
+    bool _text_seen, _text_done, _data_seen, _data_done;
+    unsigned _text_decl, _data_decl;
+    unsigned _textsize, _datasize, _dataend;
+
+    // Sortie
+    FILE *_out;
+    unsigned _flags;
+    bool _seekable;
+
+    Asm_Stats _stats;
+} Asm;
+
+//! Description d'un mnémonique
+typedef struct
+{
+    const char *_name;  //!< Mnémonique
+    Code_Op _cop;       //!< Code opération
+    enum
+    {
+        FORM_NONE,      //!< Pas d'opérande
+        FORM_REG,       //!< Registre, opérande
+        FORM_COND,      //!< Condition, opérande
+        FORM_OPERAND,   //!< Opérande seul
+        FORM_MOVE,      //!< Registre, registre
+    } _form;
+    bool _immediate;    //!< Adressages immédiat et registre autorisés ?
+} Mnemonic;
+
+//! Table des mnémoniques
+static const Mnemonic mnemonics[] =
+{
+    {"ILLOP",   ILLOP,  FORM_NONE,      false},
+    {"NOP",     NOP,    FORM_NONE,      false},
+    {"LOAD",    LOAD,   FORM_REG,       true},
+    {"STORE",   STORE,  FORM_REG,       false},
+    {"ADD",     ADD,    FORM_REG,       true},
+    {"SUB",     SUB,    FORM_REG,       true},
+    {"BRANCH",  BRANCH, FORM_COND,      false},
+    {"CALL",    CALL,   FORM_COND,      false},
+    {"RET",     RET,    FORM_NONE,      false},
+    {"PUSH",    PUSH,   FORM_OPERAND,   true},
+    {"POP",     POP,    FORM_OPERAND,   false},
+    {"HALT",    HALT,   FORM_NONE,      false},
+    {"XCHG",    XCHG,   FORM_REG,       false},
+    {"MUL",     MUL,    FORM_REG,       true},
+    {"DIV",     DIV,    FORM_REG,       true},
+    {"MOD",     MOD,    FORM_REG,       true},
+    {"AND",     AND,    FORM_REG,       true},
+    {"OR",      OR,     FORM_REG,       true},
+    {"XOR",     XOR,    FORM_REG,       true},
+    {"SHL",     SHL,    FORM_REG,       true},
+    {"SHR",     SHR,    FORM_REG,       true},
+    {"SAR",     SAR,    FORM_REG,       true},
+    {"CMP",     CMP,    FORM_REG,       true},
+    {"MOV",     LOAD,   FORM_MOVE,      true},
+};
+
+//! Affiche une erreur de syntaxe
+/*!
+ * \param a l'assembleur
+ * \param line la ligne de l'erreur
+ * \param fmt le format du message (comme printf)
+ */
+static void asm_error(Asm *a, unsigned line, const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "%s:%u: error: ", a->_name, line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    ++a->_errors;
+}
+
+//! Agrandit un tableau dynamique
+/*!
+ * Abandonne le programme si la mémoire est épuisée.
+ *
+ * \param ptr le tableau
+ * \param cap sa capacité courante (mise à jour)
+ * \param need la capacité minimale souhaitée
+ * \param elsize la taille d'un élément
+ * \return le tableau agrandi
+ */
+static void *grow(void *ptr, unsigned *cap, unsigned need, size_t elsize)
+{
+    if(need <= *cap)
+        return ptr;
+
+    unsigned newcap = *cap ? *cap : 64;
+    while(newcap < need)
+        newcap *= 2;
+
+    if(!(ptr = realloc(ptr, newcap * elsize)))
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(1);
+    }
+
+    *cap = newcap;
+    return ptr;
+}
+
+//! Hachage FNV-1a d'un nom de symbole
+static uint32_t hash_name(const char *name, size_t len)
+{
+    uint32_t h = 2166136261u;
+
+    for(size_t i = 0; i < len; ++i)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+
+    return h;
+}
+
+//! Double la table de hachage et y réinsère les symboles
+static void rehash(Asm *a)
+{
+    unsigned n = a->_nslots ? 2 * a->_nslots : 1024;
+    int *slots = malloc(n * sizeof(int));
+
+    if(!slots)
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(1);
+    }
+
+    memset(slots, -1, n * sizeof(int));
+
+    for(unsigned s = 0; s < a->_nsymbols; ++s)
+    {
+        unsigned i = a->_symbols[s]._hash & (n - 1);
+        while(slots[i] >= 0)
+            i = (i + 1) & (n - 1);
+        slots[i] = s;
+    }
+
+    free(a->_slots);
+    a->_slots = slots;
+    a->_nslots = n;
+}
+
+//! Recherche (ou création) d'un symbole
+/*!
+ * \param a l'assembleur
+ * \param name le nom (non terminé par un nul)
+ * \param len sa longueur
+ * \return le numéro du symbole
+ */
+static unsigned lookup(Asm *a, const char *name, size_t len)
+{
+    uint32_t h = hash_name(name, len);
+    unsigned i = h & (a->_nslots - 1);
+
+    for(int s; (s = a->_slots[i]) >= 0; i = (i + 1) & (a->_nslots - 1))
+    {
+        const char *sname = a->_strings + a->_symbols[s]._name;
+        if(a->_symbols[s]._hash == h && strncmp(sname, name, len) == 0
+                && sname[len] == '\0')
+            return s;
+    }
+
+    // Nouveau symbole
+    a->_strings = grow(a->_strings, &a->_strcap, a->_strlen + len + 1, 1);
+    memcpy(a->_strings + a->_strlen, name, len);
+    a->_strings[a->_strlen + len] = '\0';
+
+    a->_symbols = grow(a->_symbols, &a->_symcap, a->_nsymbols + 1,
+            sizeof(Symbol));
+    unsigned s = a->_nsymbols++;
+    a->_symbols[s] = (Symbol) {h, a->_strlen, 0, SECT_NONE, false, -1};
+    a->_strlen += len + 1;
+    a->_slots[i] = s;
+
+    // Taux de remplissage maximal : 1/2
+    if(2 * a->_nsymbols > a->_nslots)
+        rehash(a);
+
+    return s;
+}
+
+//! Ajoute un mot au segment courant
+static void emit(Asm *a, Asm_Section sect, Word w)
+{
+    Segment *seg = &a->_seg[sect];
+
+    seg->_words = grow(seg->_words, &seg->_cap, seg->_count + 1, sizeof(Word));
+    seg->_words[seg->_count++] = w;
+}
+
+//! Écrit des mots dans le fichier binaire (ordre du format de sortie)
+static bool write_words(Asm *a, const Word *words, size_t n, uint32_t *crc)
+{
+    if(a->_flags & ASM_LEGACY)
+        return fwrite(words, sizeof(Word), n, a->_out) == n;
+
+    return write_program_words(a->_out, words, n, crc);
+}
+
+//! Écrit les mots du segment qui ne dépendent plus d'aucun symbole indéfini
+/*!
+ * Le texte est écrit en premier ; les données ne sont écrites qu'une fois
+ * le texte entièrement écrit, afin de respecter l'ordre du fichier.
+ *
+ * \param a l'assembleur
+ * \param force écrire même si moins de FLUSH_CHUNK mots sont prêts
+ */
+static void flush(Asm *a, bool force)
+{
+    if(!a->_seekable)
+        return;
+
+    for(Asm_Section sect = SECT_TEXT; sect <= SECT_DATA; ++sect)
+    {
+        Segment *seg = &a->_seg[sect];
+
+        // On retire de la file les références déjà corrigées
+        while(seg->_len > 0 && a->_fixups[seg->_ring[seg->_head]]._resolved)
+        {
+            int f = seg->_ring[seg->_head];
+            a->_fixups[f]._next = a->_freefix;
+            a->_freefix = f;
+            seg->_head = (seg->_head + 1) & (seg->_ringcap - 1);
+            --seg->_len;
+        }
+
+        unsigned limit = seg->_len > 0 ?
+            a->_fixups[seg->_ring[seg->_head]]._addr : seg->_count;
+
+        if(limit > seg->_flushed && (force || limit - seg->_flushed >= FLUSH_CHUNK))
+        {
+            if(!write_words(a, seg->_words + seg->_flushed,
+                        limit - seg->_flushed, &seg->_crc))
+            {
+                fprintf(stderr, "Erreur durant l'écriture du fichier binaire.\n");
+                exit(1);
+            }
+            seg->_flushed = limit;
+        }
+
+        // Le texte doit être complet avant d'écrire les données
+        if(!a->_text_done || seg->_flushed < a->_textsize)
+            return;
+    }
+}
+
+//! La valeur tient-elle dans le champ de nature \a kind ?
+static bool fits(Fixup_Kind kind, Word value)
+{
+    int32_t v = (int32_t)value;
+
+    switch(kind)
+    {
+        case FIX_ADDRESS:
+            return value < (1u << 20);
+
+        case FIX_IMMEDIATE:
+            return v >= -(1 << 19) && v < (1 << 19);
+
+        case FIX_OFFSET:
+            return v >= -(1 << 15) && v < (1 << 15);
+
+        default:    // FIX_WORD, FIX_ALIAS
+            return true;
+    }
+}
+
+//! Corrige un champ d'un mot d'un segment
+static void patch(Asm *a, const Fixup *fix, Word value)
+{
+    // Un mot jamais produit ne peut être corrigé
+    if(fix->_sect == SECT_NONE || fix->_addr >= a->_seg[fix->_sect]._count)
+    {
+        asm_error(a, fix->_line, "unresolvable reference");
+        return;
+    }
+
+    // Le champ serait tronqué
+    if(!fits(fix->_kind, value))
+    {
+        asm_error(a, fix->_line, "value out of range");
+        return;
+    }
+
+    Word *w = &a->_seg[fix->_sect]._words[fix->_addr];
+    Instruction instr = {._raw = *w};
+
+    switch(fix->_kind)
+    {
+        case FIX_ADDRESS:
+            instr.instr_absolute._address = value;
+            break;
+
+        case FIX_IMMEDIATE:
+            instr.instr_immediate._value = value;
+            break;
+
+        case FIX_OFFSET:
+            instr.instr_indexed._offset = value;
+            break;
+
+        default:    // FIX_WORD
+            instr._raw = value;
+            break;
+    }
+
+    *w = instr._raw;
+}
+
+//! Définit un symbole et résout les références qui l'attendaient
+/*!
+ * \param a l'assembleur
+ * \param s le numéro du symbole
+ * \param value sa valeur
+ * \param sect sa section
+ */
+static void define(Asm *a, unsigned s, Word value, Asm_Section sect)
+{
+    if(a->_symbols[s]._defined)
+    {
+        asm_error(a, a->_line, "symbol %s redefined",
+                a->_strings + a->_symbols[s]._name);
+        return;
+    }
+
+    a->_symbols[s]._defined = true;
+    a->_symbols[s]._value = value;
+    a->_symbols[s]._sect = sect;
+    ++a->_stats._symbols;
+
+    int f = a->_symbols[s]._fixups;
+    a->_symbols[s]._fixups = -1;
+
+    while(f >= 0)
+    {
+        Fixup *fix = &a->_fixups[f];
+        int next = fix->_next;
+
+        --a->_pending;
+        ++a->_stats._fixups;
+
+        if(fix->_kind == FIX_ALIAS)
+        {
+            // Les synonymes ne figurent dans aucune file : libération immédiate
+            unsigned alias = fix->_addr;
+            fix->_next = a->_freefix;
+            a->_freefix = f;
+            define(a, alias, value, sect);
+        }
+        else
+        {
+            patch(a, fix, value);
+            fix->_resolved = true;
+        }
+
+        f = next;
+    }
+}
+
+//! Valeur d'un symbole, ou enregistrement d'une référence en avant
+/*!
+ * \param a l'assembleur
+ * \param s le numéro du symbole référencé
+ * \param kind le champ à corriger
+ * \param sect le segment du mot à corriger
+ * \param addr l'adresse du mot (ou le symbole synonyme pour FIX_ALIAS)
+ * \param value la valeur si le symbole est déjà défini
+ * \return vrai si le symbole est défini
+ */
+static bool reference(Asm *a, unsigned s, Fixup_Kind kind,
+        Asm_Section sect, unsigned addr, Word *value)
+{
+    if(a->_symbols[s]._defined)
+    {
+        *value = a->_symbols[s]._value;
+        return true;
+    }
+
+    int f;
+    if(a->_freefix >= 0)
+    {
+        f = a->_freefix;
+        a->_freefix = a->_fixups[f]._next;
+    }
+    else
+    {
+        a->_fixups = grow(a->_fixups, &a->_fixcap, a->_nfixups + 1,
+                sizeof(Fixup));
+        f = a->_nfixups++;
+    }
+
+    a->_fixups[f] = (Fixup) {a->_symbols[s]._fixups, kind, sect, addr,
+        a->_line, false};
+    a->_symbols[s]._fixups = f;
+    a->_linefix = f;
+    a->_linesym = s;
+
+    if(++a->_pending > a->_stats._max_pending)
+        a->_stats._max_pending = a->_pending;
+
+    if(kind != FIX_ALIAS)
+    {
+        Segment *seg = &a->_seg[sect];
+
+        if(seg->_len == seg->_ringcap)
+        {
+            // Agrandissement de la file en conservant l'ordre
+            unsigned oldcap = seg->_ringcap;
+            int *ring = malloc((oldcap ? 2 * oldcap : 256) * sizeof(int));
+            if(!ring)
+            {
+                fprintf(stderr, "Mémoire insuffisante.\n");
+                exit(1);
+            }
+            for(unsigned i = 0; i < seg->_len; ++i)
+                ring[i] = seg->_ring[(seg->_head + i) & (oldcap - 1)];
+            free(seg->_ring);
+            seg->_ring = ring;
+            seg->_head = 0;
+            seg->_ringcap = oldcap ? 2 * oldcap : 256;
+        }
+
+        seg->_ring[(seg->_head + seg->_len++) & (seg->_ringcap - 1)] = f;
+    }
+
+    *value = 0;
+    return false;
+}
+
+//! Abandon de la référence en avant de la ligne courante
+/*!
+ * Appelée quand la ligne est rejetée après l'enregistrement de sa
+ * référence : le mot à corriger n'a pas été produit. Une ligne enregistre au
+ * plus une référence, la plus récente de son symbole et de la file de son
+ * segment.
+ */
+static void cancel_reference(Asm *a)
+{
+    int f = a->_linefix;
+
+    if(f < 0)
+        return;
+
+    Fixup *fix = &a->_fixups[f];
+
+    a->_symbols[a->_linesym]._fixups = fix->_next;
+    if(fix->_kind != FIX_ALIAS)
+        --a->_seg[fix->_sect]._len;
+    --a->_pending;
+
+    fix->_next = a->_freefix;
+    a->_freefix = f;
+    a->_linefix = -1;
+}
+
+//! Lecture d'une ligne du source
+/*!
+ * \param a l'assembleur
+ * \param line tampon de ASM_MAXLINE caractères
+ * \return faux à la fin du source
+ */
+static bool read_line(Asm *a, char *line)
+{
+    size_t n = 0;
+    bool truncated = false;
+
+    if(a->_eof && a->_bufpos == a->_buflen)
+        return false;
+
+    while(true)
+    {
+        if(a->_bufpos == a->_buflen)
+        {
+            a->_buflen = a->_eof ? 0 : fread(a->_buf, 1, READBUF_SIZE, a->_in);
+            a->_bufpos = 0;
+            if(a->_buflen == 0)
+            {
+                a->_eof = true;
+                break;
+            }
+        }
+
+        const char *start = a->_buf + a->_bufpos;
+        size_t avail = a->_buflen - a->_bufpos;
+        const char *nl = memchr(start, '\n', avail);
+        size_t len = nl ? (size_t)(nl - start) : avail;
+        size_t copy = len < ASM_MAXLINE - 1 - n ? len : ASM_MAXLINE - 1 - n;
+
+        memcpy(line + n, start, copy);
+        n += copy;
+        truncated |= copy < len;
+        a->_bufpos += len + (nl ? 1 : 0);
+
+        if(nl)
+            break;
+    }
+
+    line[n] = '\0';
+    ++a->_line;
+
+    // Une ligne tronquée serait assemblée en silence de travers
+    if(truncated)
+    {
+        asm_error(a, a->_line, "line too long");
+        line[0] = '\0';
+    }
+    return true;
+}
+
+//! Saute les espaces
+static char *skip_spaces(char *p)
+{
+    while(*p == ' ' || *p == '\t' || *p == '\r')
+        ++p;
+    return p;
+}
+
+//! Longueur d'un identificateur commençant en \a p (0 si aucun)
+static size_t ident_len(const char *p)
+{
+    size_t n = 0;
+
+    if(isalpha((unsigned char)*p) || *p == '_')
+        while(isalnum((unsigned char)p[n]) || p[n] == '_')
+            ++n;
+
+    return n;
+}
+
+//! Compare un identificateur à un mot-clé
+static bool is_keyword(const char *p, size_t len, const char *kw)
+{
+    return strlen(kw) == len && strncmp(p, kw, len) == 0;
+}
+
+//! Lecture d'une valeur numérique ou symbolique
+/*!
+ * \param a l'assembleur
+ * \param pp position courante (mise à jour)
+ * \param kind le champ à corriger si la valeur est un symbole indéfini
+ * \param sect le segment du mot à corriger
+ * \param addr l'adresse du mot à corriger
+ * \param value la valeur lue
+ * \return faux en cas d'erreur de syntaxe
+ */
+static bool parse_value(Asm *a, char **pp, Fixup_Kind kind,
+        Asm_Section sect, unsigned addr, Word *value)
+{
+    char *p = *pp;
+    size_t len = ident_len(p);
+
+    if(len > 0)
+    {
+        reference(a, lookup(a, p, len), kind, sect, addr, value);
+        *pp = p + len;
+        return true;
+    }
+
+    bool neg = false;
+    if(*p == '+' || *p == '-')
+        neg = *p++ == '-';
+
+    if(!isdigit((unsigned char)*p))
+        return false;
+
+    char *end;
+    unsigned long v = strtoul(p, &end, 0);
+    *value = neg ? -(Word)v : (Word)v;
+    *pp = end;
+    return true;
+}
+
+//! Lecture d'un numéro de registre (R0 à R15)
+static bool parse_register(char **pp, unsigned *reg)
+{
+    char *p = *pp;
+
+    if(*p != 'R' || !isdigit((unsigned char)p[1]))
+        return false;
+
+    char *end;
+    unsigned long r = strtoul(p + 1, &end, 10);
+    if(r > 15 || ident_len(p) != (size_t)(end - p))
+        return false;
+
+    *reg = r;
+    *pp = end;
+    return true;
+}
+
+//! Lecture d'une condition (NC, EQ, ...)
+static bool parse_condition(char **pp, unsigned *cond)
+{
+    size_t len = ident_len(*pp);
+
+    for(unsigned c = 0; c <= LAST_CONDITION; ++c)
+        if(is_keyword(*pp, len, condition_names[c]))
+        {
+            *cond = c;
+            *pp += len;
+            return true;
+        }
+
+    return false;
+}
+
+//! Lecture d'un opérande et encodage dans l'instruction
+/*!
+ * Formes reconnues : <tt>\#valeur</tt>, <tt>\@valeur</tt>,
+ * <tt>valeur[Rn]</tt>, <tt>[Rn]</tt> et <tt>Rn</tt> (mode registre).
+ *
+ * \param a l'assembleur
+ * \param pp position courante (mise à jour)
+ * \param instr l'instruction à compléter
+ * \return faux en cas d'erreur de syntaxe
+ */
+static bool parse_operand(Asm *a, char **pp, Instruction *instr)
+{
+    char *p = *pp;
+    unsigned addr = a->_seg[SECT_TEXT]._count;
+    Word v = 0;
+    unsigned r;
+
+    if(*p == '#' || *p == '@')
+    {
+        bool imm = *p++ == '#';
+
+        if(!parse_value(a, &p, imm ? FIX_IMMEDIATE : FIX_ADDRESS,
+                    SECT_TEXT, addr, &v))
+            return false;
+        if(!fits(imm ? FIX_IMMEDIATE : FIX_ADDRESS, v))
+            asm_error(a, a->_line, "value out of range");
+
+        instr->instr_generic._immediate = imm;
+        if(imm)
+            instr->instr_immediate._value = v;
+        else
+            instr->instr_absolute._address = v;
+    }
+    else if(parse_register(&p, &r))
+    {
+        // Mode registre : les deux bits de mode positionnés
+        instr->instr_generic._immediate = true;
+        instr->instr_generic._indexed = true;
+        instr->instr_register._rsource = r;
+    }
+    else
+    {
+        if(*p != '[' && !parse_value(a, &p, FIX_OFFSET, SECT_TEXT, addr, &v))
+            return false;
+        if(!fits(FIX_OFFSET, v))
+            asm_error(a, a->_line, "value out of range");
+
+        p = skip_spaces(p);
+        if(*p++ != '[')
+            return false;
+        p = skip_spaces(p);
+        if(!parse_register(&p, &r))
+            return false;
+        p = skip_spaces(p);
+        if(*p++ != ']')
+            return false;
+
+        instr->instr_generic._indexed = true;
+        instr->instr_indexed._rindex = r;
+        instr->instr_indexed._offset = v;
+    }
+
+    *pp = p;
+    return true;
+}
+
+//! Assemblage d'une instruction
+/*!
+ * \param a l'assembleur
+ * \param m le mnémonique
+ * \param p les opérandes
+ */
+static void assemble_instruction(Asm *a, const Mnemonic *m, char *p)
+{
+    Instruction instr = {._raw = 0};
+    unsigned regcond = 0;
+
+    instr.instr_generic._cop = m->_cop;
+
+    if(m->_form == FORM_REG || m->_form == FORM_MOVE || m->_form == FORM_COND)
+    {
+        if(m->_form != FORM_COND ? !parse_register(&p, &regcond)
+                : !parse_condition(&p, &regcond))
+        {
+            asm_error(a, a->_line, m->_form != FORM_COND ?
+                    "register expected" : "condition expected");
+            return;
+        }
+
+        p = skip_spaces(p);
+        if(*p++ != ',')
+        {
+            asm_error(a, a->_line, "',' expected");
+            return;
+        }
+        p = skip_spaces(p);
+    }
+
+    instr.instr_generic._regcond = regcond;
+
+    if(m->_form != FORM_NONE && !parse_operand(a, &p, &instr))
+    {
+        asm_error(a, a->_line, "bad operand");
+        return;
+    }
+
+    if(*skip_spaces(p) != '\0')
+    {
+        asm_error(a, a->_line, "bad syntax");
+        return;
+    }
+
+    bool reg = instruction_mode(instr) == MODE_REGISTER;
+
+    if(m->_form == FORM_MOVE && !reg)
+    {
+        asm_error(a, a->_line, "register operand expected for %s", m->_name);
+        return;
+    }
+
+    if(instr.instr_generic._immediate && !m->_immediate)
+    {
+        asm_error(a, a->_line, "%s operand not allowed for %s",
+                reg ? "register" : "immediate", m->_name);
+        return;
+    }
+
+    emit(a, SECT_TEXT, instr._raw);
+}
+
+//! Fin d'une section (directive END)
+static void end_section(Asm *a)
+{
+    if(a->_current == SECT_TEXT)
+    {
+        unsigned count = a->_seg[SECT_TEXT]._count;
+
+        a->_textsize = count > a->_text_decl ? count : a->_text_decl;
+        while(a->_seg[SECT_TEXT]._count < a->_textsize)
+            emit(a, SECT_TEXT, 0);
+        a->_text_done = true;
+    }
+    else if(a->_current == SECT_DATA)
+    {
+        a->_dataend = a->_seg[SECT_DATA]._count;
+        a->_datasize = a->_dataend + ASM_MINSTACK > a->_data_decl ?
+            a->_dataend + ASM_MINSTACK : a->_data_decl;
+        while(a->_seg[SECT_DATA]._count < a->_datasize)
+            emit(a, SECT_DATA, 0);
+        a->_data_done = true;
+    }
+    else
+        asm_error(a, a->_line, "END outside of a section");
+
+    a->_current = SECT_NONE;
+}
+
+//! Lecture de la taille optionnelle d'une directive TEXT ou DATA
+static bool parse_size(Asm *a, char *p, unsigned *size)
+{
+    p = skip_spaces(p);
+    if(*p == '\0')
+        return true;
+
+    char *end;
+    *size = strtoul(p, &end, 0);
+    if(end == p || *skip_spaces(end) != '\0')
+    {
+        asm_error(a, a->_line, "bad section size");
+        return false;
+    }
+    return true;
+}
+
+//! Assemblage d'une ligne de source
+static void assemble_line(Asm *a, char *line)
+{
+    a->_linefix = -1;
+
+    // Suppression du commentaire
+    for(char *c = line; (c = strchr(c, '/')); ++c)
+        if(c[1] == '/')
+        {
+            *c = '\0';
+            break;
+        }
+
+    char *p = line;
+    char *label = NULL;
+    size_t labellen = 0;
+
+    // Une étiquette commence en première colonne
+    if(*p != '\0' && !isspace((unsigned char)*p))
+    {
+        if(!(labellen = ident_len(p)))
+        {
+            asm_error(a, a->_line, "bad label");
+            return;
+        }
+        label = p;
+        p += labellen;
+    }
+
+    p = skip_spaces(p);
+    size_t oplen = ident_len(p);
+    char *op = p;
+    p = skip_spaces(p + oplen);
+
+    if(oplen == 0)
+    {
+        if(*p != '\0')
+            asm_error(a, a->_line, "bad syntax");
+        else if(label && a->_current != SECT_NONE)
+            define(a, lookup(a, label, labellen),
+                    a->_seg[a->_current]._count, a->_current);
+        else if(label)
+            asm_error(a, a->_line, "label outside of a section");
+        return;
+    }
+
+    if(is_keyword(op, oplen, "EQU"))
+    {
+        // Sans symbole, la directive n'a aucun effet
+        if(!label)
+            return;
+
+        unsigned s = lookup(a, label, labellen);
+        size_t len = ident_len(p);
+        unsigned errors = a->_errors;
+        Word v;
+
+        if(*p == '*' && *skip_spaces(p + 1) == '\0')
+        {
+            if(a->_current == SECT_NONE)
+                asm_error(a, a->_line, "'*' outside of a section");
+            else
+                define(a, s, a->_seg[a->_current]._count, a->_current);
+        }
+        else if(len > 0 && *skip_spaces(p + len) == '\0')
+        {
+            unsigned target = lookup(a, p, len);
+            if(reference(a, target, FIX_ALIAS, SECT_NONE, s, &v))
+                define(a, s, v, a->_symbols[target]._sect);
+        }
+        else if(parse_value(a, &p, FIX_WORD, SECT_NONE, 0, &v)
+                && *skip_spaces(p) == '\0')
+            define(a, s, v, SECT_NONE);
+        else
+            asm_error(a, a->_line, "bad EQU value");
+
+        if(a->_errors != errors)
+            cancel_reference(a);
+        return;
+    }
+
+    // Une étiquette devant une directive ou une instruction
+    if(label && a->_current != SECT_NONE)
+        define(a, lookup(a, label, labellen),
+                a->_seg[a->_current]._count, a->_current);
+
+    if(is_keyword(op, oplen, "TEXT"))
+    {
+        if(a->_text_seen || a->_data_seen || a->_current != SECT_NONE)
+            asm_error(a, a->_line, "misplaced TEXT section");
+        else if(parse_size(a, p, &a->_text_decl))
+        {
+            a->_text_seen = true;
+            a->_current = SECT_TEXT;
+        }
+    }
+    else if(is_keyword(op, oplen, "DATA"))
+    {
+        if(a->_data_seen || a->_current != SECT_NONE)
+            asm_error(a, a->_line, "misplaced DATA section");
+        else if(parse_size(a, p, &a->_data_decl))
+        {
+            if(!a->_text_seen)
+            {
+                // Pas de section de texte : texte vide
+                a->_text_seen = a->_text_done = true;
+                a->_textsize = 0;
+            }
+            a->_data_seen = true;
+            a->_current = SECT_DATA;
+        }
+    }
+    else if(is_keyword(op, oplen, "END"))
+        end_section(a);
+    else if(is_keyword(op, oplen, "WORD"))
+    {
+        Word v;
+
+        if(a->_current != SECT_DATA)
+            asm_error(a, a->_line, "WORD outside of DATA section");
+        else if(!parse_value(a, &p, FIX_WORD, SECT_DATA,
+                    a->_seg[SECT_DATA]._count, &v) || *skip_spaces(p) != '\0')
+        {
+            asm_error(a, a->_line, "bad WORD value");
+            cancel_reference(a);
+        }
+        else
+            emit(a, SECT_DATA, v);
+    }
+    else
+    {
+        const Mnemonic *m = NULL;
+
+        for(unsigned i = 0; i < sizeof(mnemonics) / sizeof(Mnemonic); ++i)
+            if(is_keyword(op, oplen, mnemonics[i]._name))
+                m = &mnemonics[i];
+
+        if(!m)
+            asm_error(a, a->_line, "unknown instruction %.*s", (int)oplen, op);
+        else if(a->_current != SECT_TEXT)
+            asm_error(a, a->_line, "instruction outside of TEXT section");
+        else
+        {
+            unsigned errors = a->_errors;
+
+            assemble_instruction(a, m, p);
+            if(a->_errors != errors)
+                cancel_reference(a);
+        }
+    }
+}
+
+//! Écriture de l'en-tête
+/*!
+ * Dans l'ancien format : textsize, datasize, dataend. Sinon, en-tête et
+ * table des sections de binfmt.h (le texte suit l'en-tête, les données
+ * suivent le texte) ; les CRC sont ceux des mots déjà écrits.
+ */
+static void write_header(Asm *a)
+{
+    unsigned sizes[3] = {a->_textsize, a->_datasize, a->_dataend};
+    Program_Header hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr._textsize = a->_textsize;
+    hdr._initsize = a->_datasize;
+    hdr._dataend = a->_dataend;
+    hdr._nsections = 2;
+    hdr._sections[0] = (Bin_Section){BIN_TEXT, 0, BIN_HEADER_SIZE,
+        4 * a->_textsize, 4 * a->_textsize, a->_seg[SECT_TEXT]._crc};
+    hdr._sections[1] = (Bin_Section){BIN_DATA, 0,
+        BIN_HEADER_SIZE + 4 * a->_textsize, 4 * a->_datasize,
+        4 * a->_datasize, a->_seg[SECT_DATA]._crc};
+
+    if((a->_flags & ASM_LEGACY) ? fwrite(sizes, sizeof(unsigned), 3, a->_out) != 3
+            : !write_program_header(a->_out, &hdr))
+    {
+        fprintf(stderr, "Erreur durant l'écriture du fichier binaire.\n");
+        exit(1);
+    }
+}
+
+//! Libération de la mémoire de l'assembleur
+static void release(Asm *a)
+{
+    free(a->_symbols);
+    free(a->_slots);
+    free(a->_strings);
+    free(a->_fixups);
+    for(Asm_Section s = SECT_TEXT; s <= SECT_DATA; ++s)
+    {
+        free(a->_seg[s]._words);
+        free(a->_seg[s]._ring);
+    }
+    free(a);
+}
+
+//! Table des symboles au format de <tt>sasm -s</tt> (à libérer par \c free)
+static char *symbols_text(const Asm *a)
+{
+    size_t size = 1;
+
+    for(unsigned s = 0; s < a->_nsymbols; ++s)
+        size += strlen(a->_strings + a->_symbols[s]._name) + 32;
+
+    char *text = malloc(size), *p = text;
+    if(!text)
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(1);
+    }
+
+    *p = '\0';
+    for(unsigned s = 0; s < a->_nsymbols; ++s)
+        p += sprintf(p, "%s 0x%08x %s\n", a->_strings + a->_symbols[s]._name,
+                a->_symbols[s]._value, asm_section_names[a->_symbols[s]._sect]);
+
+    return text;
+}
+
+//! Écriture de l'image complète à la fin de l'assemblage
+static bool write_image(Asm *a)
+{
+    if(a->_flags & ASM_LEGACY)
+    {
+        write_header(a);
+        for(Asm_Section s = SECT_TEXT; s <= SECT_DATA; ++s)
+            if(!write_words(a, a->_seg[s]._words, a->_seg[s]._count, NULL))
+                return false;
+        return true;
+    }
+
+    char *symbols = a->_flags & ASM_SYMBOLS ? symbols_text(a) : NULL;
+    bool ok = write_program(a->_out, a->_textsize,
+            (const Instruction *)a->_seg[SECT_TEXT]._words, a->_datasize,
+            a->_seg[SECT_DATA]._words, a->_dataend, symbols,
+            a->_flags & ASM_COMPRESS ? BIN_COMPRESS : 0);
+
+    free(symbols);
+    return ok;
+}
+
+unsigned assemble_stream(FILE *in, const char *name, FILE *out,
+                         unsigned flags, Asm_Symbol_Func symfunc, void *ctx,
+                         Asm_Stats *stats)
+{
+    Asm *a = calloc(1, sizeof(Asm));
+    char line[ASM_MAXLINE];
+
+    if(!a)
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(1);
+    }
+
+    a->_in = in;
+    a->_name = name;
+    a->_out = out;
+    a->_flags = flags;
+    a->_freefix = -1;
+    rehash(a);
+
+    // En-tête provisoire, réécrit à la fin si la sortie est positionnable ;
+    // la compression et les symboles demandent l'image complète
+    a->_seekable = ftell(out) == 0
+        && (flags & ASM_LEGACY || !(flags & (ASM_COMPRESS | ASM_SYMBOLS)));
+    if(a->_seekable)
+        write_header(a);
+
+    while(read_line(a, line))
+    {
+        assemble_line(a, line);
+        flush(a, false);
+    }
+
+    if(a->_current != SECT_NONE)
+        end_section(a);
+    if(!a->_text_done)
+        a->_text_done = true;
+    if(!a->_data_done)
+    {
+        a->_current = SECT_DATA;
+        end_section(a);
+    }
+
+    // Symboles jamais définis
+    for(unsigned s = 0; s < a->_nsymbols; ++s)
+        for(int f = a->_symbols[s]._fixups; f >= 0; f = a->_fixups[f]._next)
+            asm_error(a, a->_fixups[f]._line, "undefined symbol %s",
+                    a->_strings + a->_symbols[s]._name);
+
+    if(a->_errors == 0)
+    {
+        if(a->_seekable)
+        {
+            flush(a, true);
+            fseek(out, 0, SEEK_SET);
+            write_header(a);
+            fseek(out, 0, SEEK_END);
+        }
+        else if(!write_image(a))
+        {
+            fprintf(stderr, "Erreur durant l'écriture du fichier binaire.\n");
+            exit(1);
+        }
+
+        if(symfunc)
+            for(unsigned s = 0; s < a->_nsymbols; ++s)
+                symfunc(a->_strings + a->_symbols[s]._name,
+                        a->_symbols[s]._value, a->_symbols[s]._sect, ctx);
+    }
+
+    a->_stats._lines = a->_line;
+    a->_stats._textsize = a->_textsize;
+    a->_stats._datasize = a->_datasize;
+    a->_stats._dataend = a->_dataend;
+    if(stats)
+        *stats = a->_stats;
+
+    unsigned errors = a->_errors;
+    release(a);
+    return errors;
+}
@@ -0,0 +1,95 @@
+#ifndef _ASSEMBLER_H_
+#define _ASSEMBLER_H_
+
+/*!
+ * \file assembler.h
+ * \brief Assembleur en une seule passe, en flot (\e streaming).
+ *
+ * Cet assembleur accepte la même syntaxe que l'outil \c asm (voir
+ * Examples/syntax.asm). Il lit le source une seule fois, ligne par ligne,
+ * et produit au fil de l'eau le fichier binaire au format de binfmt.h
+ * (ou, sur demande, dans l'ancien format : tailles, texte puis données).
+ *
+ * Les références en avant (étiquettes, symboles \c EQU) sont résolues par
+ * une liste de correctifs (\e backpatch) attachée à chaque symbole non
+ * encore défini. La mémoire utilisée, en dehors de l'image produite et de la
+ * table des symboles, est bornée par le nombre de références en suspens.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "instruction.h"
+
+//! Taille minimale de pile réservée par l'assembleur dans le segment de données
+#define ASM_MINSTACK 20
+
+//! Longueur maximale d'une ligne de source
+#define ASM_MAXLINE 4096
+
+//! Section d'un symbole
+typedef enum
+{
+    SECT_NONE = 0,  //!< Valeur absolue (EQU numérique)
+    SECT_TEXT,      //!< Adresse dans le segment de texte
+    SECT_DATA,      //!< Adresse dans le segment de données
+} Asm_Section;
+
+//! Statistiques d'un assemblage
+typedef struct
+{
+    unsigned _lines;            //!< Nombre de lignes lues
+    unsigned _textsize;         //!< Taille du segment de texte produit
+    unsigned _datasize;         //!< Taille du segment de données produit
+    unsigned _dataend;          //!< Fin des données statiques
+    unsigned _symbols;          //!< Nombre de symboles définis
+    unsigned _fixups;           //!< Nombre de références en avant corrigées
+    unsigned _max_pending;      //!< Maximum de références en suspens simultanées
+} Asm_Stats;
+
+//! Options d'assemblage
+enum
+{
+    ASM_LEGACY = 1,     //!< Produire l'ancien format (sans en-tête ni CRC)
+    ASM_COMPRESS = 2,   //!< Compresser le segment de données
+    ASM_SYMBOLS = 4,    //!< Inclure la table des symboles dans le binaire
+};
+
+//! Fonction appelée pour chaque symbole défini à la fin de l'assemblage
+/*!
+ * \param name le nom du symbole
+ * \param value sa valeur
+ * \param sect sa section
+ * \param ctx contexte de l'appelant
+ */
+typedef void (*Asm_Symbol_Func)(const char *name, Word value,
+                                Asm_Section sect, void *ctx);
+
+//! Assemblage d'un flot source vers un fichier binaire
+/*!
+ * Si \a out est positionnable (fichier ordinaire), les mots sont écrits dès
+ * qu'ils ne dépendent plus d'aucun symbole indéfini et l'en-tête (avec les
+ * CRC) est réécrit à la fin. Sinon (tube), ou si l'image doit être
+ * compressée ou accompagnée des symboles, l'image complète est écrite à la
+ * fin.
+ *
+ * Les erreurs de syntaxe sont signalées sur \c stderr sous la forme
+ * <tt>fichier:ligne: error: message</tt>.
+ *
+ * \param in le flot source
+ * \param name le nom du source (pour les messages)
+ * \param out le fichier binaire produit
+ * \param flags options (\c ASM_LEGACY, \c ASM_COMPRESS, \c ASM_SYMBOLS)
+ * \param symfunc appelée pour chaque symbole en fin d'assemblage (ou NULL)
+ * \param ctx contexte transmis à \a symfunc
+ * \param stats statistiques de l'assemblage (ou NULL)
+ * \return le nombre d'erreurs rencontrées (0 si succès)
+ */
+unsigned assemble_stream(FILE *in, const char *name, FILE *out,
+                         unsigned flags, Asm_Symbol_Func symfunc, void *ctx,
+                         Asm_Stats *stats);
+
+//! Forme imprimable des sections
+extern const char *asm_section_names[];
+
+#endif
@@ -0,0 +1,568 @@
+/*!
+ * \file bench.c
+ * \brief Mesure du coût de chaque fonction d'exécution : programme principal
+ *
+ * Pour chaque couple (code opération, mode d'adressage) mesuré, on engendre
+ * deux segments de texte synthétiques, exécutés par run() avec un budget
+ * fixe :
+ *
+ *   - une \e boucle : \c BENCH_UNROLL copies du corps suivies d'un
+ *   branchement au début ;
+ *
+ *   - une <em>ligne droite</em> : \c BENCH_STRAIGHT copies du corps, soit
+ *   un texte bien plus grand que les caches de premier niveau ; le
+ *   branchement final n'est exécuté qu'une fois par parcours.
+ *
+ * Le corps compte une ou deux instructions : \c PUSH et \c POP vont par
+ * paires, \c SUB et \c BRANCH forment une séquence fusionnée
+ * (exec_predecode()), et chaque \c CALL exécute le \c RET placé en fin de
+ * texte.
+ * Chaque mesure est répétée ; après une exécution de chauffe, les
+ * échantillons sont triés et seul l'intervalle interquartile est retenu. Le processus est fixé sur un processeur. Les
+ * résultats sont donnés en nanosecondes et, sur x86, en cycles du compteur
+ * d'horodatage (\c rdtsc) par instruction exécutée ; la colonne \c delta
+ * retranche le coût de \c NOP dans la même forme de texte, c'est-à-dire
+ * celui de la boucle de dispatch.
+ */
+
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC 1
+#endif
+
+#include "error.h"
+#include "machine.h"
+#include "pool.h"
+
+//! Nombre de copies du corps dans une boucle
+#define BENCH_UNROLL 256
+
+//! Nombre de copies du corps dans une ligne droite
+#define BENCH_STRAIGHT 8192
+
+//! Taille du segment de données
+#define BENCH_DATASIZE 1024
+
+//! Adresse de la donnée lue ou écrite par les instructions mesurées
+#define BENCH_SLOT 8
+
+//! Instructions exécutées par échantillon (par défaut)
+#define BENCH_DEFAULT_COUNT 2000000
+
+//! Nombre d'échantillons (par défaut)
+#define BENCH_DEFAULT_SAMPLES 15
+
+//! Un cas mesuré
+typedef struct
+{
+    const char *_name;          //!< Nom affiché
+    Instruction _body[2];       //!< Corps
+    unsigned _length;           //!< Nombre d'instructions du corps
+} Bench_Case;
+
+//! Résultat d'une mesure
+typedef struct
+{
+    double _ns;                 //!< Nanosecondes par instruction
+    double _cycles;             //!< Cycles TSC par instruction (0 : indisponible)
+    double _spread;             //!< Dispersion des échantillons retenus (%)
+} Bench_Result;
+
+//! Instruction avec un opérande
+/*!
+ * \param cop le code opération
+ * \param mode le mode d'adressage
+ * \param regcond le registre ou la condition
+ * \param operand la valeur, l'adresse, le déplacement (index R00) ou le
+ * registre source selon le mode
+ */
+static Instruction make(Code_Op cop, Mode mode, unsigned regcond, int operand)
+{
+    Instruction instr = {._raw = 0};
+
+    instr.instr_generic._cop = cop;
+    instr.instr_generic._regcond = regcond;
+    switch(mode)
+    {
+        case MODE_ABSOLUTE:
+            instr.instr_absolute._address = operand;
+            break;
+
+        case MODE_INDEXED:
+            instr.instr_generic._indexed = true;
+            instr.instr_indexed._rindex = 0;
+            instr.instr_indexed._offset = operand;
+            break;
+
+        case MODE_IMMEDIATE:
+            instr.instr_generic._immediate = true;
+            instr.instr_immediate._value = operand;
+            break;
+
+        case MODE_REGISTER:
+            instr.instr_generic._immediate = true;
+            instr.instr_generic._indexed = true;
+            instr.instr_register._rsource = operand;
+            break;
+    }
+
+    return instr;
+}
+
+//! Adresse symbolique de la cible des CALL (remplacée à la construction)
+#define TARGET_RET (-1)
+
+//! Adresse symbolique de l'instruction suivante (BRANCH pris)
+#define TARGET_NEXT (-2)
+
+//! Opérande de chaque mode pour une instruction à valeur
+static const int value_operands[NMODES] =
+{
+    [MODE_ABSOLUTE] = BENCH_SLOT,
+    [MODE_INDEXED] = BENCH_SLOT,
+    [MODE_IMMEDIATE] = 5,
+    [MODE_REGISTER] = 2,
+};
+
+//! Noms courts des modes
+static const char *mode_names[NMODES] =
+{
+    [MODE_ABSOLUTE] = "abs",
+    [MODE_INDEXED] = "idx",
+    [MODE_IMMEDIATE] = "imm",
+    [MODE_REGISTER] = "reg",
+};
+
+//! Nombre maximal de cas
+#define BENCH_MAXCASES 64
+
+//! Cas mesurés
+static Bench_Case cases[BENCH_MAXCASES];
+
+//! Nombre de cas
+static unsigned ncases;
+
+//! Ajout d'un cas
+static void add_case(const char *name, unsigned length,
+                     Instruction first, Instruction second)
+{
+    Bench_Case *c = &cases[ncases++];
+
+    c->_name = strdup(name);
+    c->_length = length;
+    c->_body[0] = first;
+    c->_body[1] = second;
+}
+
+//! Construction de la liste des cas
+static void build_cases(void)
+{
+    static const Code_Op value_ops[] = {LOAD, ADD, SUB};
+    static const Mode address_modes[] = {MODE_ABSOLUTE, MODE_INDEXED};
+    Instruction none = {._raw = 0};
+    char name[32];
+
+    add_case("NOP", 1, make(NOP, MODE_ABSOLUTE, 0, 0), none);
+
+    for(unsigned i = 0; i < sizeof(value_ops) / sizeof(value_ops[0]); ++i)
+        for(Mode m = MODE_ABSOLUTE; m < NMODES; ++m)
+        {
+            snprintf(name, sizeof(name), "%s %s", cop_names[value_ops[i]],
+                    mode_names[m]);
+            add_case(name, 1, make(value_ops[i], m, 1, value_operands[m]),
+                    none);
+        }
+
+    for(unsigned i = 0; i < 2; ++i)
+    {
+        Mode m = address_modes[i];
+
+        snprintf(name, sizeof(name), "STORE %s", mode_names[m]);
+        add_case(name, 1, make(STORE, m, 1, BENCH_SLOT), none);
+
+        snprintf(name, sizeof(name), "BRANCH %s taken", mode_names[m]);
+        add_case(name, 1, make(BRANCH, m, NC, TARGET_NEXT), none);
+
+        snprintf(name, sizeof(name), "BRANCH %s not taken", mode_names[m]);
+        add_case(name, 1, make(BRANCH, m, EQ, TARGET_NEXT), none);
+
+        // Le RET est la cible commune des CALL (en fin de texte)
+        snprintf(name, sizeof(name), "CALL %s + RET", mode_names[m]);
+        add_case(name, 1, make(CALL, m, NC, TARGET_RET), none);
+    }
+
+    for(Mode m = MODE_ABSOLUTE; m < NMODES; ++m)
+    {
+        snprintf(name, sizeof(name), "PUSH %s + POP abs", mode_names[m]);
+        add_case(name, 2, make(PUSH, m, 0, value_operands[m]),
+                make(POP, MODE_ABSOLUTE, 0, BENCH_SLOT + 1));
+    }
+
+    add_case("PUSH imm + POP idx", 2, make(PUSH, MODE_IMMEDIATE, 0, 5),
+            make(POP, MODE_INDEXED, 0, BENCH_SLOT + 1));
+
+    // R01 ne s'annule pas : le branchement est toujours pris
+    add_case("SUB imm + BRANCH abs", 2, make(SUB, MODE_IMMEDIATE, 1, 5),
+            make(BRANCH, MODE_ABSOLUTE, NE, TARGET_NEXT));
+}
+
+//! Adresse effective d'un opérande symbolique
+static Instruction resolve(Instruction instr, unsigned addr, unsigned ret)
+{
+    bool indexed = instr.instr_generic._indexed;
+    int operand = indexed ? instr.instr_indexed._offset
+        : (int)instr.instr_absolute._address;
+
+    if(instr.instr_generic._immediate)
+        return instr;
+
+    // Les champs sont de 20 (absolu) ou 16 bits (indexé) : on compare
+    // après troncature
+    if(operand == (indexed ? TARGET_RET : (TARGET_RET & 0xfffff)))
+        operand = ret;
+    else if(operand == (indexed ? TARGET_NEXT : (TARGET_NEXT & 0xfffff)))
+        operand = addr + 1;
+    else
+        return instr;
+
+    if(indexed)
+        instr.instr_indexed._offset = operand;
+    else
+        instr.instr_absolute._address = operand;
+    return instr;
+}
+
+//! Segment de texte d'un cas
+/*!
+ * Le texte commence par un prologue (\c ADD R03, #1 : code condition
+ * positif, pour les branchements conditionnels) et se termine par le
+ * branchement au début des copies, puis par le \c RET qui sert de cible
+ * aux \c CALL.
+ *
+ * \param c le cas
+ * \param copies le nombre de copies du corps
+ * \param size la taille du texte
+ * \return le texte (à libérer par \c free)
+ */
+static Instruction *build_text(const Bench_Case *c, unsigned copies,
+                               unsigned *size)
+{
+    unsigned n = 1 + copies * c->_length + 2;
+    unsigned ret = n - 1;
+    Instruction *text = malloc(n * sizeof(Instruction));
+
+    if(!text)
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    text[0] = make(ADD, MODE_IMMEDIATE, 3, 1);
+    for(unsigned i = 0; i < copies; ++i)
+        for(unsigned j = 0; j < c->_length; ++j)
+        {
+            unsigned addr = 1 + i * c->_length + j;
+            text[addr] = resolve(c->_body[j], addr, ret);
+        }
+
+    text[n - 2] = make(BRANCH, MODE_ABSOLUTE, NC, 1);
+    text[ret] = make(RET, MODE_ABSOLUTE, 0, 0);
+
+    *size = n;
+    return text;
+}
+
+//! Horloge (nanosecondes)
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//! Compteur d'horodatage (0 si indisponible)
+static unsigned long long now_tsc(void)
+{
+#ifdef BENCH_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//! Ordre croissant (pour qsort)
+static int by_value(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+//! Moyenne de l'intervalle interquartile (les échantillons sont triés)
+static double trimmed_mean(double *samples, unsigned n, double *spread)
+{
+    unsigned lo = n / 4, hi = n - n / 4;
+    double sum = 0;
+
+    qsort(samples, n, sizeof(double), by_value);
+    for(unsigned i = lo; i < hi; ++i)
+        sum += samples[i];
+
+    double mean = sum / (hi - lo);
+    *spread = mean > 0 ? 100 * (samples[hi - 1] - samples[lo]) / mean : 0;
+    return mean;
+}
+
+//! Exécution chronométrée d'un échantillon
+/*!
+ * \param pmach la machine chargée
+ * \param count nombre d'instructions à exécuter
+ * \param ns durée par instruction (nanosecondes)
+ * \param tsc durée par instruction (cycles TSC)
+ */
+static void sample(Machine *pmach, uint64_t count, double *ns, double *tsc)
+{
+    double t0 = now_ns();
+    unsigned long long c0 = now_tsc();
+    Run_Result res = run(pmach, count);
+    unsigned long long c1 = now_tsc();
+    double t1 = now_ns();
+
+    if(res._status != RUN_BUDGET)
+    {
+        error_report(res._error, res._address);
+        exit(EXIT_FAILURE);
+    }
+
+    *ns = (t1 - t0) / res._executed;
+    *tsc = (double)(c1 - c0) / res._executed;
+}
+
+//! Mesure d'un cas dans une forme de texte
+static Bench_Result measure(Machine *pmach, const Bench_Case *c, bool loop,
+                            uint64_t count, unsigned nsamples)
+{
+    Word data[BENCH_SLOT + 2] = {0};
+    unsigned size;
+    Instruction *text = build_text(c, loop ? BENCH_UNROLL : BENCH_STRAIGHT,
+            &size);
+    double ns[nsamples], cycles[nsamples];
+    Bench_Result result;
+
+    if(!machine_load(pmach, size, text, BENCH_DATASIZE,
+                BENCH_SLOT + 2, data, BENCH_SLOT + 2))
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(EXIT_FAILURE);
+    }
+    free(text);
+
+    // Chauffe (caches, prédicteurs, pages du segment de données)
+    sample(pmach, count / 4 + 1, &ns[0], &cycles[0]);
+
+    for(unsigned i = 0; i < nsamples; ++i)
+        sample(pmach, count, &ns[i], &cycles[i]);
+
+    double unused;
+    result._ns = trimmed_mean(ns, nsamples, &result._spread);
+    result._cycles = trimmed_mean(cycles, nsamples, &unused);
+    return result;
+}
+
+//! Création de \a n machines simultanées
+/*!
+ * Vérifie qu'autant de segments gardés (guard.h) peuvent coexister : chaque
+ * machine vide sa pile d'un \c POP de trop, qui doit tomber sur sa page de
+ * garde.
+ *
+ * \param n le nombre de machines
+ * \return vrai si toutes les machines ont été créées et ont signalé
+ * \c ERR_SEGSTACK
+ */
+static bool machines(unsigned n)
+{
+    Instruction text[] = {
+        make(PUSH, MODE_IMMEDIATE, 0, 1),
+        make(POP, MODE_ABSOLUTE, 0, 0),
+        make(POP, MODE_ABSOLUTE, 0, 0),
+    };
+    Word data[1] = {0};
+    Machine **mach = calloc(n, sizeof(Machine *));
+    unsigned created = 0, faulted = 0;
+
+    if(!mach)
+        return false;
+
+    for(; created < n; ++created)
+        if(!(mach[created] = machine_create(NULL))
+                || !machine_load(mach[created], 3, text, MINSTACKSIZE + 1,
+                    1, data, 1))
+            break;
+
+    for(unsigned i = 0; i < created; ++i)
+    {
+        Run_Result res = run(mach[i], 10);
+        faulted += res._status == RUN_FAULTED && res._error == ERR_SEGSTACK
+            && res._address == 2;
+    }
+
+    printf("%u machines created, %u stack underflows detected\n",
+            created, faulted);
+
+    for(unsigned i = 0; i < n && mach[i]; ++i)
+        machine_destroy(mach[i]);
+    free(mach);
+    return created == n && faulted == n;
+}
+
+//! Fixe le processus sur un processeur
+/*!
+ * \param cpu le processeur (négatif : celui sur lequel on s'exécute)
+ * \return le processeur choisi, ou -1 en cas d'échec
+ */
+static int pin(int cpu)
+{
+    cpu_set_t set;
+
+    if(cpu < 0)
+        cpu = sched_getcpu();
+    if(cpu < 0)
+        return -1;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? cpu : -1;
+}
+
+//! Help message.
+/*!
+ * Printed with option \c -h.
+ */
+static void usage()
+{
+    printf("Usage: bench [options] [filter]\n");
+    printf("where options are:\n"
+            "\t-n N\tInstructions executed per sample (default: %d)\n"
+            "\t-r N\tSamples per measurement (default: %d)\n"
+            "\t-c cpu\tPin to this CPU (default: the current one)\n"
+            "\t-m N\tOnly create N simultaneous machines and check that\n"
+            "\t\teach detects a stack underflow\n"
+            "\t-h\tprint this help message\n"
+            "Only the cases whose name contains filter are measured.\n"
+            "Times are per executed instruction: trimmed mean of the\n"
+            "samples (interquartile range), for a looped text and a\n"
+            "straight-line text; delta subtracts the cost of NOP.\n",
+            BENCH_DEFAULT_COUNT, BENCH_DEFAULT_SAMPLES);
+}
+
+//! Programme principal du banc d'essai
+int main(int argc, char *argv[])
+{
+    uint64_t count = BENCH_DEFAULT_COUNT;
+    unsigned nsamples = BENCH_DEFAULT_SAMPLES;
+    const char *filter = NULL;
+    int cpu = -1;
+    unsigned nmachines = 0;
+
+    for(int iarg = 1; iarg < argc; ++iarg)
+    {
+        if(argv[iarg][0] == '-')
+        {
+            if(strchr("nrcm", argv[iarg][1]) && iarg + 1 >= argc)
+            {
+                usage();
+                exit(EXIT_FAILURE);
+            }
+            switch(argv[iarg][1])
+            {
+                case 'n':
+                    count = strtoull(argv[++iarg], NULL, 0);
+                    break;
+                case 'r':
+                    nsamples = strtoul(argv[++iarg], NULL, 0);
+                    break;
+                case 'c':
+                    cpu = atoi(argv[++iarg]);
+                    break;
+                case 'm':
+                    nmachines = strtoul(argv[++iarg], NULL, 0);
+                    break;
+                case 'h':
+                    usage();
+                    exit(EXIT_SUCCESS);
+                default:
+                    fprintf(stderr, "Unknown option: %s\n", argv[iarg]);
+                    usage();
+                    exit(EXIT_FAILURE);
+            }
+        }
+        else
+            filter = argv[iarg];
+    }
+
+    if(count == 0 || nsamples == 0)
+    {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if(nmachines)
+        return machines(nmachines) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    build_cases();
+    if((cpu = pin(cpu)) < 0)
+        fprintf(stderr, "Warning: cannot pin to a CPU\n");
+
+    Machine *mach = machine_create(NULL);
+    if(!mach)
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Référence : NOP, dans les deux formes
+    Bench_Result nop[2] = {
+        measure(mach, &cases[0], true, count, nsamples),
+        measure(mach, &cases[0], false, count, nsamples),
+    };
+
+    printf("# CPU %d, %llu instructions x %u samples per measurement\n",
+            cpu, (unsigned long long)count, nsamples);
+    printf("# %-22s %27s   %27s\n", "", "loop", "straight-line");
+    printf("# %-22s %7s %7s %7s %4s   %7s %7s %7s %4s\n", "case",
+            "ns", "cycles", "delta", "+-%", "ns", "cycles", "delta", "+-%");
+
+    for(unsigned i = 0; i < ncases; ++i)
+    {
+        const Bench_Case *c = &cases[i];
+
+        if(filter && !strstr(c->_name, filter))
+            continue;
+
+        printf("  %-22s", c->_name);
+        for(int loop = 1; loop >= 0; --loop)
+        {
+            Bench_Result r = i == 0 ? nop[!loop]
+                : measure(mach, c, loop, count, nsamples);
+            double ref = nop[!loop]._cycles ? nop[!loop]._cycles
+                : nop[!loop]._ns;
+            double val = nop[!loop]._cycles ? r._cycles : r._ns;
+
+            printf(" %7.2f %7.2f %+7.2f %4.0f  ", r._ns, r._cycles,
+                    val - ref, r._spread);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    machine_destroy(mach);
+    return 0;
+}
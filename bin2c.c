@@ -0,0 +1,90 @@
+/*!
+ * \file bin2c.c
+ * \brief Traducteur d'un fichier binaire en source C : programme principal
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "machine.h"
+#include "translate.h"
+
+//! Modules requis par le code traduit (liste fournie par le Makefile)
+#ifndef SIMUL_OBJECTS
+#define SIMUL_OBJECTS "$(USEROBJ) (see the Makefile)"
+#endif
+
+//! Help message.
+/*!
+ * Printed with option \c -h.
+ */
+static void usage()
+{
+    printf("Usage: bin2c [options] binfile\n");
+    printf("where options are:\n"
+            "\t-o file\tOutput C file (default: standard output)\n"
+            "\t-n\tDo not generate main() (for a shared object)\n"
+            "\t-h\tprint this help message\n"
+            "The generated file compiles with the simulator objects, e.g.\n"
+            "\tcc -O2 -I. -o prog prog.c " SIMUL_OBJECTS "\n"
+            "and prints the same final state as test_simul.\n");
+}
+
+//! Programme principal du traducteur
+int main(int argc, char *argv[])
+{
+    const char *outfile = NULL;
+    const char *binfile = NULL;
+    bool standalone = true;
+
+    for(int iarg = 1; iarg < argc; ++iarg)
+    {
+        if(argv[iarg][0] == '-')
+            switch(argv[iarg][1])
+            {
+                case 'o':
+                    if(iarg + 1 >= argc)
+                    {
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    outfile = argv[++iarg];
+                    break;
+                case 'n':
+                    standalone = false;
+                    break;
+                case 'h':
+                    usage();
+                    exit(EXIT_SUCCESS);
+                default:
+                    fprintf(stderr, "Unknown option: %s\n", argv[iarg]);
+                    usage();
+                    exit(EXIT_FAILURE);
+            }
+        else
+            binfile = argv[iarg];
+    }
+
+    if(!binfile)
+    {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    Machine mach;
+    read_program(&mach, binfile);
+
+    FILE *out = stdout;
+    if(outfile && !(out = fopen(outfile, "w")))
+    {
+        fprintf(stderr, "Ecriture du fichier \"%s\" impossible.\n", outfile);
+        exit(EXIT_FAILURE);
+    }
+
+    translate_program(out, &mach, standalone);
+
+    if(out != stdout)
+        fclose(out);
+
+    return 0;
+}
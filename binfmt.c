@@ -0,0 +1,462 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "binfmt.h"
+#include "machine.h"
+
+/*!
+ * \file binfmt.c
+ * \brief Implémentation de binfmt.h. Lecture et écriture des programmes.
+ *
+ * Les sections de texte et de données non compressées sont lues d'un seul
+ * \c fread directement dans les segments de destination ; sur un hôte
+ * petit-boutiste, aucune conversion n'est nécessaire.
+ */
+
+//! Cause du dernier échec de lecture
+static __thread const char *format_error = "no error";
+
+//! Table du CRC-32 (calculée au premier usage)
+static uint32_t crc_table[256];
+
+//! Calcul de la table du CRC-32
+static void crc_init(void)
+{
+    for(uint32_t n = 0; n < 256; ++n)
+    {
+        uint32_t c = n;
+        for(int k = 0; k < 8; ++k)
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+
+    // Calcul idempotent : une course entre threads est sans conséquence
+    if(crc_table[1] == 0)
+        crc_init();
+
+    crc = ~crc;
+    while(size--)
+        crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+//! L'hôte est-il gros-boutiste ?
+static inline bool big_endian(void)
+{
+    const uint32_t one = 1;
+    return *(const unsigned char *)&one == 0;
+}
+
+//! Conversion sur place entre petit-boutiste et ordre de l'hôte
+static void swap_words(uint32_t *words, size_t n)
+{
+    if(!big_endian())
+        return;
+
+    for(size_t i = 0; i < n; ++i)
+        words[i] = (words[i] >> 24) | ((words[i] >> 8) & 0xff00u)
+            | ((words[i] << 8) & 0xff0000u) | (words[i] << 24);
+}
+
+//! Échec de lecture
+static bool fail(const char *reason)
+{
+    format_error = reason;
+    return false;
+}
+
+const char *program_format_error(void)
+{
+    return format_error;
+}
+
+//! Fixe la taille du segment de données (pile minimale comprise)
+static void set_datasize(Program_Header *phdr)
+{
+    unsigned stack_size = phdr->_initsize - phdr->_dataend;
+
+    if(stack_size < MINSTACKSIZE)
+        stack_size = MINSTACKSIZE;
+    phdr->_datasize = phdr->_dataend + stack_size;
+}
+
+//! Recherche d'une section
+static const Bin_Section *find_section(const Program_Header *phdr, unsigned type)
+{
+    for(unsigned i = 0; i < phdr->_nsections; ++i)
+        if(phdr->_sections[i]._type == type)
+            return &phdr->_sections[i];
+
+    return NULL;
+}
+
+//! Lecture d'un en-tête de l'ancien format (le premier mot est déjà lu)
+static bool read_legacy_header(FILE *file, uint32_t first, long filesize,
+                               Program_Header *phdr)
+{
+    unsigned sizes[3] = {first};
+
+    if(fread(sizes + 1, sizeof(unsigned), 2, file) != 2)
+        return fail("truncated header");
+
+    phdr->_version = 0;
+    phdr->_nsections = 0;
+    phdr->_textsize = sizes[0];
+    phdr->_initsize = sizes[1];
+    phdr->_dataend = sizes[2];
+
+    if(sizes[2] > sizes[1])
+        return fail("data end beyond data size");
+
+    if(filesize >= 0 && (uint64_t)filesize < 3 * sizeof(unsigned)
+            + ((uint64_t)sizes[0] + sizes[1]) * sizeof(Word))
+        return fail("truncated file");
+
+    set_datasize(phdr);
+    return true;
+}
+
+bool read_program_header(FILE *file, Program_Header *phdr)
+{
+    return read_program_header_length(file, -1, phdr);
+}
+
+bool read_program_header_length(FILE *file, long filesize, Program_Header *phdr)
+{
+    uint32_t words[7 + 6 * BIN_MAXSECTIONS];
+    struct stat st;
+
+    if(filesize < 0 && fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode))
+        filesize = (long)st.st_size;
+
+    if(fread(words, sizeof(uint32_t), 1, file) != 1)
+        return fail("empty file");
+    swap_words(words, 1);
+
+    if(words[0] != BIN_MAGIC)
+    {
+        swap_words(words, 1);
+        return read_legacy_header(file, words[0], filesize, phdr);
+    }
+
+    if(fread(words + 1, sizeof(uint32_t), 6 + 6 * BIN_MAXSECTIONS, file)
+            != 6 + 6 * BIN_MAXSECTIONS)
+        return fail("truncated header");
+    swap_words(words + 1, 6 + 6 * BIN_MAXSECTIONS);
+
+    if(words[1] != BIN_VERSION)
+        return fail("unsupported format version");
+    if(words[5] > BIN_MAXSECTIONS)
+        return fail("bad section count");
+
+    // Le CRC couvre les mots 0 à 5 et les entrées utilisées de la table
+    uint32_t crc = words[6];
+    words[6] = 0;
+    swap_words(words, 7 + 6 * words[5]);
+    uint32_t check = crc32_update(0, words, 4 * (7 + 6 * words[5]));
+    swap_words(words, 7 + 6 * words[5]);
+    if(check != crc)
+        return fail("header checksum mismatch");
+
+    phdr->_version = words[1];
+    phdr->_textsize = words[2];
+    phdr->_initsize = words[3];
+    phdr->_dataend = words[4];
+    phdr->_nsections = words[5];
+    memcpy(phdr->_sections, words + 7, sizeof(phdr->_sections));
+
+    if(phdr->_dataend > phdr->_initsize)
+        return fail("data end beyond data size");
+
+    for(unsigned i = 0; i < phdr->_nsections; ++i)
+    {
+        const Bin_Section *s = &phdr->_sections[i];
+
+        if(filesize >= 0 && (uint64_t)s->_offset + s->_stored > (uint64_t)filesize)
+            return fail("section beyond end of file");
+        if(!(s->_flags & BIN_RLE) && s->_stored != s->_size)
+            return fail("bad section size");
+    }
+
+    const Bin_Section *text = find_section(phdr, BIN_TEXT);
+    const Bin_Section *data = find_section(phdr, BIN_DATA);
+    if(!text || text->_size != (uint64_t)phdr->_textsize * sizeof(Instruction))
+        return fail("missing or inconsistent text section");
+    if(!data || data->_size != (uint64_t)phdr->_initsize * sizeof(Word))
+        return fail("missing or inconsistent data section");
+
+    set_datasize(phdr);
+    return true;
+}
+
+//! Décompression des plages de zéros
+/*!
+ * \param in les mots stockés (petit-boutistes)
+ * \param nin leur nombre
+ * \param out les mots décodés (petit-boutistes)
+ * \param nout leur nombre attendu
+ * \return faux si le flot est incohérent
+ */
+static bool rle_decode(uint32_t *in, size_t nin, uint32_t *out, size_t nout)
+{
+    size_t i = 0, o = 0;
+
+    swap_words(in, nin);
+    while(o < nout)
+    {
+        if(i >= nin)
+            return false;
+        uint32_t lit = in[i++];
+        if(lit > nin - i || lit > nout - o)
+            return false;
+        memcpy(out + o, in + i, lit * sizeof(uint32_t));
+        i += lit, o += lit;
+
+        if(i >= nin)
+            return false;
+        uint32_t zeros = in[i++];
+        if(zeros > nout - o)
+            return false;
+        memset(out + o, 0, zeros * sizeof(uint32_t));
+        o += zeros;
+    }
+
+    // Les littéraux sont rendus à leur ordre d'origine
+    swap_words(out, nout);
+    return i == nin;
+}
+
+//! Lecture d'une section dans \a dest (contenu petit-boutiste, CRC vérifié)
+static bool read_section(FILE *file, const Bin_Section *s, void *dest)
+{
+    if(fseek(file, s->_offset, SEEK_SET) != 0)
+        return fail("truncated file");
+
+    if(!(s->_flags & BIN_RLE))
+    {
+        if(fread(dest, 1, s->_size, file) != s->_size)
+            return fail("truncated file");
+    }
+    else
+    {
+        uint32_t *stored = malloc(s->_stored ? s->_stored : 1);
+        bool ok = stored && s->_stored % 4 == 0 && s->_size % 4 == 0
+            && fread(stored, 1, s->_stored, file) == s->_stored
+            && rle_decode(stored, s->_stored / 4, dest, s->_size / 4);
+
+        free(stored);
+        if(!ok)
+            return fail("bad compressed section");
+    }
+
+    if(crc32_update(0, dest, s->_size) != s->_crc)
+        return fail("section checksum mismatch");
+
+    return true;
+}
+
+bool read_program_body(FILE *file, const Program_Header *phdr,
+                       Instruction *text, Word *data)
+{
+    if(phdr->_version == 0)
+    {
+        if(fread(text, sizeof(Instruction), phdr->_textsize, file)
+                != phdr->_textsize
+                || fread(data, sizeof(Word), phdr->_initsize, file)
+                != phdr->_initsize)
+            return fail("truncated file");
+        return true;
+    }
+
+    if(!read_section(file, find_section(phdr, BIN_TEXT), text)
+            || !read_section(file, find_section(phdr, BIN_DATA), data))
+        return false;
+
+    swap_words((uint32_t *)text, phdr->_textsize);
+    swap_words(data, phdr->_initsize);
+    return true;
+}
+
+char *read_program_symbols(FILE *file, const Program_Header *phdr)
+{
+    const Bin_Section *s = find_section(phdr, BIN_SYMBOLS);
+    char *symbols;
+
+    if(!s || (s->_flags & BIN_RLE))
+        return NULL;
+
+    // La taille est bornée : le nul final ne peut pas faire déborder le calcul
+    if(s->_size > BIN_MAXSYMBOLS)
+    {
+        fail("symbol table too large");
+        return NULL;
+    }
+
+    if(!(symbols = malloc((size_t)s->_size + 1)))
+        return NULL;
+
+    if(!read_section(file, s, symbols))
+    {
+        free(symbols);
+        return NULL;
+    }
+
+    symbols[s->_size] = '\0';
+    return symbols;
+}
+
+bool write_program_words(FILE *file, const Word *words, size_t n, uint32_t *crc)
+{
+    uint32_t buf[1024];
+
+    while(n > 0)
+    {
+        size_t chunk = n < 1024 ? n : 1024;
+
+        memcpy(buf, words, chunk * sizeof(uint32_t));
+        swap_words(buf, chunk);
+        if(crc)
+            *crc = crc32_update(*crc, buf, chunk * sizeof(uint32_t));
+        if(fwrite(buf, sizeof(uint32_t), chunk, file) != chunk)
+            return false;
+
+        words += chunk, n -= chunk;
+    }
+
+    return true;
+}
+
+bool write_program_header(FILE *file, const Program_Header *phdr)
+{
+    uint32_t words[7 + 6 * BIN_MAXSECTIONS] = {
+        BIN_MAGIC, BIN_VERSION, phdr->_textsize, phdr->_initsize,
+        phdr->_dataend, phdr->_nsections, 0
+    };
+
+    memcpy(words + 7, phdr->_sections, sizeof(phdr->_sections));
+    swap_words(words, 7 + 6 * BIN_MAXSECTIONS);
+    words[6] = crc32_update(0, words, 4 * (7 + 6 * phdr->_nsections));
+    swap_words(words + 6, 1);
+
+    return fwrite(words, sizeof(words), 1, file) == 1;
+}
+
+//! Compression des plages de zéros
+/*!
+ * Une plage de moins de trois zéros reste littérale (un groupe coûte deux
+ * mots).
+ *
+ * \param in les mots
+ * \param n leur nombre
+ * \param out au moins <tt>n + 2</tt> mots
+ * \return le nombre de mots produits
+ */
+static size_t rle_encode(const Word *in, size_t n, Word *out)
+{
+    size_t i = 0, o = 0;
+
+    while(i < n)
+    {
+        size_t start = i, zeros = 0;
+
+        while(i < n)
+        {
+            size_t z = 0;
+            while(i + z < n && in[i + z] == 0)
+                ++z;
+            if(z >= 3 || (z > 0 && i + z == n))
+                break;
+            i += z ? z : 1;
+        }
+
+        out[o++] = i - start;
+        memcpy(out + o, in + start, (i - start) * sizeof(Word));
+        o += i - start;
+
+        while(i < n && in[i] == 0)
+            ++i, ++zeros;
+        out[o++] = zeros;
+    }
+
+    return o;
+}
+
+bool write_program(FILE *file, unsigned textsize, const Instruction *text,
+                   unsigned initsize, const Word *data, unsigned dataend,
+                   const char *symbols, unsigned flags)
+{
+    Program_Header hdr;
+    Word *packed = NULL;
+    size_t npacked = 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr._textsize = textsize;
+    hdr._initsize = initsize;
+    hdr._dataend = dataend;
+
+    if((flags & BIN_COMPRESS) && (packed = malloc((initsize + 2) * sizeof(Word))))
+    {
+        npacked = rle_encode(data, initsize, packed);
+        if(npacked >= initsize)
+        {
+            free(packed);
+            packed = NULL;
+        }
+    }
+
+    uint32_t offset = BIN_HEADER_SIZE;
+    Bin_Section *s = hdr._sections;
+
+    *s = (Bin_Section){BIN_TEXT, 0, offset, 4 * textsize, 4 * textsize, 0};
+    offset += s++->_stored;
+    *s = (Bin_Section){BIN_DATA, packed ? BIN_RLE : 0, offset,
+        4 * (packed ? npacked : initsize), 4 * initsize, 0};
+    offset += s++->_stored;
+    if(symbols)
+    {
+        uint32_t size = strlen(symbols);
+        *s = (Bin_Section){BIN_SYMBOLS, 0, offset, size, size,
+            crc32_update(0, symbols, size)};
+        offset += s++->_stored;
+    }
+    hdr._nsections = s - hdr._sections;
+
+    // CRC du texte et des données décodées
+    Word *le = NULL;
+    bool ok = true;
+    if(big_endian())
+        ok = (le = malloc(((size_t)textsize + initsize + 1) * sizeof(Word))) != NULL;
+    if(ok)
+    {
+        if(le)
+        {
+            memcpy(le, text, textsize * sizeof(Word));
+            memcpy(le + textsize, data, initsize * sizeof(Word));
+            swap_words(le, textsize + initsize);
+        }
+        hdr._sections[0]._crc = crc32_update(0, le ? le : (const void *)text,
+                4 * textsize);
+        hdr._sections[1]._crc = crc32_update(0, le ? le + textsize : data,
+                4 * initsize);
+        free(le);
+
+        ok = write_program_header(file, &hdr)
+            && write_program_words(file, (const Word *)text, textsize, NULL)
+            && (packed ? write_program_words(file, packed, npacked, NULL)
+                    : write_program_words(file, data, initsize, NULL))
+            && (!symbols || fwrite(symbols, 1, hdr._sections[2]._size, file)
+                    == hdr._sections[2]._size);
+    }
+
+    free(packed);
+    return ok;
+}
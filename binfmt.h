@@ -0,0 +1,212 @@
+#ifndef _BINFMT_H_
+#define _BINFMT_H_
+
+/*!
+ * \file binfmt.h
+ * \brief Format des fichiers binaires de programmes.
+ *
+ * Un fichier binaire (version 1) commence par un en-tête de mots de 32 bits
+ * \e petit-boutistes, quel que soit l'hôte :
+ *
+ * \verbatim
+ *   mot 0    magique "SIMB" (BIN_MAGIC)
+ *   mot 1    version (BIN_VERSION)
+ *   mot 2    textsize : taille du segment de texte
+ *   mot 3    datasize : nombre de mots de données fournis
+ *   mot 4    dataend  : fin des données statiques
+ *   mot 5    nombre de sections (au plus BIN_MAXSECTIONS)
+ *   mot 6    CRC-32 des mots 0 à 5 et des entrées de la table
+ *   mots 7-  table des sections : BIN_MAXSECTIONS entrées de 6 mots
+ *            (type, attributs, position, taille stockée, taille, CRC-32)
+ * \endverbatim
+ *
+ * Chaque section occupe <tt>taille stockée</tt> octets à partir de sa
+ * position dans le fichier ; son CRC-32 porte sur son contenu décodé. Les
+ * sections de texte et de données sont obligatoires (la seconde peut être
+ * vide) ; la section des symboles (format de <tt>sasm -s</tt>) est
+ * facultative, de même que la section réservée aux formes prédécodées du
+ * texte. Les sections de type inconnu sont ignorées.
+ *
+ * Une section marquée \c BIN_RLE est compressée par plages de zéros : une
+ * suite de groupes <tt>n, n mots, z</tt> (\e n mots littéraux suivis de
+ * \e z mots nuls), qui réduit fortement les segments de données creux.
+ *
+ * Les fichiers de l'ancien format (trois \c unsigned de l'hôte, puis le
+ * texte et les données bruts) sont toujours lus ; leurs tailles sont
+ * vérifiées par rapport à la taille du fichier.
+ *
+ * Un fichier corrompu (en-tête, table ou CRC incorrect, tailles
+ * incohérentes, fichier tronqué) est refusé avant toute exécution.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "instruction.h"
+
+//! Nombre magique ("SIMB" en petit-boutiste)
+#define BIN_MAGIC 0x424d4953u
+
+//! Version du format
+#define BIN_VERSION 1
+
+//! Nombre maximal de sections
+#define BIN_MAXSECTIONS 8
+
+//! Taille de l'en-tête en octets (table comprise)
+#define BIN_HEADER_SIZE (4 * (7 + 6 * BIN_MAXSECTIONS))
+
+//! Taille maximale de la section des symboles (octets)
+#define BIN_MAXSYMBOLS (64u << 20)
+
+//! Types de section
+typedef enum
+{
+    BIN_TEXT = 1,       //!< Segment de texte
+    BIN_DATA,           //!< Données initiales
+    BIN_SYMBOLS,        //!< Table des symboles (facultative)
+    BIN_PREDECODED,     //!< Forme prédécodée du texte (facultative, réservée)
+} Bin_Section_Type;
+
+//! Attributs de section
+enum
+{
+    BIN_RLE = 1,        //!< Contenu compressé par plages de zéros
+};
+
+//! Entrée de la table des sections
+typedef struct
+{
+    uint32_t _type;             //!< Type (Bin_Section_Type)
+    uint32_t _flags;            //!< Attributs
+    uint32_t _offset;           //!< Position dans le fichier
+    uint32_t _stored;           //!< Taille dans le fichier (octets)
+    uint32_t _size;             //!< Taille décodée (octets)
+    uint32_t _crc;              //!< CRC-32 du contenu décodé
+} Bin_Section;
+
+//! En-tête d'un programme binaire
+typedef struct
+{
+    unsigned _textsize;         //!< Taille du segment de texte
+    unsigned _initsize;         //!< Nombre de mots de données dans le fichier
+    unsigned _dataend;          //!< Première adresse libre après les données statiques
+    unsigned _datasize;         //!< Taille du segment de données (pile minimale comprise)
+
+    unsigned _version;          //!< Version du format (0 : ancien format)
+    unsigned _nsections;        //!< Nombre de sections
+    Bin_Section _sections[BIN_MAXSECTIONS]; //!< Table des sections
+} Program_Header;
+
+//! Options d'écriture
+enum
+{
+    BIN_COMPRESS = 1,           //!< Compresser les données si c'est rentable
+};
+
+//! Calcul incrémental d'un CRC-32 (polynôme IEEE 802.3)
+/*!
+ * \param crc le CRC des octets précédents (0 au départ)
+ * \param data les octets suivants
+ * \param size leur nombre
+ * \return le CRC de l'ensemble
+ */
+uint32_t crc32_update(uint32_t crc, const void *data, size_t size);
+
+//! Lecture de l'en-tête d'un programme binaire
+/*!
+ * Les deux formats sont reconnus. Le segment de données est agrandi si
+ * nécessaire pour que la pile ait au moins \c MINSTACKSIZE mots.
+ *
+ * \param file le fichier binaire, positionné au début
+ * \param phdr l'en-tête lu
+ * \return faux si l'en-tête est illisible ou incohérent (voir
+ * program_format_error())
+ */
+bool read_program_header(FILE *file, Program_Header *phdr);
+
+//! Lecture de l'en-tête d'un programme de taille connue
+/*!
+ * Comme read_program_header(), mais les sections sont vérifiées par
+ * rapport à \a length plutôt qu'à la taille du fichier, inconnue pour un
+ * flot qui n'est pas un fichier régulier (tube, image en mémoire ouverte
+ * par \c fmemopen...).
+ *
+ * \param file le fichier binaire, positionné au début
+ * \param length la taille de l'image en octets (-1 : taille du fichier s'il
+ * est régulier, sans vérification sinon)
+ * \param phdr l'en-tête lu
+ * \return faux si l'en-tête est illisible ou incohérent
+ */
+bool read_program_header_length(FILE *file, long length, Program_Header *phdr);
+
+//! Lecture des segments d'un programme binaire
+/*!
+ * Les segments sont fournis par l'appelant : \a text doit pouvoir contenir
+ * \c _textsize instructions et \a data \c _initsize mots (les mots suivants
+ * ne sont pas touchés). Les CRC sont vérifiés.
+ *
+ * \param file le fichier binaire, positionné après l'en-tête
+ * \param phdr l'en-tête lu par read_program_header()
+ * \param text le segment de texte
+ * \param data le segment de données
+ * \return faux si le fichier est tronqué ou corrompu
+ */
+bool read_program_body(FILE *file, const Program_Header *phdr,
+                       Instruction *text, Word *data);
+
+//! Lecture de la section des symboles
+/*!
+ * Une section de plus de \c BIN_MAXSYMBOLS octets est refusée.
+ *
+ * \param file le fichier binaire
+ * \param phdr son en-tête
+ * \return le texte de la table (terminé par un nul, à libérer par \c free),
+ * ou NULL s'il n'y en a pas ou si elle est corrompue
+ */
+char *read_program_symbols(FILE *file, const Program_Header *phdr);
+
+//! Cause du dernier échec de lecture (thread courant)
+const char *program_format_error(void);
+
+//! Écriture d'un programme binaire (version 1)
+/*!
+ * \param file le fichier, positionné au début
+ * \param textsize taille du segment de texte
+ * \param text le segment de texte
+ * \param initsize nombre de mots de données
+ * \param data les données
+ * \param dataend fin des données statiques
+ * \param symbols la table des symboles (format de <tt>sasm -s</tt>) ou NULL
+ * \param flags options d'écriture (\c BIN_COMPRESS)
+ * \return faux en cas d'erreur d'écriture
+ */
+bool write_program(FILE *file, unsigned textsize, const Instruction *text,
+                   unsigned initsize, const Word *data, unsigned dataend,
+                   const char *symbols, unsigned flags);
+
+//! Écriture de l'en-tête et de la table des sections
+/*!
+ * Pour les écritures en flot : l'en-tête peut être écrit d'abord avec une
+ * table provisoire, puis réécrit à la fin. Le CRC de l'en-tête est calculé
+ * ici.
+ *
+ * \param file le fichier, positionné au début
+ * \param phdr l'en-tête (\c _datasize et \c _version sont ignorés)
+ * \return faux en cas d'erreur d'écriture
+ */
+bool write_program_header(FILE *file, const Program_Header *phdr);
+
+//! Écriture de mots en petit-boutiste
+/*!
+ * \param file le fichier
+ * \param words les mots
+ * \param n leur nombre
+ * \param crc CRC mis à jour avec les octets écrits (ou NULL)
+ * \return faux en cas d'erreur d'écriture
+ */
+bool write_program_words(FILE *file, const Word *words, size_t n, uint32_t *crc);
+
+#endif
@@ -0,0 +1,243 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+/*!
+ * \file cache.c
+ * \brief Implémentation de cache.h. Cache persistant.
+ */
+
+//! Préfixe des fichiers temporaires (ignorés par l'éviction)
+#define TMP_PREFIX ".tmp-"
+
+//! Construction du chemin <tt>dir/name[.ext]</tt>
+/*!
+ * \return faux si le chemin est trop long
+ */
+static bool make_path(char path[CACHE_MAXPATH], const char *dir,
+                      const char *name, const char *ext)
+{
+    return snprintf(path, CACHE_MAXPATH, "%s/%s%s%s", dir, name,
+            ext ? "." : "", ext ? ext : "") < CACHE_MAXPATH;
+}
+
+//! Création récursive d'un répertoire
+static bool make_dirs(const char *dir)
+{
+    char path[CACHE_MAXPATH];
+
+    snprintf(path, sizeof(path), "%s", dir);
+    for(char *p = path + 1; *p; ++p)
+        if(*p == '/')
+        {
+            *p = '\0';
+            if(mkdir(path, 0777) != 0 && errno != EEXIST)
+                return false;
+            *p = '/';
+        }
+
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+bool cache_open(Cache *cache, const char *dir, uint64_t maxsize)
+{
+    if(strlen(dir) >= CACHE_MAXPATH - 2 * HASH_SIZE - 32 || !make_dirs(dir))
+        return false;
+
+    snprintf(cache->_dir, sizeof(cache->_dir), "%s", dir);
+    cache->_maxsize = maxsize ? maxsize : CACHE_DEFAULT_MAXSIZE;
+    return true;
+}
+
+char *cache_path(const Cache *cache, const Hash *key, const char *ext,
+                 char path[CACHE_MAXPATH])
+{
+    char hex[HASH_HEXSIZE];
+
+    make_path(path, cache->_dir, hash_hex(key, hex), ext);
+    return path;
+}
+
+bool cache_lookup(const Cache *cache, const Hash *key, const char *ext)
+{
+    char path[CACHE_MAXPATH];
+
+    // La date de modification sert de date de dernier accès (LRU)
+    return utimensat(AT_FDCWD, cache_path(cache, key, ext, path), NULL, 0) == 0;
+}
+
+bool cache_map(const Cache *cache, const Hash *key, const char *ext,
+               Cache_Mapping *map)
+{
+    char path[CACHE_MAXPATH];
+    int fd = open(cache_path(cache, key, ext, path), O_RDONLY);
+    struct stat st;
+
+    if(fd < 0)
+        return false;
+
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    futimens(fd, NULL);
+    map->_size = st.st_size;
+    map->_data = st.st_size > 0 ?
+        mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+
+    return map->_data != MAP_FAILED;
+}
+
+void cache_unmap(Cache_Mapping *map)
+{
+    if(map->_data)
+        munmap((void *)map->_data, map->_size);
+    map->_data = NULL;
+    map->_size = 0;
+}
+
+int cache_temporary(const Cache *cache, const char *ext,
+                    char path[CACHE_MAXPATH])
+{
+    if(!make_path(path, cache->_dir, TMP_PREFIX "XXXXXX", ext))
+        return -1;
+    return mkstemps(path, strlen(ext) + 1);
+}
+
+bool cache_commit(const Cache *cache, const char *tmppath, const Hash *key,
+                  const char *ext)
+{
+    char path[CACHE_MAXPATH];
+
+    if(rename(tmppath, cache_path(cache, key, ext, path)) != 0)
+    {
+        unlink(tmppath);
+        return false;
+    }
+
+    cache_evict(cache);
+    return true;
+}
+
+bool cache_store(const Cache *cache, const Hash *key, const char *ext,
+                 const void *data, size_t size)
+{
+    char tmppath[CACHE_MAXPATH];
+    int fd = cache_temporary(cache, ext, tmppath);
+
+    if(fd < 0)
+        return false;
+
+    const char *p = data;
+    while(size > 0)
+    {
+        ssize_t n = write(fd, p, size);
+        if(n <= 0)
+        {
+            close(fd);
+            unlink(tmppath);
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+
+    close(fd);
+    return cache_commit(cache, tmppath, key, ext);
+}
+
+//! Artefact candidat à l'éviction
+typedef struct
+{
+    char _name[2 * HASH_SIZE + 32];     //!< Nom du fichier
+    time_t _mtime;                      //!< Date de dernier accès
+    off_t _size;                        //!< Taille
+} Entry;
+
+//! Comparaison par date de dernier accès (pour qsort)
+static int compare_entries(const void *a, const void *b)
+{
+    time_t x = ((const Entry *)a)->_mtime, y = ((const Entry *)b)->_mtime;
+    return (x > y) - (x < y);
+}
+
+void cache_evict(const Cache *cache)
+{
+    char path[CACHE_MAXPATH];
+    int lock;
+
+    make_path(path, cache->_dir, ".lock", NULL);
+    if((lock = open(path, O_RDWR | O_CREAT, 0666)) < 0)
+        return;
+
+    // Un seul processus à la fois réduit le cache
+    if(flock(lock, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(lock);
+        return;
+    }
+
+    DIR *dir = opendir(cache->_dir);
+    Entry *entries = NULL;
+    unsigned n = 0, cap = 0;
+    uint64_t total = 0;
+
+    for(struct dirent *d; dir && (d = readdir(dir)); )
+    {
+        struct stat st;
+
+        if(d->d_name[0] == '.' || strlen(d->d_name) >= sizeof(entries->_name))
+            continue;
+
+        make_path(path, cache->_dir, d->d_name, NULL);
+        if(stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        if(n == cap)
+        {
+            Entry *e = realloc(entries, (cap = cap ? 2 * cap : 64) * sizeof(Entry));
+            if(!e)
+                break;
+            entries = e;
+        }
+
+        strcpy(entries[n]._name, d->d_name);
+        entries[n]._mtime = st.st_mtime;
+        entries[n]._size = st.st_size;
+        total += st.st_size;
+        ++n;
+    }
+
+    if(dir)
+        closedir(dir);
+
+    if(total > cache->_maxsize)
+    {
+        qsort(entries, n, sizeof(Entry), compare_entries);
+        for(unsigned i = 0; i < n && total > cache->_maxsize; ++i)
+        {
+            make_path(path, cache->_dir, entries[i]._name, NULL);
+            if(unlink(path) == 0)
+                total -= entries[i]._size;
+        }
+    }
+
+    free(entries);
+    flock(lock, LOCK_UN);
+    close(lock);
+}
@@ -0,0 +1,137 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+/*!
+ * \file cache.h
+ * \brief Cache persistant d'artefacts indexés par empreinte.
+ *
+ * Un cache est un répertoire contenant un fichier par artefact, nommé
+ * <tt>empreinte.extension</tt>. Plusieurs processus peuvent le remplir en
+ * même temps : chaque artefact est écrit dans un fichier temporaire du
+ * répertoire puis renommé atomiquement, de sorte qu'un lecteur voit soit
+ * l'ancien état, soit l'artefact complet. La taille totale est bornée : les
+ * artefacts les moins récemment utilisés sont supprimés (LRU, d'après la
+ * date de modification, mise à jour à chaque accès).
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash.h"
+
+//! Taille maximale par défaut d'un cache (256 Mo)
+#define CACHE_DEFAULT_MAXSIZE (256ull << 20)
+
+//! Longueur maximale du chemin d'un fichier du cache
+#define CACHE_MAXPATH 4096
+
+//! Cache d'artefacts
+typedef struct
+{
+    char _dir[CACHE_MAXPATH];   //!< Répertoire du cache
+    uint64_t _maxsize;          //!< Taille totale maximale en octets
+} Cache;
+
+//! Artefact projeté en mémoire
+typedef struct
+{
+    const void *_data;          //!< Contenu (lecture seule)
+    size_t _size;               //!< Taille en octets
+} Cache_Mapping;
+
+//! Ouverture (et création si besoin) d'un cache
+/*!
+ * \param cache le cache à initialiser
+ * \param dir le répertoire du cache
+ * \param maxsize la taille totale maximale (0 : valeur par défaut)
+ * \return faux si le répertoire ne peut être créé
+ */
+bool cache_open(Cache *cache, const char *dir, uint64_t maxsize);
+
+//! Chemin d'un artefact du cache
+/*!
+ * \param cache le cache
+ * \param key l'empreinte de l'artefact
+ * \param ext l'extension (type d'artefact)
+ * \param path tampon de \c CACHE_MAXPATH caractères
+ * \return \a path
+ */
+char *cache_path(const Cache *cache, const Hash *key, const char *ext,
+                 char path[CACHE_MAXPATH]);
+
+//! Recherche d'un artefact
+/*!
+ * En cas de succès, l'artefact est marqué comme récemment utilisé.
+ *
+ * \param cache le cache
+ * \param key l'empreinte de l'artefact
+ * \param ext l'extension
+ * \return vrai si l'artefact est présent
+ */
+bool cache_lookup(const Cache *cache, const Hash *key, const char *ext);
+
+//! Projection en mémoire d'un artefact
+/*!
+ * \param cache le cache
+ * \param key l'empreinte de l'artefact
+ * \param ext l'extension
+ * \param map la projection obtenue (à libérer par cache_unmap())
+ * \return faux si l'artefact est absent
+ */
+bool cache_map(const Cache *cache, const Hash *key, const char *ext,
+               Cache_Mapping *map);
+
+//! Libération d'une projection
+void cache_unmap(Cache_Mapping *map);
+
+//! Création d'un fichier temporaire dans le répertoire du cache
+/*!
+ * Le fichier est destiné à devenir un artefact par cache_commit().
+ *
+ * \param cache le cache
+ * \param ext l'extension souhaitée du fichier temporaire
+ * \param path tampon de \c CACHE_MAXPATH caractères recevant son chemin
+ * \return un descripteur ouvert en écriture, ou -1
+ */
+int cache_temporary(const Cache *cache, const char *ext,
+                    char path[CACHE_MAXPATH]);
+
+//! Installation d'un fichier temporaire comme artefact
+/*!
+ * Le renommage est atomique ; si un autre processus a installé le même
+ * artefact entre-temps, le résultat est équivalent. Le cache est ensuite
+ * réduit à sa taille maximale.
+ *
+ * \param cache le cache
+ * \param tmppath le fichier temporaire (créé par cache_temporary())
+ * \param key l'empreinte de l'artefact
+ * \param ext l'extension
+ * \return faux si le renommage a échoué
+ */
+bool cache_commit(const Cache *cache, const char *tmppath, const Hash *key,
+                  const char *ext);
+
+//! Enregistrement d'un artefact en mémoire
+/*!
+ * \param cache le cache
+ * \param key l'empreinte de l'artefact
+ * \param ext l'extension
+ * \param data le contenu
+ * \param size sa taille
+ * \return faux en cas d'erreur d'écriture
+ */
+bool cache_store(const Cache *cache, const Hash *key, const char *ext,
+                 const void *data, size_t size);
+
+//! Réduction du cache à sa taille maximale
+/*!
+ * Les artefacts sont supprimés du moins récemment utilisé au plus récent.
+ * L'opération est protégée par un verrou sur le fichier \c .lock du
+ * répertoire.
+ *
+ * \param cache le cache
+ */
+void cache_evict(const Cache *cache);
+
+#endif
@@ -0,0 +1,473 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "error.h"
+#include "exec.h"
+
+/*!
+ * \file cfg.c
+ * \brief Implémentation de cfg.h. Graphe de flot de contrôle.
+ *
+ * Le graphe est construit en trois passes : repérage des débuts de blocs,
+ * découpage, puis arcs de la dernière instruction de chaque bloc (deux au
+ * plus). L'accessibilité est un parcours en largeur depuis le bloc 0.
+ */
+
+const char *cfg_kind_names[] =
+{
+    "next",
+    "jump",
+    "call",
+    "return",
+};
+
+//! Effet d'une instruction sur le flot de contrôle
+typedef enum
+{
+    FLOW_NONE,          //!< Passage à l'instruction suivante
+    FLOW_BRANCH,        //!< \c BRANCH (éventuellement conditionnel)
+    FLOW_CALL,          //!< \c CALL (éventuellement conditionnel)
+    FLOW_END,           //!< \c RET ou \c HALT
+    FLOW_FAULT,         //!< Erreur certaine
+} Flow;
+
+//! Effet d'une instruction
+/*!
+ * \param instr l'instruction
+ * \param textsize la taille du segment de texte
+ * \param target la cible d'un saut absolu dans le segment, sinon \a
+ * textsize (saut indexé, ou cible hors du segment)
+ * \return l'effet de l'instruction
+ */
+static Flow flow_of(Instruction instr, unsigned textsize, unsigned *target)
+{
+    Code_Op cop = instr.instr_generic._cop;
+
+    *target = textsize;
+    if(cop == RET || cop == HALT)
+        return FLOW_END;
+    if(cop > LAST_COP || cop == ILLOP)
+        return FLOW_FAULT;
+
+    // Mode immédiat interdit (il l'emporte sur le mode registre)
+    if(!cop_takes_value(cop) && instr.instr_generic._immediate)
+        return FLOW_FAULT;
+
+    if(cop != BRANCH && cop != CALL)
+        return FLOW_NONE;
+
+    if(instr.instr_generic._regcond > LAST_CONDITION)
+        return FLOW_FAULT;
+
+    if(!instr.instr_generic._indexed
+            && instr.instr_absolute._address < textsize)
+        *target = instr.instr_absolute._address;
+
+    return cop == BRANCH ? FLOW_BRANCH : FLOW_CALL;
+}
+
+//! Ajout d'un arc (la capacité est suffisante pour les arcs statiques)
+static Cfg_Edge *add_edge(Cfg *cfg, unsigned from, unsigned to,
+        Cfg_Kind kind, Condition cond)
+{
+    if(cfg->_nedges == cfg->_capacity)
+    {
+        unsigned capacity = cfg->_capacity ? 2 * cfg->_capacity : 16;
+        Cfg_Edge *edges = realloc(cfg->_edges, capacity * sizeof(Cfg_Edge));
+
+        if(!edges)
+            return NULL;
+        cfg->_edges = edges;
+        cfg->_capacity = capacity;
+    }
+
+    Cfg_Edge *edge = &cfg->_edges[cfg->_nedges++];
+    memset(edge, 0, sizeof(*edge));
+    edge->_from = from;
+    edge->_to = to;
+    edge->_kind = kind;
+    edge->_cond = cond;
+    return edge;
+}
+
+//! Arcs statiques d'un bloc
+static void block_edges(Cfg *cfg, unsigned b)
+{
+    Cfg_Block *block = &cfg->_blocks[b];
+    unsigned last = block->_last, target;
+    Instruction instr = cfg->_text[last];
+    Flow flow = flow_of(instr, cfg->_textsize, &target);
+    Condition cond = instr.instr_generic._regcond;
+    // Le segment peut se terminer sans HALT : l'exécution sort alors du texte
+    bool next = last + 1 < cfg->_textsize;
+    unsigned follower = next ? cfg->_block[last + 1] : 0;
+
+    // Une erreur certaine arrête l'exécution du bloc avant sa fin
+    for(unsigned addr = block->_first, unused; addr < last; ++addr)
+        if(flow_of(cfg->_text[addr], cfg->_textsize, &unused) == FLOW_FAULT)
+            return;
+
+    switch(flow)
+    {
+        case FLOW_NONE:
+            if(next)
+                add_edge(cfg, b, follower, CFG_NEXT, NC);
+            break;
+
+        case FLOW_BRANCH:
+            block->_indirect = instr.instr_generic._indexed;
+            if(target < cfg->_textsize)
+                add_edge(cfg, b, cfg->_block[target], CFG_JUMP, cond);
+            if(next && cond != NC)
+                add_edge(cfg, b, follower, CFG_NEXT, cond);
+            break;
+
+        case FLOW_CALL:
+            block->_indirect = instr.instr_generic._indexed;
+            if(target < cfg->_textsize)
+                add_edge(cfg, b, cfg->_block[target], CFG_CALL, cond);
+            if(next)
+                add_edge(cfg, b, follower, CFG_RETURN, NC);
+            break;
+
+        case FLOW_END:
+        case FLOW_FAULT:
+            break;
+    }
+}
+
+//! Marquage des blocs accessibles depuis le point d'entrée
+static void mark_reachable(Cfg *cfg, unsigned *queue)
+{
+    unsigned head = 0, tail = 0;
+
+    if(cfg->_nblocks == 0)
+        return;
+
+    cfg->_blocks[0]._reachable = true;
+    queue[tail++] = 0;
+    while(head < tail)
+    {
+        unsigned b = queue[head++];
+
+        for(unsigned e = cfg->_out[b]; e < cfg->_out[b + 1]; ++e)
+        {
+            Cfg_Block *to = &cfg->_blocks[cfg->_edges[e]._to];
+            if(!to->_reachable)
+            {
+                to->_reachable = true;
+                queue[tail++] = cfg->_edges[e]._to;
+            }
+        }
+    }
+}
+
+Cfg *cfg_build(const Instruction *text, unsigned textsize)
+{
+    Cfg *cfg = calloc(1, sizeof(Cfg));
+    bool *leader = calloc(textsize + 1, sizeof(bool));
+
+    if(!cfg || !leader)
+    {
+        free(leader);
+        free(cfg);
+        return NULL;
+    }
+
+    cfg->_text = text;
+    cfg->_textsize = textsize;
+
+    // Débuts de blocs
+    leader[0] = true;
+    for(unsigned addr = 0; addr < textsize; ++addr)
+    {
+        unsigned target;
+
+        Flow flow = flow_of(text[addr], textsize, &target);
+
+        if(flow == FLOW_NONE || flow == FLOW_FAULT)
+            continue;
+        leader[addr + 1] = true;
+        if(target < textsize)
+            leader[target] = true;
+    }
+
+    // Découpage
+    for(unsigned addr = 0; addr < textsize; ++addr)
+        cfg->_nblocks += leader[addr];
+
+    cfg->_block = malloc((textsize ? textsize : 1) * sizeof(unsigned));
+    cfg->_blocks = calloc(cfg->_nblocks + 1, sizeof(Cfg_Block));
+    cfg->_out = calloc(cfg->_nblocks + 1, sizeof(unsigned));
+    cfg->_capacity = 2 * cfg->_nblocks + 1;
+    cfg->_edges = malloc(cfg->_capacity * sizeof(Cfg_Edge));
+    unsigned *queue = malloc((cfg->_nblocks + 1) * sizeof(unsigned));
+    if(!cfg->_block || !cfg->_blocks || !cfg->_out || !cfg->_edges || !queue)
+    {
+        free(queue);
+        free(leader);
+        cfg_free(cfg);
+        return NULL;
+    }
+
+    for(unsigned addr = 0, b = 0; addr < textsize; ++addr)
+    {
+        if(leader[addr] && addr > 0)
+            ++b;
+        if(leader[addr])
+            cfg->_blocks[b]._first = addr;
+        cfg->_blocks[b]._last = addr;
+        cfg->_block[addr] = b;
+    }
+
+    // Arcs, groupés par bloc de départ
+    for(unsigned b = 0; b < cfg->_nblocks; ++b)
+    {
+        cfg->_out[b] = cfg->_nedges;
+        block_edges(cfg, b);
+    }
+    cfg->_out[cfg->_nblocks] = cfg->_nstatic = cfg->_nedges;
+
+    mark_reachable(cfg, queue);
+
+    free(queue);
+    free(leader);
+    return cfg;
+}
+
+void cfg_free(Cfg *cfg)
+{
+    if(!cfg)
+        return;
+
+    free(cfg->_block);
+    free(cfg->_blocks);
+    free(cfg->_edges);
+    free(cfg->_out);
+    free(cfg);
+}
+
+void cfg_count(Cfg *cfg, unsigned from, unsigned to)
+{
+    if(from >= cfg->_textsize || to >= cfg->_textsize)
+        return;
+
+    unsigned src = cfg->_block[from], dst = cfg->_block[to];
+    Cfg_Block *block = &cfg->_blocks[dst];
+
+    // Passage interne, ou saut indexé au milieu d'un bloc
+    if(to != block->_first)
+        return;
+
+    ++block->_count;
+
+    Instruction instr = cfg->_text[from];
+    Code_Op cop = instr.instr_generic._cop;
+    Condition cond = NC;
+    Cfg_Kind kind = CFG_NEXT;
+
+    if(cop == RET)
+    {
+        // Retour : arc du bloc de l'appel vers son site de retour
+        if(to == 0 || cfg->_text[to - 1].instr_generic._cop != CALL)
+            return;
+        src = cfg->_block[to - 1];
+        kind = CFG_RETURN;
+    }
+    else if(cop == CALL)
+    {
+        kind = to == from + 1 ? CFG_RETURN : CFG_CALL;
+        cond = instr.instr_generic._regcond;
+    }
+    else if(cop == BRANCH)
+    {
+        kind = to == from + 1 ? CFG_NEXT : CFG_JUMP;
+        cond = instr.instr_generic._regcond;
+    }
+
+    for(unsigned e = cfg->_out[src]; e < cfg->_out[src + 1]; ++e)
+        if(cfg->_edges[e]._to == dst && cfg->_edges[e]._kind == kind)
+        {
+            ++cfg->_edges[e]._count;
+            return;
+        }
+
+    for(unsigned e = cfg->_nstatic; e < cfg->_nedges; ++e)
+        if(cfg->_edges[e]._from == src && cfg->_edges[e]._to == dst
+                && cfg->_edges[e]._kind == kind)
+        {
+            ++cfg->_edges[e]._count;
+            return;
+        }
+
+    // Premier parcours d'un saut indexé (sans mémoire, l'arc est perdu)
+    Cfg_Edge *edge = add_edge(cfg, src, dst, kind, cond);
+    if(edge)
+    {
+        edge->_dynamic = true;
+        edge->_count = 1;
+    }
+}
+
+Run_Result cfg_run(Cfg *cfg, Machine *pmach, uint64_t budget)
+{
+    Run_Result result = {RUN_BUDGET, 0, ERR_NOERROR, 0, 0, 0, 0};
+    uint64_t before = counters_retired(&pmach->_counters);
+    Error_Trap trap;
+    Machine *previous = machine_enter(pmach);
+
+    cfg->_counted = true;
+    if(pmach->_pc < cfg->_textsize
+            && cfg->_blocks[cfg->_block[pmach->_pc]]._first == pmach->_pc)
+        ++cfg->_blocks[cfg->_block[pmach->_pc]]._count;
+
+    counters_start(&pmach->_counters);
+    error_trap_enter(&trap);
+    if(setjmp(trap._env) == 0)
+    {
+        for(uint64_t n = 0; n < budget; ++n)
+        {
+            unsigned from = pmach->_pc;
+
+            if(from >= pmach->_textsize)
+                error(ERR_SEGTEXT, from);
+
+            if(!decode_execute(pmach, pmach->_text[pmach->_pc++]))
+            {
+                result._status = RUN_HALTED;
+                break;
+            }
+            cfg_count(cfg, from, pmach->_pc);
+        }
+    }
+    else
+    {
+        result._status = RUN_FAULTED;
+        result._error = trap._error;
+        result._address = trap._address;
+    }
+    error_trap_leave(&trap);
+    counters_stop(&pmach->_counters);
+    machine_leave(previous);
+
+    result._executed = counters_retired(&pmach->_counters) - before;
+    return result;
+}
+
+//! Écriture d'une chaîne entre guillemets (\c dot et JSON)
+static void write_string(FILE *out, const char *s, const char *eol)
+{
+    for(; *s; ++s)
+        if(*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if(*s == '\n')
+            fputs(eol, out);
+        else
+            fputc(*s, out);
+}
+
+//! Libellé d'un arc (nature, condition, nombre de parcours)
+static void edge_label(char *buf, size_t size, const Cfg *cfg,
+        const Cfg_Edge *edge)
+{
+    int n = snprintf(buf, size, "%s", cfg_kind_names[edge->_kind]);
+
+    if(edge->_cond != NC && n >= 0 && (size_t)n < size)
+        n += snprintf(buf + n, size - n, edge->_kind == CFG_NEXT ? " !%s"
+                : " %s", condition_names[edge->_cond]);
+    if(cfg->_counted && n >= 0 && (size_t)n < size)
+        snprintf(buf + n, size - n, "\n%llu",
+                (unsigned long long)edge->_count);
+}
+
+void cfg_write_dot(FILE *out, const Cfg *cfg, const Symbol_Map *map)
+{
+    char line[DISASM_MAXLEN + SYMBOL_MAXLEN + 64];
+
+    fprintf(out, "digraph cfg {\n"
+            "    node [shape=box, fontname=\"monospace\"];\n");
+
+    for(unsigned b = 0; b < cfg->_nblocks; ++b)
+    {
+        const Cfg_Block *block = &cfg->_blocks[b];
+        const char *name = symbol_map_text(map, block->_first);
+
+        fprintf(out, "    b%u [label=\"", b);
+        snprintf(line, sizeof(line), "0x%04x%s%s", block->_first,
+                name ? " " : "", name ? name : "");
+        write_string(out, line, "");
+        if(cfg->_counted)
+            fprintf(out, " (%llu)", (unsigned long long)block->_count);
+        fputs("\\l", out);
+
+        for(unsigned addr = block->_first; addr <= block->_last; ++addr)
+        {
+            disasm_instruction(line, cfg->_text[addr], map);
+            write_string(out, line, "");
+            fputs("\\l", out);
+        }
+        fprintf(out, "\"%s];\n", block->_reachable ? ""
+                : ", style=filled, fillcolor=lightgrey");
+    }
+
+    for(unsigned e = 0; e < cfg->_nedges; ++e)
+    {
+        const Cfg_Edge *edge = &cfg->_edges[e];
+        static const char *styles[] = {"solid", "solid", "dashed", "dotted"};
+
+        edge_label(line, sizeof(line), cfg, edge);
+        fprintf(out, "    b%u -> b%u [label=\"", edge->_from, edge->_to);
+        write_string(out, line, "\\n");
+        fprintf(out, "\", style=%s%s];\n", styles[edge->_kind],
+                edge->_dynamic ? ", color=blue" : "");
+    }
+
+    fprintf(out, "}\n");
+}
+
+void cfg_write_json(FILE *out, const Cfg *cfg, const Symbol_Map *map)
+{
+    fprintf(out, "{\n  \"blocks\": [");
+
+    for(unsigned b = 0; b < cfg->_nblocks; ++b)
+    {
+        const Cfg_Block *block = &cfg->_blocks[b];
+        const char *name = symbol_map_text(map, block->_first);
+
+        fprintf(out, "%s\n    {\"id\": %u, \"first\": %u, \"last\": %u",
+                b ? "," : "", b, block->_first, block->_last);
+        if(name)
+        {
+            fprintf(out, ", \"label\": \"");
+            write_string(out, name, "");
+            fputc('"', out);
+        }
+        fprintf(out, ", \"reachable\": %s, \"indirect\": %s",
+                block->_reachable ? "true" : "false",
+                block->_indirect ? "true" : "false");
+        if(cfg->_counted)
+            fprintf(out, ", \"count\": %llu",
+                    (unsigned long long)block->_count);
+        fputc('}', out);
+    }
+
+    fprintf(out, "%s],\n  \"edges\": [", cfg->_nblocks ? "\n  " : "");
+
+    for(unsigned e = 0; e < cfg->_nedges; ++e)
+    {
+        const Cfg_Edge *edge = &cfg->_edges[e];
+
+        fprintf(out, "%s\n    {\"from\": %u, \"to\": %u, \"kind\": \"%s\", "
+                "\"cond\": \"%s\", \"dynamic\": %s", e ? "," : "",
+                edge->_from, edge->_to, cfg_kind_names[edge->_kind],
+                condition_names[edge->_cond],
+                edge->_dynamic ? "true" : "false");
+        if(cfg->_counted)
+            fprintf(out, ", \"count\": %llu",
+                    (unsigned long long)edge->_count);
+        fputc('}', out);
+    }
+
+    fprintf(out, "%s]\n}\n", cfg->_nedges ? "\n  " : "");
+}
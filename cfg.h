@@ -0,0 +1,158 @@
+#ifndef _CFG_H_
+#define _CFG_H_
+
+/*!
+ * \file cfg.h
+ * \brief Graphe de flot de contrôle d'un segment de texte.
+ *
+ * Un bloc de base est une suite d'instructions exécutées l'une après
+ * l'autre : seule la première peut être la cible d'un saut, seule la
+ * dernière peut en faire un. Un bloc commence à l'adresse 0 (point
+ * d'entrée), à la cible d'un \c BRANCH ou d'un \c CALL absolu, et après un
+ * \c BRANCH, un \c CALL, un \c RET ou un \c HALT. Une instruction qui
+ * provoque toujours une erreur (\c ILLOP, mode immédiat interdit, condition
+ * invalide...) ne termine pas son bloc, pour que les mots nuls qui
+ * complètent un segment forment un seul bloc, mais celui-ci n'a pas
+ * d'arc.
+ *
+ * Les arcs relient des blocs :
+ *
+ *   - \c CFG_NEXT : passage au bloc suivant en séquence, y compris quand un
+ *   branchement conditionnel n'est pas pris (\c _cond est alors sa
+ *   condition, qui est fausse) ;
+ *
+ *   - \c CFG_JUMP : branchement pris, sous la condition \c _cond (\c NC :
+ *   inconditionnel) ;
+ *
+ *   - \c CFG_CALL : appel, vers le bloc appelé ;
+ *
+ *   - \c CFG_RETURN : du bloc qui se termine par un \c CALL vers son site de
+ *   retour (l'instruction suivante), où l'exécution reprend après le \c RET
+ *   de l'appelé ou quand l'appel n'est pas pris.
+ *
+ * Un \c RET n'a pas d'arc : ses destinations sont les sites de retour. Les
+ * cibles d'un \c BRANCH ou d'un \c CALL indexé ne sont connues qu'à
+ * l'exécution : le bloc est marqué \c _indirect et ses arcs sont ajoutés
+ * par cfg_count() quand ils sont parcourus. Un bloc est inaccessible si
+ * aucun chemin d'arcs statiques ne le relie au point d'entrée ; en présence
+ * de sauts indirects (\c _indirect), il peut néanmoins être exécuté.
+ *
+ * Les arcs et les blocs peuvent être pondérés par une exécution
+ * (cfg_run()), puis le graphe exporté au format Graphviz (\c dot) ou JSON.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "disasm.h"
+#include "machine.h"
+
+//! Nature d'un arc
+typedef enum
+{
+    CFG_NEXT,           //!< Passage au bloc suivant en séquence
+    CFG_JUMP,           //!< Branchement pris
+    CFG_CALL,           //!< Appel
+    CFG_RETURN,         //!< Du bloc d'un appel vers son site de retour
+} Cfg_Kind;
+
+//! Noms des natures d'arcs
+extern const char *cfg_kind_names[];
+
+//! Arc du graphe
+typedef struct
+{
+    unsigned _from;             //!< Bloc de départ
+    unsigned _to;               //!< Bloc d'arrivée
+    Cfg_Kind _kind;             //!< Nature de l'arc
+    Condition _cond;            //!< Condition du saut (voir Cfg_Kind)
+    bool _dynamic;              //!< Découvert à l'exécution (saut indirect)
+    uint64_t _count;            //!< Nombre de parcours
+} Cfg_Edge;
+
+//! Bloc de base
+typedef struct
+{
+    unsigned _first;            //!< Première instruction
+    unsigned _last;             //!< Dernière instruction (comprise)
+    bool _reachable;            //!< Accessible depuis le point d'entrée
+    bool _indirect;             //!< Se termine par un saut indexé
+    uint64_t _count;            //!< Nombre d'entrées dans le bloc
+} Cfg_Block;
+
+//! Graphe de flot de contrôle
+typedef struct
+{
+    const Instruction *_text;   //!< Le segment de texte (non copié)
+    unsigned _textsize;         //!< Sa taille
+    unsigned *_block;           //!< Bloc de chaque instruction
+
+    Cfg_Block *_blocks;         //!< Blocs par adresse croissante
+    unsigned _nblocks;          //!< Nombre de blocs
+
+    Cfg_Edge *_edges;           //!< Arcs : statiques par bloc de départ, puis dynamiques
+    unsigned _nedges;           //!< Nombre d'arcs
+    unsigned _nstatic;          //!< Nombre d'arcs statiques
+    unsigned _capacity;         //!< Taille allouée pour \c _edges
+    unsigned *_out;             //!< Premier arc statique de chaque bloc (\c _nblocks + 1 entrées)
+
+    bool _counted;              //!< Pondéré par une exécution
+} Cfg;
+
+//! Construction du graphe d'un segment de texte
+/*!
+ * \param text le segment de texte, qui doit survivre au graphe
+ * \param textsize sa taille
+ * \return le graphe (à libérer par cfg_free()), ou NULL si la mémoire manque
+ */
+Cfg *cfg_build(const Instruction *text, unsigned textsize);
+
+//! Libération d'un graphe (NULL accepté)
+void cfg_free(Cfg *cfg);
+
+//! Comptage d'un passage d'une instruction à la suivante exécutée
+/*!
+ * Un passage interne à un bloc n'est pas compté. Un saut indexé vers un
+ * début de bloc ajoute, à son premier parcours, un arc dynamique.
+ *
+ * \param cfg le graphe
+ * \param from l'adresse de l'instruction exécutée
+ * \param to l'adresse de l'instruction suivante
+ */
+void cfg_count(Cfg *cfg, unsigned from, unsigned to);
+
+//! Exécution bornée pondérant le graphe
+/*!
+ * Comme run(), mais instruction par instruction (sans flot prédécodé, ni
+ * boucles accélérées, ni détection des boucles sans progrès) : chaque
+ * passage est compté par cfg_count(), ainsi que l'entrée dans le bloc
+ * initial.
+ *
+ * \param cfg le graphe du texte de la machine
+ * \param pmach la machine
+ * \param budget le nombre maximal d'instructions exécutées
+ * \return le compte rendu de l'exécution
+ */
+Run_Result cfg_run(Cfg *cfg, Machine *pmach, uint64_t budget);
+
+//! Export au format Graphviz
+/*!
+ * Chaque bloc est un nœud qui liste ses instructions ; les blocs
+ * inaccessibles sont grisés. Les arcs portent leur nature, leur condition
+ * et, si le graphe est pondéré, leur nombre de parcours.
+ *
+ * \param out le flot de sortie
+ * \param cfg le graphe
+ * \param map la table des symboles (ou NULL)
+ */
+void cfg_write_dot(FILE *out, const Cfg *cfg, const Symbol_Map *map);
+
+//! Export au format JSON
+/*!
+ * \param out le flot de sortie
+ * \param cfg le graphe
+ * \param map la table des symboles (ou NULL), pour les étiquettes des blocs
+ */
+void cfg_write_json(FILE *out, const Cfg *cfg, const Symbol_Map *map);
+
+#endif
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <time.h>
+
+#include "counters.h"
+
+/*!
+ * \file counters.c
+ * \brief Implémentation de counters.h. Compteurs de performance.
+ */
+
+//! Lecture d'une horloge de l'hôte, en secondes
+static double clock_seconds(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void counters_reset(Counters *pc, Word sp)
+{
+    memset(pc, 0, sizeof(*pc));
+    pc->_min_sp = sp;
+}
+
+void counters_start(Counters *pc)
+{
+    pc->_wall_start = clock_seconds(CLOCK_MONOTONIC);
+    pc->_cpu_start = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+    pc->_running = true;
+}
+
+void counters_stop(Counters *pc)
+{
+    if(!pc->_running)
+        return;
+
+    pc->_wall_time += clock_seconds(CLOCK_MONOTONIC) - pc->_wall_start;
+    pc->_cpu_time += clock_seconds(CLOCK_THREAD_CPUTIME_ID) - pc->_cpu_start;
+    pc->_running = false;
+}
+
+uint64_t counters_retired(const Counters *pc)
+{
+    uint64_t total = 0;
+
+    for(unsigned i = 0; i < NCOPS; ++i)
+        total += pc->_retired[i];
+
+    return total;
+}
+
+void counters_add(Counters *dst, const Counters *src)
+{
+    for(unsigned i = 0; i < NCOPS; ++i)
+        dst->_retired[i] += src->_retired[i];
+
+    dst->_taken += src->_taken;
+    dst->_not_taken += src->_not_taken;
+    dst->_reads += src->_reads;
+    dst->_writes += src->_writes;
+    dst->_pushes += src->_pushes;
+    dst->_pops += src->_pops;
+    dst->_cpu_time += src->_cpu_time;
+    if(src->_wall_time > dst->_wall_time)
+        dst->_wall_time = src->_wall_time;
+}
+
+void counters_write_json(FILE *out, const Counters *pc, unsigned datasize)
+{
+    double wall = pc->_wall_time, cpu = pc->_cpu_time;
+
+    if(pc->_running)
+    {
+        wall += clock_seconds(CLOCK_MONOTONIC) - pc->_wall_start;
+        cpu += clock_seconds(CLOCK_THREAD_CPUTIME_ID) - pc->_cpu_start;
+    }
+
+    fprintf(out, "{\n  \"retired\": {");
+
+    const char *sep = "";
+    for(unsigned i = 0; i < NCOPS; ++i)
+    {
+        if(pc->_retired[i] == 0)
+            continue;
+
+        if(i <= LAST_COP)
+            fprintf(out, "%s\n    \"%s\": %llu", sep, cop_names[i],
+                    (unsigned long long)pc->_retired[i]);
+        else
+            fprintf(out, "%s\n    \"%u\": %llu", sep, i,
+                    (unsigned long long)pc->_retired[i]);
+        sep = ",";
+    }
+
+    fprintf(out, "%s},\n"
+            "  \"instructions\": %llu,\n"
+            "  \"branches_taken\": %llu,\n"
+            "  \"branches_not_taken\": %llu,\n"
+            "  \"data_reads\": %llu,\n"
+            "  \"data_writes\": %llu,\n"
+            "  \"pushes\": %llu,\n"
+            "  \"pops\": %llu,\n"
+            "  \"min_sp\": %u,\n"
+            "  \"max_stack_depth\": %u,\n"
+            "  \"wall_time\": %.9f,\n"
+            "  \"cpu_time\": %.9f\n"
+            "}\n",
+            *sep ? "\n  " : "",
+            (unsigned long long)counters_retired(pc),
+            (unsigned long long)pc->_taken,
+            (unsigned long long)pc->_not_taken,
+            (unsigned long long)pc->_reads,
+            (unsigned long long)pc->_writes,
+            (unsigned long long)pc->_pushes,
+            (unsigned long long)pc->_pops,
+            pc->_min_sp,
+            datasize > pc->_min_sp ? datasize - 1 - pc->_min_sp : 0,
+            wall, cpu);
+}
@@ -0,0 +1,95 @@
+#ifndef _COUNTERS_H_
+#define _COUNTERS_H_
+
+/*!
+ * \file counters.h
+ * \brief Compteurs de performance de la machine simulée.
+ *
+ * Chaque machine tient à jour, à la manière des compteurs matériels d'un
+ * processeur, le nombre d'instructions exécutées par code opération, de
+ * branchements pris et non pris, de lectures et écritures de données,
+ * d'empilements et de dépilements, ainsi que la profondeur de pile maximale
+ * atteinte. Les mises à jour sont de simples incréments placés dans les
+ * fonctions d'exécution spécialisées (exec.c) et dans le code traduit
+ * (translate.c) : elles sont assez peu coûteuses pour rester toujours
+ * actives.
+ *
+ * Les durées (temps réel et temps processeur de l'hôte) sont mesurées entre
+ * counters_start() et counters_stop(), appelées par le même thread : le temps
+ * processeur est celui de ce thread, de sorte que les temps de machines
+ * exécutées en parallèle (smp.h, sched.h) peuvent s'ajouter.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "instruction.h"
+
+//! Compteurs de performance
+typedef struct
+{
+    uint64_t _retired[NCOPS];   //!< Instructions exécutées par code opération
+    uint64_t _taken;            //!< Branchements (et appels) pris
+    uint64_t _not_taken;        //!< Branchements (et appels) non pris
+    uint64_t _reads;            //!< Lectures dans le segment de données
+    uint64_t _writes;           //!< Écritures dans le segment de données
+    uint64_t _pushes;           //!< Empilements (PUSH, CALL)
+    uint64_t _pops;             //!< Dépilements (POP, RET)
+    Word _min_sp;               //!< Plus petite valeur atteinte par SP
+
+    double _wall_time;          //!< Temps réel cumulé (secondes)
+    double _cpu_time;           //!< Temps processeur cumulé (secondes)
+    bool _running;              //!< Mesure des durées en cours ?
+    double _wall_start;         //!< Début de la mesure en cours (temps réel)
+    double _cpu_start;          //!< Début de la mesure en cours (processeur)
+} Counters;
+
+//! Remise à zéro des compteurs
+/*!
+ * \param pc les compteurs
+ * \param sp la valeur initiale du pointeur de pile
+ */
+void counters_reset(Counters *pc, Word sp);
+
+//! Début de la mesure des durées
+void counters_start(Counters *pc);
+
+//! Fin de la mesure des durées (cumulée avec les précédentes)
+void counters_stop(Counters *pc);
+
+//! Nombre total d'instructions exécutées
+uint64_t counters_retired(const Counters *pc);
+
+//! Cumul de compteurs (par exemple ceux des processeurs d'une machine SMP)
+/*!
+ * Les nombres d'événements et le temps processeur s'ajoutent ; le temps
+ * réel est le plus long des deux ; le minimum de SP de \a dst est conservé.
+ *
+ * \param dst les compteurs cumulés
+ * \param src les compteurs à ajouter
+ */
+void counters_add(Counters *dst, const Counters *src);
+
+//! Mise à jour du minimum de SP
+/*!
+ * Sans branchement : le compilateur produit un \c cmov.
+ */
+static inline void counters_sp(Counters *pc, Word sp)
+{
+    pc->_min_sp = sp < pc->_min_sp ? sp : pc->_min_sp;
+}
+
+//! Export des compteurs au format JSON
+/*!
+ * Si la mesure des durées est en cours, les durées incluent le temps écoulé
+ * jusqu'à l'appel.
+ *
+ * \param out le flot de sortie
+ * \param pc les compteurs
+ * \param datasize la taille du segment de données (pour la profondeur de
+ * pile)
+ */
+void counters_write_json(FILE *out, const Counters *pc, unsigned datasize);
+
+#endif
@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "disasm.h"
+
+/*!
+ * \file disasm.c
+ * \brief Implémentation de disasm.h. Désassemblage par tables.
+ */
+
+//! Préfixe d'opérande (avant la virgule)
+typedef enum
+{
+    PREFIX_NONE,        //!< Pas de préfixe
+    PREFIX_REG,         //!< Numéro de registre
+    PREFIX_COND,        //!< Condition
+} Prefix_Kind;
+
+//! Nature de l'opérande
+typedef enum
+{
+    OPND_NONE,          //!< Pas d'opérande
+    OPND_TEXT,          //!< Adresse absolue dans le segment de texte
+    OPND_DATA,          //!< Adresse absolue dans le segment de données
+    OPND_INDEXED,       //!< Déplacement et registre d'index
+    OPND_IMMEDIATE,     //!< Valeur immédiate
+    OPND_REGISTER,      //!< Registre source
+} Operand_Kind;
+
+//! Gabarit de désassemblage d'un couple (code opération, mode)
+typedef struct
+{
+    const char *_mnemonic;      //!< Mnémonique suivi d'une espace
+    unsigned char _len;         //!< Longueur du mnémonique
+    Prefix_Kind _prefix;        //!< Préfixe d'opérande
+    Operand_Kind _operand;      //!< Opérande
+} Template;
+
+//! Gabarits des quatre modes d'un code opération
+/*!
+ * \a reg est l'opérande du mode registre : \c OPND_REGISTER pour les
+ * instructions qui prennent une valeur, \c OPND_IMMEDIATE (ou \c OPND_NONE)
+ * pour les autres.
+ */
+#define TEMPLATE(cop, prefix, abs, reg) \
+    [cop * NMODES + MODE_ABSOLUTE] = \
+        {#cop " ", sizeof(#cop), prefix, abs}, \
+    [cop * NMODES + MODE_INDEXED] = \
+        {#cop " ", sizeof(#cop), prefix, abs ? OPND_INDEXED : OPND_NONE}, \
+    [cop * NMODES + MODE_IMMEDIATE] = \
+        {#cop " ", sizeof(#cop), prefix, abs ? OPND_IMMEDIATE : OPND_NONE}, \
+    [cop * NMODES + MODE_REGISTER] = \
+        {#cop " ", sizeof(#cop), prefix, reg}
+
+//! Table des gabarits, indexée par instruction_key()
+/*!
+ * Les entrées absentes (codes opérations inconnus) ont un mnémonique nul :
+ * le mot correspondant est rendu sous la forme <tt>.word</tt>.
+ */
+static const Template templates[NKEYS] =
+{
+    TEMPLATE(ILLOP,     PREFIX_NONE,    OPND_NONE,  OPND_NONE),
+    TEMPLATE(NOP,       PREFIX_NONE,    OPND_NONE,  OPND_NONE),
+    TEMPLATE(LOAD,      PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(STORE,     PREFIX_REG,     OPND_DATA,  OPND_IMMEDIATE),
+    TEMPLATE(ADD,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(SUB,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(BRANCH,    PREFIX_COND,    OPND_TEXT,  OPND_IMMEDIATE),
+    TEMPLATE(CALL,      PREFIX_COND,    OPND_TEXT,  OPND_IMMEDIATE),
+    TEMPLATE(RET,       PREFIX_NONE,    OPND_NONE,  OPND_NONE),
+    TEMPLATE(PUSH,      PREFIX_NONE,    OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(POP,       PREFIX_NONE,    OPND_DATA,  OPND_IMMEDIATE),
+    TEMPLATE(HALT,      PREFIX_NONE,    OPND_NONE,  OPND_NONE),
+    TEMPLATE(XCHG,      PREFIX_REG,     OPND_DATA,  OPND_IMMEDIATE),
+    TEMPLATE(MUL,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(DIV,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(MOD,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(AND,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(OR,        PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(XOR,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(SHL,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(SHR,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(SAR,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+    TEMPLATE(CMP,       PREFIX_REG,     OPND_DATA,  OPND_REGISTER),
+};
+
+//! Chiffres hexadécimaux
+static const char hexdigits[] = "0123456789abcdef";
+
+//! Écriture de \a n chiffres hexadécimaux
+static char *put_hex(char *p, Word v, unsigned n)
+{
+    for(unsigned i = n; i > 0; --i, v >>= 4)
+        p[i - 1] = hexdigits[v & 0xf];
+    return p + n;
+}
+
+//! Écriture d'un entier signé en décimal
+static char *put_dec(char *p, int v)
+{
+    char tmp[12];
+    unsigned n = 0;
+    unsigned u = v < 0 ? -(unsigned)v : (unsigned)v;
+
+    do
+        tmp[n++] = '0' + u % 10;
+    while(u /= 10);
+
+    if(v < 0)
+        *p++ = '-';
+    while(n > 0)
+        *p++ = tmp[--n];
+    return p;
+}
+
+//! Écriture d'une chaîne
+static char *put_str(char *p, const char *s, size_t len)
+{
+    memcpy(p, s, len);
+    return p + len;
+}
+
+//! Écriture d'un numéro de registre (R00 à R15)
+static char *put_reg(char *p, unsigned r)
+{
+    *p++ = 'R';
+    *p++ = '0' + r / 10;
+    *p++ = '0' + r % 10;
+    return p;
+}
+
+//! Recherche dichotomique d'une adresse dans une table triée
+static const char *find(const Symbol_Entry *entries, unsigned n, unsigned addr)
+{
+    unsigned lo = 0, hi = n;
+
+    while(lo < hi)
+    {
+        unsigned mid = lo + (hi - lo) / 2;
+        if(entries[mid]._addr < addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo < n && entries[lo]._addr == addr ? entries[lo]._name : NULL;
+}
+
+const char *symbol_map_text(const Symbol_Map *map, unsigned addr)
+{
+    return map ? find(map->_text, map->_ntext, addr) : NULL;
+}
+
+//! Comparaison de deux entrées par adresse (pour qsort)
+static int compare_entries(const void *a, const void *b)
+{
+    unsigned x = ((const Symbol_Entry *)a)->_addr;
+    unsigned y = ((const Symbol_Entry *)b)->_addr;
+    return (x > y) - (x < y);
+}
+
+Symbol_Map *symbol_map_read(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if(!file)
+        return NULL;
+
+    // Lecture du fichier entier, puis analyse
+    size_t size = 0, cap = 4096;
+    char *text = malloc(cap);
+    for(size_t n; text && (n = fread(text + size, 1, cap - size - 1, file)) > 0; )
+        if((size += n) == cap - 1)
+        {
+            char *bigger = realloc(text, cap *= 2);
+            if(!bigger)
+                free(text);
+            text = bigger;
+        }
+    fclose(file);
+
+    if(!text)
+        return NULL;
+
+    text[size] = '\0';
+    Symbol_Map *map = symbol_map_parse(text);
+    free(text);
+    return map;
+}
+
+Symbol_Map *symbol_map_parse(const char *text)
+{
+    Symbol_Map *map = calloc(1, sizeof(Symbol_Map));
+    unsigned textcap = 0, datacap = 0;
+    char line[512], name[256], sect[16];
+    unsigned value;
+
+    // Une ligne par symbole ; les lignes invalides sont ignorées
+    while(map && *text)
+    {
+        const char *end = strchr(text, '\n');
+        size_t len = end ? (size_t)(end - text) : strlen(text);
+
+        if(len >= sizeof(line))
+            len = sizeof(line) - 1;
+        memcpy(line, text, len);
+        line[len] = '\0';
+        text = end ? end + 1 : text + strlen(text);
+
+        if(sscanf(line, "%255s %x %15s", name, &value, sect) != 3)
+            continue;
+
+        Symbol_Entry **entries;
+        unsigned *n, *cap;
+
+        if(strcmp(sect, "TEXT") == 0)
+            entries = &map->_text, n = &map->_ntext, cap = &textcap;
+        else if(strcmp(sect, "DATA") == 0)
+            entries = &map->_data, n = &map->_ndata, cap = &datacap;
+        else
+            continue;
+
+        if(*n == *cap)
+        {
+            *cap = *cap ? 2 * *cap : 64;
+            Symbol_Entry *e = realloc(*entries, *cap * sizeof(Symbol_Entry));
+            if(!e)
+            {
+                symbol_map_free(map);
+                map = NULL;
+                break;
+            }
+            *entries = e;
+        }
+
+        (*entries)[*n]._addr = value;
+        strncpy((*entries)[*n]._name, name, SYMBOL_MAXLEN);
+        (*entries)[*n]._name[SYMBOL_MAXLEN] = '\0';
+        ++*n;
+    }
+
+    if(map)
+    {
+        qsort(map->_text, map->_ntext, sizeof(Symbol_Entry), compare_entries);
+        qsort(map->_data, map->_ndata, sizeof(Symbol_Entry), compare_entries);
+    }
+
+    return map;
+}
+
+void symbol_map_free(Symbol_Map *map)
+{
+    if(map)
+    {
+        free(map->_text);
+        free(map->_data);
+        free(map);
+    }
+}
+
+size_t disasm_instruction(char *buf, Instruction instr, const Symbol_Map *map)
+{
+    const Template *t = &templates[instruction_key(instr)];
+    unsigned regcond = instr.instr_generic._regcond;
+    char *p = buf;
+
+    // Mot indécodable : code opération ou condition inconnus
+    if(!t->_mnemonic || (t->_prefix == PREFIX_COND && regcond > LAST_CONDITION))
+    {
+        p = put_str(p, ".word 0x", 8);
+        p = put_hex(p, instr._raw, 8);
+        *p = '\0';
+        return p - buf;
+    }
+
+    p = put_str(p, t->_mnemonic, t->_len);
+
+    if(t->_prefix == PREFIX_REG)
+    {
+        p = put_reg(p, regcond);
+        p = put_str(p, ", ", 2);
+    }
+    else if(t->_prefix == PREFIX_COND)
+    {
+        p = put_str(p, condition_names[regcond], 2);
+        p = put_str(p, ", ", 2);
+    }
+
+    const char *name = NULL;
+
+    switch(t->_operand)
+    {
+        case OPND_NONE:
+            break;
+
+        case OPND_IMMEDIATE:
+            *p++ = '#';
+            p = put_dec(p, instr.instr_immediate._value);
+            break;
+
+        case OPND_REGISTER:
+            p = put_reg(p, instr.instr_register._rsource);
+            break;
+
+        case OPND_INDEXED:
+            p = put_dec(p, instr.instr_indexed._offset);
+            *p++ = '[';
+            p = put_reg(p, instr.instr_indexed._rindex);
+            *p++ = ']';
+            break;
+
+        case OPND_TEXT:
+        case OPND_DATA:
+            *p++ = '@';
+            if(map)
+                name = t->_operand == OPND_TEXT ?
+                    find(map->_text, map->_ntext, instr.instr_absolute._address) :
+                    find(map->_data, map->_ndata, instr.instr_absolute._address);
+
+            if(name)
+                p = put_str(p, name, strlen(name));
+            else
+            {
+                p = put_str(p, "0x", 2);
+                p = put_hex(p, instr.instr_absolute._address, 4);
+            }
+            break;
+    }
+
+    *p = '\0';
+    return p - buf;
+}
+
+//! Longueur maximale d'une ligne de listing (préfixe d'adresse compris)
+#define LISTING_LINE (DISASM_MAXLEN + 32)
+
+size_t disasm_listing_size(unsigned textsize, const Symbol_Map *map)
+{
+    size_t labels = map ? map->_ntext * (SYMBOL_MAXLEN + 2) : 0;
+    return (size_t)textsize * LISTING_LINE + labels + 1;
+}
+
+size_t disasm_listing(char *buf, const Instruction *text, unsigned textsize,
+                      const Symbol_Map *map)
+{
+    char *p = buf;
+    unsigned label = 0;
+
+    for(unsigned i = 0; i < textsize; ++i)
+    {
+        // Étiquettes de l'adresse courante (la table est triée)
+        if(map)
+            for(; label < map->_ntext && map->_text[label]._addr <= i; ++label)
+                if(map->_text[label]._addr == i)
+                {
+                    const char *name = map->_text[label]._name;
+                    p = put_str(p, name, strlen(name));
+                    p = put_str(p, ":\n", 2);
+                }
+
+        p = put_str(p, "0x", 2);
+        p = put_hex(p, i, i > 0xffff ? 8 : 4);
+        p = put_str(p, ": 0x", 4);
+        p = put_hex(p, text[i]._raw, 8);
+        p = put_str(p, " \t ", 3);
+        p += disasm_instruction(p, text[i], map);
+        *p++ = '\n';
+    }
+
+    *p = '\0';
+    return p - buf;
+}
+
+void print_listing(Sink *out, const Instruction *text, unsigned textsize,
+                   const Symbol_Map *map)
+{
+    char *buf = malloc(disasm_listing_size(textsize, map));
+
+    if(!buf)
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(1);
+    }
+
+    sink_write(out, buf, disasm_listing(buf, text, textsize, map));
+    free(buf);
+}
@@ -0,0 +1,116 @@
+#ifndef _DISASM_H_
+#define _DISASM_H_
+
+/*!
+ * \file disasm.h
+ * \brief Désassembleur par tables, vers un tampon fourni par l'appelant.
+ *
+ * Contrairement à print_instruction(), ces fonctions n'écrivent rien
+ * directement et ne s'arrêtent jamais sur une instruction indécodable : un
+ * tel mot est rendu sous la forme <tt>.word 0x...</tt>.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "instruction.h"
+
+//! Longueur maximale d'une instruction désassemblée (nul final compris)
+#define DISASM_MAXLEN 160
+
+//! Longueur maximale d'un nom de symbole (les noms plus longs sont tronqués)
+#define SYMBOL_MAXLEN 63
+
+//! Entrée de la table des symboles
+typedef struct
+{
+    unsigned _addr;                     //!< Adresse associée
+    char _name[SYMBOL_MAXLEN + 1];      //!< Nom du symbole
+} Symbol_Entry;
+
+//! Table des symboles d'un programme
+/*!
+ * Les adresses de texte (cibles de BRANCH et CALL) et de données (opérandes
+ * absolus des autres instructions) sont dans deux espaces distincts. Chaque
+ * table est triée par adresse croissante.
+ */
+typedef struct
+{
+    Symbol_Entry *_text;        //!< Étiquettes du segment de texte
+    unsigned _ntext;            //!< Nombre d'étiquettes de texte
+    Symbol_Entry *_data;        //!< Étiquettes du segment de données
+    unsigned _ndata;            //!< Nombre d'étiquettes de données
+} Symbol_Map;
+
+//! Lecture d'une table des symboles
+/*!
+ * Le fichier a le format produit par l'option \c -s de \c sasm : une ligne
+ * <tt>nom valeur section</tt> par symbole. Les symboles de section \c NONE
+ * sont ignorés.
+ *
+ * \param filename le nom du fichier
+ * \return la table, ou NULL si le fichier ne peut être lu
+ */
+Symbol_Map *symbol_map_read(const char *filename);
+
+//! Analyse d'une table des symboles
+/*!
+ * \param text le contenu d'un fichier de symboles (voir symbol_map_read())
+ * \return la table, ou NULL si la mémoire manque
+ */
+Symbol_Map *symbol_map_parse(const char *text);
+
+//! Libération d'une table des symboles
+void symbol_map_free(Symbol_Map *map);
+
+//! Recherche d'une étiquette de texte
+/*!
+ * \param map la table (ou NULL)
+ * \param addr l'adresse dans le segment de texte
+ * \return le nom de l'étiquette, ou NULL
+ */
+const char *symbol_map_text(const Symbol_Map *map, unsigned addr);
+
+//! Désassemblage d'une instruction
+/*!
+ * \param buf le tampon, d'au moins \c DISASM_MAXLEN caractères
+ * \param instr l'instruction
+ * \param map la table des symboles (ou NULL)
+ * \return le nombre de caractères écrits (sans le nul final)
+ */
+size_t disasm_instruction(char *buf, Instruction instr, const Symbol_Map *map);
+
+//! Taille de tampon suffisante pour disasm_listing()
+/*!
+ * \param textsize le nombre d'instructions
+ * \param map la table des symboles (ou NULL)
+ * \return la taille en octets
+ */
+size_t disasm_listing_size(unsigned textsize, const Symbol_Map *map);
+
+//! Listing d'un segment de texte complet
+/*!
+ * Chaque ligne a la forme <tt>0xADDR: 0xMOT \\t INSTRUCTION</tt>, comme
+ * print_program(). Si une étiquette désigne une adresse, elle est écrite
+ * sur sa propre ligne avant l'instruction.
+ *
+ * \param buf le tampon, d'au moins disasm_listing_size() octets
+ * \param text le segment de texte
+ * \param textsize sa taille
+ * \param map la table des symboles (ou NULL)
+ * \return le nombre de caractères écrits (sans le nul final)
+ */
+size_t disasm_listing(char *buf, const Instruction *text, unsigned textsize,
+                      const Symbol_Map *map);
+
+//! Écriture du listing d'un segment de texte en une seule opération
+/*!
+ * \param out le puits de sortie
+ * \param text le segment de texte
+ * \param textsize sa taille
+ * \param map la table des symboles (ou NULL)
+ */
+void print_listing(Sink *out, const Instruction *text, unsigned textsize,
+                   const Symbol_Map *map);
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdio.h>
 
 #include "error.h"
+#include "sink.h"
 
 const char *error_names[] =
 {
@@ -12,6 +13,7 @@ const char *error_names[] =
     "SEGTEXT",
     "SEGDATA",
     "SEGSTACK",
+    "DIVIDE",
 };
 
 const char *warning_names[] =
@@ -20,16 +22,49 @@ const char *warning_names[] =
     "PUSH_STATIC",
 }; 
 
-void error(Error err, unsigned addr)
+//! Point de reprise actif du thread courant
+static __thread Error_Trap *current_trap = NULL;
+
+void error_trap_enter(Error_Trap *trap)
+{
+    trap->_error = ERR_NOERROR;
+    trap->_address = 0;
+    trap->_previous = current_trap;
+    current_trap = trap;
+}
+
+void error_trap_leave(Error_Trap *trap)
+{
+    current_trap = trap->_previous;
+}
+
+void error_report(Error err, unsigned addr)
 {
-    fprintf(stderr, "ERROR: %s at address 0x%x\n",
+    sink_printf(sink_messages(), "ERROR: %s at address 0x%x\n",
             error_names[err], addr);
+}
+
+void error(Error err, unsigned addr)
+{
+    Error_Trap *trap = current_trap;
+
+    if(trap)
+    {
+        trap->_error = err;
+        trap->_address = addr;
+        current_trap = trap->_previous;
+        longjmp(trap->_env, 1);
+    }
+
+    error_report(err, addr);
+    sink_flush(sink_output());
+    sink_flush(sink_messages());
     exit(1);
 }
 
 void warning(Warning warn, unsigned addr)
 {
-    fprintf(stderr, "WARNING: %s reached at address 0x%x\n",
+    sink_printf(sink_messages(), "WARNING: %s reached at address 0x%x\n",
             warning_names[warn], addr);
 }
 
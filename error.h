@@ -1,6 +1,7 @@
 #ifndef _ERROR_H_
 #define _ERROR_H_
 
+#include <setjmp.h>
 #include <stdlib.h>
 
 /*!
@@ -13,7 +14,7 @@
  * Ce sont les différentes sortes d'erreur rencontrées lors du décodage ou de
  * l'exécution des instructions. Elles sont toutes fatales et provoquent la
  * terminaison du programme (du programme simulé comme du simulateur lui-même
- * !).
+ * !), sauf si un point de reprise (Error_Trap) est installé.
  */
 typedef enum 
 {
@@ -25,10 +26,11 @@ typedef enum
     ERR_SEGTEXT,	//!< Violation de taille du segment de texte
     ERR_SEGDATA,	//!< Violation de taille du segment de données
     ERR_SEGSTACK,	//!< Violation de taille du segment de pile
+    ERR_DIVIDE,		//!< Division par zéro
 } Error; 
 
 //! Dernière valeur possible du code d'erreur
-static const unsigned LAST_ERROR = ERR_SEGSTACK;
+static const unsigned LAST_ERROR = ERR_DIVIDE;
 
 //! Codes d'avertissement
 /*!
@@ -44,11 +46,66 @@ typedef enum
 //! Dernière valeur possible du code d'avertissement
 static const unsigned LAST_WARNING = WARN_PUSH_STATIC;
 
+//! Point de reprise des erreurs
+/*!
+ * Un point de reprise rend les erreurs non fatales pour le simulateur : si
+ * un point de reprise est installé dans le thread courant, error()
+ * enregistre l'erreur et y revient par \c longjmp au lieu de terminer le
+ * processus. L'utilisation est la suivante :
+ *
+ * \code
+ * Error_Trap trap;
+ *
+ * error_trap_enter(&trap);
+ * if(setjmp(trap._env) == 0)
+ *     ... // exécution pouvant appeler error()
+ * else
+ *     ... // erreur trap._error à l'adresse trap._address
+ * error_trap_leave(&trap);
+ * \endcode
+ *
+ * Les points de reprise s'emboîtent ; chaque thread a les siens.
+ */
+typedef struct Error_Trap
+{
+    jmp_buf _env;                   //!< Contexte de reprise
+    Error _error;                   //!< Erreur survenue
+    unsigned _address;              //!< Adresse de l'erreur
+    struct Error_Trap *_previous;   //!< Point de reprise englobant
+} Error_Trap;
+
+//! Installation d'un point de reprise dans le thread courant
+/*!
+ * \param trap le point de reprise (son contexte doit être initialisé par
+ * \c setjmp juste après)
+ */
+void error_trap_enter(Error_Trap *trap);
+
+//! Retrait d'un point de reprise
+/*!
+ * Le point de reprise englobant redevient actif. On peut appeler cette
+ * fonction après une reprise sur erreur comme après une exécution normale.
+ *
+ * \param trap le point de reprise
+ */
+void error_trap_leave(Error_Trap *trap);
+
+//! Affichage d'une erreur (sans terminaison)
+/*!
+ * Le message est écrit dans le puits de messages du thread (sink.h).
+ *
+ * \param err code de l'erreur
+ * \param addr adresse de l'erreur
+ */
+void error_report(Error err, unsigned addr);
+
 //! Affichage d'une erreur et fin du simulateur
 /*!
  * \note Toutes les erreurs étant fatales on ne revient jamais de cette
  * fonction. L'attribut \a noreturn est une extension (non standard) de GNU C
- * qui indique ce fait.
+ * qui indique ce fait. Si un point de reprise est installé, l'erreur n'est
+ * pas affichée et l'exécution reprend au point de reprise. Sinon, les puits
+ * du thread sont vidés avant la terminaison.
  * 
  * \param err code de l'erreur
  * \param addr adresse de l'erreur
@@ -62,6 +119,8 @@ void error(Error err, unsigned addr);
 
 //! Affichage d'un avertissement
 /*!
+ * Le message est écrit dans le puits de messages du thread (sink.h).
+ *
  * \param warn code de l'avertissement
  * \param addr adresse de l'erreur
  */
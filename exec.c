@@ -1,13 +1,36 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "error.h"
 #include "exec.h"
+#include "port.h"
 
 /*!
  * \file exec.c
  * \brief Implémentation de exec.h. Execute une instruction.
+ *
+ * Les fonctions d'exécution sont spécialisées par couple (code opération,
+ * mode d'adressage) : aucune ne teste le mode à l'exécution. Elles sont
+ * toutes engendrées par macros à partir d'une description unique de la
+ * sémantique de chaque instruction (les macros \c XXX_SEMANTICS), ce qui
+ * garantit que les variantes d'un même code opération ne divergent pas.
+ *
+ * Les compteurs de performance (counters.h) sont mis à jour par de simples
+ * incréments, sans test supplémentaire : un branchement pris ou non ajoute
+ * le résultat du test (0 ou 1) à chacun des deux compteurs.
+ *
+ * Les accès à la pile ne sont pas vérifiés : le segment de données est
+ * gardé (guard.h) et un débordement est signalé par le gestionnaire de
+ * fautes, avec la même erreur et la même adresse qu'un test explicite.
+ *
+ * Les séquences fusionnées (exec_predecode()) sont engendrées à partir des
+ * mêmes macros : chaque instruction de la séquence est exécutée par sa
+ * sémantique, comme par sa propre fonction.
  */
 
+//! Compteurs de la machine
+#define COUNTERS (pmach->_counters)
+
 //! Mets à jour CC
 /*!
  * \param pmach la machine/programme en cours d'exécution
@@ -25,32 +48,6 @@ static void set_cc(Machine *pmach, int res)
         pmach->_cc = CC_P;
 }
 
-//! Calcule l'adresse "réelle" d'une instruction en mode absolu/indexé
-/*!
- * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return l'adresse absolu en mode absolu, l'adresse indexée sinon
- */
-static unsigned address(Machine *pmach, Instruction instr)
-{
-    return instr.instr_generic._indexed ?
-        pmach->_registers[instr.instr_indexed._rindex] +
-        instr.instr_indexed._offset
-        :
-        instr.instr_absolute._address;
-}
-
-//! Appelle error si l'instruction est en mode immédiat
-/*!
- * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- */
-static void error_if_immediate(Machine *pmach, Instruction instr)
-{
-    if(instr.instr_generic._immediate)
-        error(ERR_IMMEDIATE, pmach->_pc - 1);
-}
-
 /*!
  * Appelle error si l'on essayer d'accèder à une donnée en dehors
  * du segment de données
@@ -65,112 +62,40 @@ static void error_if_segdata(Machine *pmach, unsigned addr)
         error(ERR_SEGDATA, pmach->_pc - 1);
 }
 
-//! Appelle error si l'on veut sortir de la pile
-/*!
- * \param pmach la machine/programme en cours d'exécution
- */
-static void error_if_segstack(Machine *pmach)
-{
-    if(pmach->_sp < 0 || pmach->_sp >= pmach->_datasize)
-        error(ERR_SEGSTACK, pmach->_pc - 1);
-}
-
-//! Effectue un ILLOP sur la machine
-/*!
- * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return cette fonction ne retourne jamais, puisqu'error non plus
- */
-static bool illop_func(Machine *pmach, Instruction instr)
-{
-    error(ERR_ILLEGAL, pmach->_pc - 1);
-}
-
-//! Effectue un NOP sur la machine
-/*!
- * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return true
- */
-static bool nop_func(Machine *pmach, Instruction instr)
-{
-    return true;
-}
-
-//! Effectue un LOAD sur la machine
+//! Lit une donnée après avoir vérifié son adresse
 /*!
  * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return true si aucune erreur, pas de return sinon
+ * \param addr l'adresse de la donnée
+ * \return la donnée, pas de return si l'adresse est invalide
  */
-static bool load_func(Machine *pmach, Instruction instr)
+static Word read_data(Machine *pmach, unsigned addr)
 {
-    unsigned r = instr.instr_generic._regcond;
-
-    if(instr.instr_generic._immediate)
-        pmach->_registers[r] = instr.instr_immediate._value;
-
-    else
-    {
-        unsigned addr = address(pmach, instr);
-        error_if_segdata(pmach, addr);
-        pmach->_registers[r] = pmach->_data[addr];
-    }
-
-    set_cc(pmach, pmach->_registers[r]);
-    return true;
-}
-
-//! Effectue un STORE sur la machine
-/*!
- * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return true si aucune erreur, pas de return sinon
- */
-static bool store_func(Machine *pmach, Instruction instr)
-{
-    error_if_immediate(pmach, instr);
-
-    unsigned r = instr.instr_generic._regcond,
-             addr = address(pmach, instr);
-
     error_if_segdata(pmach, addr);
-    pmach->_data[addr] = pmach->_registers[r];
-
-    return true;
+    ++COUNTERS._reads;
+    return pmach->_data[addr];
 }
 
-//! Effectue une addition/soustraction
+//! Division signée
 /*!
+ * La division de \c INT32_MIN par -1 donne \c INT32_MIN (reste nul), comme
+ * le ferait une arithmétique en complément à 2 sur 32 bits.
+ *
  * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return true si aucune erreur, pas de return sinon
+ * \param a le dividende
+ * \param b le diviseur
+ * \param mod calcul du reste (vrai) ou du quotient (faux)
+ * \return le quotient ou le reste, pas de return si \a b est nul
  */
-static bool add_sub_func(Machine *pmach, Instruction instr)
+static Word divide(Machine *pmach, Word a, Word b, bool mod)
 {
-    unsigned r = instr.instr_generic._regcond;
-
-    if(instr.instr_generic._immediate)
-        if(instr.instr_generic._cop == ADD)
-            pmach->_registers[r] += instr.instr_immediate._value;
-
-        else
-            pmach->_registers[r] -= instr.instr_immediate._value;
-
-    else
-    {
-        unsigned addr = address(pmach, instr);
-        error_if_segdata(pmach, addr);
+    if(b == 0)
+        error(ERR_DIVIDE, pmach->_pc - 1);
 
-        if(instr.instr_generic._cop == ADD)
-            pmach->_registers[r] += pmach->_data[addr];
+    if((int32_t)b == -1)
+        return mod ? 0 : -a;
 
-        else
-            pmach->_registers[r] -= pmach->_data[addr];
-    }
-
-    set_cc(pmach, pmach->_registers[r]);
-    return true;
+    return mod ? (Word)((int32_t)a % (int32_t)b)
+        : (Word)((int32_t)a / (int32_t)b);
 }
 
 //! Retourne vrai, si l'on doit sauter false sinon
@@ -213,146 +138,542 @@ static bool should_jump(Machine *pmach, Instruction instr)
     }
 }
 
-//! Effectue un BRANCH sur la machine
-/*!
- * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return true si aucune erreur, pas de return sinon
+/*
+ * Accès aux opérandes selon le mode d'adressage
+ * ---------------------------------------------
+ *
+ * Pour chaque mode M, VALUE_M est la valeur de l'opérande, ADDRESS_M son
+ * adresse et CHECK_M la vérification préalable (seul le mode immédiat est
+ * interdit pour les instructions qui désignent une adresse). Le mode
+ * registre n'existe que pour les instructions qui prennent une valeur.
  */
-static bool branch_func(Machine *pmach, Instruction instr)
-{
 
-    error_if_immediate(pmach, instr);
+//! Registre désigné par le champ \c _regcond
+#define REG (pmach->_registers[instr.instr_generic._regcond])
 
-    if(should_jump(pmach, instr))
-        pmach->_pc = address(pmach, instr);
+#define VALUE_IMMEDIATE ((Word)instr.instr_immediate._value)
+#define VALUE_REGISTER (pmach->_registers[instr.instr_register._rsource])
+#define VALUE_ABSOLUTE read_data(pmach, ADDRESS_ABSOLUTE)
+#define VALUE_INDEXED read_data(pmach, ADDRESS_INDEXED)
 
-    return true;
-}
+#define ADDRESS_IMMEDIATE 0u
+#define ADDRESS_ABSOLUTE instr.instr_absolute._address
+#define ADDRESS_INDEXED (pmach->_registers[instr.instr_indexed._rindex] \
+        + instr.instr_indexed._offset)
 
-//! Effectue un CALL sur la machine
-/*!
- * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return true si aucune erreur, pas de return sinon
+#define CHECK_IMMEDIATE error(ERR_IMMEDIATE, pmach->_pc - 1)
+#define CHECK_ABSOLUTE (void)0
+#define CHECK_INDEXED (void)0
+
+/*
+ * PROBE_M touche le sommet de pile avant la lecture d'un opérande en
+ * mémoire : un débordement de pile est ainsi signalé avant une éventuelle
+ * erreur sur l'opérande, dans l'ordre des tests explicites.
+ */
+#define PROBE_IMMEDIATE (void)0
+#define PROBE_REGISTER (void)0
+#define PROBE_ABSOLUTE (void)*(volatile Word *)&pmach->_data[stack_slot(pmach)]
+#define PROBE_INDEXED PROBE_ABSOLUTE
+
+/*
+ * Sémantique des instructions
+ * ---------------------------
+ *
+ * Chaque macro reçoit le nom du mode d'adressage M et décrit l'effet de
+ * l'instruction sur la machine \c pmach pour l'instruction \c instr.
  */
-static bool call_func(Machine *pmach, Instruction instr)
-{
-    error_if_immediate(pmach, instr);
 
-    if(should_jump(pmach, instr))
-    {
-        error_if_segstack(pmach);
-        pmach->_data[pmach->_sp] = pmach->_pc;
-        pmach->_pc = address(pmach, instr);
-        --pmach->_sp;
+#define LOAD_SEMANTICS(M) \
+    REG = VALUE_##M; \
+    set_cc(pmach, REG);
+
+#define ADD_SEMANTICS(M) \
+    REG += VALUE_##M; \
+    set_cc(pmach, REG);
+
+#define SUB_SEMANTICS(M) \
+    REG -= VALUE_##M; \
+    set_cc(pmach, REG);
+
+#define MUL_SEMANTICS(M) \
+    REG *= VALUE_##M; \
+    set_cc(pmach, REG);
+
+#define DIV_SEMANTICS(M) \
+    REG = divide(pmach, REG, VALUE_##M, false); \
+    set_cc(pmach, REG);
+
+#define MOD_SEMANTICS(M) \
+    REG = divide(pmach, REG, VALUE_##M, true); \
+    set_cc(pmach, REG);
+
+#define AND_SEMANTICS(M) \
+    REG &= VALUE_##M; \
+    set_cc(pmach, REG);
+
+#define OR_SEMANTICS(M) \
+    REG |= VALUE_##M; \
+    set_cc(pmach, REG);
+
+#define XOR_SEMANTICS(M) \
+    REG ^= VALUE_##M; \
+    set_cc(pmach, REG);
+
+//! Les décalages ne retiennent que les 5 bits de poids faible du nombre
+#define SHL_SEMANTICS(M) \
+    REG <<= VALUE_##M & 31; \
+    set_cc(pmach, REG);
+
+#define SHR_SEMANTICS(M) \
+    REG >>= VALUE_##M & 31; \
+    set_cc(pmach, REG);
+
+#define SAR_SEMANTICS(M) \
+    REG = (Word)((int32_t)REG >> (VALUE_##M & 31)); \
+    set_cc(pmach, REG);
+
+#define CMP_SEMANTICS(M) \
+    set_cc(pmach, REG - VALUE_##M);
+
+#define PUSH_SEMANTICS(M) \
+    if(pmach->_sp < pmach->_dataend) \
+        warning(WARN_PUSH_STATIC, pmach->_pc - 1); \
+    PROBE_##M; \
+    Word value = VALUE_##M; \
+    pmach->_data[stack_slot(pmach)] = value; \
+    --pmach->_sp; \
+    ++COUNTERS._pushes; \
+    counters_sp(&COUNTERS, pmach->_sp);
+
+//! Hors du segment de données : port de sortie (port.h) ou erreur
+#define STORE_SEMANTICS(M) \
+    CHECK_##M; \
+    unsigned addr = ADDRESS_##M; \
+    if(addr < pmach->_datasize) \
+        pmach->_data[addr] = REG; \
+    else \
+        port_store(pmach, addr, REG, pmach->_pc - 1); \
+    ++COUNTERS._writes;
+
+#define BRANCH_SEMANTICS(M) \
+    CHECK_##M; \
+    bool jump = should_jump(pmach, instr); \
+    COUNTERS._taken += jump; \
+    COUNTERS._not_taken += !jump; \
+    if(jump) \
+        pmach->_pc = ADDRESS_##M;
+
+#define CALL_SEMANTICS(M) \
+    CHECK_##M; \
+    bool jump = should_jump(pmach, instr); \
+    COUNTERS._taken += jump; \
+    COUNTERS._not_taken += !jump; \
+    if(jump) \
+    { \
+        pmach->_data[stack_slot(pmach)] = pmach->_pc; \
+        pmach->_pc = ADDRESS_##M; \
+        shadow_call(pmach, pmach->_pc); \
+        --pmach->_sp; \
+        ++COUNTERS._pushes; \
+        counters_sp(&COUNTERS, pmach->_sp); \
     }
 
-    return true;
-}
+//! Échange atomique (barrière complète, voir smp.h)
+#define XCHG_SEMANTICS(M) \
+    CHECK_##M; \
+    unsigned addr = ADDRESS_##M; \
+    error_if_segdata(pmach, addr); \
+    REG = __atomic_exchange_n(&pmach->_data[addr], REG, __ATOMIC_SEQ_CST); \
+    set_cc(pmach, REG); \
+    ++COUNTERS._reads; \
+    ++COUNTERS._writes;
+
+#define POP_SEMANTICS(M) \
+    ++pmach->_sp; \
+    CHECK_##M; \
+    Word value = pmach->_data[stack_slot(pmach)]; \
+    unsigned addr = ADDRESS_##M; \
+    error_if_segdata(pmach, addr); \
+    pmach->_data[addr] = value; \
+    ++COUNTERS._pops; \
+    ++COUNTERS._writes;
+
+#define ILLOP_SEMANTICS(M) \
+    error(ERR_ILLEGAL, pmach->_pc - 1);
+
+#define NOP_SEMANTICS(M)
+
+#define RET_SEMANTICS(M) \
+    ++pmach->_sp; \
+    pmach->_pc = pmach->_data[stack_slot(pmach)]; \
+    shadow_return(pmach); \
+    ++COUNTERS._pops;
+
+#define HALT_SEMANTICS(M) \
+    warning(WARN_HALT, pmach->_pc - 1); \
+    running = false;
+
+/*
+ * Classes d'instructions
+ * ----------------------
+ */
+
+//! Instructions dont l'opérande est une valeur (tous les modes)
+#define VALUE_OPS(X) X(LOAD) X(ADD) X(SUB) X(PUSH) \
+    X(MUL) X(DIV) X(MOD) X(AND) X(OR) X(XOR) X(SHL) X(SHR) X(SAR) X(CMP)
+
+//! Instructions dont l'opérande est une adresse (mode immédiat interdit)
+#define ADDRESS_OPS(X) X(STORE) X(BRANCH) X(CALL) X(POP) X(XCHG)
 
-//! Effectue un RET sur la machine
+//! Instructions sans opérande (le mode est ignoré)
+#define PLAIN_OPS(X) X(ILLOP) X(NOP) X(RET) X(HALT)
+
+/*
+ * Génération des fonctions d'exécution
+ * ------------------------------------
+ */
+
+//! Fonction d'exécution d'un code opération dans un mode
+/*!
+ * L'instruction n'est comptée qu'une fois exécutée sans erreur.
+ */
+#define DEFINE_HANDLER(cop, M) \
+    static bool exec_##cop##_##M(Machine *pmach, Instruction instr) \
+    { \
+        bool running = true; \
+        cop##_SEMANTICS(M) \
+        ++COUNTERS._retired[cop]; \
+        return running; \
+    }
+
+//! Variantes d'une instruction à opérande
+#define DEFINE_OPERAND_HANDLERS(cop) \
+    DEFINE_HANDLER(cop, IMMEDIATE) \
+    DEFINE_HANDLER(cop, ABSOLUTE) \
+    DEFINE_HANDLER(cop, INDEXED)
+
+//! Variantes d'une instruction à valeur (mode registre en plus)
+#define DEFINE_VALUE_HANDLERS(cop) \
+    DEFINE_OPERAND_HANDLERS(cop) \
+    DEFINE_HANDLER(cop, REGISTER)
+
+//! Variante unique d'une instruction sans opérande
+#define DEFINE_PLAIN_HANDLER(cop) DEFINE_HANDLER(cop, ABSOLUTE)
+
+VALUE_OPS(DEFINE_VALUE_HANDLERS)
+ADDRESS_OPS(DEFINE_OPERAND_HANDLERS)
+PLAIN_OPS(DEFINE_PLAIN_HANDLER)
+
+//! Code opération inconnu
 /*!
  * \param pmach la machine/programme en cours d'exécution
  * \param instr l'instruction à exécuter
- * \return true si aucune erreur, pas de return sinon
+ * \return cette fonction ne retourne jamais, puisqu'error non plus
  */
-static bool ret_func(Machine *pmach, Instruction instr)
+static bool exec_unknown(Machine *pmach, Instruction instr)
 {
-    ++pmach->_sp;
-    error_if_segstack(pmach);
-    pmach->_pc = pmach->_data[pmach->_sp];
-    return true;
+    error(ERR_ILLEGAL, pmach->_pc - 1);
 }
 
-//! Effectue un PUSH sur la machine
+//! Entrées de la table pour une instruction à valeur
+#define VALUE_ENTRIES(cop) \
+    [cop * NMODES + MODE_ABSOLUTE] = exec_##cop##_ABSOLUTE, \
+    [cop * NMODES + MODE_INDEXED] = exec_##cop##_INDEXED, \
+    [cop * NMODES + MODE_IMMEDIATE] = exec_##cop##_IMMEDIATE, \
+    [cop * NMODES + MODE_REGISTER] = exec_##cop##_REGISTER,
+
+//! Entrées de la table pour une instruction à adresse
 /*!
- * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return true si aucune erreur, pas de return sinon
+ * Le mode registre y est traité comme le mode immédiat (interdit).
  */
-static bool push_func(Machine *pmach, Instruction instr)
+#define ADDRESS_ENTRIES(cop) \
+    [cop * NMODES + MODE_ABSOLUTE] = exec_##cop##_ABSOLUTE, \
+    [cop * NMODES + MODE_INDEXED] = exec_##cop##_INDEXED, \
+    [cop * NMODES + MODE_IMMEDIATE] = exec_##cop##_IMMEDIATE, \
+    [cop * NMODES + MODE_REGISTER] = exec_##cop##_IMMEDIATE,
+
+//! Entrées de la table pour une instruction sans opérande
+#define PLAIN_ENTRIES(cop) \
+    [cop * NMODES + MODE_ABSOLUTE] = exec_##cop##_ABSOLUTE, \
+    [cop * NMODES + MODE_INDEXED] = exec_##cop##_ABSOLUTE, \
+    [cop * NMODES + MODE_IMMEDIATE] = exec_##cop##_ABSOLUTE, \
+    [cop * NMODES + MODE_REGISTER] = exec_##cop##_ABSOLUTE,
+
+//! Table des fonctions d'exécution, indexée par instruction_key()
+/*!
+ * Les entrées absentes correspondent aux codes opérations inconnus.
+ */
+static const Exec_Func handlers[NKEYS] =
 {
-    error_if_segstack(pmach);
+    VALUE_OPS(VALUE_ENTRIES)
+    ADDRESS_OPS(ADDRESS_ENTRIES)
+    PLAIN_OPS(PLAIN_ENTRIES)
+};
 
-    if(pmach->_sp < pmach->_dataend)
-        warning(WARN_PUSH_STATIC, pmach->_pc - 1);
+Exec_Func exec_lookup(Instruction instr)
+{
+    Exec_Func func = handlers[instruction_key(instr)];
+
+    return func ? func : exec_unknown;
+}
 
-    if(instr.instr_generic._immediate)
-        pmach->_data[pmach->_sp] = instr.instr_immediate._value;
+/*
+ * Séquences fusionnées
+ * --------------------
+ *
+ * Une fonction fusionnée enchaîne les étapes d'une séquence ; entre deux
+ * étapes, l'instruction suivante est lue dans le segment de texte et le
+ * compteur ordinal avancé, comme le ferait la boucle d'exécution. Seule la
+ * dernière étape peut modifier le compteur ordinal.
+ */
+
+//! Exécution d'une étape de séquence (instruction \c instr)
+#define STEP(cop, M) \
+    { \
+        cop##_SEMANTICS(M) \
+        ++COUNTERS._retired[cop]; \
+    }
+
+//! Passage à l'instruction suivante de la séquence
+#define NEXT_STEP instr = pmach->_text[pmach->_pc++];
+
+/*
+ * Chaque idiome est décrit par une macro \c XXX_SEQUENCE(M, V), où M est le
+ * mode de l'instruction à adresse (absolu ou indexé) et V celui de
+ * l'instruction à valeur.
+ */
+
+#define LOAD_ADD_STORE_SEQUENCE(M, V) \
+    STEP(LOAD, M) NEXT_STEP STEP(ADD, V) NEXT_STEP STEP(STORE, M)
+
+#define SUB_BRANCH_SEQUENCE(M, V) \
+    STEP(SUB, V) NEXT_STEP STEP(BRANCH, M)
+
+#define PUSH_CALL_SEQUENCE(M, V) \
+    STEP(PUSH, V) NEXT_STEP STEP(CALL, M)
+
+//! Les idiomes fusionnés
+#define IDIOMS(X) X(LOAD_ADD_STORE) X(SUB_BRANCH) X(PUSH_CALL)
+
+//! Variantes d'un idiome selon le mode de l'instruction à valeur
+#define IDIOM_VARIANTS(X, idiom, M) \
+    X(idiom, M, IMMEDIATE) X(idiom, M, ABSOLUTE) \
+    X(idiom, M, INDEXED) X(idiom, M, REGISTER)
+
+//! Fonction d'exécution d'une variante d'un idiome
+#define DEFINE_FUSED(idiom, M, V) \
+    static bool exec_##idiom##_##M##_##V(Machine *pmach, Instruction instr) \
+    { \
+        bool running = true; \
+        idiom##_SEQUENCE(M, V) \
+        return running; \
+    }
+
+//! Toutes les variantes d'un idiome
+#define DEFINE_IDIOM(idiom) \
+    IDIOM_VARIANTS(DEFINE_FUSED, idiom, ABSOLUTE) \
+    IDIOM_VARIANTS(DEFINE_FUSED, idiom, INDEXED)
+
+IDIOMS(DEFINE_IDIOM)
+
+//! Entrée de la table d'un idiome
+#define FUSED_ENTRY(idiom, M, V) [MODE_##M][MODE_##V] = exec_##idiom##_##M##_##V,
+
+//! Table des variantes d'un idiome, indexée par les modes (M, V)
+#define IDIOM_TABLE(idiom) \
+    static const Exec_Func idiom##_handlers[NMODES][NMODES] = \
+    { \
+        IDIOM_VARIANTS(FUSED_ENTRY, idiom, ABSOLUTE) \
+        IDIOM_VARIANTS(FUSED_ENTRY, idiom, INDEXED) \
+    };
+
+IDIOMS(IDIOM_TABLE)
+
+//! Retour suivi, le cas échéant, du POP sur lequel il revient
+/*!
+ * La cible d'un \c RET n'est connue qu'à l'exécution : l'instruction de
+ * retour est examinée après le retour, et exécutée ici s'il s'agit d'un
+ * \c POP à adresse.
+ */
+static bool exec_RET_POP(Machine *pmach, Instruction instr)
+{
+    STEP(RET, ABSOLUTE)
 
-    else
+    if(pmach->_pc < pmach->_textsize)
     {
-        unsigned addr = address(pmach, instr);
-        error_if_segdata(pmach, addr);
-        pmach->_data[pmach->_sp] = pmach->_data[addr];
+        instr = pmach->_text[pmach->_pc];
+        if(instruction_key(instr) == POP * NMODES + MODE_ABSOLUTE)
+        {
+            ++pmach->_pc;
+            STEP(POP, ABSOLUTE)
+        }
+        else if(instruction_key(instr) == POP * NMODES + MODE_INDEXED)
+        {
+            ++pmach->_pc;
+            STEP(POP, INDEXED)
+        }
     }
 
-    --pmach->_sp;
     return true;
 }
 
-//! Effectue un POP sur la machine
+//! Code opération d'une instruction
+static Code_Op cop_of(Instruction instr)
+{
+    return instr.instr_generic._cop;
+}
+
+//! Vrai si l'instruction désigne une adresse (absolue ou indexée)
+static bool addresses_memory(Instruction instr)
+{
+    Mode mode = instruction_mode(instr);
+
+    return mode == MODE_ABSOLUTE || mode == MODE_INDEXED;
+}
+
+//! Vrai si deux instructions à adresse désignent le même mot
 /*!
- * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return true si aucune erreur, pas de return sinon
+ * En adressage indexé, le registre d'index ne doit pas être celui que
+ * modifie la séquence.
  */
-static bool pop_func(Machine *pmach, Instruction instr)
+static bool same_word(Instruction a, Instruction b)
 {
-    ++pmach->_sp;
-    error_if_immediate(pmach, instr);
-    error_if_segstack(pmach);
+    if(instruction_mode(a) != instruction_mode(b))
+        return false;
 
-    unsigned addr = address(pmach, instr);
-    error_if_segdata(pmach, addr);
-
-    if(addr < pmach->_datasize)
-        pmach->_data[addr] = pmach->_data[pmach->_sp];
+    if(instruction_mode(a) == MODE_ABSOLUTE)
+        return a.instr_absolute._address == b.instr_absolute._address;
 
-    return true;
+    return a.instr_indexed._rindex == b.instr_indexed._rindex
+        && a.instr_indexed._offset == b.instr_indexed._offset
+        && a.instr_indexed._rindex != a.instr_generic._regcond;
 }
 
-//! Effectue un HALT sur la machine
+//! Fonction fusionnée de la séquence qui commence en \a seq
 /*!
- * \param pmach la machine/programme en cours d'exécution
- * \param instr l'instruction à exécuter
- * \return false
+ * \param seq les instructions à partir de la tête de séquence
+ * \param avail le nombre d'instructions disponibles
+ * \param length la longueur de la séquence reconnue
+ * \param count le compteur de l'idiome reconnu
+ * \param fusions les compteurs des idiomes
+ * \return la fonction fusionnée, ou NULL si aucun idiome ne commence ici
  */
-static bool halt_func(Machine *pmach, Instruction instr)
+static Exec_Func match_idiom(const Instruction *seq, unsigned avail,
+        unsigned *length, unsigned **count, Fusion_Stats *fusions)
 {
-    warning(WARN_HALT, pmach->_pc - 1);
-    return false;
+    if(avail >= 3 && cop_of(seq[0]) == LOAD && addresses_memory(seq[0])
+            && cop_of(seq[1]) == ADD && cop_of(seq[2]) == STORE
+            && seq[1].instr_generic._regcond == seq[0].instr_generic._regcond
+            && seq[2].instr_generic._regcond == seq[0].instr_generic._regcond
+            && same_word(seq[0], seq[2]))
+    {
+        *length = 3;
+        *count = &fusions->_load_add_store;
+        return LOAD_ADD_STORE_handlers[instruction_mode(seq[0])]
+            [instruction_mode(seq[1])];
+    }
+
+    if(avail >= 2 && cop_of(seq[0]) == SUB && cop_of(seq[1]) == BRANCH
+            && addresses_memory(seq[1]) && seq[1].instr_generic._regcond != NC)
+    {
+        *length = 2;
+        *count = &fusions->_sub_branch;
+        return SUB_BRANCH_handlers[instruction_mode(seq[1])]
+            [instruction_mode(seq[0])];
+    }
+
+    if(avail >= 2 && cop_of(seq[0]) == PUSH && cop_of(seq[1]) == CALL
+            && addresses_memory(seq[1]))
+    {
+        *length = 2;
+        *count = &fusions->_push_call;
+        return PUSH_CALL_handlers[instruction_mode(seq[1])]
+            [instruction_mode(seq[0])];
+    }
+
+    return NULL;
 }
 
-bool decode_execute(Machine *pmach, Instruction instr)
+Exec_Slot *exec_predecode(const Instruction *text, unsigned size,
+        Fusion_Stats *fusions)
 {
-    static bool (*funcs[])(Machine *, Instruction) =
+    Exec_Slot *stream = malloc((size ? size : 1) * sizeof(Exec_Slot));
+    bool *target = calloc(size + 1, sizeof(bool));
+    bool pop_returns = false;
+
+    *fusions = (Fusion_Stats){0, 0, 0, 0};
+    if(!stream || !target)
     {
-        illop_func,
-        nop_func,
-        load_func,
-        store_func,
-        add_sub_func,
-        add_sub_func,
-        branch_func,
-        call_func,
-        ret_func,
-        push_func,
-        pop_func,
-        halt_func,
-    };
+        free(stream);
+        free(target);
+        return NULL;
+    }
 
-    if(instr.instr_generic._cop > LAST_COP)
-        error(ERR_ILLEGAL, pmach->_pc - 1);
+    // Cibles connues avant l'exécution : branchements et appels absolus,
+    // adresses de retour
+    for(unsigned addr = 0; addr < size; ++addr)
+    {
+        Code_Op cop = cop_of(text[addr]);
+
+        if((cop == BRANCH || cop == CALL)
+                && instruction_mode(text[addr]) == MODE_ABSOLUTE
+                && text[addr].instr_absolute._address < size)
+            target[text[addr].instr_absolute._address] = true;
+        if(cop == CALL)
+            target[addr + 1] = true;
+    }
 
-    return funcs[instr.instr_generic._cop](pmach, instr);
+    for(unsigned addr = 0; addr < size; ++addr)
+    {
+        stream[addr]._func = exec_lookup(text[addr]);
+        stream[addr]._instr = text[addr];
+        stream[addr]._length = 1;
+        stream[addr]._loop = 0;
+
+        // Un retour peut revenir sur un POP : les RET en tiennent compte
+        if(addr > 0 && cop_of(text[addr - 1]) == CALL
+                && cop_of(text[addr]) == POP && addresses_memory(text[addr]))
+            pop_returns = true;
+    }
+
+    for(unsigned addr = 0; addr < size; ++addr)
+    {
+        unsigned length, *count;
+        Exec_Func func = match_idiom(text + addr, size - addr, &length,
+                &count, fusions);
+        bool inside = false;
+
+        for(unsigned i = 1; func && i < length; ++i)
+            inside |= target[addr + i];
+
+        if(func && !inside)
+        {
+            stream[addr]._func = func;
+            stream[addr]._length = length;
+            ++*count;
+        }
+        else if(cop_of(text[addr]) == RET && pop_returns)
+        {
+            stream[addr]._func = exec_RET_POP;
+            stream[addr]._length = 2;
+            ++fusions->_ret_pop;
+        }
+    }
+
+    free(target);
+    return stream;
 }
 
-void trace(const char *msg, Machine *pmach, Instruction instr, unsigned addr)
+bool decode_execute(Machine *pmach, Instruction instr)
 {
-    printf("TRACE: %s: 0x%04x: ", msg, addr);
-    print_instruction(instr, addr);
-    printf("\n");
+    return exec_lookup(instr)(pmach, instr);
 }
 
+void trace(const char *msg, Machine *pmach, Instruction instr, unsigned addr)
+{
+    Sink *out = machine_output(pmach);
+
+    sink_printf(out, "TRACE: %s: 0x%04x: ", msg, addr);
+    print_instruction(out, instr, addr);
+    sink_write(out, "\n", 1);
+}
@@ -8,6 +8,80 @@
 
 #include "machine.h"
 
+//! Fonction d'exécution d'une instruction
+/*!
+ * \param pmach la machine/programme en cours d'exécution
+ * \param instr l'instruction à exécuter
+ * \return faux après l'exécution de \c HALT ; vrai sinon
+ */
+typedef bool (*Exec_Func)(Machine *pmach, Instruction instr);
+
+//! Fonction d'exécution spécialisée d'une instruction
+/*!
+ * La fonction est choisie d'après la clé (code opération, mode) de
+ * l'instruction ; elle ne teste plus le mode d'adressage à l'exécution. La
+ * recherche peut donc être faite une fois pour toutes par instruction.
+ *
+ * \param instr l'instruction
+ * \return la fonction qui exécute \a instr
+ */
+Exec_Func exec_lookup(Instruction instr);
+
+//! Instruction du flot d'exécution prédécodé
+/*!
+ * Le flot compte une entrée par adresse du segment de texte. La fonction
+ * d'une entrée exécute l'instruction de cette adresse et, pour une
+ * séquence fusionnée, celles qui la suivent (au plus \c _length en tout) ;
+ * les entrées intérieures à une séquence gardent leur fonction propre, si
+ * bien qu'un saut au milieu d'une séquence reste exact.
+ */
+typedef struct
+{
+    Exec_Func _func;            //!< Fonction d'exécution
+    Instruction _instr;         //!< L'instruction de cette adresse
+    unsigned _length : 8;       //!< Nombre maximal d'instructions exécutées
+    unsigned _loop : 24;        //!< 1 + indice de la boucle (loop.h) dont c'est la tête, ou 0
+} Exec_Slot;
+
+//! Séquences fusionnées par exec_predecode()
+typedef struct
+{
+    unsigned _load_add_store;   //!< \c LOAD, \c ADD, \c STORE d'un même mot
+    unsigned _sub_branch;       //!< \c SUB suivi d'un \c BRANCH conditionnel
+    unsigned _push_call;        //!< \c PUSH suivi d'un \c CALL
+    unsigned _ret_pop;          //!< \c RET installés avec le \c POP de leur retour
+} Fusion_Stats;
+
+//! Construction du flot d'exécution prédécodé d'un segment de texte
+/*!
+ * Les idiomes suivants sont remplacés par une fonction unique, qui exécute
+ * la séquence en une seule indirection :
+ *
+ *   - <tt>LOAD Rn, x</tt> ; <tt>ADD Rn, v</tt> ; <tt>STORE Rn, x</tt> (même
+ *   registre, même mot en adressage absolu ou indexé) ;
+ *
+ *   - \c SUB suivi d'un \c BRANCH conditionnel ;
+ *
+ *   - \c PUSH suivi d'un \c CALL.
+ *
+ * Une séquence dont une instruction intérieure est la cible d'un
+ * branchement ou d'un appel absolu, ou une adresse de retour, n'est pas
+ * fusionnée. Enfin, si une adresse de retour porte un \c POP, chaque \c RET
+ * exécute dans la foulée le \c POP sur lequel il revient.
+ *
+ * Les fonctions fusionnées exécutent la sémantique de chaque instruction
+ * dans l'ordre, en avançant le compteur ordinal et les compteurs de
+ * performance entre deux : l'état de la machine est celui de l'exécution
+ * instruction par instruction, y compris après une erreur.
+ *
+ * \param text les instructions
+ * \param size leur nombre
+ * \param fusions les séquences fusionnées (comptées)
+ * \return le flot (à libérer par free()), ou NULL si la mémoire manque
+ */
+Exec_Slot *exec_predecode(const Instruction *text, unsigned size,
+        Fusion_Stats *fusions);
+
 //! Décodage et exécution d'une instruction
 /*!
  * \param pmach la machine/programme en cours d'exécution
@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "guard.h"
+#include "livelock.h"
+
+/*!
+ * \file guard.c
+ * \brief Implémentation de guard.h. Pages de garde.
+ *
+ * Une réservation comporte les pages du segment (lecture et écriture),
+ * suivies de la zone gardée. Le gestionnaire de \c SIGSEGV sort par
+ * error(), c'est-à-dire par \c longjmp ou \c exit : il est installé avec
+ * \c SA_NODEFER pour que le signal ne reste pas bloqué après la reprise.
+ */
+
+//! Traitement précédent de \c SIGSEGV
+static struct sigaction previous;
+
+//! Installation unique du gestionnaire
+static pthread_once_t install_once = PTHREAD_ONCE_INIT;
+
+//! Taille des pages du segment (octets)
+static size_t segment_bytes(unsigned capacity)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    return ((size_t)capacity * sizeof(Word) + page - 1) / page * page;
+}
+
+//! Taille de la zone gardée (octets), fixée à l'installation
+static size_t guard_size;
+
+//! Gestionnaire de \c SIGSEGV
+static void on_fault(int sig, siginfo_t *info, void *context)
+{
+    Machine *pmach = machine_current();
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    (void)sig;
+    (void)context;
+
+    // Première écriture dans une page suivie par un détecteur : l'écriture
+    // est reprise
+    if(pmach && livelock_write_fault(pmach, info->si_addr))
+        return;
+
+    uintptr_t end = pmach && pmach->_data
+        ? (uintptr_t)(pmach->_data + pmach->_datasize) : 0;
+
+    if(end && addr >= end && addr < end + guard_size)
+    {
+        unsigned pc = pmach->_pc - 1;
+        Error err = ERR_SEGDATA;
+
+        if(pc < pmach->_textsize)
+            switch(pmach->_text[pc].instr_generic._cop)
+            {
+                case PUSH:
+                case POP:
+                case CALL:
+                case RET:
+                    err = ERR_SEGSTACK;
+                    break;
+
+                default:
+                    break;
+            }
+
+        error(err, pc);
+    }
+
+    // Faute étrangère : l'instruction fautive est réexécutée avec le
+    // traitement précédent
+    sigaction(SIGSEGV, &previous, NULL);
+}
+
+//! Installation du gestionnaire
+static void install(void)
+{
+    struct sigaction sa;
+
+    // Lue par le gestionnaire : sysconf() n'y est pas permis
+    guard_size = GUARD_PAGES * (size_t)sysconf(_SC_PAGESIZE);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = on_fault;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, &previous);
+}
+
+Word *guard_reserve(unsigned capacity)
+{
+    size_t bytes = segment_bytes(capacity);
+    char *base;
+
+    pthread_once(&install_once, install);
+
+    base = mmap(NULL, bytes + guard_size, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(base == MAP_FAILED)
+        return NULL;
+
+    if(bytes && mprotect(base, bytes, PROT_READ | PROT_WRITE) != 0)
+    {
+        munmap(base, bytes + guard_size);
+        return NULL;
+    }
+
+    return (Word *)(base + bytes);
+}
+
+void guard_release(Word *end, unsigned capacity)
+{
+    size_t bytes = segment_bytes(capacity);
+
+    if(end)
+        munmap((char *)end - bytes, bytes + guard_size);
+}
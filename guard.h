@@ -0,0 +1,61 @@
+#ifndef _GUARD_H_
+#define _GUARD_H_
+
+/*!
+ * \file guard.h
+ * \brief Segments de données protégés par des pages de garde.
+ *
+ * Un segment gardé est placé de sorte que sa fin coïncide avec une limite
+ * de page ; il est suivi de \c GUARD_PAGES pages sans aucun droit d'accès
+ * (\c PROT_NONE). Les accès à la pile passent par stack_slot(), qui ramène
+ * tout SP hors du segment à l'indice \a datasize : la pile vidée par un \c
+ * POP ou un \c RET de trop, la pile débordant sous l'adresse 0 (SP vaut
+ * alors 0xffffffff) et un SP quelconque chargé dans \c R15 tombent tous sur
+ * la première page de garde. Les autres accès aux données sont vérifiés
+ * explicitement (ils dépendent du mode d'adressage, non de SP).
+ *
+ * Une machine ne réserve donc que son segment et une page d'espace
+ * d'adressage : le nombre de segments gardés simultanés (machines en
+ * activité et machines libres des réserves, pool.h) n'est pas borné par
+ * l'espace d'adressage mais par le nombre de projections mémoire du
+ * processus, deux par segment (\c vm.max_map_count, 65530 par défaut sous
+ * Linux, soit environ 32000 machines). <tt>make check</tt> crée
+ * \c CHECK_MACHINES machines simultanées (<tt>bench -m</tt>).
+ *
+ * Un accès hors du segment provoque un \c SIGSEGV. Le gestionnaire,
+ * installé à la première réservation, retrouve la machine exécutée par le
+ * thread (machine_enter()) ; si l'adresse fautive est dans la zone gardée
+ * de son segment de données, il appelle error() avec \c ERR_SEGSTACK pour
+ * une instruction de pile (\c PUSH, \c POP, \c CALL, \c RET), \c ERR_SEGDATA
+ * sinon, à l'adresse de l'instruction en cours. Les erreurs sont donc
+ * signalées exactement comme par un test explicite, et sont récupérables
+ * par un point de reprise (Error_Trap). Les autres fautes gardent leur
+ * traitement habituel.
+ *
+ * L'interpréteur et le code traduit ne testent plus les bornes de la pile :
+ * le segment de données de toute machine doit être gardé.
+ */
+
+#include "machine.h"
+
+//! Nombre de pages de garde après un segment
+#define GUARD_PAGES 1
+
+//! Réservation d'un segment gardé
+/*!
+ * Le segment de \a n mots (\a n au plus égal à \a capacity) commence à
+ * <tt>end - n</tt> ; ses pages sont initialement nulles.
+ *
+ * \param capacity la taille maximale du segment (en mots)
+ * \return la fin du segment, ou NULL si l'espace d'adressage manque
+ */
+Word *guard_reserve(unsigned capacity);
+
+//! Libération d'un segment gardé
+/*!
+ * \param end la fin du segment rendue par guard_reserve() (ou NULL)
+ * \param capacity la capacité passée à guard_reserve()
+ */
+void guard_release(Word *end, unsigned capacity);
+
+#endif
@@ -0,0 +1,146 @@
+#include <string.h>
+
+#include "hash.h"
+
+/*!
+ * \file hash.c
+ * \brief Implémentation de hash.h. SHA-256 (FIPS 180-4).
+ */
+
+//! Constantes de tour
+static const uint32_t K[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+//! Rotation à droite
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+//! Traitement d'un bloc de 64 octets
+static void compress(Hash_Context *ctx, const unsigned char *block)
+{
+    uint32_t w[64];
+
+    for(int i = 0; i < 16; ++i)
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16
+            | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+
+    for(int i = 16; i < 64; ++i)
+    {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->_state[0], b = ctx->_state[1], c = ctx->_state[2],
+             d = ctx->_state[3], e = ctx->_state[4], f = ctx->_state[5],
+             g = ctx->_state[6], h = ctx->_state[7];
+
+    for(int i = 0; i < 64; ++i)
+    {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25))
+            + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22))
+            + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    ctx->_state[0] += a;
+    ctx->_state[1] += b;
+    ctx->_state[2] += c;
+    ctx->_state[3] += d;
+    ctx->_state[4] += e;
+    ctx->_state[5] += f;
+    ctx->_state[6] += g;
+    ctx->_state[7] += h;
+}
+
+void hash_init(Hash_Context *ctx)
+{
+    static const uint32_t init[8] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(ctx->_state, init, sizeof(init));
+    ctx->_length = 0;
+    ctx->_fill = 0;
+}
+
+void hash_update(Hash_Context *ctx, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+
+    ctx->_length += size;
+
+    while(size > 0)
+    {
+        if(ctx->_fill == 0 && size >= 64)
+        {
+            compress(ctx, p);
+            p += 64;
+            size -= 64;
+            continue;
+        }
+
+        size_t n = 64 - ctx->_fill < size ? 64 - ctx->_fill : size;
+        memcpy(ctx->_block + ctx->_fill, p, n);
+        ctx->_fill += n;
+        p += n;
+        size -= n;
+
+        if(ctx->_fill == 64)
+        {
+            compress(ctx, ctx->_block);
+            ctx->_fill = 0;
+        }
+    }
+}
+
+void hash_final(Hash_Context *ctx, Hash *hash)
+{
+    uint64_t bits = ctx->_length * 8;
+    unsigned char pad[72] = {0x80};
+    size_t padlen = ctx->_fill < 56 ? 56 - ctx->_fill : 120 - ctx->_fill;
+
+    for(int i = 0; i < 8; ++i)
+        pad[padlen + i] = bits >> (56 - 8 * i);
+
+    hash_update(ctx, pad, padlen + 8);
+
+    for(int i = 0; i < 8; ++i)
+        for(int j = 0; j < 4; ++j)
+            hash->_bytes[4 * i + j] = ctx->_state[i] >> (24 - 8 * j);
+}
+
+char *hash_hex(const Hash *hash, char hex[HASH_HEXSIZE])
+{
+    static const char digits[] = "0123456789abcdef";
+
+    for(int i = 0; i < HASH_SIZE; ++i)
+    {
+        hex[2 * i] = digits[hash->_bytes[i] >> 4];
+        hex[2 * i + 1] = digits[hash->_bytes[i] & 0xf];
+    }
+    hex[2 * HASH_SIZE] = '\0';
+
+    return hex;
+}
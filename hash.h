@@ -0,0 +1,62 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+/*!
+ * \file hash.h
+ * \brief Empreinte cryptographique (SHA-256) de contenus binaires.
+ *
+ * Les empreintes servent de clés aux caches persistants : deux contenus
+ * d'empreintes égales sont considérés comme identiques.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Taille d'une empreinte en octets
+#define HASH_SIZE 32
+
+//! Taille de la forme hexadécimale d'une empreinte (nul final compris)
+#define HASH_HEXSIZE (2 * HASH_SIZE + 1)
+
+//! Calcul incrémental d'une empreinte
+typedef struct
+{
+    uint32_t _state[8];         //!< État interne
+    uint64_t _length;           //!< Nombre d'octets traités
+    unsigned char _block[64];   //!< Bloc en cours de remplissage
+    unsigned _fill;             //!< Nombre d'octets dans le bloc
+} Hash_Context;
+
+//! Empreinte
+typedef struct
+{
+    unsigned char _bytes[HASH_SIZE];    //!< Octets de l'empreinte
+} Hash;
+
+//! Début du calcul d'une empreinte
+void hash_init(Hash_Context *ctx);
+
+//! Ajout de données au calcul
+/*!
+ * \param ctx le calcul en cours
+ * \param data les données
+ * \param size leur taille en octets
+ */
+void hash_update(Hash_Context *ctx, const void *data, size_t size);
+
+//! Fin du calcul
+/*!
+ * \param ctx le calcul en cours
+ * \param hash l'empreinte obtenue
+ */
+void hash_final(Hash_Context *ctx, Hash *hash);
+
+//! Forme hexadécimale d'une empreinte
+/*!
+ * \param hash l'empreinte
+ * \param hex tampon de \c HASH_HEXSIZE caractères
+ * \return \a hex
+ */
+char *hash_hex(const Hash *hash, char hex[HASH_HEXSIZE]);
+
+#endif
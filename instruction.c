@@ -17,6 +17,17 @@ const char *cop_names[] =
     "PUSH",
     "POP",
     "HALT",
+    "XCHG",
+    "MUL",
+    "DIV",
+    "MOD",
+    "AND",
+    "OR",
+    "XOR",
+    "SHL",
+    "SHR",
+    "SAR",
+    "CMP",
 };
 
 const char *condition_names[] =
@@ -30,7 +41,7 @@ const char *condition_names[] =
     "LE",
 };
 
-void print_instruction(Instruction instr, unsigned addr)
+void print_instruction(Sink *out, Instruction instr, unsigned addr)
 {
     Code_Op op = instr.instr_generic._cop;
 
@@ -38,7 +49,7 @@ void print_instruction(Instruction instr, unsigned addr)
     if(op > LAST_COP)
         error(ERR_UNKNOWN, addr);
 
-    printf("%s ", cop_names[op]);
+    sink_printf(out, "%s ", cop_names[op]);
 
     if(op == RET || op == HALT || op == NOP || op == ILLOP)
         return;
@@ -49,20 +60,23 @@ void print_instruction(Instruction instr, unsigned addr)
         if(instr.instr_generic._regcond > LAST_CONDITION)
             error(ERR_CONDITION, addr);
 
-        printf("%s, ", condition_names[instr.instr_generic._regcond]);
+        sink_printf(out, "%s, ", condition_names[instr.instr_generic._regcond]);
     }
 
     else if(op != PUSH && op != POP)
-        printf("R%02u, ", instr.instr_generic._regcond);
+        sink_printf(out, "R%02u, ", instr.instr_generic._regcond);
 
-    if(instr.instr_generic._immediate)
-        printf("#%u", instr.instr_immediate._value);
+    if(instruction_mode(instr) == MODE_REGISTER && cop_takes_value(op))
+        sink_printf(out, "R%02u", instr.instr_register._rsource);
+
+    else if(instr.instr_generic._immediate)
+        sink_printf(out, "#%u", instr.instr_immediate._value);
 
     else if(instr.instr_generic._indexed)
-        printf("%d[R%02u]", instr.instr_indexed._offset,
+        sink_printf(out, "%d[R%02u]", instr.instr_indexed._offset,
                 instr.instr_indexed._rindex);
 
     else
-        printf("@0x%04x", instr.instr_absolute._address);
+        sink_printf(out, "@0x%04x", instr.instr_absolute._address);
 }
 
@@ -9,6 +9,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "sink.h"
+
 //! Codes opérations
 typedef enum 
 {
@@ -24,10 +26,21 @@ typedef enum
     PUSH,	//!< Empilement sur la pile d'exécution 
     POP,	//!< Dépilement de la pile d'exécution
     HALT,	//!< Arrêt (normal) du programme
+    XCHG,	//!< Échange atomique d'un registre et d'un mot de données
+    MUL,	//!< Multiplication d'un registre
+    DIV,	//!< Division (entière, signée) d'un registre
+    MOD,	//!< Reste de la division (signée) d'un registre
+    AND,	//!< Et bit à bit
+    OR,		//!< Ou bit à bit
+    XOR,	//!< Ou exclusif bit à bit
+    SHL,	//!< Décalage à gauche
+    SHR,	//!< Décalage logique à droite
+    SAR,	//!< Décalage arithmétique à droite
+    CMP,	//!< Comparaison (positionne le code condition seulement)
 } Code_Op;
 
 //! Dernière valeur possible du code opération
-const static unsigned LAST_COP = HALT;
+const static unsigned LAST_COP = CMP;
 
 
 //! Structure d'une instruction 
@@ -95,6 +108,17 @@ typedef union Instruction
         signed int _offset : 16;//!< Déplacement
     } instr_indexed;
 
+    //! Format d'une instruction registre à registre
+    struct 
+    {
+        Code_Op _cop : 6; 	//!< Code opération
+        bool _immediate : 1;	//!< Positionné (mode registre)
+        bool _indexed : 1;	//!< Positionné (mode registre)
+        unsigned _regcond : 4;	//!< Numéro du registre destination
+        unsigned _rsource : 4;  //!< Numéro du registre source
+        unsigned _unused : 16;  //!< Inutilisé (nul)
+    } instr_register;
+
 } Instruction;
 
 //! Conditions
@@ -123,6 +147,62 @@ static const unsigned LAST_CONDITION = LE;
 //! Type d'un mot de donnée
 typedef uint32_t Word;
 
+//! Modes d'adressage
+/*!
+ * Le mode est formé des bits \c _immediate et \c _indexed de l'instruction.
+ * Lorsque les deux bits sont positionnés, l'opérande est un registre (format
+ * \c instr_register) pour les instructions qui prennent une valeur (voir
+ * cop_takes_value()) ; pour les autres, l'adressage immédiat l'emporte.
+ */
+typedef enum
+{
+    MODE_ABSOLUTE = 0,          //!< Adressage absolu
+    MODE_INDEXED,               //!< Adressage indexé
+    MODE_IMMEDIATE,             //!< Valeur immédiate
+    MODE_REGISTER,              //!< Registre (les deux bits positionnés)
+} Mode;
+
+//! Nombre de codes opérations représentables (champ \c _cop de 6 bits)
+#define NCOPS 64
+
+//! Nombre de modes d'adressage
+#define NMODES 4
+
+//! Nombre de clés (code opération, mode) possibles
+#define NKEYS (NCOPS * NMODES)
+
+//! Clé (code opération, mode) d'une instruction
+/*!
+ * La clé est calculée une seule fois par instruction et sert d'index aux
+ * tables indexées par code opération et mode d'adressage.
+ *
+ * \param instr l'instruction
+ * \return la clé, comprise entre 0 et \c NKEYS - 1
+ */
+static inline unsigned instruction_key(Instruction instr)
+{
+    return instr.instr_generic._cop * NMODES
+        + (instr.instr_generic._immediate << 1)
+        + instr.instr_generic._indexed;
+}
+
+//! Mode d'adressage d'une instruction
+static inline Mode instruction_mode(Instruction instr)
+{
+    return instruction_key(instr) % NMODES;
+}
+
+//! Le code opération prend-il une valeur (et non une adresse) ?
+/*!
+ * Ces instructions acceptent tous les modes d'adressage, y compris les
+ * modes immédiat et registre.
+ */
+static inline bool cop_takes_value(Code_Op op)
+{
+    return op == LOAD || op == ADD || op == SUB || op == PUSH
+        || (op >= MUL && op <= CMP);
+}
+
 //! Forme imprimable des codes opérations
 extern const char *cop_names[];
 
@@ -131,9 +211,10 @@ extern const char *condition_names[];
 
 //! Impression d'une instruction sous forme lisible (désassemblage)
 /*!
+ * \param out le puits de sortie
  * \param instr l'instruction à imprimer
  * \param addr son adresse
  */
-void print_instruction(Instruction instr, unsigned addr);
+void print_instruction(Sink *out, Instruction instr, unsigned addr);
 
 #endif
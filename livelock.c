@@ -0,0 +1,353 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "livelock.h"
+
+/*!
+ * \file livelock.c
+ * \brief Implémentation de livelock.h. Détection des boucles sans progrès.
+ *
+ * Les pages du segment de données sont comptées à partir de la page qui
+ * contient son premier mot. Seules les pages entièrement comprises dans le
+ * segment sont protégées ; celles des extrémités, qu'il partage peut-être
+ * avec d'autres données, sont relues à chaque point de contrôle.
+ *
+ * L'empreinte d'une page est un FNV-1a sur ses mots, initialisé par son
+ * numéro ; celle du segment est la somme des empreintes des pages, mise à
+ * jour page par page.
+ */
+
+//! Début de la page \a i du segment suivi
+static uintptr_t page_start(const Livelock *watch, unsigned i)
+{
+    size_t page = watch->_page;
+
+    return (uintptr_t)watch->_data / page * page + (uintptr_t)i * page;
+}
+
+//! Mots du segment compris dans la page \a i
+static void page_words(const Livelock *watch, unsigned i,
+        const Word **first, const Word **last)
+{
+    const Word *begin = watch->_data;
+    const Word *end = watch->_data + watch->_datasize;
+    const Word *start = (const Word *)page_start(watch, i);
+    const Word *stop = (const Word *)(page_start(watch, i) + watch->_page);
+
+    *first = start > begin ? start : begin;
+    *last = stop < end ? stop : end;
+}
+
+//! Empreinte d'une page
+static uint64_t page_hash(const Livelock *watch, unsigned i)
+{
+    const Word *p, *last;
+    uint64_t h = 0xcbf29ce484222325ULL ^ i;
+
+    for(page_words(watch, i, &p, &last); p < last; ++p)
+    {
+        h ^= *p;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+//! Relecture d'une page
+static void rehash_page(Livelock *watch, unsigned i)
+{
+    uint64_t h = page_hash(watch, i);
+
+    watch->_datahash += h - watch->_pagehash[i];
+    watch->_pagehash[i] = h;
+}
+
+//! Protection (ou non) d'une suite de pages protégeables
+static bool protect(const Livelock *watch, unsigned first, unsigned count,
+        bool readonly)
+{
+    return mprotect((void *)page_start(watch, first), count * watch->_page,
+            readonly ? PROT_READ : PROT_READ | PROT_WRITE) == 0;
+}
+
+//! Relecture des pages écrites ; elles sont protégées à nouveau si
+//! \a readonly
+static void refresh(Livelock *watch, bool readonly)
+{
+    unsigned run = 0;
+
+    for(unsigned i = 0; i <= watch->_npages; ++i)
+    {
+        // Les pages à reprotéger sont regroupées par suites contiguës
+        if(i < watch->_npages && watch->_protected[i] && watch->_dirty[i])
+        {
+            rehash_page(watch, i);
+            watch->_dirty[i] = false;
+            ++run;
+            continue;
+        }
+
+        if(run && readonly)
+            protect(watch, i - run, run, true);
+        run = 0;
+
+        if(i < watch->_npages && !watch->_protected[i])
+            rehash_page(watch, i);
+    }
+}
+
+//! Empreinte de l'état architectural
+static uint64_t state_hash(const Machine *pmach, const Livelock *watch)
+{
+    uint64_t h = watch->_datahash;
+
+    h = (h ^ pmach->_pc) * 0x100000001b3ULL;
+    h = (h ^ pmach->_cc) * 0x100000001b3ULL;
+    for(unsigned r = 0; r < NREGISTERS; ++r)
+        h = (h ^ pmach->_registers[r]) * 0x100000001b3ULL;
+    h = (h ^ pmach->_portwords) * 0x100000001b3ULL;
+
+    return h;
+}
+
+//! Libération des tableaux du détecteur
+static void release(Livelock *watch)
+{
+    free(watch->_pagehash);
+    free(watch->_dirty);
+    free(watch->_protected);
+    free(watch->_saveddata);
+    free(watch->_stops);
+}
+
+bool livelock_enable(Machine *pmach, uint64_t period)
+{
+    if(!pmach->_livelock)
+    {
+        if(!(pmach->_livelock = calloc(1, sizeof(Livelock))))
+            return false;
+        pmach->_livelock->_exitretired = UINT64_MAX;
+        // Lue par le gestionnaire de SIGSEGV, où sysconf() n'est pas permis
+        pmach->_livelock->_page = (size_t)sysconf(_SC_PAGESIZE);
+    }
+
+    pmach->_livelock->_period = period ? period : LIVELOCK_PERIOD;
+    return true;
+}
+
+void livelock_disable(Machine *pmach)
+{
+    if(!pmach->_livelock)
+        return;
+
+    release(pmach->_livelock);
+    free(pmach->_livelock);
+    pmach->_livelock = NULL;
+}
+
+//! Dimensionnement des tableaux pour le segment et le texte de la machine
+static bool resize(Livelock *watch, const Machine *pmach)
+{
+    size_t page = watch->_page;
+
+    if(watch->_data != pmach->_data || watch->_datasize != pmach->_datasize)
+    {
+        uintptr_t first = (uintptr_t)pmach->_data / page;
+        uintptr_t last = ((uintptr_t)(pmach->_data + pmach->_datasize)
+                + page - 1) / page;
+        unsigned n = pmach->_datasize ? last - first : 0;
+
+        free(watch->_pagehash);
+        free(watch->_dirty);
+        free(watch->_protected);
+        free(watch->_saveddata);
+        watch->_pagehash = calloc(n + 1, sizeof(uint64_t));
+        watch->_dirty = calloc(n + 1, sizeof(bool));
+        watch->_protected = calloc(n + 1, sizeof(bool));
+        watch->_saveddata = malloc((pmach->_datasize + 1) * sizeof(Word));
+        watch->_data = pmach->_data;
+        watch->_datasize = pmach->_datasize;
+        watch->_npages = n;
+        watch->_saved = false;
+        watch->_exitretired = UINT64_MAX;
+        if(!watch->_pagehash || !watch->_dirty || !watch->_protected
+                || !watch->_saveddata)
+        {
+            watch->_data = NULL;
+            return false;
+        }
+
+        for(unsigned i = 0; i < n; ++i)
+        {
+            const Word *p, *q;
+
+            page_words(watch, i, &p, &q);
+            watch->_protected[i] = (uintptr_t)p == page_start(watch, i)
+                && (uintptr_t)q == page_start(watch, i) + page;
+        }
+    }
+
+    if(watch->_textsize != pmach->_textsize || !watch->_stops)
+    {
+        free(watch->_stops);
+        if(!(watch->_stops = malloc(pmach->_textsize + 1)))
+        {
+            watch->_textsize = 0;
+            return false;
+        }
+        watch->_textsize = pmach->_textsize;
+    }
+
+    return true;
+}
+
+bool livelock_begin(Machine *pmach)
+{
+    Livelock *watch = pmach->_livelock;
+    unsigned first = 0, count = 0;
+
+    if(!resize(watch, pmach))
+        return false;
+
+    // Cibles des branchements arrière et points d'arrêt
+    memset(watch->_stops, 0, watch->_textsize);
+    for(unsigned addr = 0; addr < pmach->_textsize; ++addr)
+    {
+        Instruction instr = pmach->_text[addr];
+
+        if(instr.instr_generic._cop == BRANCH
+                && instruction_mode(instr) == MODE_ABSOLUTE
+                && instr.instr_absolute._address <= addr)
+            watch->_stops[instr.instr_absolute._address] = true;
+        if(pmach->_breakpoints && pmach->_breakpoints[addr])
+            watch->_stops[addr] = true;
+    }
+
+    // Relecture complète : le segment a pu changer depuis le dernier appel
+    watch->_datahash = 0;
+    for(unsigned i = 0; i < watch->_npages; ++i)
+    {
+        watch->_pagehash[i] = page_hash(watch, i);
+        watch->_datahash += watch->_pagehash[i];
+        watch->_dirty[i] = false;
+        if(watch->_protected[i] && !count++)
+            first = i;
+    }
+
+    // La machine n'a pas changé depuis la fin de l'appel précédent : la
+    // détection continue
+    if(state_hash(pmach, watch) != watch->_exithash
+            || counters_retired(&pmach->_counters) != watch->_exitretired)
+    {
+        watch->_saved = false;
+        watch->_power = 1;
+        watch->_lambda = 0;
+    }
+
+    return !count || protect(watch, first, count, true);
+}
+
+//! Sauvegarde de l'état courant
+static void save(Livelock *watch, const Machine *pmach, uint64_t hash)
+{
+    watch->_saved = true;
+    watch->_savedhash = hash;
+    watch->_savedretired = counters_retired(&pmach->_counters);
+    watch->_savedpc = pmach->_pc;
+    watch->_savedcc = pmach->_cc;
+    memcpy(watch->_savedregs, pmach->_registers, sizeof(watch->_savedregs));
+    watch->_savedport = pmach->_portwords;
+    memcpy(watch->_saveddata, pmach->_data,
+            pmach->_datasize * sizeof(Word));
+}
+
+//! Vrai si l'état courant est exactement l'état sauvegardé
+static bool same_state(const Livelock *watch, const Machine *pmach)
+{
+    // Une sortie sur le port est un progrès
+    return watch->_savedpc == pmach->_pc && watch->_savedcc == pmach->_cc
+        && watch->_savedport == pmach->_portwords
+        && !memcmp(watch->_savedregs, pmach->_registers,
+                sizeof(watch->_savedregs))
+        && !memcmp(watch->_saveddata, pmach->_data,
+                pmach->_datasize * sizeof(Word));
+}
+
+bool livelock_repeated(const Machine *pmach)
+{
+    return same_state(pmach->_livelock, pmach);
+}
+
+void livelock_restore(Machine *pmach)
+{
+    const Livelock *watch = pmach->_livelock;
+
+    pmach->_pc = watch->_savedpc;
+    pmach->_cc = watch->_savedcc;
+    memcpy(pmach->_registers, watch->_savedregs, sizeof(watch->_savedregs));
+    memcpy(pmach->_data, watch->_saveddata, pmach->_datasize * sizeof(Word));
+}
+
+bool livelock_checkpoint(Machine *pmach, uint64_t *cycle)
+{
+    Livelock *watch = pmach->_livelock;
+
+    refresh(watch, true);
+    uint64_t hash = state_hash(pmach, watch);
+
+    if(watch->_saved && hash == watch->_savedhash
+            && same_state(watch, pmach))
+    {
+        *cycle = counters_retired(&pmach->_counters) - watch->_savedretired;
+        return true;
+    }
+
+    // Brent : l'état de référence est remplacé à chaque doublement de la
+    // fenêtre
+    if(!watch->_saved || ++watch->_lambda == watch->_power)
+    {
+        if(watch->_saved)
+            watch->_power *= 2;
+        watch->_lambda = 0;
+        save(watch, pmach, hash);
+    }
+
+    return false;
+}
+
+void livelock_end(Machine *pmach)
+{
+    Livelock *watch = pmach->_livelock;
+    unsigned first = 0, count = 0;
+
+    refresh(watch, false);
+    for(unsigned i = 0; i < watch->_npages; ++i)
+        if(watch->_protected[i] && !count++)
+            first = i;
+    if(count)
+        protect(watch, first, count, false);
+
+    watch->_exithash = state_hash(pmach, watch);
+    watch->_exitretired = counters_retired(&pmach->_counters);
+}
+
+bool livelock_write_fault(Machine *pmach, const void *addr)
+{
+    Livelock *watch = pmach->_livelock;
+    uintptr_t a = (uintptr_t)addr;
+
+    if(!watch || !watch->_data || watch->_npages == 0
+            || a < page_start(watch, 0)
+            || a >= page_start(watch, watch->_npages))
+        return false;
+
+    unsigned i = (a - page_start(watch, 0)) / watch->_page;
+    if(!watch->_protected[i] || watch->_dirty[i])
+        return false;
+
+    watch->_dirty[i] = true;
+    return protect(watch, i, 1, false);
+}
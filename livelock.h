@@ -0,0 +1,142 @@
+#ifndef _LIVELOCK_H_
+#define _LIVELOCK_H_
+
+/*!
+ * \file livelock.h
+ * \brief Détection des programmes qui ne progressent plus.
+ *
+ * La machine est déterministe : si elle repasse par un état architectural
+ * déjà vu (compteur ordinal, code condition, registres, segment de données
+ * et nombre de mots écrits sur le port de sortie, port.h), elle bouclera
+ * indéfiniment. Quand un détecteur est attaché à
+ * une machine (livelock_enable()), run() prend des <em>points de
+ * contrôle</em> : toutes les \c _period instructions, l'exécution est
+ * poursuivie jusqu'à la prochaine cible d'un branchement arrière, et l'état
+ * y est résumé par une empreinte de 64 bits. L'algorithme de Brent compare
+ * chaque point de contrôle à un état sauvegardé ; une égalité d'empreinte
+ * est confirmée par une comparaison exacte avec cette sauvegarde. run()
+ * s'arrête alors avec \c RUN_LIVELOCK.
+ *
+ * L'empreinte du segment de données est entretenue page par page : après
+ * chaque point de contrôle, les pages sont protégées en écriture ; la
+ * première écriture dans une page provoque une faute, traitée par le
+ * gestionnaire de guard.h, qui marque la page et lui rend ses droits. Seules
+ * les pages écrites sont relues au point de contrôle suivant.
+ *
+ * Les points de contrôle sont conservés d'un appel de run() au suivant si
+ * la machine n'a pas été modifiée entre-temps (même empreinte, même nombre
+ * d'instructions exécutées) ; sinon la détection repart de zéro.
+ */
+
+#include "machine.h"
+
+//! Période par défaut entre deux points de contrôle (instructions)
+#define LIVELOCK_PERIOD 65536
+
+//! Longueur maximale du parcours qui relève la plage d'adresses d'un cycle
+/*!
+ * Le parcours n'est compté ni dans les instructions exécutées ni dans les
+ * compteurs, et ses avertissements sont ignorés : la machine est rendue
+ * dans l'état où le cycle a été détecté.
+ */
+#define LIVELOCK_TRACE (1u << 24)
+
+//! Détecteur attaché à une machine
+typedef struct Livelock
+{
+    uint64_t _period;           //!< Instructions entre deux points de contrôle
+
+    // Pages du segment de données
+    size_t _page;               //!< Taille d'une page (octets)
+    Word *_data;                //!< Segment suivi
+    unsigned _datasize;         //!< Sa taille (mots)
+    unsigned _npages;           //!< Nombre de pages (même partielles)
+    uint64_t *_pagehash;        //!< Empreinte de chaque page
+    bool *_dirty;               //!< Pages écrites depuis le dernier contrôle
+    bool *_protected;           //!< Pages protégeables (entières dans le segment)
+    uint64_t _datahash;         //!< Empreinte du segment
+
+    // Cibles de branchement arrière (et points d'arrêt de la machine)
+    bool *_stops;               //!< Arrêts par adresse du texte
+    unsigned _textsize;         //!< Taille de \c _stops
+
+    // Algorithme de Brent
+    bool _saved;                //!< Un état est sauvegardé
+    uint64_t _savedhash;        //!< Son empreinte
+    uint64_t _savedretired;     //!< Instructions exécutées à la sauvegarde
+    unsigned _savedpc;          //!< Compteur ordinal sauvegardé
+    Condition_Code _savedcc;    //!< Code condition sauvegardé
+    Word _savedregs[NREGISTERS];//!< Registres sauvegardés
+    uint64_t _savedport;        //!< Mots écrits sur le port de sortie (port.h)
+    Word *_saveddata;           //!< Segment de données sauvegardé
+    uint64_t _power;            //!< Longueur de la fenêtre courante
+    uint64_t _lambda;           //!< Points de contrôle dans la fenêtre
+
+    // État à la sortie du dernier run()
+    uint64_t _exithash;         //!< Empreinte
+    uint64_t _exitretired;      //!< Instructions exécutées
+} Livelock;
+
+//! Attache d'un détecteur à une machine (ou changement de période)
+/*!
+ * \param pmach la machine
+ * \param period les instructions entre deux points de contrôle (0 : \c
+ * LIVELOCK_PERIOD)
+ * \return faux si la mémoire manque
+ */
+bool livelock_enable(Machine *pmach, uint64_t period);
+
+//! Retrait du détecteur d'une machine (sans effet s'il n'y en a pas)
+void livelock_disable(Machine *pmach);
+
+//! Début d'une exécution surveillée (par run())
+/*!
+ * Relit tout le segment de données et protège ses pages en écriture.
+ *
+ * \return faux si les pages ne peuvent pas être protégées (la surveillance
+ * est alors abandonnée pour cette exécution)
+ */
+bool livelock_begin(Machine *pmach);
+
+//! Point de contrôle (par run())
+/*!
+ * \param pmach la machine, sur une cible de branchement arrière ou après
+ * une période sans en rencontrer
+ * \param cycle le nombre d'instructions depuis le précédent passage par
+ * l'état courant
+ * \return vrai si l'état courant a déjà été vu
+ */
+bool livelock_checkpoint(Machine *pmach, uint64_t *cycle);
+
+//! Retour à l'état du dernier point de contrôle qui a conclu à un cycle
+/*!
+ * Le segment de données n'est comparé que si le compteur ordinal, le code
+ * condition et les registres sont égaux.
+ *
+ * \param pmach la machine
+ * \return vrai si son état est exactement l'état sauvegardé
+ */
+bool livelock_repeated(const Machine *pmach);
+
+//! Retour à l'état sauvegardé, qui est celui du cycle détecté
+/*!
+ * Rétablit le compteur ordinal, le code condition, les registres et le
+ * segment de données du dernier point de contrôle qui a conclu à un cycle.
+ *
+ * \param pmach la machine
+ */
+void livelock_restore(Machine *pmach);
+
+//! Fin d'une exécution surveillée (par run()), même après une erreur
+void livelock_end(Machine *pmach);
+
+//! Faute d'écriture dans une page protégée (gestionnaire de guard.h)
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param addr l'adresse fautive
+ * \return vrai si la faute est due à la protection (la page est alors
+ * marquée et rendue accessible en écriture)
+ */
+bool livelock_write_fault(Machine *pmach, const void *addr);
+
+#endif
@@ -0,0 +1,301 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "loop.h"
+
+/*!
+ * \file loop.c
+ * \brief Implémentation de loop.h. Boucles à compteur.
+ *
+ * La valeur testée à l'itération k est <tt>a + b.k</tt> modulo 2^32. Tant
+ * qu'elle ne déborde pas sur 32 bits signés, son signe change au plus deux
+ * fois (négatif, nul, positif, ou l'inverse) : la première itération dont
+ * le branchement n'est pas pris est le début du premier de ces intervalles
+ * où la condition est fausse.
+ */
+
+//! Opérande d'une instruction à valeur (immédiat ou registre)
+static Loop_Operand operand_of(Instruction instr)
+{
+    if(instruction_mode(instr) == MODE_REGISTER)
+        return (Loop_Operand){true, instr.instr_register._rsource};
+
+    return (Loop_Operand){false, (Word)instr.instr_immediate._value};
+}
+
+//! Analyse d'un corps de boucle
+/*!
+ * \param text les instructions
+ * \param head la première instruction du corps
+ * \param branch l'adresse du branchement arrière
+ * \param loop la boucle décrite (si elle est reconnue)
+ * \return vrai si la boucle est reconnue
+ */
+static bool analyze_body(const Instruction *text, unsigned head,
+        unsigned branch, Loop *loop)
+{
+    int writer[NREGISTERS];
+    int ccpos = -1;
+
+    memset(loop, 0, sizeof(*loop));
+    for(unsigned r = 0; r < NREGISTERS; ++r)
+        writer[r] = -1;
+
+    for(unsigned addr = head; addr < branch; ++addr)
+    {
+        Instruction instr = text[addr];
+        Code_Op cop = instr.instr_generic._cop;
+        Mode mode = instruction_mode(instr);
+        unsigned r = instr.instr_generic._regcond;
+
+        if(cop == NOP)
+        {
+            ++loop->_retired[NOP];
+            continue;
+        }
+
+        if((cop != LOAD && cop != ADD && cop != SUB && cop != CMP)
+                || (mode != MODE_IMMEDIATE && mode != MODE_REGISTER))
+            return false;
+
+        ++loop->_retired[cop];
+        ccpos = addr;
+        if(cop == CMP)
+            continue;
+
+        // Un seul écrivain par registre
+        if(writer[r] >= 0)
+            return false;
+        writer[r] = addr;
+        loop->_effect[r] = cop == LOAD ? LOOP_SET : LOOP_STEP;
+        loop->_operand[r] = operand_of(instr);
+        loop->_negate[r] = cop == SUB;
+    }
+
+    if(ccpos < 0)
+        return false;
+
+    // Les registres lus doivent être invariants
+    for(unsigned addr = head; addr < branch; ++addr)
+        if(instruction_mode(text[addr]) == MODE_REGISTER
+                && writer[text[addr].instr_register._rsource] >= 0)
+            return false;
+
+    Instruction test = text[ccpos];
+    loop->_ccreg = test.instr_generic._regcond;
+    if(test.instr_generic._cop == CMP)
+    {
+        loop->_ccphase = writer[loop->_ccreg] >= 0
+            && writer[loop->_ccreg] < ccpos;
+        loop->_ccsub = operand_of(test);
+    }
+    else
+    {
+        loop->_ccphase = 1;
+        loop->_ccsub = (Loop_Operand){false, 0};
+    }
+
+    loop->_head = head;
+    loop->_branch = branch;
+    loop->_cond = text[branch].instr_generic._regcond;
+    return true;
+}
+
+//! Comparaison de deux boucles par adresse de tête (pour qsort)
+static int compare_heads(const void *a, const void *b)
+{
+    const Loop *la = a, *lb = b;
+
+    return (la->_head > lb->_head) - (la->_head < lb->_head);
+}
+
+Loop *loop_analyze(const Instruction *text, unsigned size, unsigned *count)
+{
+    Loop *loops = NULL;
+    unsigned capacity = 0;
+
+    *count = 0;
+    for(unsigned addr = 0; addr < size; ++addr)
+    {
+        Instruction instr = text[addr];
+        Loop loop;
+
+        if(instr.instr_generic._cop != BRANCH
+                || instruction_mode(instr) != MODE_ABSOLUTE
+                || instr.instr_generic._regcond == NC
+                || instr.instr_generic._regcond > LAST_CONDITION
+                || instr.instr_absolute._address >= addr
+                || !analyze_body(text, instr.instr_absolute._address, addr,
+                    &loop))
+            continue;
+
+        if(*count == capacity)
+        {
+            Loop *grown = realloc(loops, (capacity ? 2 * capacity : 8)
+                    * sizeof(Loop));
+            if(!grown)
+            {
+                free(loops);
+                *count = 0;
+                return NULL;
+            }
+            loops = grown;
+            capacity = capacity ? 2 * capacity : 8;
+        }
+        loops[(*count)++] = loop;
+    }
+
+    // Le corps d'une boucle ne contient pas de branchement : une tête
+    // n'appartient qu'à une boucle
+    if(loops)
+        qsort(loops, *count, sizeof(Loop), compare_heads);
+    return loops;
+}
+
+//! Valeur courante d'un opérande
+static Word operand_value(const Machine *pmach, Loop_Operand op)
+{
+    return op._register ? pmach->_registers[op._value] : op._value;
+}
+
+//! Pas (modulo 2^32) d'un registre d'induction
+static Word step_of(const Machine *pmach, const Loop *loop, unsigned r)
+{
+    Word step = operand_value(pmach, loop->_operand[r]);
+
+    return loop->_negate[r] ? -step : step;
+}
+
+//! Valeur d'un registre après \a w écritures par le corps
+static Word register_after(const Machine *pmach, const Loop *loop,
+        unsigned r, uint64_t w)
+{
+    switch(loop->_effect[r])
+    {
+        case LOOP_STEP:
+            return pmach->_registers[r] + step_of(pmach, loop, r) * (Word)w;
+
+        case LOOP_SET:
+            return w ? operand_value(pmach, loop->_operand[r])
+                : pmach->_registers[r];
+
+        default:
+            return pmach->_registers[r];
+    }
+}
+
+//! Valeur testée par le branchement à la fin de l'itération \a k
+static Word tested_value(const Machine *pmach, const Loop *loop, uint64_t k)
+{
+    return register_after(pmach, loop, loop->_ccreg, k + loop->_ccphase)
+        - operand_value(pmach, loop->_ccsub);
+}
+
+//! Vrai si le branchement est pris pour une valeur de signe \a sign
+static bool holds(Condition cond, int sign)
+{
+    switch(cond)
+    {
+        case EQ:
+            return sign == 0;
+
+        case NE:
+            return sign != 0;
+
+        case GT:
+            return sign > 0;
+
+        case GE:
+            return sign >= 0;
+
+        case LT:
+            return sign < 0;
+
+        case LE:
+            return sign <= 0;
+
+        default:
+            return true;
+    }
+}
+
+//! Signe d'une valeur testée
+static int sign_of(Word value)
+{
+    return ((int32_t)value > 0) - ((int32_t)value < 0);
+}
+
+//! Nombre d'itérations, à partir de l'itération courante, dont le
+//! branchement est pris (\c UINT64_MAX : toutes)
+static uint64_t taken_iterations(const Machine *pmach, const Loop *loop)
+{
+    unsigned r = loop->_ccreg;
+
+    if(loop->_effect[r] != LOOP_STEP || step_of(pmach, loop, r) == 0)
+    {
+        // Valeur constante, sauf à la première itération pour un registre
+        // affecté après le test
+        if(!holds(loop->_cond, sign_of(tested_value(pmach, loop, 0))))
+            return 0;
+        if(!holds(loop->_cond, sign_of(tested_value(pmach, loop, 1))))
+            return 1;
+        return UINT64_MAX;
+    }
+
+    int64_t a = (int32_t)tested_value(pmach, loop, 0);
+    int64_t b = (int32_t)step_of(pmach, loop, r);
+    int64_t magnitude = b > 0 ? b : -b;
+    int first = b > 0 ? -1 : 1;
+
+    // Intervalles de signe : [0, zero[ de signe first, [zero, last[ nul,
+    // [last, ...[ de signe -first
+    int64_t distance = first < 0 ? -a : a;
+    uint64_t zero = distance <= 0 ? 0
+        : (uint64_t)((distance + magnitude - 1) / magnitude);
+    uint64_t last = a + b * (int64_t)zero == 0 ? zero + 1 : zero;
+    uint64_t stop = UINT64_MAX;
+
+    if(zero > 0 && !holds(loop->_cond, first))
+        stop = 0;
+    else if(last > zero && !holds(loop->_cond, 0))
+        stop = zero;
+    else if(!holds(loop->_cond, -first))
+        stop = last;
+
+    // Au-delà de la dernière itération sans débordement, l'analyse ne vaut
+    // plus
+    int64_t room = b > 0 ? INT32_MAX - a : a - INT32_MIN;
+    uint64_t safe = (uint64_t)(room / magnitude) + 1;
+
+    return stop < safe ? stop : safe;
+}
+
+uint64_t loop_skip(Machine *pmach, const Loop *loop, uint64_t budget)
+{
+    unsigned length = loop->_branch - loop->_head + 1;
+    uint64_t k = taken_iterations(pmach, loop);
+
+    if(k > budget / length)
+        k = budget / length;
+    if(k == 0)
+        return 0;
+
+    // Code condition laissé par l'itération k - 1, avant de modifier les
+    // registres
+    Word last = tested_value(pmach, loop, k - 1);
+    pmach->_cc = sign_of(last) < 0 ? CC_N : sign_of(last) == 0 ? CC_Z : CC_P;
+
+    Word values[NREGISTERS];
+    for(unsigned r = 0; r < NREGISTERS; ++r)
+        values[r] = register_after(pmach, loop, r, k);
+    for(unsigned r = 0; r < NREGISTERS; ++r)
+        pmach->_registers[r] = values[r];
+
+    for(unsigned cop = 0; cop < NCOPS; ++cop)
+        pmach->_counters._retired[cop] += k * loop->_retired[cop];
+    pmach->_counters._retired[BRANCH] += k;
+    pmach->_counters._taken += k;
+
+    return k * length;
+}
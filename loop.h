@@ -0,0 +1,95 @@
+#ifndef _LOOP_H_
+#define _LOOP_H_
+
+/*!
+ * \file loop.h
+ * \brief Boucles à compteur : détection et exécution accélérée.
+ *
+ * Une boucle reconnue est un corps en ligne droite <tt>[head, branch[</tt>
+ * suivi de <tt>BRANCH cond, @head</tt> (condition autre que \c NC), dont
+ * les instructions ne touchent que les registres :
+ *
+ *   - <tt>ADD Rn, v</tt> et <tt>SUB Rn, v</tt>, \a v immédiat ou registre
+ *   invariant (\e induction : Rn varie d'un pas constant) ;
+ *
+ *   - <tt>LOAD Rn, v</tt>, même \a v (Rn constant après une itération) ;
+ *
+ *   - <tt>CMP Rn, v</tt>, même \a v, et \c NOP.
+ *
+ * Un registre est écrit par une seule instruction du corps ; un registre
+ * invariant n'y est pas écrit. Le corps ne lit ni n'écrit la mémoire et ne
+ * peut pas provoquer d'erreur : le branchement ne dépend que de la dernière
+ * instruction qui positionne le code condition, dont la valeur est une
+ * fonction affine du numéro d'itération.
+ *
+ * À chaque arrivée en tête de boucle, loop_skip() calcule à partir des
+ * registres le nombre d'itérations dont le branchement sera pris, puis
+ * applique leur effet en O(1) : registres, code condition et compteurs de
+ * performance (les instructions sautées sont comptées). L'itération de
+ * sortie est exécutée normalement. Quand la valeur testée déborderait
+ * (arithmétique modulo 2^32), seules les itérations qui précèdent le
+ * débordement sont sautées.
+ */
+
+#include "machine.h"
+
+//! Effet d'une itération sur un registre
+typedef enum
+{
+    LOOP_KEEP = 0,              //!< Registre non écrit
+    LOOP_STEP,                  //!< Ajout d'un pas constant
+    LOOP_SET,                   //!< Affectation d'une valeur constante
+} Loop_Effect;
+
+//! Opérande d'une instruction du corps : immédiat ou registre invariant
+typedef struct
+{
+    bool _register;             //!< Registre (vrai) ou valeur immédiate
+    Word _value;                //!< La valeur, ou le numéro du registre
+} Loop_Operand;
+
+//! Boucle à compteur reconnue
+typedef struct
+{
+    unsigned _head;             //!< Première instruction du corps
+    unsigned _branch;           //!< Adresse du branchement arrière
+    Condition _cond;            //!< Condition du branchement
+
+    // Effet d'une itération sur chaque registre
+    Loop_Effect _effect[NREGISTERS];    //!< Nature de l'effet
+    Loop_Operand _operand[NREGISTERS];  //!< Pas ou valeur affectée
+    bool _negate[NREGISTERS];           //!< Pas retranché (\c SUB)
+
+    // Valeur testée à la k-ième itération (k à partir de 0) : registre
+    // \c _ccreg après <tt>k + _ccphase</tt> écritures, moins \c _ccsub
+    unsigned _ccreg;            //!< Registre testé
+    unsigned _ccphase;          //!< 1 si l'écriture du registre précède le test
+    Loop_Operand _ccsub;        //!< Valeur retranchée (\c CMP), sinon 0
+
+    unsigned _retired[NCOPS];   //!< Instructions exécutées par itération
+} Loop;
+
+//! Détection des boucles à compteur d'un segment de texte
+/*!
+ * \param text les instructions
+ * \param size leur nombre
+ * \param count le nombre de boucles reconnues
+ * \return les boucles par adresse de tête croissante (à libérer par free()),
+ * ou NULL s'il n'y en a pas ou si la mémoire manque
+ */
+Loop *loop_analyze(const Instruction *text, unsigned size, unsigned *count);
+
+//! Saut des itérations d'une boucle dont le branchement sera pris
+/*!
+ * La machine doit être en tête de la boucle (le compteur ordinal désigne
+ * \c _head). Elle y reste ; son état est celui qu'aurait donné l'exécution
+ * des itérations sautées.
+ *
+ * \param pmach la machine
+ * \param loop la boucle
+ * \param budget le nombre maximal d'instructions à sauter
+ * \return le nombre d'instructions sautées (éventuellement 0)
+ */
+uint64_t loop_skip(Machine *pmach, const Loop *loop, uint64_t budget);
+
+#endif
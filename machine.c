@@ -1,7 +1,23 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "error.h"
 #include "exec.h"
 #include "debug.h"
+#include "disasm.h"
+#include "guard.h"
+#include "livelock.h"
+#include "profile.h"
+#include "text.h"
+
+const char *run_status_names[] =
+{
+    "HALTED",
+    "FAULTED",
+    "BUDGET",
+    "BREAKPOINT",
+    "LIVELOCK",
+};
 
 const char *condition_code_names[] =
 {
@@ -31,54 +47,44 @@ void create_binary_file(Machine *pmach)
         exit(1);
     }
 
-    //On commence par écrire la taille du segment de texte.
-    if(fwrite(&(pmach->_textsize), sizeof(unsigned), 1, file) != 1)
+    //En-tête, texte et données (compressées si elles sont creuses)
+    if(!write_program(file, pmach->_textsize, pmach->_text,
+                pmach->_datasize, pmach->_data, pmach->_dataend, NULL,
+                BIN_COMPRESS))
     {
         //Problème pendant l'écriture : on l'écrit sur la sortie d'erreur
         //standard et on sort de la fonction
-        fprintf(stderr, "Erreur durant l'écriture de _textsize.\n");
+        fprintf(stderr, "Erreur durant l'écriture du fichier binaire.\n");
         exit(1);
     }
 
-    //Ecriture des instructions
-    if(fwrite(&(pmach->_datasize), sizeof(unsigned), 1, file) != 1)
-    {
-        //Problème pendant l'écriture : on l'écrit sur la sortie d'erreur
-        //standard et on sort de la fonction
-        fprintf(stderr, "Erreur durant l'écriture de _datasize.\n");
-        exit(1);
-    }
+    //On ferme le fichier
+    fclose(file);
+}
 
-    //Ecriture du dataend
-    if(fwrite(&(pmach->_dataend), sizeof(unsigned int), 1, file) != 1)
-    {
-        //Problème pendant l'écriture : on l'écrit sur la sortie d'erreur
-        //standard et on sort de la fonction
-        fprintf(stderr, "Erreur durant l'écriture de _dataend.\n");
-        exit(1);
-    }
+//! Machine publiée par le thread
+static __thread Machine *volatile current;
 
-    //Ecriture des instructions
-    if(fwrite(&(pmach->_text->_raw), sizeof(Word), pmach->_textsize, file) !=
-            pmach->_textsize)
-    {
-        //Problème pendant l'écriture : on l'écrit sur la sortie d'erreur
-        //standard et on sort de la fonction
-        fprintf(stderr, "Erreur durant l'écriture des instructions.\n");
-        exit(1);
-    }
+Machine *machine_enter(Machine *pmach)
+{
+    Machine *previous = current;
 
-    //Ecriture des données
-    if(fwrite(pmach->_data, sizeof(Word), pmach->_datasize, file)
-            != pmach->_datasize)
-    {
-        //Problème pendant l'écriture : on l'écrit sur la sortie d'erreur
-        //standard et on sort de la fonction
-        fprintf(stderr, "Erreur durant l'écriture des données.\n");
-        exit(1);
-    }
-    //On ferme le fichier
-    fclose(file);
+    current = pmach;
+    sink_select(pmach ? pmach->_output : NULL,
+            pmach ? pmach->_messages : NULL);
+    return previous;
+}
+
+void machine_leave(Machine *previous)
+{
+    current = previous;
+    sink_select(previous ? previous->_output : NULL,
+            previous ? previous->_messages : NULL);
+}
+
+Machine *machine_current(void)
+{
+    return current;
 }
 
 void load_program(Machine *pmach,
@@ -100,6 +106,21 @@ void load_program(Machine *pmach,
     {
         pmach->_registers[i] = 0;
     } 
+    //Remise à zéro des compteurs de performance
+    counters_reset(&pmach->_counters, pmach->_sp);
+    //Aucun point d'arrêt
+    pmach->_breakpoints = NULL;
+    //Segment de texte propre à la machine
+    pmach->_shared = NULL;
+    //Pas de détection d'absence de progrès
+    pmach->_livelock = NULL;
+    pmach->_output = NULL;
+    pmach->_messages = NULL;
+    //Port de sortie sans canal
+    pmach->_port = NULL;
+    pmach->_portwords = 0;
+    //Aucun appel en cours
+    pmach->_depth = 0;
 }
 
 void read_program(Machine *mach, const char *programfile)
@@ -115,41 +136,47 @@ void read_program(Machine *mach, const char *programfile)
         exit(1);
     }
 
-    //Tableau d'entiers non signés pour la récupération de
-    //textsize, datasize et dataend
-    unsigned sizes[3];
     //Récupération des tailles des segments à allouer
-    fread(sizes, sizeof(unsigned), 3, file);
-
-    unsigned int stack_size = sizes[1] - sizes[2]; //Place occupée par la pile
-    //On teste si on a assez de place pour la pile
-    if(stack_size < MINSTACKSIZE)
-        //Si c'est inférieur, on modifie la taille de manière à ce
-        //que la taille pile d'execution soit de la taille minimale imposée
-        stack_size = MINSTACKSIZE;
+    Program_Header hdr;
+    if(!read_program_header(file, &hdr))
+    {
+        fprintf(stderr, "Fichier \"%s\" invalide : %s.\n", programfile,
+                program_format_error());
+        exit(1);
+    }
 
     //Allocation de l'espace nécessaire pour stocker les instructions
     //du programme à simuler
-    Instruction *text = malloc(sizes[0] * sizeof(Instruction));
+    Instruction *text = malloc(hdr._textsize * sizeof(Instruction));
     //Allocation de l'espace nécessaire pour stocker les données du programme
-    Word *data = calloc(sizes[2] + stack_size, sizeof(Word));
-    //On extrait du fichier binaire les instructions du programme
-    //et on les place dans le segment de texte
-    fread(text, sizeof(Instruction), sizes[0], file);
-    //On extrait du fichier binaire les données du programme et on
-    //les place dans le segment de données
-    fread(data, sizeof(Word), sizes[1], file);
+    //(segment gardé, initialement nul)
+    Word *end = guard_reserve(hdr._datasize);
+    Word *data = end ? end - hdr._datasize : NULL;
+    if(!text || !data)
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(1);
+    }
+
+    if(!read_program_body(file, &hdr, text, data))
+    {
+        fprintf(stderr, "Fichier \"%s\" invalide : %s.\n", programfile,
+                program_format_error());
+        exit(1);
+    }
     //Fermeture du fichier
     fclose(file);
 
     //On appelle load_program pour initialiser la machine avec les
     //données que l'on vient de récuperer
-    load_program(mach, sizes[0], text, sizes[2] + stack_size, data, sizes[2]);
+    load_program(mach, hdr._textsize, text, hdr._datasize, data, hdr._dataend);
 }
 
 void dump_memory(Machine *pmach)
 {
-    printf("Instruction text[] = {\n");
+    Sink *out = machine_output(pmach);
+
+    sink_printf(out, "Instruction text[] = {\n");
 
     //Affichage du contenu du segment de texte
     for(int i = 0; i < pmach->_textsize; ++i)
@@ -157,22 +184,22 @@ void dump_memory(Machine *pmach)
         {
             case 0:
                 //Début de ligne donc on fait un alinéa
-                printf("    0x%08x, ", pmach->_text[i]._raw);
+                sink_printf(out, "    0x%08x, ", pmach->_text[i]._raw);
                 break;
             case 3:
                 //4 instructions sur une ligne donc on fait un saut de ligne
-                printf("0x%08x, \n", pmach->_text[i]._raw);
+                sink_printf(out, "0x%08x, \n", pmach->_text[i]._raw);
                 break;
             default:
-                printf("0x%08x, ", pmach->_text[i]._raw); 
+                sink_printf(out, "0x%08x, ", pmach->_text[i]._raw); 
         }
 
     if(pmach->_textsize % 4 != 0)
-        printf("\n");
+        sink_write(out, "\n", 1);
 
     // Affichage de la taille du segment de texte
-    printf("};\nunsigned textsize = %d;\n", (pmach->_textsize));
-    printf("\nWord data[] = {\n");
+    sink_printf(out, "};\nunsigned textsize = %d;\n", (pmach->_textsize));
+    sink_printf(out, "\nWord data[] = {\n");
 
     //Affichage du contenu du segment de données
     for(int i = 0; i < pmach->_datasize; ++i)
@@ -180,23 +207,23 @@ void dump_memory(Machine *pmach)
         {
             case 0:
                 //Début de ligne donc on fait un alinéa
-                printf("    0x%08x, ", pmach->_data[i]);
+                sink_printf(out, "    0x%08x, ", pmach->_data[i]);
                 break;
             case 3:
                 //4 instructions sur une ligne donc on fait un saut de ligne
-                printf("0x%08x, \n", pmach->_data[i]);
+                sink_printf(out, "0x%08x, \n", pmach->_data[i]);
                 break;
             default:
-                printf("0x%08x, ", pmach->_data[i]); 
+                sink_printf(out, "0x%08x, ", pmach->_data[i]); 
         }
 
     if(pmach->_datasize % 4 != 0)
-        printf("\n");
+        sink_write(out, "\n", 1);
 
     //Affichage de la taille du segment de données
-    printf("};\nunsigned datasize = %d;\n", (pmach->_datasize));
+    sink_printf(out, "};\nunsigned datasize = %d;\n", (pmach->_datasize));
     //Affichage du dataend
-    printf("unsigned dataend = %d;\n", (pmach->_dataend));
+    sink_printf(out, "unsigned dataend = %d;\n", (pmach->_dataend));
 
     //On créé le fichier binaire correspondant au programme que l'on va simuler
     create_binary_file(pmach);
@@ -204,56 +231,60 @@ void dump_memory(Machine *pmach)
 
 void print_program(Machine *pmach)
 {
-    printf("\n*** PROGRAM (size: %i) ***\n", pmach->_textsize);
-    for(int i = 0; i < pmach->_textsize; ++i)
-    {
-        printf("0x%04x: 0x%08x \t ", i, pmach->_text[i]._raw);
-        print_instruction(pmach->_text[i], i);
-        printf("\n");
-    }
+    Sink *out = machine_output(pmach);
 
-    printf("\n");
+    sink_printf(out, "\n*** PROGRAM (size: %i) ***\n", pmach->_textsize);
+    print_listing(out, pmach->_text, pmach->_textsize, NULL);
+    sink_write(out, "\n", 1);
 }
 
 void print_data(Machine *pmach)
 {
-    printf("*** DATA (size: %i, end = 0x%08x (%i)) ***\n",
+    Sink *out = machine_output(pmach);
+
+    sink_printf(out, "*** DATA (size: %i, end = 0x%08x (%i)) ***\n",
             pmach->_datasize, pmach->_dataend, pmach->_dataend);
 
     for(int i = 0; i < pmach->_datasize; ++i)
     {
-        printf("0x%04x: 0x%08x %-6i ", i, pmach->_data[i], pmach->_data[i]);
+        sink_printf(out, "0x%04x: 0x%08x %-6i ",
+                i, pmach->_data[i], pmach->_data[i]);
         if(i % 3 == 2)
-            printf("\n");
+            sink_write(out, "\n", 1);
     }
 
     if(pmach->_datasize % 3 != 0)
-        printf("\n");
+        sink_write(out, "\n", 1);
 
-    printf("\n");
+    sink_write(out, "\n", 1);
 }
 
 void print_cpu(Machine *pmach)
 {
-    printf("\n*** CPU ***\nPC:  0x%08x   CC: %s\n\n",
+    Sink *out = machine_output(pmach);
+
+    sink_printf(out, "\n*** CPU ***\nPC:  0x%08x   CC: %s\n\n",
             pmach->_pc, condition_code_names[pmach->_cc]);
 
     for(int i = 0; i < NREGISTERS; ++i)
     {
-        printf("R%02i: 0x%08x %-6i ",
+        sink_printf(out, "R%02i: 0x%08x %-6i ",
                 i, pmach->_registers[i], pmach->_registers[i]);
         if(i % 3 == 2)
-            printf("\n");
+            sink_write(out, "\n", 1);
     }
 
     if(NREGISTERS % 3 != 0)
-        printf("\n");
+        sink_write(out, "\n", 1);
 
-    printf("\n");
+    sink_write(out, "\n", 1);
 }
 
 void simul(Machine *pmach, bool debug)
 {
+    Machine *previous = machine_enter(pmach);
+
+    counters_start(&pmach->_counters);
     do
     {
         if(pmach->_pc >= pmach->_textsize)
@@ -264,5 +295,264 @@ void simul(Machine *pmach, bool debug)
         if(debug)
             debug = debug_ask(pmach);
     } while(decode_execute(pmach, pmach->_text[pmach->_pc++]));
+    counters_stop(&pmach->_counters);
+    machine_leave(previous);
+}
+
+
+void set_breakpoint(Machine *pmach, unsigned addr, bool on)
+{
+    if(addr >= pmach->_textsize)
+        return;
+
+    if(!pmach->_breakpoints)
+    {
+        if(!on)
+            return;
+
+        if(!(pmach->_breakpoints = calloc(pmach->_textsize, sizeof(bool))))
+        {
+            fprintf(stderr, "Mémoire insuffisante.\n");
+            exit(1);
+        }
+    }
+
+    pmach->_breakpoints[addr] = on;
+}
+
+//! Boucle d'exécution sur le flot prédécodé
+/*!
+ * Une entrée du flot exécute jusqu'à \c _length instructions : \a n majore
+ * le nombre d'instructions exécutées. Quand le reste du budget ne suffit
+ * plus pour une entrée, le décompte exact est repris des compteurs et, si
+ * besoin, l'instruction est exécutée seule : le budget n'est jamais
+ * dépassé.
+ *
+ * En tête d'une boucle à compteur, les itérations dont le branchement sera
+ * pris sont sautées par loop_skip(), dans la limite du budget.
+ */
+static Run_Status run_stream(Machine *pmach, const Exec_Slot *stream,
+        const Loop *loops, uint64_t budget)
+{
+    uint64_t before = counters_retired(&pmach->_counters);
+
+    for(uint64_t n = 0; n < budget; )
+    {
+        if(pmach->_pc >= pmach->_textsize)
+            error(ERR_SEGTEXT, pmach->_pc);
+
+        const Exec_Slot *slot = &stream[pmach->_pc];
+        if(slot->_loop)
+        {
+            uint64_t skipped = loop_skip(pmach, &loops[slot->_loop - 1],
+                    budget - n);
+            if(skipped)
+            {
+                n += skipped;
+                continue;
+            }
+        }
+
+        ++pmach->_pc;
+        Exec_Func func = slot->_func;
+
+        if(budget - n < slot->_length)
+        {
+            n = counters_retired(&pmach->_counters) - before;
+            if(budget - n < slot->_length)
+                func = exec_lookup(slot->_instr);
+        }
+
+        n += func == slot->_func ? slot->_length : 1;
+        if(!func(pmach, slot->_instr))
+            return RUN_HALTED;
+    }
+
+    return RUN_BUDGET;
+}
+
+//! Boucle d'exécution bornée
+/*!
+ * Les erreurs sortent de cette fonction par \c longjmp : rien de ce
+ * qu'elle calcule n'est utilisé après une erreur.
+ *
+ * Le flot prédécodé du texte partagé est employé s'il existe, sauf en
+ * présence de points d'arrêt : une séquence fusionnée ne s'arrêterait pas
+ * sur ses instructions intérieures.
+ *
+ * \param pmach la machine
+ * \param budget le nombre maximal d'instructions
+ * \return la cause de l'arrêt (sauf erreur)
+ */
+static Run_Status run_loop(Machine *pmach, uint64_t budget)
+{
+    const bool *breakpoints = pmach->_breakpoints;
+
+    if(!breakpoints && pmach->_shared && pmach->_shared->_stream)
+        return run_stream(pmach, pmach->_shared->_stream,
+                pmach->_shared->_loops, budget);
+
+    for(uint64_t n = 0; n < budget; ++n)
+    {
+        if(pmach->_pc >= pmach->_textsize)
+            error(ERR_SEGTEXT, pmach->_pc);
+
+        if(breakpoints && breakpoints[pmach->_pc] && n > 0)
+            return RUN_BREAKPOINT;
+
+        Instruction instr = pmach->_text[pmach->_pc++];
+        if(!exec_lookup(instr)(pmach, instr))
+            return RUN_HALTED;
+    }
+
+    return RUN_BUDGET;
 }
 
+//! Puits qui ignore ce qu'on y écrit
+static void discard(void *context, const char *bytes, size_t length)
+{
+    (void)context;
+    (void)bytes;
+    (void)length;
+}
+
+//! Parcours d'un cycle : plage des adresses exécutées
+/*!
+ * La machine est revenue dans un état déjà vu, \a length instructions plus
+ * tôt ; parcourir le cycle ne peut donc ni échouer ni s'arrêter. Les points
+ * de contrôle ne voient qu'un multiple de la période : le parcours s'arrête
+ * au premier retour à l'état, qui donne la période exacte.
+ *
+ * Le parcours ne laisse pas de trace : ses avertissements sont ignorés, les
+ * compteurs et la pile d'appels fantôme sont rétablis, et la machine est
+ * rendue dans l'état du cycle si le parcours s'est arrêté avant d'y
+ * revenir.
+ *
+ * \param pmach la machine
+ * \param length le nombre maximal d'instructions à exécuter
+ * \param result le compte rendu, où la plage et la période sont notées
+ */
+static void cycle_range(Machine *pmach, uint64_t length, Run_Result *result)
+{
+    Counters counters = pmach->_counters;
+    unsigned depth = pmach->_depth;
+    unsigned calls[SHADOW_DEPTH];
+    bool repeated = false;
+    Sink quiet;
+
+    memcpy(calls, pmach->_calls, sizeof(calls));
+    sink_callback(&quiet, discard, NULL, 0);
+    sink_select(pmach->_output, &quiet);
+
+    result->_first = result->_last = pmach->_pc;
+
+    for(uint64_t n = 0; n < length && !repeated; ++n)
+    {
+        if(pmach->_pc < result->_first)
+            result->_first = pmach->_pc;
+        if(pmach->_pc > result->_last)
+            result->_last = pmach->_pc;
+
+        Instruction instr = pmach->_text[pmach->_pc++];
+        exec_lookup(instr)(pmach, instr);
+        if((repeated = livelock_repeated(pmach)))
+            result->_cycle = n + 1;
+    }
+
+    sink_select(pmach->_output, pmach->_messages);
+    sink_release(&quiet);
+
+    if(!repeated)
+        livelock_restore(pmach);
+    pmach->_counters = counters;
+    pmach->_depth = depth;
+    memcpy(pmach->_calls, calls, sizeof(calls));
+}
+
+//! Exécution surveillée par le détecteur d'absence de progrès
+/*!
+ * Après chaque période, l'exécution est poursuivie (au plus une autre
+ * période) jusqu'à une cible de branchement arrière, où le point de
+ * contrôle est pris. Les points d'arrêt de la machine restent actifs.
+ *
+ * \param pmach la machine
+ * \param budget le nombre maximal d'instructions
+ * \param result le compte rendu (cycle et plage si \c RUN_LIVELOCK)
+ * \return la cause de l'arrêt (sauf erreur)
+ */
+static Run_Status run_watched(Machine *pmach, uint64_t budget,
+        Run_Result *result)
+{
+    Livelock *watch = pmach->_livelock;
+    bool *breakpoints = pmach->_breakpoints;
+    uint64_t before = counters_retired(&pmach->_counters);
+    uint64_t left = budget;
+    Run_Status status;
+
+    while(left > 0)
+    {
+        status = run_loop(pmach, left < watch->_period ? left : watch->_period);
+        left = budget - (counters_retired(&pmach->_counters) - before);
+        if(status != RUN_BUDGET || left == 0)
+            return status;
+
+        pmach->_breakpoints = watch->_stops;
+        status = run_loop(pmach, left < watch->_period ? left : watch->_period);
+        pmach->_breakpoints = breakpoints;
+        left = budget - (counters_retired(&pmach->_counters) - before);
+        if(status == RUN_BREAKPOINT && breakpoints
+                && breakpoints[pmach->_pc])
+            return RUN_BREAKPOINT;
+        if(status != RUN_BUDGET && status != RUN_BREAKPOINT)
+            return status;
+
+        if(livelock_checkpoint(pmach, &result->_cycle))
+        {
+            uint64_t length = result->_cycle;
+
+            if(length > left)
+                length = left;
+            if(length > LIVELOCK_TRACE)
+                length = LIVELOCK_TRACE;
+            cycle_range(pmach, length, result);
+            return RUN_LIVELOCK;
+        }
+    }
+
+    return RUN_BUDGET;
+}
+
+Run_Result run(Machine *pmach, uint64_t budget)
+{
+    Run_Result result = {RUN_BUDGET, 0, ERR_NOERROR, 0, 0, 0, 0};
+    uint64_t before = counters_retired(&pmach->_counters);
+    bool *breakpoints = pmach->_breakpoints;
+    Error_Trap trap;
+    Machine *previous = machine_enter(pmach);
+    const bool watched = pmach->_livelock && livelock_begin(pmach);
+
+    counters_start(&pmach->_counters);
+    error_trap_enter(&trap);
+    if(setjmp(trap._env) == 0)
+        result._status = watched ? run_watched(pmach, budget, &result)
+            : run_loop(pmach, budget);
+    else
+    {
+        result._status = RUN_FAULTED;
+        result._error = trap._error;
+        result._address = trap._address;
+    }
+    error_trap_leave(&trap);
+    counters_stop(&pmach->_counters);
+    if(watched)
+    {
+        // Une erreur a pu survenir pendant la recherche d'une cible
+        pmach->_breakpoints = breakpoints;
+        livelock_end(pmach);
+    }
+    machine_leave(previous);
+
+    // Les instructions exécutées sont celles qui ont été comptées
+    result._executed = counters_retired(&pmach->_counters) - before;
+    return result;
+}
@@ -7,8 +7,13 @@
  */
 
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "instruction.h"
+#include "binfmt.h"
+#include "counters.h"
+#include "error.h"
+#include "sink.h"
 
 //! Nombre de resitres généraux
 #define NREGISTERS 16
@@ -37,6 +42,9 @@ static const unsigned LAST_CC = CC_N;
 //! Taille minimale de la pile d'exécution
 static const unsigned MINSTACKSIZE = 10;
 
+//! Nombre d'appels conservés par la pile d'appels fantôme
+#define SHADOW_DEPTH 32
+
 //! Structure générale de la machine.
 /*!
  * Cette machine simple est composée de mémoire et d'un processeur. 
@@ -83,14 +91,96 @@ typedef struct
     Condition_Code _cc;		//!< Code condition : signe de la dernière opération
     Word _registers[NREGISTERS];//!< Registres généraux (accumulateurs)
 
+    Counters _counters;         //!< Compteurs de performance
+    bool *_breakpoints;         //!< Points d'arrêt par adresse (ou NULL)
+    struct Shared_Text *_shared;//!< Texte partagé (text.h) dont \c _text est issu, ou NULL
+    struct Livelock *_livelock; //!< Détecteur d'absence de progrès (livelock.h), ou NULL
+    Sink *_output;              //!< Puits des affichages (sink.h), ou NULL pour \c stdout
+    Sink *_messages;            //!< Puits des messages, ou NULL pour \c stderr
+    Sink *_port;                //!< Canal du port de sortie (port.h), ou NULL
+    uint64_t _portwords;        //!< Mots écrits sur le port de sortie
+
+    // Pile d'appels fantôme (pour le profilage, voir profile.h)
+    unsigned _depth;            //!< Nombre d'appels en cours
+    unsigned _calls[SHADOW_DEPTH];  //!< Cibles des appels en cours (les plus anciens)
+
 //! Définition de _sp comme synonyme du registre R15    
 #   define _sp _registers[NREGISTERS - 1] 
 } Machine;
 
+//! Puits des affichages d'une machine
+static inline Sink *machine_output(const Machine *pmach)
+{
+    return pmach->_output ? pmach->_output : sink_stdout();
+}
+
+//! Mise à jour de la pile d'appels fantôme par un appel
+/*!
+ * La pile fantôme double la pile d'exécution : elle ne contient que les
+ * cibles des \c CALL pris, sans les données empilées, et peut donc être
+ * lue à tout instant (par un échantillonneur) sans interpréter le segment
+ * de données. Seuls les \c SHADOW_DEPTH appels les plus anciens sont
+ * conservés ; \c _depth compte tous les appels.
+ *
+ * \param pmach la machine
+ * \param target l'adresse appelée
+ */
+static inline void shadow_call(Machine *pmach, unsigned target)
+{
+    if(pmach->_depth < SHADOW_DEPTH)
+        pmach->_calls[pmach->_depth] = target;
+    ++pmach->_depth;
+}
+
+//! Mise à jour de la pile d'appels fantôme par un retour
+static inline void shadow_return(Machine *pmach)
+{
+    if(pmach->_depth > 0)
+        --pmach->_depth;
+}
+
+//! Case du sommet de pile dans le segment de données
+/*!
+ * Un SP hors du segment (pile vidée, débordement sous l'adresse 0, ou
+ * valeur quelconque chargée dans \c R15) donne \c _datasize : l'accès tombe
+ * dans la page de garde qui suit le segment (guard.h), qui n'a donc pas à
+ * couvrir tous les indices de 32 bits. Sans branchement : le compilateur
+ * produit un \c cmov.
+ */
+static inline unsigned stack_slot(const Machine *pmach)
+{
+    Word sp = pmach->_sp;
+
+    return sp < pmach->_datasize ? sp : pmach->_datasize;
+}
+
+//! Publication de la machine exécutée par le thread courant
+/*!
+ * Les moteurs d'exécution publient leur machine le temps de l'exécution ;
+ * les gestionnaires de signaux (profile.h, guard.h) retrouvent ainsi la
+ * machine interrompue. Les puits de la machine sont publiés en même temps
+ * (sink_select()).
+ *
+ * \param pmach la machine qui va s'exécuter sur ce thread (ou NULL)
+ * \return la machine publiée jusqu'ici, à republier par machine_leave()
+ */
+Machine *machine_enter(Machine *pmach);
+
+//! Fin de l'exécution d'une machine sur le thread courant
+/*!
+ * \param previous la valeur rendue par machine_enter()
+ */
+void machine_leave(Machine *previous);
+
+//! Machine publiée par le thread courant (ou NULL)
+Machine *machine_current(void);
+
 //! Chargement d'un programme
 /*!
  * La machine est réinitialisée et ses segments de texte et de données sont
- * remplacés par ceux fournis en paramètre.
+ * remplacés par ceux fournis en paramètre. Le segment de données doit être
+ * gardé (guard.h) : les débordements de pile ne sont détectés que par ses
+ * pages de garde.
  *
  * \param pmach la machine en cours d'exécution
  * \param textsize taille utile du segment de texte
@@ -104,26 +194,20 @@ void load_program(Machine *pmach,
 
 //! Lecture d'un programme depuis un fichier binaire
 /*!
- * Le fichier binaire a le format suivant :
- * 
- *    - 3 entiers non signés, la taille du segment de texte (\c textsize),
- *    celle du segment de données (\c datasize) et la première adresse libre de
- *    données (\c dataend) ;
- *
- *    - une suite de \c textsize entiers non signés représentant le contenu du
- *    segment de texte (les instructions) ;
- *
- *    - une suite de \c datasize entiers non signés représentant le contenu initial du
- *    segment de données.
- *
- * Tous les entiers font 32 bits et les adresses de chaque segment commencent à
- * 0. La fonction initialise complétement la machine.
+ * Le format du fichier (et l'ancien format, toujours accepté) est décrit
+ * dans binfmt.h ; un fichier invalide ou corrompu arrête le simulateur
+ * avant toute exécution. Les adresses de chaque segment commencent à 0. La
+ * fonction initialise complétement la machine. Les segments sont
+ * alloués par \c malloc (texte) et guard_reserve() (données) et
+ * appartiennent à l'appelant ; machine_read()
+ * (module \c pool) lit un programme dans une machine recyclable.
  *
  * \param pmach la machine à simuler
  * \param programfile le nom du fichier binaire
  *
  */
 void read_program(Machine *mach, const char *programfile);  
+
  
 //! Affichage du programme et des données
 /*!
@@ -134,6 +218,9 @@ void read_program(Machine *mach, const char *programfile);
  * dump.prog. Le format de ce fichier est compatible avec l'option -b de
  * test_simul.
  *
+ * Comme les autres affichages, le texte est écrit dans le puits \c _output
+ * de la machine (\c stdout s'il est NULL).
+ *
  * \param pmach la machine en cours d'exécution
  */
 void dump_memory(Machine *pmach);
@@ -166,13 +253,74 @@ void print_cpu(Machine *pmach);
 /*!
  * La boucle de simualtion est très simple : recherche de l'instruction
  * suivante (pointée par le compteur ordinal \c _pc) puis décodage et exécution
- * de l'instruction.
+ * de l'instruction. La durée de la simulation est ajoutée aux compteurs de
+ * performance de la machine.
  *
  * \param pmach la machine en cours d'exécution
  * \param debug mode de mise au point (pas à apas) ?
  */
 void simul(Machine *pmach, bool debug);
 
+//! Résultat d'une exécution bornée
+typedef enum
+{
+    RUN_HALTED,         //!< Le programme a exécuté \c HALT
+    RUN_FAULTED,        //!< Le programme s'est arrêté sur une erreur
+    RUN_BUDGET,         //!< Le nombre maximal d'instructions est atteint
+    RUN_BREAKPOINT,     //!< Le compteur ordinal est sur un point d'arrêt
+    RUN_LIVELOCK,       //!< La machine est revenue dans un état déjà vu
+} Run_Status;
+
+//! Forme imprimable des résultats d'exécution
+extern const char *run_status_names[];
+
+//! Compte rendu d'une exécution bornée
+typedef struct
+{
+    Run_Status _status;         //!< Cause de l'arrêt
+    uint64_t _executed;         //!< Nombre d'instructions exécutées
+    Error _error;               //!< Erreur (si \c RUN_FAULTED)
+    unsigned _address;          //!< Adresse de l'erreur (si \c RUN_FAULTED)
+    unsigned _first;            //!< Première adresse du cycle (si \c RUN_LIVELOCK)
+    unsigned _last;             //!< Dernière adresse du cycle (si \c RUN_LIVELOCK)
+    uint64_t _cycle;            //!< Instructions par tour du cycle (si \c RUN_LIVELOCK)
+} Run_Result;
+
+//! Exécution d'au plus \a budget instructions
+/*!
+ * Contrairement à simul(), les erreurs ne sont pas fatales : elles sont
+ * rapportées dans le résultat et la machine reste dans l'état où l'erreur
+ * l'a laissée. Sans erreur, on peut reprendre l'exécution par un nouvel
+ * appel (après \c RUN_BUDGET ou \c RUN_BREAKPOINT). L'exécution s'arrête
+ * avant une instruction marquée par un point d'arrêt, sauf s'il s'agit de
+ * la première de l'appel : reprendre après un point d'arrêt progresse donc
+ * toujours.
+ *
+ * Si un détecteur est attaché à la machine (livelock.h), l'exécution
+ * s'arrête avec \c RUN_LIVELOCK quand la machine revient dans un état déjà
+ * vu. Le cycle est alors parcouru une fois de plus (au plus \c
+ * LIVELOCK_TRACE instructions, dans la limite du budget) pour en relever la
+ * plage d'adresses. Ce parcours n'est pas compté (\c _executed, compteurs
+ * de performance), ses avertissements sont ignorés et la machine reste dans
+ * l'état où le cycle a été détecté.
+ *
+ * Il n'y a pas de trace ; la fonction peut être appelée en parallèle sur
+ * des machines distinctes depuis des threads distincts.
+ *
+ * \param pmach la machine
+ * \param budget le nombre maximal d'instructions à exécuter
+ * \return le compte rendu de l'exécution
+ */
+Run_Result run(Machine *pmach, uint64_t budget);
+
+//! Pose ou retrait d'un point d'arrêt
+/*!
+ * \param pmach la machine
+ * \param addr l'adresse de l'instruction (dans le segment de texte)
+ * \param on pose (vrai) ou retrait (faux)
+ */
+void set_breakpoint(Machine *pmach, unsigned addr, bool on);
+
 //! Forme imprimable des codes conditions
 extern const char *condition_code_names[];
 
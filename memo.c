@@ -0,0 +1,230 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "livelock.h"
+#include "memo.h"
+
+/*!
+ * \file memo.c
+ * \brief Implémentation de memo.h. Cache des résultats d'exécution.
+ *
+ * Un enregistrement est un en-tête (Record) suivi des avertissements puis,
+ * s'il est conservé, du segment de données final.
+ */
+
+//! Signature d'un enregistrement
+#define MEMO_MAGIC "SIMULRES"
+
+//! En-tête d'un enregistrement
+typedef struct
+{
+    char _magic[8];             //!< \c MEMO_MAGIC (sans nul final)
+    uint32_t _version;          //!< \c MEMO_VERSION
+    uint32_t _length;           //!< Longueur des avertissements
+    uint32_t _datasize;         //!< Mots du segment de données (0 : absent)
+
+    Run_Result _result;         //!< Compte rendu de run()
+    unsigned _pc;               //!< Compteur ordinal final
+    Condition_Code _cc;         //!< Code condition final
+    Word _registers[NREGISTERS];//!< Registres finaux
+    Counters _counters;         //!< Compteurs de performance
+} Record;
+
+//! Taille des compteurs comparés (les événements, sans les durées)
+#define COUNTED_EVENTS (offsetof(Counters, _min_sp) + sizeof(Word))
+
+bool memo_open(Memo *memo, const char *dir, uint64_t maxsize)
+{
+    memo->_maxrecord = MEMO_MAXRECORD;
+    memo->_verify = getenv("SIMUL_VERIFY")
+        ? strtoul(getenv("SIMUL_VERIFY"), NULL, 0) : MEMO_VERIFY;
+    return cache_open(&memo->_cache, dir, maxsize);
+}
+
+void memo_key(const Machine *pmach, uint64_t budget, Hash *key)
+{
+    Hash_Context ctx;
+    unsigned version = MEMO_VERSION;
+    uint64_t period = pmach->_livelock ? pmach->_livelock->_period : 0;
+    uint64_t retired = counters_retired(&pmach->_counters);
+
+    hash_init(&ctx);
+    hash_update(&ctx, "simul-result", sizeof("simul-result"));
+    hash_update(&ctx, &version, sizeof(version));
+    hash_update(&ctx, &budget, sizeof(budget));
+    hash_update(&ctx, &period, sizeof(period));
+    hash_update(&ctx, &retired, sizeof(retired));
+
+    hash_update(&ctx, &pmach->_textsize, sizeof(pmach->_textsize));
+    hash_update(&ctx, &pmach->_datasize, sizeof(pmach->_datasize));
+    hash_update(&ctx, &pmach->_dataend, sizeof(pmach->_dataend));
+    hash_update(&ctx, pmach->_text, pmach->_textsize * sizeof(Instruction));
+    hash_update(&ctx, pmach->_data, pmach->_datasize * sizeof(Word));
+
+    hash_update(&ctx, &pmach->_pc, sizeof(pmach->_pc));
+    hash_update(&ctx, &pmach->_cc, sizeof(pmach->_cc));
+    hash_update(&ctx, pmach->_registers, sizeof(pmach->_registers));
+    hash_final(&ctx, key);
+}
+
+//! Validation d'un enregistrement projeté
+/*!
+ * \return l'en-tête, ou NULL si l'enregistrement est invalide pour cette
+ * machine
+ */
+static const Record *check(const Cache_Mapping *map, const Machine *pmach)
+{
+    const Record *rec = map->_data;
+
+    if(map->_size < sizeof(Record)
+            || memcmp(rec->_magic, MEMO_MAGIC, sizeof(rec->_magic)) != 0
+            || rec->_version != MEMO_VERSION
+            || (rec->_datasize != 0 && rec->_datasize != pmach->_datasize)
+            || map->_size != sizeof(Record) + rec->_length
+                + (size_t)rec->_datasize * sizeof(Word))
+        return NULL;
+
+    return rec;
+}
+
+//! Tirage d'un succès à vérifier
+/*!
+ * Les tirages d'un même processus sont décorrélés par un compteur, ceux de
+ * processus différents par l'heure et le numéro de processus.
+ */
+static bool sample(const Memo *memo)
+{
+    static uint64_t draws = 0;
+    struct timespec now;
+
+    if(memo->_verify == 0)
+        return false;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t x = __atomic_add_fetch(&draws, 1, __ATOMIC_RELAXED)
+        * 0x9e3779b97f4a7c15ull
+        ^ (uint64_t)now.tv_nsec << 16 ^ (uint64_t)now.tv_sec
+        ^ (uint64_t)getpid() << 40;
+
+    // Mélange final de splitmix64
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    x ^= x >> 31;
+
+    return x % memo->_verify == 0;
+}
+
+Memo_Lookup memo_lookup(const Memo *memo, const Hash *key, Machine *pmach,
+                        bool data, Run_Result *result, Sink *messages)
+{
+    Cache_Mapping map;
+    const Record *rec;
+
+    if(!cache_map(&memo->_cache, key, MEMO_EXT, &map))
+        return MEMO_MISS;
+
+    if(!(rec = check(&map, pmach)) || (data && rec->_datasize == 0))
+    {
+        cache_unmap(&map);
+        return MEMO_MISS;
+    }
+
+    if(sample(memo))
+    {
+        cache_unmap(&map);
+        return MEMO_SAMPLED;
+    }
+
+    const char *bytes = (const char *)(rec + 1);
+
+    *result = rec->_result;
+    pmach->_pc = rec->_pc;
+    pmach->_cc = rec->_cc;
+    memcpy(pmach->_registers, rec->_registers, sizeof(pmach->_registers));
+    pmach->_counters = rec->_counters;
+    if(rec->_datasize)
+        memcpy(pmach->_data, bytes + rec->_length,
+                (size_t)rec->_datasize * sizeof(Word));
+    sink_write(messages ? messages : sink_stderr(), bytes, rec->_length);
+
+    cache_unmap(&map);
+    return MEMO_HIT;
+}
+
+//! Comparaison de deux enregistrements, durées exceptées
+static bool same(const Record *a, const Record *b)
+{
+    const Run_Result *ra = &a->_result, *rb = &b->_result;
+    const char *ba = (const char *)(a + 1), *bb = (const char *)(b + 1);
+
+    return ra->_status == rb->_status && ra->_executed == rb->_executed
+        && ra->_error == rb->_error && ra->_address == rb->_address
+        && ra->_first == rb->_first && ra->_last == rb->_last
+        && ra->_cycle == rb->_cycle
+        && a->_pc == b->_pc && a->_cc == b->_cc
+        && !memcmp(a->_registers, b->_registers, sizeof(a->_registers))
+        && !memcmp(&a->_counters, &b->_counters, COUNTED_EVENTS)
+        && a->_length == b->_length && !memcmp(ba, bb, a->_length)
+        && (!a->_datasize || !b->_datasize
+            || !memcmp(ba + a->_length, bb + b->_length,
+                (size_t)a->_datasize * sizeof(Word)));
+}
+
+bool memo_store(const Memo *memo, const Hash *key, const Machine *pmach,
+                const Run_Result *result, const char *messages,
+                size_t length, bool data)
+{
+    size_t words = data ? pmach->_datasize : 0;
+
+    // Trop grand : enregistré sans le segment de données
+    if(sizeof(Record) + length + words * sizeof(Word) > memo->_maxrecord)
+        words = 0;
+    if(sizeof(Record) + length > memo->_maxrecord)
+        return false;
+
+    size_t size = sizeof(Record) + length + words * sizeof(Word);
+    Record *rec = calloc(1, size);
+    if(!rec)
+        return false;
+
+    memcpy(rec->_magic, MEMO_MAGIC, sizeof(rec->_magic));
+    rec->_version = MEMO_VERSION;
+    rec->_length = length;
+    rec->_datasize = words;
+    rec->_result = *result;
+    rec->_pc = pmach->_pc;
+    rec->_cc = pmach->_cc;
+    memcpy(rec->_registers, pmach->_registers, sizeof(rec->_registers));
+    rec->_counters = pmach->_counters;
+    rec->_counters._running = false;
+    memcpy(rec + 1, messages, length);
+    memcpy((char *)(rec + 1) + length, pmach->_data, words * sizeof(Word));
+
+    // Vérification d'un enregistrement existant
+    Cache_Mapping map;
+    bool write = true;
+    if(cache_map(&memo->_cache, key, MEMO_EXT, &map))
+    {
+        const Record *old = check(&map, pmach);
+
+        if(old && same(old, rec))
+            write = old->_datasize < words;
+        else if(old)
+        {
+            char hex[HASH_HEXSIZE];
+            fprintf(stderr, "Result cache mismatch for %s: entry replaced\n",
+                    hash_hex(key, hex));
+        }
+        cache_unmap(&map);
+    }
+
+    bool ok = !write || cache_store(&memo->_cache, key, MEMO_EXT, rec, size);
+    free(rec);
+    return ok;
+}
@@ -0,0 +1,135 @@
+#ifndef _MEMO_H_
+#define _MEMO_H_
+
+/*!
+ * \file memo.h
+ * \brief Cache persistant des résultats d'exécution.
+ *
+ * Un programme simulé n'a pas d'autre entrée que l'état initial de la
+ * machine : deux exécutions du même programme, avec les mêmes options,
+ * aboutissent au même état. Le résultat d'une exécution bornée (run()) est
+ * donc conservé dans un cache (cache.h), sous l'empreinte de la version de
+ * la sémantique d'exécution, du segment de texte, du segment de données
+ * initial, des registres, du budget et de la période de détection des
+ * boucles sans progrès (livelock.h). Une nouvelle soumission du même
+ * programme obtient directement :
+ *
+ *   - le compte rendu de run() (état, erreur ou cycle) ;
+ *
+ *   - le compteur ordinal, le code condition et les registres finaux ;
+ *
+ *   - les compteurs de performance, y compris les durées de l'exécution
+ *   d'origine ;
+ *
+ *   - les avertissements émis pendant l'exécution ;
+ *
+ *   - facultativement, le segment de données final.
+ *
+ * Un enregistrement plus grand que la limite \c _maxrecord est conservé sans
+ * le segment de données. Pour détecter un enregistrement périmé (sémantique
+ * modifiée sans changement de \c MEMO_VERSION), une fraction des succès est
+ * réexécutée et comparée à l'enregistrement (memo_store()).
+ */
+
+#include "cache.h"
+#include "machine.h"
+
+//! Extension des résultats dans le cache
+#define MEMO_EXT "result"
+
+//! Version de la sémantique d'exécution, incluse dans les empreintes
+/*!
+ * À incrémenter à chaque modification qui change le résultat ou les
+ * compteurs d'une exécution.
+ */
+#define MEMO_VERSION 3
+
+//! Taille maximale par défaut d'un enregistrement (16 Mo)
+#define MEMO_MAXRECORD (16u << 20)
+
+//! Un succès sur \c MEMO_VERIFY est réexécuté par défaut
+#define MEMO_VERIFY 64
+
+//! Cache des résultats
+typedef struct
+{
+    Cache _cache;               //!< Le cache des artefacts
+    size_t _maxrecord;          //!< Taille maximale d'un enregistrement (octets)
+    unsigned _verify;           //!< Un succès sur \c _verify réexécuté (0 : aucun)
+} Memo;
+
+//! Issue d'une recherche
+typedef enum
+{
+    MEMO_MISS,          //!< Absent : le programme doit être exécuté
+    MEMO_HIT,           //!< Présent : la machine est dans l'état final
+    MEMO_SAMPLED,       //!< Présent, mais tiré pour vérification : le
+                        //!< programme doit être exécuté puis enregistré
+} Memo_Lookup;
+
+//! Ouverture (et création si besoin) d'un cache de résultats
+/*!
+ * Les limites prennent leurs valeurs par défaut ; l'appelant peut les
+ * modifier ensuite. La variable d'environnement \c SIMUL_VERIFY, si elle
+ * est définie, remplace \c MEMO_VERIFY (0 : aucune vérification).
+ *
+ * \param memo le cache à initialiser
+ * \param dir le répertoire du cache (il peut être partagé avec d'autres
+ * artefacts, les traductions natives par exemple)
+ * \param maxsize la taille totale maximale du répertoire (0 : valeur par
+ * défaut de cache_open())
+ * \return faux si le répertoire ne peut être créé
+ */
+bool memo_open(Memo *memo, const char *dir, uint64_t maxsize);
+
+//! Empreinte d'une exécution
+/*!
+ * À calculer avant l'exécution, détection des boucles sans progrès
+ * comprise (livelock_enable()).
+ *
+ * \param pmach la machine dans son état initial
+ * \param budget le budget qui sera donné à run()
+ * \param key l'empreinte obtenue
+ */
+void memo_key(const Machine *pmach, uint64_t budget, Hash *key);
+
+//! Recherche du résultat d'une exécution
+/*!
+ * En cas de succès, la machine est placée dans son état final (registres,
+ * compteurs et, s'il a été conservé, segment de données) et les
+ * avertissements enregistrés sont écrits dans \a messages.
+ *
+ * \param memo le cache
+ * \param key l'empreinte de l'exécution (memo_key())
+ * \param pmach la machine
+ * \param data le segment de données final est nécessaire : un
+ * enregistrement qui ne le contient pas est ignoré
+ * \param result le compte rendu enregistré (\c MEMO_HIT)
+ * \param messages le puits des avertissements (NULL : sink_stderr())
+ * \return l'issue de la recherche
+ */
+Memo_Lookup memo_lookup(const Memo *memo, const Hash *key, Machine *pmach,
+                        bool data, Run_Result *result, Sink *messages);
+
+//! Enregistrement du résultat d'une exécution
+/*!
+ * Si un enregistrement existe déjà (vérification d'un succès tiré par
+ * memo_lookup()), il est comparé au nouveau, durées exceptées : une
+ * différence est signalée sur la sortie d'erreur et l'enregistrement est
+ * remplacé.
+ *
+ * \param memo le cache
+ * \param key l'empreinte de l'exécution (memo_key())
+ * \param pmach la machine dans son état final
+ * \param result le compte rendu de l'exécution (\c _executed : total des
+ * instructions depuis l'état initial)
+ * \param messages les avertissements émis pendant l'exécution
+ * \param length leur longueur
+ * \param data conserver le segment de données final
+ * \return faux en cas d'erreur d'écriture
+ */
+bool memo_store(const Memo *memo, const Hash *key, const Machine *pmach,
+                const Run_Result *result, const char *messages,
+                size_t length, bool data);
+
+#endif
@@ -0,0 +1,278 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <spawn.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "native.h"
+#include "text.h"
+
+/*!
+ * \file native.c
+ * \brief Implémentation de native.h. Compilation et chargement du code traduit.
+ */
+
+#ifndef SIMUL_INCDIR
+//! Répertoire des en-têtes du simulateur (fixé par la Makefile)
+#define SIMUL_INCDIR "."
+#endif
+
+//! Options de compilation du code traduit (après le compilateur)
+#define NATIVE_CFLAGS "-std=c99 -O2 -shared -fPIC -w"
+
+//! Nombre maximal de mots de la commande de compilation
+#define NATIVE_MAXARGS 64
+
+extern char **environ;
+
+//! Compilateur du code traduit
+static const char *native_cc(void)
+{
+    const char *cc = getenv("CC");
+
+    return cc && *cc ? cc : "cc";
+}
+
+//! Ajout des mots (séparés par des blancs) de \a words aux arguments
+/*!
+ * \param words la chaîne, découpée sur place
+ * \param argv les arguments
+ * \param argc leur nombre
+ * \return le nouveau nombre d'arguments (4 places restent libres)
+ */
+static unsigned add_words(char *words, char *argv[NATIVE_MAXARGS],
+                          unsigned argc)
+{
+    char *save;
+
+    for(char *w = strtok_r(words, " \t", &save);
+            w && argc < NATIVE_MAXARGS - 4; w = strtok_r(NULL, " \t", &save))
+        argv[argc++] = w;
+
+    return argc;
+}
+
+//! Agencement des structures lues et écrites par le code traduit
+/*!
+ * Le code traduit accède aux champs de Machine et de Counters par leurs
+ * positions, figées à sa compilation : toute modification de ces
+ * structures doit invalider les traductions du cache.
+ */
+static const size_t layout[] =
+{
+    sizeof(Machine),
+    offsetof(Machine, _text),
+    offsetof(Machine, _textsize),
+    offsetof(Machine, _data),
+    offsetof(Machine, _datasize),
+    offsetof(Machine, _dataend),
+    offsetof(Machine, _pc),
+    offsetof(Machine, _cc),
+    offsetof(Machine, _registers),
+    offsetof(Machine, _counters),
+    offsetof(Machine, _depth),
+    offsetof(Machine, _calls),
+    SHADOW_DEPTH,
+    sizeof(Counters),
+    offsetof(Counters, _retired),
+    offsetof(Counters, _taken),
+    offsetof(Counters, _not_taken),
+    offsetof(Counters, _reads),
+    offsetof(Counters, _writes),
+    offsetof(Counters, _pushes),
+    offsetof(Counters, _pops),
+    offsetof(Counters, _min_sp),
+    sizeof(Instruction),
+    sizeof(Word),
+};
+
+void native_key(Machine *pmach, Hash *key)
+{
+    Hash_Context ctx;
+    unsigned version = TRANSLATOR_VERSION;
+
+    hash_init(&ctx);
+    hash_update(&ctx, "simul-translation", sizeof("simul-translation"));
+    hash_update(&ctx, &version, sizeof(version));
+    hash_update(&ctx, layout, sizeof(layout));
+
+    // La commande de compilation (compilateur, options, en-têtes)
+    const char *cc = native_cc();
+    hash_update(&ctx, cc, strlen(cc) + 1);
+    hash_update(&ctx, NATIVE_CFLAGS, sizeof(NATIVE_CFLAGS));
+    hash_update(&ctx, SIMUL_INCDIR, sizeof(SIMUL_INCDIR));
+
+    hash_update(&ctx, &pmach->_textsize, sizeof(pmach->_textsize));
+    hash_update(&ctx, pmach->_text, pmach->_textsize * sizeof(Instruction));
+    hash_final(&ctx, key);
+}
+
+//! Chargement d'une bibliothèque traduite
+/*!
+ * \param path le chemin de la bibliothèque
+ * \param lib reçoit la bibliothèque ouverte
+ * \return la fonction d'entrée, ou NULL en cas d'échec
+ */
+static Translated_Func open_library(const char *path, void **lib)
+{
+    Translated_Func run;
+
+    if(!(*lib = dlopen(path, RTLD_NOW | RTLD_LOCAL)))
+    {
+        fprintf(stderr, "Cannot load translation: %s\n", dlerror());
+        return NULL;
+    }
+
+    *(void **)&run = dlsym(*lib, TRANSLATED_ENTRY);
+    if(!run)
+    {
+        fprintf(stderr, "Bad translation %s: %s\n", path, dlerror());
+        dlclose(*lib);
+    }
+
+    return run;
+}
+
+//! Rattachement du code natif au texte partagé (s'il y en a un)
+/*!
+ * La bibliothèque est alors fermée avec le texte partagé ; sans texte
+ * partagé, elle reste ouverte jusqu'à la fin du processus.
+ */
+static Translated_Func share_native(Shared_Text *shared, Translated_Func run,
+                                    void *lib)
+{
+    if(shared && !text_attach_native(shared, *(void **)&run, lib))
+    {
+        // Déjà chargé par un autre thread : on garde le sien
+        dlclose(lib);
+        *(void **)&run = __atomic_load_n(&shared->_native, __ATOMIC_ACQUIRE);
+    }
+
+    return run;
+}
+
+//! Traduction et compilation dans un fichier temporaire du cache
+/*!
+ * \param pmach la machine contenant le programme
+ * \param cache le cache
+ * \param sopath reçoit le chemin de la bibliothèque temporaire
+ * \return faux en cas d'échec
+ */
+static bool compile_program(Machine *pmach, const Cache *cache,
+                            char sopath[CACHE_MAXPATH])
+{
+    char cpath[CACHE_MAXPATH];
+    int fd;
+
+    if((fd = cache_temporary(cache, "c", cpath)) < 0)
+        return false;
+
+    FILE *out = fdopen(fd, "w");
+    if(!out)
+    {
+        close(fd);
+        unlink(cpath);
+        return false;
+    }
+    translate_program(out, pmach, false);
+    fclose(out);
+
+    if((fd = cache_temporary(cache, NATIVE_EXT, sopath)) < 0)
+    {
+        unlink(cpath);
+        return false;
+    }
+    close(fd);
+
+    // Le compilateur est lancé sans shell : les chemins (répertoire du
+    // cache compris) ne sont jamais interprétés
+    char cc[CACHE_MAXPATH], flags[] = NATIVE_CFLAGS;
+    char include[sizeof(SIMUL_INCDIR) + 2] = "-I" SIMUL_INCDIR;
+    char *argv[NATIVE_MAXARGS];
+    unsigned argc;
+
+    snprintf(cc, sizeof(cc), "%s", native_cc());
+    argc = add_words(flags, argv, add_words(cc, argv, 0));
+    argv[argc++] = include;
+    argv[argc++] = "-o";
+    argv[argc++] = sopath;
+    argv[argc++] = cpath;
+    argv[argc] = NULL;
+
+    pid_t pid;
+    int status;
+    bool ok = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ) == 0;
+    while(ok && waitpid(pid, &status, 0) < 0)
+        ok = errno == EINTR;
+    unlink(cpath);
+
+    if(!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "Compilation of translated program failed\n");
+        unlink(sopath);
+        return false;
+    }
+
+    return true;
+}
+
+Translated_Func native_load(Machine *pmach, const Cache *cache, bool *hit)
+{
+    char path[CACHE_MAXPATH];
+    char sopath[CACHE_MAXPATH];
+    Hash key;
+
+    // Traduction déjà chargée pour le texte partagé de la machine
+    Shared_Text *shared = pmach->_shared;
+    if(shared)
+    {
+        Translated_Func run;
+        *(void **)&run = __atomic_load_n(&shared->_native, __ATOMIC_ACQUIRE);
+        if(run)
+        {
+            if(hit)
+                *hit = true;
+            return run;
+        }
+    }
+
+    native_key(pmach, &key);
+    cache_path(cache, &key, NATIVE_EXT, path);
+
+    if(hit)
+        *hit = false;
+
+    void *lib;
+
+    if(cache_lookup(cache, &key, NATIVE_EXT))
+    {
+        Translated_Func run = open_library(path, &lib);
+        if(run)
+        {
+            if(hit)
+                *hit = true;
+            return share_native(shared, run, lib);
+        }
+    }
+
+    // Absent (ou inutilisable) : on traduit, on charge, puis on installe
+    // atomiquement (le code chargé reste valide après le renommage)
+    if(!compile_program(pmach, cache, sopath))
+        return NULL;
+
+    Translated_Func run = open_library(sopath, &lib);
+    if(!run)
+    {
+        unlink(sopath);
+        return NULL;
+    }
+
+    cache_commit(cache, sopath, &key, NATIVE_EXT);
+    return share_native(shared, run, lib);
+}
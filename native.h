@@ -0,0 +1,56 @@
+#ifndef _NATIVE_H_
+#define _NATIVE_H_
+
+/*!
+ * \file native.h
+ * \brief Exécution native d'un programme traduit, avec cache persistant.
+ *
+ * Le programme est traduit en C (translate.h), compilé en bibliothèque
+ * partagée puis chargé dynamiquement. La bibliothèque est conservée dans un
+ * cache (cache.h) sous l'empreinte de la version du traducteur et des mots
+ * du segment de texte : une exécution ultérieure du même programme la charge
+ * directement (projection en mémoire par \c dlopen), sans traduction ni
+ * compilation.
+ *
+ * Le code chargé appelle error() et warning() de l'exécutable : celui-ci
+ * doit exporter ses symboles (option \c -rdynamic de l'éditeur de liens).
+ */
+
+#include "cache.h"
+#include "machine.h"
+#include "translate.h"
+
+//! Extension des artefacts de traduction dans le cache
+#define NATIVE_EXT "so"
+
+//! Clé de cache d'un programme
+/*!
+ * L'empreinte couvre le texte, la version du traducteur, l'agencement des
+ * structures Machine et Counters auxquelles accède le code traduit et la
+ * commande de compilation.
+ *
+ * \param pmach la machine contenant le programme
+ * \param key l'empreinte obtenue
+ */
+void native_key(Machine *pmach, Hash *key);
+
+//! Obtention du code natif d'un programme
+/*!
+ * En cas d'échec (compilateur absent, erreur de chargement...), un message
+ * est affiché sur la sortie d'erreur et le résultat est \c NULL : l'appelant
+ * peut alors revenir à l'interprétation par simul().
+ *
+ * Le code chargé le reste jusqu'à la fin du processus. Si le texte de la
+ * machine est partagé (text.h), le code est rattaché au texte : les autres
+ * machines qui exécutent le même programme l'obtiennent sans consulter le
+ * cache.
+ *
+ * \param pmach la machine contenant le programme
+ * \param cache le cache des traductions
+ * \param hit indique en retour si la traduction était dans le cache (peut
+ * être \c NULL)
+ * \return la fonction d'entrée du programme traduit, ou \c NULL
+ */
+Translated_Func native_load(Machine *pmach, const Cache *cache, bool *hit);
+
+#endif
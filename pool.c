@@ -0,0 +1,319 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "guard.h"
+#include "livelock.h"
+#include "pool.h"
+#include "text.h"
+
+/*!
+ * \file pool.c
+ * \brief Implémentation de pool.h. Réserve de machines recyclables.
+ *
+ * L'arène d'une machine est faite d'un segment gardé (guard.h) et d'un
+ * tableau pour l'image initiale des données, tous deux de \c _datacap mots.
+ * La capacité ne fait que croître : c'est la plus grande taille demandée
+ * jusqu'ici. Le segment de texte est interné (text.h).
+ */
+
+//! Machine gérée par une réserve
+/*!
+ * La machine est le premier champ : un pointeur sur \c Machine rendu par
+ * machine_create() est aussi un pointeur sur la structure englobante.
+ */
+typedef struct Pooled_Machine
+{
+    Machine _mach;                  //!< La machine
+    Machine_Pool *_pool;            //!< Sa réserve
+    struct Pooled_Machine *_next;   //!< Suivante dans la liste des libres
+
+    Word *_end;                     //!< Fin du segment gardé (NULL : pas d'arène)
+    unsigned _datacap;              //!< Capacité du segment de données
+    Word *_image;                   //!< Image initiale des données
+    unsigned _initsize;             //!< Taille utile de l'image
+} Pooled_Machine;
+
+struct Machine_Pool
+{
+    Pooled_Machine *_free;          //!< Machines libres
+    Pool_Stats _stats;              //!< Statistiques
+    pthread_mutex_t _lock;          //!< Verrou de la réserve
+};
+
+//! Tampon de lecture du texte d'un programme (un par thread, jamais libéré)
+static __thread Instruction *scratch;
+
+//! Capacité de \c scratch
+static __thread unsigned scratchcap;
+
+//! Réserve par défaut du processus
+static Machine_Pool *default_pool;
+
+//! Initialisation unique de la réserve par défaut
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+//! Création de la réserve par défaut
+static void create_default_pool(void)
+{
+    default_pool = pool_create();
+}
+
+Machine_Pool *pool_create(void)
+{
+    Machine_Pool *pool = calloc(1, sizeof(Machine_Pool));
+
+    if(!pool)
+        return NULL;
+
+    pthread_mutex_init(&pool->_lock, NULL);
+    return pool;
+}
+
+void pool_destroy(Machine_Pool *pool)
+{
+    while(pool->_free)
+    {
+        Pooled_Machine *pm = pool->_free;
+        pool->_free = pm->_next;
+        guard_release(pm->_end, pm->_datacap);
+        free(pm->_image);
+        free(pm);
+    }
+
+    pthread_mutex_destroy(&pool->_lock);
+    free(pool);
+}
+
+Pool_Stats pool_stats(Machine_Pool *pool)
+{
+    pthread_mutex_lock(&pool->_lock);
+    Pool_Stats stats = pool->_stats;
+    pthread_mutex_unlock(&pool->_lock);
+
+    return stats;
+}
+
+Machine *machine_create(Machine_Pool *pool)
+{
+    if(!pool)
+    {
+        pthread_once(&default_once, create_default_pool);
+        if(!(pool = default_pool))
+            return NULL;
+    }
+
+    pthread_mutex_lock(&pool->_lock);
+    Pooled_Machine *pm = pool->_free;
+    if(pm)
+    {
+        pool->_free = pm->_next;
+        --pool->_stats._idle;
+        ++pool->_stats._recycled;
+    }
+    ++pool->_stats._created;
+    pthread_mutex_unlock(&pool->_lock);
+
+    if(!pm)
+    {
+        if(!(pm = calloc(1, sizeof(Pooled_Machine))))
+            return NULL;
+        pm->_pool = pool;
+    }
+
+    memset(&pm->_mach, 0, sizeof(Machine));
+    pm->_initsize = 0;
+    return &pm->_mach;
+}
+
+//! Agrandissement de l'arène
+/*!
+ * Le contenu de l'arène n'est pas conservé.
+ *
+ * \return faux si la mémoire manque (l'arène est alors libérée)
+ */
+static bool reserve(Pooled_Machine *pm, unsigned datasize)
+{
+    if(pm->_end && datasize <= pm->_datacap)
+        return true;
+
+    guard_release(pm->_end, pm->_datacap);
+    free(pm->_image);
+    pm->_end = guard_reserve(datasize);
+    pm->_image = malloc((datasize ? datasize : 1) * sizeof(Word));
+    if(!pm->_end || !pm->_image)
+    {
+        guard_release(pm->_end, datasize);
+        free(pm->_image);
+        pm->_end = NULL;
+        pm->_image = NULL;
+        pm->_datacap = 0;
+        return false;
+    }
+
+    pm->_datacap = datasize;
+
+    pthread_mutex_lock(&pm->_pool->_lock);
+    ++pm->_pool->_stats._allocations;
+    pthread_mutex_unlock(&pm->_pool->_lock);
+
+    return true;
+}
+
+//! Segments affectés à la machine (les tailles sont déjà fixées)
+static void attach(Pooled_Machine *pm, Shared_Text *shared)
+{
+    Machine *pmach = &pm->_mach;
+
+    pmach->_shared = shared;
+    pmach->_text = shared->_text;
+    pmach->_data = pm->_end - pmach->_datasize;
+}
+
+//! Tampon de lecture d'au moins \a size instructions
+static Instruction *scratch_text(unsigned size)
+{
+    if(size > scratchcap || !scratch)
+    {
+        free(scratch);
+        scratchcap = 0;
+        if(!(scratch = malloc((size ? size : 1) * sizeof(Instruction))))
+            return NULL;
+        scratchcap = size;
+    }
+
+    return scratch;
+}
+
+//! Retour de la machine à son état initial
+static void restore(Pooled_Machine *pm)
+{
+    Machine *pmach = &pm->_mach;
+    bool *breakpoints = pmach->_breakpoints;
+    Shared_Text *shared = pmach->_shared;
+    struct Livelock *livelock = pmach->_livelock;
+    Sink *output = pmach->_output, *messages = pmach->_messages;
+    Sink *port = pmach->_port;
+
+    // Seule la partie utilisée du segment de données est écrite
+    memcpy(pmach->_data, pm->_image, pm->_initsize * sizeof(Word));
+    memset(pmach->_data + pm->_initsize, 0,
+            (pmach->_datasize - pm->_initsize) * sizeof(Word));
+
+    load_program(pmach, pmach->_textsize, pmach->_text,
+            pmach->_datasize, pmach->_data, pmach->_dataend);
+    pmach->_breakpoints = breakpoints;
+    pmach->_shared = shared;
+    pmach->_livelock = livelock;
+    pmach->_output = output;
+    pmach->_messages = messages;
+    pmach->_port = port;
+}
+
+//! Machine sans programme
+static void unload(Pooled_Machine *pm)
+{
+    Machine *pmach = &pm->_mach;
+
+    free(pmach->_breakpoints);
+    text_release(pmach->_shared);
+    livelock_disable(pmach);
+    memset(pmach, 0, sizeof(Machine));
+    pm->_initsize = 0;
+}
+
+bool machine_load(Machine *pmach,
+                  unsigned textsize, const Instruction *text,
+                  unsigned datasize, unsigned initsize, const Word *data,
+                  unsigned dataend)
+{
+    Pooled_Machine *pm = (Pooled_Machine *)pmach;
+
+    unload(pm);
+    if(initsize > datasize)
+        initsize = datasize;
+
+    Shared_Text *shared;
+    if(!reserve(pm, datasize) || !(shared = text_intern(text, textsize)))
+        return false;
+
+    memcpy(pm->_image, data, initsize * sizeof(Word));
+    pm->_initsize = initsize;
+
+    pmach->_textsize = textsize;
+    pmach->_datasize = datasize;
+    pmach->_dataend = dataend;
+    attach(pm, shared);
+    restore(pm);
+
+    return true;
+}
+
+bool machine_read(Machine *pmach, const char *programfile)
+{
+    FILE *file = fopen(programfile, "r");
+
+    if(!file)
+    {
+        unload((Pooled_Machine *)pmach);
+        return false;
+    }
+
+    bool ok = machine_read_stream(pmach, file, -1);
+    fclose(file);
+    return ok;
+}
+
+bool machine_read_stream(Machine *pmach, FILE *file, long length)
+{
+    Pooled_Machine *pm = (Pooled_Machine *)pmach;
+    Program_Header hdr;
+
+    unload(pm);
+
+    // L'image initiale est lue directement dans l'arène ; le texte n'est
+    // copié que s'il n'est pas déjà interné
+    Instruction *text = NULL;
+    bool ok = read_program_header_length(file, length, &hdr)
+        && reserve(pm, hdr._datasize)
+        && (text = scratch_text(hdr._textsize))
+        && read_program_body(file, &hdr, text, pm->_image);
+
+    Shared_Text *shared;
+    if(!ok || !(shared = text_intern(text, hdr._textsize)))
+        return false;
+
+    pm->_initsize = hdr._initsize;
+    pmach->_textsize = hdr._textsize;
+    pmach->_datasize = hdr._datasize;
+    pmach->_dataend = hdr._dataend;
+    attach(pm, shared);
+    restore(pm);
+
+    return true;
+}
+
+void machine_reset(Machine *pmach)
+{
+    Pooled_Machine *pm = (Pooled_Machine *)pmach;
+
+    if(pmach->_shared)
+        restore(pm);
+}
+
+void machine_destroy(Machine *pmach)
+{
+    Pooled_Machine *pm = (Pooled_Machine *)pmach;
+
+    if(!pmach)
+        return;
+
+    Machine_Pool *pool = pm->_pool;
+    unload(pm);
+
+    pthread_mutex_lock(&pool->_lock);
+    pm->_next = pool->_free;
+    pool->_free = pm;
+    ++pool->_stats._idle;
+    pthread_mutex_unlock(&pool->_lock);
+}
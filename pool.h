@@ -0,0 +1,118 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+/*!
+ * \file pool.h
+ * \brief Cycle de vie des machines et réserve de machines recyclables.
+ *
+ * Une machine créée par machine_create() possède son segment de données :
+ * il est pris dans l'\e arène de la machine, un segment gardé (guard.h)
+ * accompagné d'une copie de l'image initiale des données. Le segment de
+ * texte est partagé entre toutes les machines qui exécutent le même
+ * programme (text.h) ; il n'est jamais modifié. Détruire la machine la rend
+ * à sa réserve sans libérer son arène ; la machine suivante la réutilise,
+ * et l'arène n'est agrandie que si le programme chargé dépasse le plus grand
+ * programme déjà chargé. En régime
+ * établi (traitement par lots de programmes de tailles comparables), créer,
+ * charger, exécuter et détruire une machine n'alloue donc rien.
+ *
+ * Au chargement comme à la réinitialisation, seuls les mots utilisés par le
+ * programme sont écrits (copie de l'image initiale, puis mise à zéro de la
+ * fin de la pile) ; le reste de l'arène n'est pas touché.
+ *
+ * Les fonctions peuvent être appelées depuis plusieurs threads : une
+ * réserve est protégée par un verrou, pris seulement à la création et à la
+ * destruction des machines.
+ */
+
+#include "machine.h"
+
+//! Réserve de machines
+typedef struct Machine_Pool Machine_Pool;
+
+//! Statistiques d'une réserve
+typedef struct
+{
+    unsigned long _created;     //!< Machines créées
+    unsigned long _recycled;    //!< ... dont machines réutilisées
+    unsigned long _allocations; //!< Allocations de blocs (ou agrandissements)
+    unsigned _idle;             //!< Machines libres dans la réserve
+} Pool_Stats;
+
+//! Création d'une réserve
+/*!
+ * \return la réserve, ou NULL si la mémoire manque
+ */
+Machine_Pool *pool_create(void);
+
+//! Destruction d'une réserve
+/*!
+ * Les machines libres sont libérées. Les machines encore en service doivent
+ * avoir été détruites auparavant.
+ */
+void pool_destroy(Machine_Pool *pool);
+
+//! Statistiques d'une réserve
+Pool_Stats pool_stats(Machine_Pool *pool);
+
+//! Création d'une machine (sans programme)
+/*!
+ * \param pool la réserve (NULL : réserve par défaut du processus)
+ * \return la machine, ou NULL si la mémoire manque
+ */
+Machine *machine_create(Machine_Pool *pool);
+
+//! Chargement d'un programme par copie
+/*!
+ * Le segment de texte est interné (il n'est recopié que s'il ne l'est pas
+ * déjà) ; les données sont recopiées dans l'arène de la machine, qui peut
+ * ensuite être réinitialisée par machine_reset(). Le segment de données a
+ * \a datasize mots dont les \a initsize premiers sont fournis par \a data ;
+ * les autres sont nuls. Les points d'arrêt sont supprimés.
+ *
+ * \param pmach une machine créée par machine_create()
+ * \param textsize taille du segment de texte
+ * \param text le contenu du segment de texte
+ * \param datasize taille du segment de données
+ * \param initsize nombre de mots fournis dans \a data
+ * \param data le contenu initial du segment de données
+ * \param dataend première adresse libre après les données statiques
+ * \return faux si la mémoire manque
+ */
+bool machine_load(Machine *pmach,
+                  unsigned textsize, const Instruction *text,
+                  unsigned datasize, unsigned initsize, const Word *data,
+                  unsigned dataend);
+
+//! Lecture d'un programme binaire (voir read_program())
+/*!
+ * \param pmach une machine créée par machine_create()
+ * \param programfile le nom du fichier binaire
+ * \return faux si le fichier est illisible ou si la mémoire manque (la
+ * machine est alors sans programme)
+ */
+bool machine_read(Machine *pmach, const char *programfile);
+
+//! Lecture d'un programme binaire depuis un flot déjà ouvert
+/*!
+ * \param pmach une machine créée par machine_create()
+ * \param file le flot, positionné au début du programme (il n'est pas
+ * fermé)
+ * \param length la taille du programme en octets, si elle est connue (-1 :
+ * taille du fichier s'il est régulier ; voir read_program_header_length())
+ * \return faux si le programme est invalide ou si la mémoire manque (la
+ * machine est alors sans programme)
+ */
+bool machine_read_stream(Machine *pmach, FILE *file, long length);
+
+//! Retour à l'état qui suit le chargement
+/*!
+ * Les données, les registres et les compteurs de performance sont
+ * réinitialisés ; les points d'arrêt sont conservés.
+ */
+void machine_reset(Machine *pmach);
+
+//! Destruction d'une machine (rendue à sa réserve)
+void machine_destroy(Machine *pmach);
+
+#endif
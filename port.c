@@ -0,0 +1,24 @@
+#include "error.h"
+#include "port.h"
+
+/*!
+ * \file port.c
+ * \brief Implémentation de port.h. Port de sortie.
+ */
+
+void port_store(Machine *pmach, unsigned addr, Word value, unsigned pc)
+{
+    if(addr == PORT_WRITE)
+    {
+        ++pmach->_portwords;
+        if(pmach->_port)
+            sink_write(pmach->_port, (const char *)&value, sizeof(value));
+    }
+    else if(addr == PORT_FLUSH)
+    {
+        if(pmach->_port)
+            sink_flush(pmach->_port);
+    }
+    else
+        error(ERR_SEGDATA, pc);
+}
@@ -0,0 +1,57 @@
+#ifndef _PORT_H_
+#define _PORT_H_
+
+/*!
+ * \file port.h
+ * \brief Port de sortie projeté en mémoire.
+ *
+ * Les deux dernières adresses absolues (20 bits) ne sont pas des mots du
+ * segment de données mais les registres d'un périphérique de sortie :
+ *
+ *   - un \c STORE à l'adresse \c PORT_WRITE ajoute le mot au canal de
+ *   sortie de la machine ;
+ *
+ *   - un \c STORE à l'adresse \c PORT_FLUSH (valeur ignorée) transmet
+ *   immédiatement les mots en attente.
+ *
+ * Le canal est un puits (sink.h, champ \c _port de Machine) : un fichier ou
+ * un tube, écrit par lots, ou une fonction de rappel. Chaque mot y est
+ * écrit en binaire (4 octets, ordre de l'hôte). Un programme peut ainsi
+ * produire ses résultats au fil de l'exécution, sans que l'on relise le
+ * segment de données après \c HALT. Sans canal, les mots sont ignorés : le
+ * programme s'exécute de la même façon, que sa sortie soit lue ou non.
+ *
+ * Seul \c STORE écrit sur le port ; toute autre instruction qui y accède
+ * (\c LOAD, \c POP, \c XCHG...) provoque \c ERR_SEGDATA comme auparavant.
+ * Le port n'est accessible qu'aux machines dont le segment de données ne
+ * recouvre pas ses adresses. L'accès n'ajoute rien au chemin rapide de \c
+ * STORE : le port n'est examiné que pour une adresse hors du segment, qui
+ * était jusque-là une erreur.
+ *
+ * Les processeurs d'une machine SMP (smp.h) n'ont pas de canal.
+ */
+
+#include "machine.h"
+
+//! Écriture d'un mot sur le canal de sortie
+#define PORT_WRITE 0xffffeu
+
+//! Transmission des mots en attente
+#define PORT_FLUSH 0xfffffu
+
+//! Taille par défaut d'un lot du canal (octets)
+#define PORT_BATCH 4096
+
+//! Écriture hors du segment de données (\c STORE)
+/*!
+ * Appelée par l'interpréteur et le code traduit quand l'adresse d'un \c
+ * STORE n'est pas dans le segment de données.
+ *
+ * \param pmach la machine
+ * \param addr l'adresse écrite
+ * \param value le mot écrit
+ * \param pc l'adresse de l'instruction (pour \c ERR_SEGDATA)
+ */
+void port_store(Machine *pmach, unsigned addr, Word value, unsigned pc);
+
+#endif
@@ -0,0 +1,250 @@
+#define _XOPEN_SOURCE 700
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "profile.h"
+
+/*!
+ * \file profile.c
+ * \brief Implémentation de profile.h. Échantillonneur.
+ *
+ * Les piles sont rangées dans une table à adressage ouvert. Le gestionnaire
+ * de signal réserve une case libre par comparaison-échange sur l'empreinte
+ * de la pile, la remplit, puis la marque prête ; une case réservée mais pas
+ * encore prête n'est pas comparée (deux cases peuvent alors décrire la même
+ * pile, ce que les outils de graphes de flammes admettent).
+ */
+
+//! Pile échantillonnée
+typedef struct
+{
+    uint32_t _hash;                 //!< Empreinte (0 : case libre)
+    uint32_t _ready;                //!< Case remplie ?
+    uint64_t _count;                //!< Nombre d'échantillons
+    unsigned _depth;                //!< Nombre d'appels (tronqué ou non)
+    unsigned _leaf;                 //!< Adresse de l'instruction en cours
+    unsigned _calls[SHADOW_DEPTH];  //!< Cibles des appels
+} Profile_Stack;
+
+//! État de l'échantillonneur
+static struct
+{
+    bool _active;               //!< Échantillonnage en cours ?
+    unsigned _textsize;         //!< Taille de l'histogramme
+    uint64_t *_histogram;       //!< Échantillons par adresse
+    Profile_Stack *_stacks;     //!< Piles distinctes
+    uint64_t _samples;          //!< Échantillons dans une machine
+    uint64_t _outside;          //!< Échantillons hors de toute machine
+    uint64_t _dropped;          //!< Piles perdues (table pleine)
+} profile;
+
+//! Empreinte d'une pile (jamais nulle)
+static uint32_t stack_hash(unsigned depth, const unsigned *calls, unsigned leaf)
+{
+    uint32_t h = 2166136261u;
+
+    h = (h ^ depth) * 16777619u;
+    for(unsigned i = 0; i < depth && i < SHADOW_DEPTH; ++i)
+        h = (h ^ calls[i]) * 16777619u;
+    h = (h ^ leaf) * 16777619u;
+
+    return h ? h : 1;
+}
+
+//! Comptage d'une pile
+static void record_stack(unsigned depth, const unsigned *calls, unsigned leaf)
+{
+    unsigned n = depth < SHADOW_DEPTH ? depth : SHADOW_DEPTH;
+    uint32_t h = stack_hash(depth, calls, leaf);
+
+    for(unsigned probe = 0, i = h % PROFILE_STACKS; probe < PROFILE_STACKS;
+            ++probe, i = (i + 1) % PROFILE_STACKS)
+    {
+        Profile_Stack *s = &profile._stacks[i];
+        uint32_t found = __atomic_load_n(&s->_hash, __ATOMIC_ACQUIRE);
+
+        if(found == 0)
+        {
+            if(__atomic_compare_exchange_n(&s->_hash, &found, h, false,
+                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                s->_depth = depth;
+                s->_leaf = leaf;
+                memcpy(s->_calls, calls, n * sizeof(unsigned));
+                __atomic_store_n(&s->_count, 1, __ATOMIC_RELAXED);
+                __atomic_store_n(&s->_ready, 1, __ATOMIC_RELEASE);
+                return;
+            }
+        }
+
+        if(found == h && __atomic_load_n(&s->_ready, __ATOMIC_ACQUIRE)
+                && s->_depth == depth && s->_leaf == leaf
+                && !memcmp(s->_calls, calls, n * sizeof(unsigned)))
+        {
+            __atomic_add_fetch(&s->_count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    __atomic_add_fetch(&profile._dropped, 1, __ATOMIC_RELAXED);
+}
+
+//! Gestionnaire de \c SIGPROF
+static void on_sample(int sig)
+{
+    Machine *pmach = machine_current();
+    (void)sig;
+
+    if(!profile._active)
+        return;
+
+    if(!pmach)
+    {
+        __atomic_add_fetch(&profile._outside, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // L'instruction suivante : après un CALL ou un RET, elle est cohérente
+    // avec la pile fantôme
+    unsigned addr = pmach->_pc;
+    unsigned depth = pmach->_depth;
+    unsigned calls[SHADOW_DEPTH];
+
+    memcpy(calls, pmach->_calls, sizeof(calls));
+
+    __atomic_add_fetch(&profile._samples, 1, __ATOMIC_RELAXED);
+    if(addr < profile._textsize)
+        __atomic_add_fetch(&profile._histogram[addr], 1, __ATOMIC_RELAXED);
+    record_stack(depth, calls, addr);
+}
+
+bool profile_start(unsigned hz, unsigned textsize)
+{
+    struct sigaction sa;
+    struct itimerval timer;
+
+    if(hz == 0)
+        hz = PROFILE_DEFAULT_HZ;
+
+    free(profile._histogram);
+    free(profile._stacks);
+    memset(&profile, 0, sizeof(profile));
+
+    profile._textsize = textsize;
+    profile._histogram = calloc(textsize ? textsize : 1, sizeof(uint64_t));
+    profile._stacks = calloc(PROFILE_STACKS, sizeof(Profile_Stack));
+    if(!profile._histogram || !profile._stacks)
+        return false;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sample;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(SIGPROF, &sa, NULL) != 0)
+        return false;
+
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / hz ? 1000000 / hz : 1;
+    timer.it_value = timer.it_interval;
+
+    profile._active = true;
+    if(setitimer(ITIMER_PROF, &timer, NULL) != 0)
+    {
+        profile._active = false;
+        return false;
+    }
+
+    return true;
+}
+
+void profile_stop(void)
+{
+    struct itimerval timer;
+
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    profile._active = false;
+}
+
+//! Ordre décroissant des échantillons (pour qsort)
+static int by_samples(const void *a, const void *b)
+{
+    uint64_t na = profile._histogram[*(const unsigned *)a];
+    uint64_t nb = profile._histogram[*(const unsigned *)b];
+
+    return na < nb ? 1 : na > nb ? -1
+        : *(const unsigned *)a < *(const unsigned *)b ? -1 : 1;
+}
+
+void profile_write_histogram(FILE *out, const Instruction *text,
+                             const Symbol_Map *map)
+{
+    unsigned *order = malloc((profile._textsize ? profile._textsize : 1)
+            * sizeof(unsigned));
+    unsigned n = 0;
+
+    fprintf(out, "# %llu samples (%llu outside the simulated program, "
+            "%llu stacks dropped)\n",
+            (unsigned long long)profile._samples,
+            (unsigned long long)profile._outside,
+            (unsigned long long)profile._dropped);
+    if(!order)
+        return;
+
+    for(unsigned addr = 0; addr < profile._textsize; ++addr)
+        if(profile._histogram[addr])
+            order[n++] = addr;
+    qsort(order, n, sizeof(unsigned), by_samples);
+
+    for(unsigned i = 0; i < n; ++i)
+    {
+        char buf[DISASM_MAXLEN];
+        const char *label = symbol_map_text(map, order[i]);
+        uint64_t count = profile._histogram[order[i]];
+
+        disasm_instruction(buf, text[order[i]], map);
+        fprintf(out, "0x%04x %10llu %6.2f%%  %-12s %s\n", order[i],
+                (unsigned long long)count, 100.0 * count / profile._samples,
+                label ? label : "", buf);
+    }
+
+    free(order);
+}
+
+//! Écriture d'une adresse de texte (étiquette ou adresse)
+static void write_frame(FILE *out, unsigned addr, const Symbol_Map *map)
+{
+    const char *label = symbol_map_text(map, addr);
+
+    if(label)
+        fputs(label, out);
+    else
+        fprintf(out, "0x%04x", addr);
+}
+
+void profile_write_folded(FILE *out, const Symbol_Map *map)
+{
+    for(unsigned i = 0; i < PROFILE_STACKS; ++i)
+    {
+        const Profile_Stack *s = &profile._stacks[i];
+
+        if(!s->_ready)
+            continue;
+
+        fputs("main", out);
+        for(unsigned d = 0; d < s->_depth && d < SHADOW_DEPTH; ++d)
+        {
+            fputc(';', out);
+            write_frame(out, s->_calls[d], map);
+        }
+        if(s->_depth > SHADOW_DEPTH)
+            fputs(";[...]", out);
+
+        fputc(';', out);
+        fprintf(out, "0x%04x", s->_leaf);
+        fprintf(out, " %llu\n", (unsigned long long)s->_count);
+    }
+}
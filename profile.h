@@ -0,0 +1,77 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+/*!
+ * \file profile.h
+ * \brief Profilage par échantillonnage du programme simulé.
+ *
+ * Un temporisateur de l'hôte (\c setitimer, \c ITIMER_PROF) interrompt
+ * périodiquement le processus par \c SIGPROF. À chaque interruption, on
+ * relève la machine \e publiée par le thread interrompu : son compteur
+ * ordinal \c _pc, que l'interpréteur comme le code traduit mettent à jour
+ * à chaque instruction, et sa pile d'appels fantôme (\c _calls, tenue à
+ * jour par \c CALL et \c RET). Le compteur ordinal désigne l'instruction
+ * suivante : comme avec les compteurs matériels d'un processeur,
+ * l'échantillon est attribué avec un décalage d'au plus une instruction.
+ * On obtient :
+ *
+ *   - un histogramme des échantillons par adresse d'instruction ;
+ *
+ *   - des piles repliées (<em>folded stacks</em>) : une ligne
+ *   <tt>appel;appel;...;adresse nombre</tt> par pile distincte, au format
+ *   attendu par les outils de graphes de flammes (\c flamegraph.pl).
+ *
+ * Le profilage ne coûte rien par instruction : le moteur d'exécution publie
+ * sa machine une fois par appel (machine_enter()), et le gestionnaire de
+ * signal ne fait que des incréments atomiques dans des tables allouées
+ * d'avance. Il fonctionne avec tous les moteurs (simul(), run(), code
+ * traduit, machines SMP ou ordonnancées).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "machine.h"
+#include "disasm.h"
+
+//! Fréquence d'échantillonnage par défaut (Hz)
+#define PROFILE_DEFAULT_HZ 997
+
+//! Nombre maximal de piles distinctes
+#define PROFILE_STACKS 4096
+
+//! Démarrage de l'échantillonnage
+/*!
+ * \param hz la fréquence d'échantillonnage (0 : \c PROFILE_DEFAULT_HZ)
+ * \param textsize la taille du segment de texte profilé (les échantillons
+ * au-delà ne figurent que dans les piles)
+ * \return faux si la mémoire manque ou si le temporisateur ne peut être armé
+ */
+bool profile_start(unsigned hz, unsigned textsize);
+
+//! Arrêt de l'échantillonnage (les résultats sont conservés)
+void profile_stop(void);
+
+//! Écriture de l'histogramme
+/*!
+ * Les adresses sont triées par nombre d'échantillons décroissant ; chacune
+ * est suivie de l'instruction désassemblée.
+ *
+ * \param out le flot de sortie
+ * \param text le segment de texte profilé
+ * \param map la table des symboles (ou NULL)
+ */
+void profile_write_histogram(FILE *out, const Instruction *text,
+                             const Symbol_Map *map);
+
+//! Écriture des piles repliées
+/*!
+ * Les appels sont désignés par l'étiquette de leur cible si \a map en
+ * donne une, par leur adresse sinon ; la racine est \c main.
+ *
+ * \param out le flot de sortie
+ * \param map la table des symboles (ou NULL)
+ */
+void profile_write_folded(FILE *out, const Symbol_Map *map);
+
+#endif
@@ -0,0 +1,138 @@
+/*!
+ * \file sasm.c
+ * \brief Assembleur en flot : programme principal
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "assembler.h"
+
+//! Help message.
+/*!
+ * Printed with option \c -h.
+ */
+static void usage()
+{
+    printf("Usage: sasm [options] [asmfile]\n");
+    printf("where options are:\n"
+            "\t-o file\tOutput binary file (default: output.bin)\n"
+            "\t-s file\tWrite the symbol table into file\n"
+            "\t-g\tInclude the symbol table in the binary file\n"
+            "\t-z\tCompress the data segment\n"
+            "\t-L\tWrite the legacy binary format (no header, no checksums)\n"
+            "\t-v\tPrint assembly statistics\n"
+            "\t-h\tprint this help message\n"
+            "If no asmfile is given, the source is read from the standard input.\n");
+}
+
+//! Écriture d'un symbole dans le fichier des symboles
+static void write_symbol(const char *name, Word value, Asm_Section sect,
+        void *ctx)
+{
+    fprintf((FILE *)ctx, "%s 0x%08x %s\n", name, value, asm_section_names[sect]);
+}
+
+//! Programme principal de l'assembleur
+int main(int argc, char *argv[])
+{
+    const char *outfile = "output.bin";
+    const char *symfile = NULL;
+    const char *asmfile = NULL;
+    bool verbose = false;
+    unsigned flags = 0;
+
+    for(int iarg = 1; iarg < argc; ++iarg)
+    {
+        if(argv[iarg][0] == '-' && argv[iarg][1] != '\0')
+            switch(argv[iarg][1])
+            {
+                case 'o':
+                case 's':
+                    if(iarg + 1 >= argc)
+                    {
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    if(argv[iarg][1] == 'o')
+                        outfile = argv[++iarg];
+                    else
+                        symfile = argv[++iarg];
+                    break;
+                case 'v':
+                    verbose = true;
+                    break;
+                case 'g':
+                    flags |= ASM_SYMBOLS;
+                    break;
+                case 'z':
+                    flags |= ASM_COMPRESS;
+                    break;
+                case 'L':
+                    flags |= ASM_LEGACY;
+                    break;
+                case 'h':
+                    usage();
+                    exit(EXIT_SUCCESS);
+                default:
+                    fprintf(stderr, "Unknown option: %s\n", argv[iarg]);
+                    usage();
+                    exit(EXIT_FAILURE);
+            }
+        else
+            asmfile = argv[iarg];
+    }
+
+    FILE *in = stdin;
+    if(asmfile && !(in = fopen(asmfile, "r")))
+    {
+        fprintf(stderr, "Ouverture du fichier \"%s\" impossible.\n", asmfile);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *out = strcmp(outfile, "-") == 0 ? stdout : fopen(outfile, "w+");
+    if(!out)
+    {
+        fprintf(stderr, "Ecriture du fichier \"%s\" impossible.\n", outfile);
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *sym = NULL;
+    if(symfile && !(sym = fopen(symfile, "w")))
+    {
+        fprintf(stderr, "Ecriture du fichier \"%s\" impossible.\n", symfile);
+        exit(EXIT_FAILURE);
+    }
+
+    Asm_Stats stats;
+    clock_t start = clock();
+    unsigned errors = assemble_stream(in, asmfile ? asmfile : "<stdin>", out,
+            flags, sym ? write_symbol : NULL, sym, &stats);
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if(in != stdin)
+        fclose(in);
+    if(sym)
+        fclose(sym);
+    if(out != stdout)
+        fclose(out);
+
+    if(errors)
+    {
+        fprintf(stderr, "%u error(s)\n", errors);
+        if(out != stdout)
+            remove(outfile);
+        exit(EXIT_FAILURE);
+    }
+
+    if(verbose)
+        fprintf(stderr, "%u lines, text size %u, data size %u, data end %u, "
+                "%u symbols, %u fixups (max pending %u), %.3f s\n",
+                stats._lines, stats._textsize, stats._datasize,
+                stats._dataend, stats._symbols, stats._fixups,
+                stats._max_pending, seconds);
+
+    return 0;
+}
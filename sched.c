@@ -0,0 +1,288 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "sched.h"
+
+/*!
+ * \file sched.c
+ * \brief Implémentation de sched.h. Ordonnanceur de machines.
+ *
+ * Les travaux prêts forment un tas binaire ordonné par (priorité, ordre
+ * d'arrivée). Un seul verrou protège le tas et les compteurs globaux ; il
+ * n'est pris qu'entre deux tranches, jamais pendant l'exécution.
+ */
+
+const char *job_state_names[] =
+{
+    "READY",
+    "RUNNING",
+    "HALTED",
+    "FAULTED",
+    "BREAKPOINT",
+    "QUOTA",
+    "CAPPED",
+    "LIVELOCK",
+};
+
+struct Scheduler
+{
+    Sched_Policy _policy;       //!< Politique
+    uint64_t _slice;            //!< Taille des tranches
+    uint64_t _cap;              //!< Plafond global (0 : illimité)
+    uint64_t _executed;         //!< Instructions exécutées (tous travaux)
+    uint64_t _reserved;         //!< Instructions réservées par les tranches en cours
+    uint64_t _sequence;         //!< Prochain numéro d'arrivée
+    unsigned _nfinished;        //!< Travaux terminés ou arrêtés
+
+    unsigned _nworkers;         //!< Nombre de threads
+
+    Sched_Job **_jobs;          //!< Tous les travaux soumis
+    unsigned _njobs;            //!< Nombre de travaux
+    unsigned _capacity;         //!< Taille allouée de \c _jobs et \c _heap
+
+    Sched_Job **_heap;          //!< Travaux prêts (tas)
+    unsigned _nready;           //!< Nombre de travaux prêts
+    unsigned _nrunning;         //!< Nombre de travaux en cours
+
+    pthread_mutex_t _lock;      //!< Verrou de l'ordonnanceur
+    pthread_cond_t _changed;    //!< Un travail a changé d'état
+};
+
+//! Le travail \a a doit-il passer avant \a b ?
+static bool job_before(const Scheduler *psched, const Sched_Job *a,
+                       const Sched_Job *b)
+{
+    if(psched->_policy == SCHED_PRIORITY && a->_priority != b->_priority)
+        return a->_priority > b->_priority;
+
+    return a->_sequence < b->_sequence;
+}
+
+//! Ajout d'un travail prêt
+static void heap_push(Scheduler *psched, Sched_Job *job)
+{
+    Sched_Job **heap = psched->_heap;
+    unsigned i = psched->_nready++;
+
+    job->_state = JOB_READY;
+    job->_sequence = psched->_sequence++;
+
+    for(; i > 0 && job_before(psched, job, heap[(i - 1) / 2]); i = (i - 1) / 2)
+        heap[i] = heap[(i - 1) / 2];
+    heap[i] = job;
+}
+
+//! Retrait du prochain travail prêt
+static Sched_Job *heap_pop(Scheduler *psched)
+{
+    Sched_Job **heap = psched->_heap;
+    Sched_Job *top = heap[0];
+    Sched_Job *last = heap[--psched->_nready];
+    unsigned n = psched->_nready, i = 0;
+
+    for(unsigned child; (child = 2 * i + 1) < n; i = child)
+    {
+        if(child + 1 < n && job_before(psched, heap[child + 1], heap[child]))
+            ++child;
+        if(!job_before(psched, heap[child], last))
+            break;
+        heap[i] = heap[child];
+    }
+    if(n > 0)
+        heap[i] = last;
+
+    return top;
+}
+
+Scheduler *sched_create(unsigned nworkers, Sched_Policy policy,
+                        uint64_t slice, uint64_t cap)
+{
+    Scheduler *psched = calloc(1, sizeof(Scheduler));
+
+    if(!psched)
+        return NULL;
+
+    psched->_policy = policy;
+    psched->_slice = slice ? slice : SCHED_DEFAULT_SLICE;
+    psched->_cap = cap;
+    psched->_nworkers = nworkers ? nworkers : 1;
+    pthread_mutex_init(&psched->_lock, NULL);
+    pthread_cond_init(&psched->_changed, NULL);
+
+    return psched;
+}
+
+Sched_Job *sched_submit(Scheduler *psched, Machine *pmach, unsigned priority,
+                        uint64_t quota)
+{
+    if(psched->_njobs == psched->_capacity)
+    {
+        unsigned capacity = psched->_capacity ? 2 * psched->_capacity : 64;
+        Sched_Job **jobs = realloc(psched->_jobs, capacity * sizeof(Sched_Job *));
+        if(!jobs)
+            return NULL;
+        psched->_jobs = jobs;
+
+        Sched_Job **heap = realloc(psched->_heap, capacity * sizeof(Sched_Job *));
+        if(!heap)
+            return NULL;
+        psched->_heap = heap;
+
+        psched->_capacity = capacity;
+    }
+
+    Sched_Job *job = calloc(1, sizeof(Sched_Job));
+    if(!job)
+        return NULL;
+
+    job->_machine = pmach;
+    job->_priority = priority;
+    job->_quota = quota;
+
+    psched->_jobs[psched->_njobs++] = job;
+    heap_push(psched, job);
+
+    return job;
+}
+
+//! Fin d'un travail (verrou pris)
+static void finish(Scheduler *psched, Sched_Job *job, Job_State state)
+{
+    job->_state = state;
+    job->_finished = ++psched->_nfinished;
+}
+
+//! Taille de la prochaine tranche d'un travail (verrou pris)
+/*!
+ * La tranche est réservée sur le plafond global.
+ *
+ * \return la taille, ou 0 si le travail doit être arrêté (son état est
+ * alors mis à jour)
+ */
+static uint64_t reserve_slice(Scheduler *psched, Sched_Job *job)
+{
+    uint64_t budget = psched->_slice;
+
+    if(job->_quota)
+    {
+        if(job->_executed >= job->_quota)
+        {
+            finish(psched, job, JOB_QUOTA);
+            return 0;
+        }
+        if(job->_quota - job->_executed < budget)
+            budget = job->_quota - job->_executed;
+    }
+
+    if(psched->_cap)
+    {
+        uint64_t used = psched->_executed + psched->_reserved;
+        if(used >= psched->_cap)
+        {
+            finish(psched, job, JOB_CAPPED);
+            return 0;
+        }
+        if(psched->_cap - used < budget)
+            budget = psched->_cap - used;
+    }
+
+    psched->_reserved += budget;
+    job->_state = JOB_RUNNING;
+    return budget;
+}
+
+//! Fin d'une tranche (verrou pris)
+static void finish_slice(Scheduler *psched, Sched_Job *job, uint64_t budget)
+{
+    psched->_reserved -= budget;
+    psched->_executed += job->_result._executed;
+    job->_executed += job->_result._executed;
+
+    switch(job->_result._status)
+    {
+        case RUN_HALTED:
+            finish(psched, job, JOB_HALTED);
+            break;
+
+        case RUN_FAULTED:
+            finish(psched, job, JOB_FAULTED);
+            break;
+
+        case RUN_BREAKPOINT:
+            finish(psched, job, JOB_BREAKPOINT);
+            break;
+
+        case RUN_LIVELOCK:
+            finish(psched, job, JOB_LIVELOCK);
+            break;
+
+        case RUN_BUDGET:
+            heap_push(psched, job);
+            break;
+    }
+}
+
+//! Thread d'exécution
+static void *worker(void *arg)
+{
+    Scheduler *psched = arg;
+
+    pthread_mutex_lock(&psched->_lock);
+    while(true)
+    {
+        // Plus rien de prêt : on attend les tranches en cours
+        while(psched->_nready == 0 && psched->_nrunning > 0)
+            pthread_cond_wait(&psched->_changed, &psched->_lock);
+
+        if(psched->_nready == 0)
+            break;
+
+        Sched_Job *job = heap_pop(psched);
+        uint64_t budget = reserve_slice(psched, job);
+        if(budget == 0)
+            continue;
+
+        ++psched->_nrunning;
+        pthread_mutex_unlock(&psched->_lock);
+
+        job->_result = run(job->_machine, budget);
+
+        pthread_mutex_lock(&psched->_lock);
+        --psched->_nrunning;
+        finish_slice(psched, job, budget);
+        pthread_cond_broadcast(&psched->_changed);
+    }
+    pthread_mutex_unlock(&psched->_lock);
+
+    return NULL;
+}
+
+uint64_t sched_run(Scheduler *psched)
+{
+    pthread_t threads[psched->_nworkers];
+    unsigned started = 0;
+
+    // Le thread appelant est l'un des threads d'exécution
+    while(started + 1 < psched->_nworkers
+            && pthread_create(&threads[started], NULL, worker, psched) == 0)
+        ++started;
+
+    worker(psched);
+
+    for(unsigned i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    return psched->_executed;
+}
+
+void sched_destroy(Scheduler *psched)
+{
+    for(unsigned i = 0; i < psched->_njobs; ++i)
+        free(psched->_jobs[i]);
+
+    free(psched->_jobs);
+    free(psched->_heap);
+    pthread_mutex_destroy(&psched->_lock);
+    pthread_cond_destroy(&psched->_changed);
+    free(psched);
+}
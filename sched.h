@@ -0,0 +1,112 @@
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+/*!
+ * \file sched.h
+ * \brief Ordonnancement coopératif de nombreuses machines.
+ *
+ * Un ordonnanceur exécute un ensemble de machines (des \e travaux) sur un
+ * petit nombre de threads de l'hôte. Chaque travail s'exécute par tranches
+ * d'au plus \c _slice instructions (voir run()) puis retourne dans la file
+ * des travaux prêts : un programme qui boucle indéfiniment ne monopolise
+ * donc jamais un thread.
+ *
+ * La file est ordonnée par priorité décroissante puis par ordre d'arrivée :
+ * en politique \c SCHED_ROUND_ROBIN toutes les priorités sont égales et les
+ * travaux sont servis à tour de rôle ; en politique \c SCHED_PRIORITY un
+ * travail prêt n'est servi que si aucun travail de priorité supérieure
+ * n'est prêt.
+ *
+ * Chaque travail peut avoir un quota d'instructions, et l'ordonnanceur un
+ * plafond global (pour l'ensemble des travaux) : un travail qui dépasse son
+ * quota, ou qui est encore en cours quand le plafond est atteint, est
+ * arrêté.
+ */
+
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Politique d'ordonnancement
+typedef enum
+{
+    SCHED_ROUND_ROBIN,  //!< À tour de rôle (priorités ignorées)
+    SCHED_PRIORITY,     //!< Priorité stricte, à tour de rôle à priorité égale
+} Sched_Policy;
+
+//! État d'un travail
+typedef enum
+{
+    JOB_READY,          //!< En attente d'exécution
+    JOB_RUNNING,        //!< En cours d'exécution
+    JOB_HALTED,         //!< Terminé par \c HALT
+    JOB_FAULTED,        //!< Terminé sur une erreur
+    JOB_BREAKPOINT,     //!< Arrêté sur un point d'arrêt
+    JOB_QUOTA,          //!< Arrêté : quota d'instructions épuisé
+    JOB_CAPPED,         //!< Arrêté : plafond global atteint
+    JOB_LIVELOCK,       //!< Arrêté : revenu dans un état déjà vu (livelock.h)
+} Job_State;
+
+//! Forme imprimable des états des travaux
+extern const char *job_state_names[];
+
+//! Travail (machine ordonnancée)
+typedef struct
+{
+    Machine *_machine;          //!< La machine exécutée
+    unsigned _priority;         //!< Priorité (la plus grande est servie d'abord)
+    uint64_t _quota;            //!< Quota d'instructions (0 : illimité)
+    uint64_t _executed;         //!< Instructions exécutées
+    Job_State _state;           //!< État courant
+    Run_Result _result;         //!< Compte rendu de la dernière tranche
+    unsigned _finished;         //!< Rang de fin (à partir de 1 ; 0 : pas fini)
+    uint64_t _sequence;         //!< Ordre d'arrivée dans la file (interne)
+} Sched_Job;
+
+//! Ordonnanceur (type opaque)
+typedef struct Scheduler Scheduler;
+
+//! Création d'un ordonnanceur
+/*!
+ * \param nworkers le nombre de threads d'exécution (au moins 1)
+ * \param policy la politique d'ordonnancement
+ * \param slice la taille des tranches, en instructions (0 : valeur par défaut)
+ * \param cap le plafond global d'instructions (0 : illimité)
+ * \return l'ordonnanceur, ou \c NULL si la mémoire manque
+ */
+Scheduler *sched_create(unsigned nworkers, Sched_Policy policy,
+                        uint64_t slice, uint64_t cap);
+
+//! Taille de tranche par défaut
+#define SCHED_DEFAULT_SLICE 10000
+
+//! Soumission d'une machine
+/*!
+ * La machine doit être chargée et ne doit pas être soumise deux fois. Les
+ * soumissions se font avant sched_run().
+ *
+ * \param psched l'ordonnanceur
+ * \param pmach la machine
+ * \param priority sa priorité
+ * \param quota son quota d'instructions (0 : illimité)
+ * \return le travail (valide jusqu'à sched_destroy()), ou \c NULL
+ */
+Sched_Job *sched_submit(Scheduler *psched, Machine *pmach, unsigned priority,
+                        uint64_t quota);
+
+//! Exécution de tous les travaux soumis
+/*!
+ * La fonction retourne quand tous les travaux sont terminés ou arrêtés.
+ *
+ * \param psched l'ordonnanceur
+ * \return le nombre total d'instructions exécutées
+ */
+uint64_t sched_run(Scheduler *psched);
+
+//! Destruction d'un ordonnanceur
+/*!
+ * Les machines ne sont pas détruites.
+ */
+void sched_destroy(Scheduler *psched);
+
+#endif
@@ -0,0 +1,236 @@
+/*!
+ * \file sclient.c
+ * \brief Client du serveur d'exécution (voir server.h)
+ *
+ * Toutes les requêtes sont envoyées d'abord, sans attendre les réponses ;
+ * les réponses sont ensuite recopiées sur la sortie standard dans l'ordre
+ * où elles arrivent.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//! Help message.
+/*!
+ * Printed with option \c -h.
+ */
+static void usage()
+{
+    printf("Usage: sclient [options] socket [binfile...]\n");
+    printf("where options are:\n"
+            "\t-n N\tExecute at most N instructions per program\n"
+            "\t-x\tExecute natively (translated program)\n"
+            "\t-w N\tStop when the machine state repeats; checked every\n"
+            "\t\tN instructions (0: default)\n"
+            "\t-c\tReturn the performance counters\n"
+            "\t-D\tReturn the data segment\n"
+            "\t-R\tExecute even if the result is cached\n"
+            "\t-r\tSend the file names instead of the programs\n"
+            "\t-s\tPrint the server statistics\n"
+            "\t-q\tShut the server down after these requests\n"
+            "\t-h\tprint this help message\n"
+            "The exit status is 0 if every program halted normally.\n");
+}
+
+//! Envoi d'un bloc
+static bool send_all(int fd, const char *bytes, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t n = write(fd, bytes, length);
+        if(n <= 0)
+            return false;
+        bytes += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+//! Lecture d'un fichier entier
+static char *read_file(const char *name, size_t *length)
+{
+    FILE *file = fopen(name, "r");
+    char *bytes = NULL;
+    long size;
+
+    if(file && fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0
+            && fseek(file, 0, SEEK_SET) == 0
+            && (bytes = malloc(size ? size : 1))
+            && fread(bytes, 1, size, file) == (size_t)size)
+        *length = size;
+    else
+    {
+        free(bytes);
+        bytes = NULL;
+    }
+
+    if(file)
+        fclose(file);
+    return bytes;
+}
+
+//! Programme principal du client
+int main(int argc, char *argv[])
+{
+    const char *socketpath = NULL;
+    char options[128] = "";
+    bool bypath = false, stats = false, quit = false;
+    int first = argc;
+
+    for(int iarg = 1; iarg < argc && first == argc; ++iarg)
+    {
+        size_t used = strlen(options);
+
+        if(argv[iarg][0] == '-' && argv[iarg][1] != '\0')
+            switch(argv[iarg][1])
+            {
+                case 'n':
+                case 'w':
+                    if(iarg + 1 >= argc)
+                    {
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    snprintf(options + used, sizeof(options) - used,
+                            argv[iarg][1] == 'n' ? " budget=%llu"
+                            : " livelock=%llu",
+                            strtoull(argv[iarg + 1], NULL, 0));
+                    ++iarg;
+                    break;
+                case 'x':
+                    snprintf(options + used, sizeof(options) - used,
+                            " engine=native");
+                    break;
+                case 'c':
+                    snprintf(options + used, sizeof(options) - used,
+                            " counters");
+                    break;
+                case 'D':
+                    snprintf(options + used, sizeof(options) - used, " data");
+                    break;
+                case 'R':
+                    snprintf(options + used, sizeof(options) - used,
+                            " nocache");
+                    break;
+                case 'r':
+                    bypath = true;
+                    break;
+                case 's':
+                    stats = true;
+                    break;
+                case 'q':
+                    quit = true;
+                    break;
+                case 'h':
+                    usage();
+                    exit(EXIT_SUCCESS);
+                default:
+                    fprintf(stderr, "Unknown option: %s\n", argv[iarg]);
+                    usage();
+                    exit(EXIT_FAILURE);
+            }
+        else if(!socketpath)
+            socketpath = argv[iarg];
+        else
+            first = iarg;
+    }
+
+    struct sockaddr_un addr;
+    int fd;
+
+    if(!socketpath || strlen(socketpath) >= sizeof(addr.sun_path))
+    {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketpath);
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+            || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        fprintf(stderr, "Connexion à \"%s\" impossible.\n", socketpath);
+        exit(EXIT_FAILURE);
+    }
+
+    // Requêtes, identifiées par leur rang
+    for(int iarg = first; iarg < argc; ++iarg)
+    {
+        char line[PATH_MAX + 256];
+        char path[PATH_MAX];
+        char *bytes = NULL;
+        size_t length = 0;
+
+        if(bypath)
+            snprintf(line, sizeof(line), "RUN %d%s path=%s\n", iarg - first,
+                    options, realpath(argv[iarg], path) ? path : argv[iarg]);
+        else if((bytes = read_file(argv[iarg], &length)))
+            snprintf(line, sizeof(line), "RUN %d%s image=%zu\n", iarg - first,
+                    options, length);
+        else
+        {
+            fprintf(stderr, "Ouverture du fichier \"%s\" impossible.\n",
+                    argv[iarg]);
+            exit(EXIT_FAILURE);
+        }
+
+        if(!send_all(fd, line, strlen(line)) || !send_all(fd, bytes, length))
+        {
+            fprintf(stderr, "Connexion interrompue.\n");
+            exit(EXIT_FAILURE);
+        }
+        free(bytes);
+    }
+
+    if((stats && !send_all(fd, "STATS\n", 6))
+            || (quit && !send_all(fd, "SHUTDOWN\n", 9)))
+    {
+        fprintf(stderr, "Connexion interrompue.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Fin des requêtes : le serveur ferme la connexion après les réponses
+    shutdown(fd, SHUT_WR);
+
+    FILE *in = fdopen(fd, "r");
+    char *line = NULL;
+    size_t capacity = 0;
+    int status = EXIT_SUCCESS;
+    unsigned answered = 0;
+
+    while(in && getline(&line, &capacity, in) > 0)
+    {
+        char state[32];
+
+        fputs(line, stdout);
+        if(sscanf(line, "RESULT %*s %31s", state) == 1)
+        {
+            ++answered;
+            if(strcmp(state, "HALTED") != 0)
+                status = EXIT_FAILURE;
+        }
+    }
+
+    free(line);
+    if(in)
+        fclose(in);
+
+    if(answered != (unsigned)(argc - first))
+    {
+        fprintf(stderr, "%u response(s) missing\n",
+                (unsigned)(argc - first) - answered);
+        status = EXIT_FAILURE;
+    }
+
+    return status;
+}
@@ -0,0 +1,780 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "livelock.h"
+#include "memo.h"
+#include "native.h"
+#include "pool.h"
+#include "server.h"
+#include "text.h"
+
+/*!
+ * \file server.c
+ * \brief Implémentation de server.h. Serveur local d'exécution.
+ *
+ * Chaque connexion a son thread de lecture, qui analyse les requêtes,
+ * charge les programmes et place les travaux dans une file commune. Les
+ * threads d'exécution prennent les travaux en tête de file et remettent en
+ * queue ceux qui ne sont pas terminés après une tranche. Les réponses d'une
+ * connexion sont écrites d'un bloc, sous le verrou de la connexion.
+ *
+ * Une connexion est fermée quand son thread de lecture a fini et que tous
+ * ses travaux ont répondu (compte de références).
+ */
+
+//! Connexion d'un client
+typedef struct Connection
+{
+    int _fd;                    //!< La socket
+    pthread_mutex_t _write;     //!< Verrou des réponses
+    unsigned _refs;             //!< Lecteur et travaux en cours (verrou du serveur)
+    struct Server *_server;     //!< Le serveur
+    struct Connection *_next;   //!< Connexion ouverte suivante
+} Connection;
+
+//! Requête en cours d'exécution
+typedef struct Job
+{
+    Connection *_conn;          //!< Connexion qui attend la réponse
+    char _id[SERVER_MAXID];     //!< Identifiant de la requête
+    Machine *_mach;             //!< Machine de la réserve du serveur
+    uint64_t _budget;           //!< Instructions permises (0 : illimité)
+    uint64_t _executed;         //!< Instructions exécutées
+    bool _native;               //!< Exécution native demandée (pas encore tentée)
+    bool _counters;             //!< Compteurs demandés dans la réponse
+    bool _data;                 //!< Segment de données demandé dans la réponse
+    bool _memo;                 //!< Résultat à enregistrer (cache des résultats)
+    Hash _key;                  //!< Son empreinte (memo_key())
+    Run_Result _result;         //!< Compte rendu de la dernière tranche
+    Sink _output;               //!< Affichages de la machine
+    Sink _messages;             //!< Avertissements de la machine
+    struct Job *_next;          //!< Suivant dans la file
+} Job;
+
+//! État du serveur
+typedef struct Server
+{
+    pthread_mutex_t _lock;      //!< Verrou de la file et des connexions
+    pthread_cond_t _ready;      //!< File non vide, ou arrêt possible
+    pthread_cond_t _closed;     //!< Une connexion a été fermée
+    Job *_head;                 //!< Tête de la file
+    Job *_tail;                 //!< Queue de la file
+    unsigned _pending;          //!< Travaux acceptés sans réponse
+    bool _stopping;             //!< \c SHUTDOWN reçu
+    Connection *_conns;         //!< Connexions ouvertes
+    int _listen;                //!< Socket d'écoute
+
+    Machine_Pool *_pool;        //!< Réserve des machines
+    Shared_Text *_texts[SERVER_TEXTS];  //!< Textes gardés internés
+    unsigned _nexttext;         //!< Prochaine entrée remplacée
+    Cache _cache;               //!< Cache des traductions
+    bool _native;               //!< Le cache est ouvert
+    Memo _memo;                 //!< Cache des résultats
+    bool _memoize;              //!< Le cache des résultats est ouvert
+    unsigned long _hits;        //!< Requêtes servies par le cache des résultats
+} Server;
+
+//! Envoi d'un bloc sur une connexion
+static void send_all(Connection *conn, const char *bytes, size_t length)
+{
+    pthread_mutex_lock(&conn->_write);
+    while(length > 0)
+    {
+        // Client parti : la réponse est perdue, sans SIGPIPE
+        ssize_t n = send(conn->_fd, bytes, length, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+        bytes += n;
+        length -= n;
+    }
+    pthread_mutex_unlock(&conn->_write);
+}
+
+//! Réponse à une requête invalide
+static void reject(Connection *conn, const char *id, const char *reason)
+{
+    Sink reply;
+
+    sink_buffer(&reply);
+    sink_printf(&reply, "RESULT %s REJECTED %s\nEND %s\n", id, reason, id);
+    send_all(conn, sink_contents(&reply), reply._length);
+    sink_release(&reply);
+}
+
+//! Abandon d'une référence à une connexion (la dernière la ferme)
+static void drop(Connection *conn)
+{
+    Server *server = conn->_server;
+    bool last;
+
+    pthread_mutex_lock(&server->_lock);
+    if((last = --conn->_refs == 0))
+    {
+        Connection **p = &server->_conns;
+        while(*p != conn)
+            p = &(*p)->_next;
+        *p = conn->_next;
+        pthread_cond_broadcast(&server->_closed);
+    }
+    pthread_mutex_unlock(&server->_lock);
+
+    if(last)
+    {
+        close(conn->_fd);
+        pthread_mutex_destroy(&conn->_write);
+        free(conn);
+    }
+}
+
+//! Conservation du texte d'une machine pour les requêtes suivantes
+static void keep_text(Server *server, Shared_Text *shared)
+{
+    pthread_mutex_lock(&server->_lock);
+    for(unsigned i = 0; i < SERVER_TEXTS; ++i)
+        if(server->_texts[i] == shared)
+        {
+            pthread_mutex_unlock(&server->_lock);
+            return;
+        }
+
+    // Remplacement circulaire du plus ancien
+    Shared_Text **slot = &server->_texts[server->_nexttext];
+    text_release(*slot);
+    *slot = text_retain(shared);
+    server->_nexttext = (server->_nexttext + 1) % SERVER_TEXTS;
+    pthread_mutex_unlock(&server->_lock);
+}
+
+//! Arrêt du serveur (après les travaux en cours)
+static void stop(Server *server)
+{
+    pthread_mutex_lock(&server->_lock);
+    server->_stopping = true;
+    pthread_cond_broadcast(&server->_ready);
+    pthread_mutex_unlock(&server->_lock);
+
+    // Réveille accept()
+    shutdown(server->_listen, SHUT_RDWR);
+}
+
+//! Libération d'un travail
+static void destroy_job(Job *job)
+{
+    machine_destroy(job->_mach);
+    sink_release(&job->_output);
+    sink_release(&job->_messages);
+    free(job);
+}
+
+//! Réponse à une requête exécutée
+static void respond(Job *job)
+{
+    Machine *pmach = job->_mach;
+    const Run_Result *res = &job->_result;
+    Sink reply;
+
+    sink_buffer(&reply);
+    sink_printf(&reply, "RESULT %s %s %llu", job->_id,
+            run_status_names[res->_status],
+            (unsigned long long)job->_executed);
+    if(res->_status == RUN_FAULTED)
+        sink_printf(&reply, " %s 0x%04x", error_names[res->_error],
+                res->_address);
+    if(res->_status == RUN_LIVELOCK)
+        sink_printf(&reply, " %llu 0x%04x 0x%04x",
+                (unsigned long long)res->_cycle, res->_first, res->_last);
+    sink_write(&reply, "\n", 1);
+    sink_write(&reply, sink_contents(&job->_messages),
+            job->_messages._length);
+
+    print_cpu(pmach);
+    if(job->_data)
+        print_data(pmach);
+    sink_write(&reply, sink_contents(&job->_output), job->_output._length);
+
+    if(job->_counters)
+    {
+        char *json = NULL;
+        size_t length = 0;
+        FILE *out = open_memstream(&json, &length);
+
+        if(out)
+        {
+            counters_write_json(out, &pmach->_counters, pmach->_datasize);
+            fclose(out);
+            sink_write(&reply, json, length);
+        }
+        free(json);
+    }
+
+    sink_printf(&reply, "END %s\n", job->_id);
+    send_all(job->_conn, sink_contents(&reply), reply._length);
+    sink_release(&reply);
+}
+
+//! Enregistrement du résultat d'un travail terminé
+static void remember(Server *server, Job *job)
+{
+    Run_Result res = job->_result;
+
+    res._executed = job->_executed;
+    memo_store(&server->_memo, &job->_key, job->_mach, &res,
+            sink_contents(&job->_messages), job->_messages._length,
+            job->_data);
+}
+
+//! Exécution native complète d'un travail
+static void run_native(Job *job, Translated_Func translated)
+{
+    Machine *pmach = job->_mach;
+    uint64_t before = counters_retired(&pmach->_counters);
+    Machine *previous = machine_enter(pmach);
+    Error_Trap trap;
+
+    job->_result = (Run_Result){RUN_HALTED, 0, ERR_NOERROR, 0, 0, 0, 0};
+    counters_start(&pmach->_counters);
+    error_trap_enter(&trap);
+    if(setjmp(trap._env) == 0)
+        translated(pmach);
+    else
+    {
+        job->_result._status = RUN_FAULTED;
+        job->_result._error = trap._error;
+        job->_result._address = trap._address;
+    }
+    error_trap_leave(&trap);
+    counters_stop(&pmach->_counters);
+    machine_leave(previous);
+
+    job->_executed = counters_retired(&pmach->_counters) - before;
+}
+
+//! Exécution d'une tranche d'un travail
+/*!
+ * \return vrai si le travail est terminé
+ */
+static bool step(Server *server, Job *job)
+{
+    if(job->_native)
+    {
+        // Traduction (ou chargement depuis le cache) par le thread
+        // d'exécution : le thread de lecture n'est pas bloqué
+        Translated_Func translated = server->_native
+            ? native_load(job->_mach, &server->_cache, NULL) : NULL;
+
+        job->_native = false;
+        if(translated)
+        {
+            run_native(job, translated);
+            return true;
+        }
+    }
+
+    uint64_t slice = SERVER_SLICE;
+    if(job->_budget && job->_budget - job->_executed < slice)
+        slice = job->_budget - job->_executed;
+
+    job->_result = run(job->_mach, slice);
+    job->_executed += job->_result._executed;
+
+    return job->_result._status != RUN_BUDGET
+        || (job->_budget && job->_executed >= job->_budget);
+}
+
+//! Thread d'exécution
+static void *worker_thread(void *arg)
+{
+    Server *server = arg;
+
+    for(;;)
+    {
+        pthread_mutex_lock(&server->_lock);
+        while(!server->_head && !(server->_stopping && !server->_pending))
+            pthread_cond_wait(&server->_ready, &server->_lock);
+
+        Job *job = server->_head;
+        if(job && !(server->_head = job->_next))
+            server->_tail = NULL;
+        pthread_mutex_unlock(&server->_lock);
+
+        if(!job)
+            return NULL;
+
+        bool done = step(server, job);
+        if(!done)
+        {
+            // Tranche épuisée : retour en queue de file, sauf pour un
+            // travail sans budget pendant l'arrêt
+            pthread_mutex_lock(&server->_lock);
+            bool requeue = job->_budget || !server->_stopping;
+            if(requeue)
+            {
+                job->_next = NULL;
+                if(server->_tail)
+                    server->_tail->_next = job;
+                else
+                    server->_head = job;
+                server->_tail = job;
+            }
+            pthread_mutex_unlock(&server->_lock);
+            if(requeue)
+                continue;
+        }
+
+        Connection *conn = job->_conn;
+        if(done && job->_memo)
+            remember(server, job);
+        respond(job);
+        destroy_job(job);
+
+        pthread_mutex_lock(&server->_lock);
+        if(--server->_pending == 0 && server->_stopping)
+            pthread_cond_broadcast(&server->_ready);
+        pthread_mutex_unlock(&server->_lock);
+        drop(conn);
+    }
+}
+
+//! Lecture d'un entier d'option
+static bool parse_number(const char *s, uint64_t *value)
+{
+    char *end;
+
+    errno = 0;
+    *value = strtoull(s, &end, 0);
+    return *s && !*end && errno == 0;
+}
+
+//! Lecture de \a length octets sans les conserver
+/*!
+ * \return faux si le flot se termine avant
+ */
+static bool skip(FILE *in, uint64_t length)
+{
+    char buffer[4096];
+
+    while(length > 0)
+    {
+        size_t n = length < sizeof(buffer) ? length : sizeof(buffer);
+
+        if(fread(buffer, 1, n, in) != n)
+            return false;
+        length -= n;
+    }
+
+    return true;
+}
+
+//! Chargement du programme d'une requête
+/*!
+ * \return NULL si le programme est chargé, sinon la raison de l'échec
+ */
+static const char *load(Machine *pmach, const char *path,
+        const char *image, size_t length)
+{
+    if(path)
+    {
+        FILE *file = fopen(path, "r");
+        bool ok = file && machine_read_stream(pmach, file, -1);
+
+        if(file)
+            fclose(file);
+        return ok ? NULL : file ? program_format_error() : strerror(errno);
+    }
+
+    // Un flot en mémoire n'a pas de taille de fichier : on donne la sienne
+    FILE *file = fmemopen((void *)image, length, "r");
+    bool ok = file && machine_read_stream(pmach, file, (long)length);
+
+    if(file)
+        fclose(file);
+    return ok ? NULL : file ? program_format_error() : "out of memory";
+}
+
+//! Requête \c RUN
+/*!
+ * \param conn la connexion
+ * \param in son flot de lecture (pour l'image du programme)
+ * \param save l'état de strtok_r() après l'identifiant
+ * \param id l'identifiant de la requête
+ * \return faux si la connexion n'est plus utilisable
+ */
+static bool request_run(Connection *conn, FILE *in, char *save,
+        const char *id)
+{
+    Server *server = conn->_server;
+    uint64_t budget = 0, period = 0, length = 0;
+    bool native = false, watch = false, counters = false, data = false;
+    bool nocache = false;
+    bool image = false;
+    const char *path = NULL;
+    const char *reason = NULL;
+
+    for(char *opt; (opt = strtok_r(NULL, " \t", &save)); )
+    {
+        char *value = strchr(opt, '=');
+        bool ok;
+
+        if(value)
+            *value++ = '\0';
+
+        if(!strcmp(opt, "budget"))
+            ok = value && parse_number(value, &budget);
+        else if(!strcmp(opt, "engine"))
+        {
+            ok = value && (!strcmp(value, "interp")
+                    || !strcmp(value, "native"));
+            native = ok && !strcmp(value, "native");
+        }
+        else if(!strcmp(opt, "livelock"))
+            ok = watch = !value || parse_number(value, &period);
+        else if(!strcmp(opt, "counters"))
+            ok = counters = !value;
+        else if(!strcmp(opt, "data"))
+            ok = data = !value;
+        else if(!strcmp(opt, "nocache"))
+            ok = nocache = !value;
+        else if(!strcmp(opt, "image"))
+            ok = image = value && !image && !path
+                && parse_number(value, &length);
+        else if(!strcmp(opt, "path"))
+        {
+            ok = value && *value && !image && !path;
+            if(ok)
+                path = value;
+        }
+        else
+            ok = false;
+
+        if(!ok && !reason)
+            reason = "bad option";
+    }
+
+    // L'image suit la ligne, même si la requête est invalide ; refusée, elle
+    // est lue sans être conservée
+    char *bytes = NULL;
+    if(image && !reason && length > SERVER_MAXIMAGE)
+        reason = "image too large";
+    if(image && !reason && !(bytes = malloc(length ? length : 1)))
+        reason = "out of memory";
+    if(image && !bytes)
+    {
+        if(!skip(in, length))
+            return false;
+    }
+    else if(image && fread(bytes, 1, length, in) != length)
+    {
+        free(bytes);
+        return false;
+    }
+
+    Job *job = NULL;
+    if(!reason && !image && !path)
+        reason = "no program";
+    if(!reason && (!(job = calloc(1, sizeof(Job)))
+                || !(job->_mach = machine_create(server->_pool))))
+        reason = "out of memory";
+    if(!reason)
+        reason = load(job->_mach, path, bytes, length);
+    free(bytes);
+
+    if(!reason)
+    {
+        keep_text(server, job->_mach->_shared);
+        if(watch && !livelock_enable(job->_mach, period))
+            reason = "out of memory";
+    }
+
+    if(reason)
+    {
+        if(job)
+        {
+            machine_destroy(job->_mach);
+            free(job);
+        }
+        reject(conn, id, reason);
+        return true;
+    }
+
+    strcpy(job->_id, id);
+    job->_conn = conn;
+    job->_budget = budget;
+    // Le code traduit ne rend pas la main : ni budget, ni détection
+    job->_native = native && !budget && !watch;
+    job->_counters = counters;
+    job->_data = data;
+    sink_buffer(&job->_output);
+    sink_buffer(&job->_messages);
+    job->_mach->_output = &job->_output;
+    job->_mach->_messages = &job->_messages;
+
+    // Résultat d'une exécution interprétée précédente
+    if(server->_memoize && !native && !nocache)
+    {
+        job->_memo = true;
+        memo_key(job->_mach, budget, &job->_key);
+        if(memo_lookup(&server->_memo, &job->_key, job->_mach, data,
+                    &job->_result, &job->_messages) == MEMO_HIT)
+        {
+            job->_executed = job->_result._executed;
+            respond(job);
+            destroy_job(job);
+
+            pthread_mutex_lock(&server->_lock);
+            ++server->_hits;
+            pthread_mutex_unlock(&server->_lock);
+            return true;
+        }
+    }
+
+    pthread_mutex_lock(&server->_lock);
+    if(server->_stopping)
+    {
+        pthread_mutex_unlock(&server->_lock);
+        destroy_job(job);
+        reject(conn, id, "server stopping");
+        return true;
+    }
+    ++conn->_refs;
+    ++server->_pending;
+    if(server->_tail)
+        server->_tail->_next = job;
+    else
+        server->_head = job;
+    server->_tail = job;
+    pthread_cond_signal(&server->_ready);
+    pthread_mutex_unlock(&server->_lock);
+
+    return true;
+}
+
+//! Requête \c STATS
+static void request_stats(Connection *conn)
+{
+    Server *server = conn->_server;
+    Pool_Stats pool = pool_stats(server->_pool);
+    Text_Stats texts = text_stats();
+    Sink reply;
+
+    pthread_mutex_lock(&server->_lock);
+    unsigned long hits = server->_hits;
+    pthread_mutex_unlock(&server->_lock);
+
+    sink_buffer(&reply);
+    sink_printf(&reply, "STATS machines=%lu recycled=%lu idle=%u texts=%u "
+            "text_hits=%lu result_hits=%lu\n", pool._created, pool._recycled,
+            pool._idle, texts._texts, texts._hits, hits);
+    send_all(conn, sink_contents(&reply), reply._length);
+    sink_release(&reply);
+}
+
+//! Thread de lecture d'une connexion
+static void *reader_thread(void *arg)
+{
+    Connection *conn = arg;
+    int fd = dup(conn->_fd);
+    FILE *in = fd >= 0 ? fdopen(fd, "r") : NULL;
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t n;
+
+    if(!in && fd >= 0)
+        close(fd);
+
+    while(in && (n = getline(&line, &capacity, in)) > 0)
+    {
+        char *save;
+
+        if(n > SERVER_MAXLINE)
+        {
+            reject(conn, "-", "line too long");
+            break;
+        }
+
+        line[strcspn(line, "\r\n")] = '\0';
+        char *cmd = strtok_r(line, " \t", &save);
+        if(!cmd)
+            continue;
+
+        if(!strcmp(cmd, "RUN"))
+        {
+            char *id = strtok_r(NULL, " \t", &save);
+
+            if(!id || strlen(id) >= SERVER_MAXID)
+                reject(conn, "-", "bad identifier");
+            else if(!request_run(conn, in, save, id))
+                break;
+        }
+        else if(!strcmp(cmd, "STATS"))
+            request_stats(conn);
+        else if(!strcmp(cmd, "SHUTDOWN"))
+        {
+            stop(conn->_server);
+            break;
+        }
+        else
+            reject(conn, "-", "unknown command");
+    }
+
+    free(line);
+    if(in)
+        fclose(in);
+    drop(conn);
+    return NULL;
+}
+
+//! Ouverture de la socket d'écoute
+static int listen_on(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(path);
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(fd, SOMAXCONN) < 0)
+    {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+bool server_run(const char *path, unsigned nworkers, const char *cachedir,
+        unsigned flags)
+{
+    Server server;
+
+    memset(&server, 0, sizeof(server));
+    if((server._listen = listen_on(path)) < 0)
+        return false;
+    if(!(server._pool = pool_create()))
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        close(server._listen);
+        return false;
+    }
+    server._native = (flags & SERVER_NATIVE)
+        && cache_open(&server._cache, cachedir, 0);
+    server._memoize = (flags & SERVER_MEMO)
+        && memo_open(&server._memo, cachedir, 0);
+    pthread_mutex_init(&server._lock, NULL);
+    pthread_cond_init(&server._ready, NULL);
+    pthread_cond_init(&server._closed, NULL);
+
+    if(nworkers == 0)
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = n > 0 ? n : 1;
+    }
+
+    pthread_t workers[nworkers];
+    unsigned started = 0;
+    for(; started < nworkers; ++started)
+        if(pthread_create(&workers[started], NULL, worker_thread,
+                    &server) != 0)
+            break;
+    if(started == 0)
+    {
+        fprintf(stderr, "Cannot start worker threads\n");
+        stop(&server);
+    }
+    else
+        fprintf(stderr, "Listening on %s (%u workers)\n", path, started);
+
+    for(;;)
+    {
+        int fd = accept(server._listen, NULL, NULL);
+        if(fd < 0 && errno == EINTR)
+            continue;
+
+        pthread_mutex_lock(&server._lock);
+        bool stopping = server._stopping;
+        pthread_mutex_unlock(&server._lock);
+        if(fd < 0 && !stopping && errno == ECONNABORTED)
+            continue;
+        if(fd < 0 || stopping)
+        {
+            if(fd >= 0)
+                close(fd);
+            stop(&server);
+            break;
+        }
+
+        Connection *conn = calloc(1, sizeof(Connection));
+        pthread_t reader;
+        if(!conn)
+        {
+            close(fd);
+            continue;
+        }
+        conn->_fd = fd;
+        conn->_server = &server;
+        conn->_refs = 1;
+        pthread_mutex_init(&conn->_write, NULL);
+
+        pthread_mutex_lock(&server._lock);
+        conn->_next = server._conns;
+        server._conns = conn;
+        pthread_mutex_unlock(&server._lock);
+
+        if(pthread_create(&reader, NULL, reader_thread, conn) != 0)
+        {
+            reject(conn, "-", "server busy");
+            drop(conn);
+            continue;
+        }
+        pthread_detach(reader);
+    }
+
+    // Les threads d'exécution finissent quand tous les travaux ont répondu
+    for(unsigned i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+
+    // Les lecteurs encore bloqués reçoivent une fin de fichier
+    pthread_mutex_lock(&server._lock);
+    for(Connection *conn = server._conns; conn; conn = conn->_next)
+        shutdown(conn->_fd, SHUT_RD);
+    while(server._conns)
+        pthread_cond_wait(&server._closed, &server._lock);
+    pthread_mutex_unlock(&server._lock);
+
+    for(unsigned i = 0; i < SERVER_TEXTS; ++i)
+        text_release(server._texts[i]);
+    pool_destroy(server._pool);
+    close(server._listen);
+    unlink(path);
+    pthread_cond_destroy(&server._closed);
+    pthread_cond_destroy(&server._ready);
+    pthread_mutex_destroy(&server._lock);
+
+    return started > 0;
+}
@@ -0,0 +1,97 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+/*!
+ * \file server.h
+ * \brief Serveur local d'exécution de programmes.
+ *
+ * Le serveur attend des requêtes sur une socket Unix (option \c -S de
+ * test_simul) et les exécute sur un groupe de threads. Il évite à chaque
+ * requête le coût d'un processus : les machines viennent d'une réserve
+ * (pool.h) et sont recyclées, et les segments de texte des derniers
+ * programmes soumis restent internés (text.h) avec leur flot prédécodé et
+ * leur code natif.
+ *
+ * Le protocole est textuel, une requête par ligne :
+ *
+ * \code
+ * RUN id [budget=N] [engine=interp|native] [livelock[=N]] [counters] [data]
+ *        [nocache] (image=N | path=FICHIER)
+ * STATS
+ * SHUTDOWN
+ * \endcode
+ *
+ * Avec \c image=N, la ligne est suivie des \e N octets du programme au
+ * format binaire (binfmt.h), au plus \c SERVER_MAXIMAGE (au-delà, ils sont
+ * lus et la requête est refusée) ; avec \c path=, le serveur lit le fichier. Un
+ * client peut envoyer plusieurs requêtes sans attendre les réponses
+ * (\e pipelining) ; elles s'exécutent en parallèle et chaque réponse est
+ * envoyée dès la fin de son exécution, dans l'ordre des fins d'exécution :
+ * l'identifiant \c id (sans espace) les apparie. Une réponse est :
+ *
+ * \code
+ * RESULT id ÉTAT instructions [ERREUR adresse | cycle première dernière]
+ * ... avertissements, registres (print_cpu()), données (print_data()),
+ *     compteurs (JSON) ...
+ * END id
+ * \endcode
+ *
+ * où ÉTAT est un nom de run_status_names, ou \c REJECTED pour une requête
+ * invalide (la ligne donne alors la raison). Les exécutions interprétées
+ * progressent par tranches de \c SERVER_SLICE instructions, à tour de rôle,
+ * de sorte qu'un programme qui boucle n'accapare pas un thread ; le budget
+ * (0 ou absent : illimité) borne le total. L'exécution native (native.h)
+ * n'est pas découpée : elle n'est employée que sans budget ni \c livelock,
+ * sinon, comme faute de code natif, le programme est interprété.
+ *
+ * Les résultats des exécutions interprétées sont conservés dans le cache
+ * des résultats (memo.h) : une requête déjà exécutée, avec les mêmes
+ * options, répond sans exécution. L'option \c nocache force l'exécution
+ * d'une requête.
+ *
+ * \c STATS répond par une ligne de statistiques de la réserve et de la
+ * table des textes ; \c SHUTDOWN arrête le serveur quand les requêtes en
+ * cours sont terminées. Les requêtes sans budget, qui pourraient ne jamais
+ * finir, répondent alors à la fin de leur tranche avec l'état \c BUDGET.
+ */
+
+#include <stdbool.h>
+
+//! Instructions exécutées par tranche
+#define SERVER_SLICE (1u << 20)
+
+//! Nombre de segments de texte gardés internés entre deux requêtes
+#define SERVER_TEXTS 64
+
+//! Longueur maximale d'une ligne de requête
+#define SERVER_MAXLINE 4096
+
+//! Longueur maximale d'un identifiant de requête (nul final compris)
+#define SERVER_MAXID 64
+
+//! Taille maximale d'une image de programme (\c image=N), en octets
+#define SERVER_MAXIMAGE (64u << 20)
+
+//! Exécution native permise (option de server_run())
+#define SERVER_NATIVE 1u
+
+//! Cache des résultats utilisé (option de server_run())
+#define SERVER_MEMO 2u
+
+//! Exécution du serveur
+/*!
+ * La fonction ne retourne qu'après une requête \c SHUTDOWN (ou si la
+ * socket ne peut pas être créée).
+ *
+ * \param path le chemin de la socket (remplacée si elle existe déjà)
+ * \param nworkers le nombre de threads d'exécution (0 : un par processeur
+ * de l'hôte)
+ * \param cachedir le répertoire du cache des traductions natives et des
+ * résultats
+ * \param flags une combinaison de \c SERVER_NATIVE et \c SERVER_MEMO
+ * \return faux si le serveur n'a pas pu démarrer
+ */
+bool server_run(const char *path, unsigned nworkers, const char *cachedir,
+        unsigned flags);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sink.h"
+
+/*!
+ * \file sink.c
+ * \brief Implémentation de sink.h. Puits de sortie.
+ *
+ * Tous les puits passent par le même tampon : un puits en mémoire le garde,
+ * un puits par lots le transmet dès qu'il atteint la taille d'un lot. Un
+ * puits à écriture immédiate ne l'utilise pas.
+ */
+
+//! Initialisation commune
+static void init(Sink *sink, Sink_Kind kind, size_t batch)
+{
+    memset(sink, 0, sizeof(Sink));
+    sink->_kind = kind;
+    sink->_batch = batch;
+}
+
+void sink_file(Sink *sink, FILE *file, size_t batch)
+{
+    init(sink, SINK_FILE, batch);
+    sink->_file = file;
+}
+
+void sink_buffer(Sink *sink)
+{
+    init(sink, SINK_BUFFER, 0);
+}
+
+void sink_callback(Sink *sink, Sink_Callback callback, void *context,
+        size_t batch)
+{
+    init(sink, SINK_CALLBACK, batch);
+    sink->_callback = callback;
+    sink->_context = context;
+}
+
+void sink_release(Sink *sink)
+{
+    sink_flush(sink);
+    free(sink->_buffer);
+    sink->_buffer = NULL;
+    sink->_length = sink->_capacity = 0;
+}
+
+// Puits standard : \c stdout n'étant pas une constante, leur fichier est
+// désigné par stream()
+static Sink standard_output = {SINK_FILE, NULL, NULL, NULL, 0};
+static Sink standard_error = {SINK_FILE, NULL, NULL, NULL, 0};
+
+//! Fichier d'un puits \c SINK_FILE
+static FILE *stream(const Sink *sink)
+{
+    if(sink->_file)
+        return sink->_file;
+
+    return sink == &standard_error ? stderr : stdout;
+}
+
+//! Transmission d'octets à la destination finale
+static void emit(Sink *sink, const char *bytes, size_t length)
+{
+    if(sink->_kind == SINK_FILE)
+        fwrite(bytes, 1, length, stream(sink));
+    else
+        sink->_callback(sink->_context, bytes, length);
+}
+
+//! Ajout d'octets au tampon
+static void append(Sink *sink, const char *bytes, size_t length)
+{
+    if(sink->_length + length + 1 > sink->_capacity)
+    {
+        size_t capacity = sink->_capacity ? sink->_capacity : 256;
+        while(capacity < sink->_length + length + 1)
+            capacity *= 2;
+
+        char *grown = realloc(sink->_buffer, capacity);
+        if(!grown)
+        {
+            fprintf(stderr, "Mémoire insuffisante.\n");
+            exit(1);
+        }
+        sink->_buffer = grown;
+        sink->_capacity = capacity;
+    }
+
+    memcpy(sink->_buffer + sink->_length, bytes, length);
+    sink->_length += length;
+    sink->_buffer[sink->_length] = '\0';
+}
+
+void sink_write(Sink *sink, const char *bytes, size_t length)
+{
+    if(sink->_kind != SINK_BUFFER && sink->_batch == 0)
+    {
+        emit(sink, bytes, length);
+        return;
+    }
+
+    append(sink, bytes, length);
+    if(sink->_kind != SINK_BUFFER && sink->_length >= sink->_batch)
+        sink_flush(sink);
+}
+
+void sink_printf(Sink *sink, const char *format, ...)
+{
+    char local[256];
+    va_list ap;
+
+    // Fichier sans tampon : formatage direct
+    if(sink->_kind == SINK_FILE && sink->_batch == 0)
+    {
+        va_start(ap, format);
+        vfprintf(stream(sink), format, ap);
+        va_end(ap);
+        return;
+    }
+
+    va_start(ap, format);
+    int n = vsnprintf(local, sizeof(local), format, ap);
+    va_end(ap);
+    if(n < 0)
+        return;
+
+    if((size_t)n < sizeof(local))
+    {
+        sink_write(sink, local, n);
+        return;
+    }
+
+    // Message long : second formatage dans un tampon à sa taille
+    char *text = malloc(n + 1);
+    if(!text)
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(1);
+    }
+
+    va_start(ap, format);
+    vsnprintf(text, n + 1, format, ap);
+    va_end(ap);
+    sink_write(sink, text, n);
+    free(text);
+}
+
+void sink_flush(Sink *sink)
+{
+    if(sink->_kind == SINK_BUFFER || sink->_length == 0)
+        return;
+
+    emit(sink, sink->_buffer, sink->_length);
+    sink->_length = 0;
+}
+
+const char *sink_contents(const Sink *sink)
+{
+    return sink->_buffer ? sink->_buffer : "";
+}
+
+void sink_clear(Sink *sink)
+{
+    sink->_length = 0;
+    if(sink->_buffer)
+        sink->_buffer[0] = '\0';
+}
+
+Sink *sink_stdout(void)
+{
+    return &standard_output;
+}
+
+Sink *sink_stderr(void)
+{
+    return &standard_error;
+}
+
+//! Puits publiés par le thread
+static __thread Sink *current_output = NULL;
+static __thread Sink *current_messages = NULL;
+
+void sink_select(Sink *output, Sink *messages)
+{
+    current_output = output;
+    current_messages = messages;
+}
+
+Sink *sink_output(void)
+{
+    return current_output ? current_output : sink_stdout();
+}
+
+Sink *sink_messages(void)
+{
+    return current_messages ? current_messages : sink_stderr();
+}
@@ -0,0 +1,134 @@
+#ifndef _SINK_H_
+#define _SINK_H_
+
+/*!
+ * \file sink.h
+ * \brief Destinations des sorties du simulateur.
+ *
+ * Les fonctions d'affichage (print_cpu(), print_data(), print_program(),
+ * dump_memory(), trace()) et les messages (warning(), error()) écrivent
+ * dans un \e puits plutôt que directement sur \c stdout ou \c stderr. Un
+ * puits est :
+ *
+ *   - un fichier (\c FILE *), écrit immédiatement ou par lots ;
+ *
+ *   - un tampon en mémoire, qui accumule tout ce qui est écrit ;
+ *
+ *   - une fonction de rappel, appelée par lots.
+ *
+ * Chaque machine désigne ses puits (champs \c _output et \c _messages de
+ * Machine, NULL pour \c stdout et \c stderr). Pendant une exécution,
+ * machine_enter() les publie pour le thread courant : error() et warning(),
+ * qui ne connaissent pas la machine, écrivent dans le puits de messages
+ * publié.
+ *
+ * Un puits n'est pas protégé contre les accès concurrents : il ne doit être
+ * utilisé que par un thread à la fois. Des exécutions parallèles capturent
+ * donc leurs sorties sans verrou, chacune dans ses propres puits.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+//! Nature d'un puits
+typedef enum
+{
+    SINK_FILE,          //!< Fichier
+    SINK_BUFFER,        //!< Tampon en mémoire
+    SINK_CALLBACK,      //!< Fonction de rappel
+} Sink_Kind;
+
+//! Fonction de rappel d'un puits
+/*!
+ * \param context le contexte donné à sink_callback()
+ * \param bytes les octets écrits depuis le lot précédent (sans nul final)
+ * \param length leur nombre
+ */
+typedef void (*Sink_Callback)(void *context, const char *bytes, size_t length);
+
+//! Puits de sortie
+typedef struct Sink
+{
+    Sink_Kind _kind;            //!< Nature du puits
+    FILE *_file;                //!< Fichier (\c SINK_FILE)
+    Sink_Callback _callback;    //!< Fonction de rappel (\c SINK_CALLBACK)
+    void *_context;             //!< Son contexte
+    size_t _batch;              //!< Taille d'un lot (0 : écriture immédiate)
+
+    char *_buffer;              //!< Octets en attente (terminés par un nul)
+    size_t _length;             //!< Leur nombre
+    size_t _capacity;           //!< Taille allouée pour \c _buffer
+} Sink;
+
+//! Initialisation d'un puits vers un fichier
+/*!
+ * \param sink le puits
+ * \param file le fichier
+ * \param batch la taille des lots en octets (0 : chaque écriture est
+ * transmise immédiatement au fichier)
+ */
+void sink_file(Sink *sink, FILE *file, size_t batch);
+
+//! Initialisation d'un puits en mémoire
+/*!
+ * Le contenu accumulé est lu par sink_contents() et effacé par
+ * sink_clear().
+ *
+ * \param sink le puits
+ */
+void sink_buffer(Sink *sink);
+
+//! Initialisation d'un puits vers une fonction de rappel
+/*!
+ * \param sink le puits
+ * \param callback la fonction appelée à chaque lot
+ * \param context son premier paramètre
+ * \param batch la taille des lots en octets (0 : un appel par écriture)
+ */
+void sink_callback(Sink *sink, Sink_Callback callback, void *context,
+        size_t batch);
+
+//! Libération d'un puits, après transmission des octets en attente
+void sink_release(Sink *sink);
+
+//! Écriture d'octets
+void sink_write(Sink *sink, const char *bytes, size_t length);
+
+//! Écriture formatée (comme \c printf)
+#ifdef __GNUC__
+void sink_printf(Sink *sink, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+#else
+void sink_printf(Sink *sink, const char *format, ...);
+#endif
+
+//! Transmission des octets en attente (sans effet sur un puits en mémoire)
+void sink_flush(Sink *sink);
+
+//! Contenu d'un puits en mémoire (chaîne terminée par un nul)
+const char *sink_contents(const Sink *sink);
+
+//! Effacement du contenu d'un puits en mémoire
+void sink_clear(Sink *sink);
+
+//! Puits de la sortie standard (écriture immédiate)
+Sink *sink_stdout(void);
+
+//! Puits de la sortie d'erreur standard (écriture immédiate)
+Sink *sink_stderr(void);
+
+//! Publication des puits du thread courant
+/*!
+ * \param output le puits des affichages (NULL : sink_stdout())
+ * \param messages le puits des messages (NULL : sink_stderr())
+ */
+void sink_select(Sink *output, Sink *messages);
+
+//! Puits des affichages publié par le thread courant
+Sink *sink_output(void);
+
+//! Puits des messages publié par le thread courant
+Sink *sink_messages(void);
+
+#endif
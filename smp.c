@@ -0,0 +1,137 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "guard.h"
+#include "smp.h"
+
+/*!
+ * \file smp.c
+ * \brief Implémentation de smp.h. Machine multiprocesseur.
+ *
+ * Chaque processeur est alloué sur ses propres lignes de cache : ses
+ * registres et compteurs, modifiés à chaque instruction, ne sont jamais
+ * partagés (faussement) avec ceux d'un autre processeur.
+ */
+
+//! Taille d'une ligne de cache de l'hôte
+#define CACHE_LINE 64
+
+//! Instructions exécutées par appel à run() en mode illimité
+#define SMP_SLICE (1u << 30)
+
+bool smp_create(Smp_Machine *psmp, const Machine *pmach, unsigned ncpus)
+{
+    unsigned stacksize = pmach->_datasize - pmach->_dataend;
+
+    if(ncpus == 0)
+        ncpus = 1;
+
+    memset(psmp, 0, sizeof(*psmp));
+    psmp->_ncpus = ncpus;
+    psmp->_stacksize = stacksize;
+    psmp->_datasize = pmach->_dataend + ncpus * stacksize;
+
+    Word *end = guard_reserve(psmp->_datasize);
+    psmp->_data = end ? end - psmp->_datasize : NULL;
+    psmp->_cpus = calloc(ncpus, sizeof(Smp_Cpu *));
+    if(!psmp->_data || !psmp->_cpus)
+    {
+        smp_destroy(psmp);
+        return false;
+    }
+
+    // Données statiques, puis une copie de la pile initiale par processeur
+    memcpy(psmp->_data, pmach->_data, pmach->_dataend * sizeof(Word));
+    for(unsigned i = 0; i < ncpus; ++i)
+        memcpy(psmp->_data + pmach->_dataend + i * stacksize,
+                pmach->_data + pmach->_dataend, stacksize * sizeof(Word));
+
+    for(unsigned i = 0; i < ncpus; ++i)
+    {
+        void *p;
+
+        if(posix_memalign(&p, CACHE_LINE, sizeof(Smp_Cpu)) != 0)
+        {
+            smp_destroy(psmp);
+            return false;
+        }
+        psmp->_cpus[i] = p;
+
+        // Zone de pile : [base, base + stacksize[, la plus haute pour CPU 0
+        unsigned base = psmp->_datasize - (i + 1) * stacksize;
+        Machine *cpu = &psmp->_cpus[i]->_mach;
+
+        load_program(cpu, pmach->_textsize, pmach->_text,
+                psmp->_datasize, psmp->_data, base);
+        // Flot prédécodé du texte de la machine d'origine, qui survit aux
+        // processeurs (pas de référence prise)
+        cpu->_shared = pmach->_shared;
+        cpu->_sp = base + stacksize - 1;
+        cpu->_registers[0] = i;
+        counters_reset(&cpu->_counters, cpu->_sp);
+        // Messages capturés sans verrou, lus après l'exécution
+        sink_buffer(&psmp->_cpus[i]->_messages);
+        cpu->_messages = &psmp->_cpus[i]->_messages;
+    }
+
+    return true;
+}
+
+//! Thread d'un processeur
+static void *cpu_thread(void *arg)
+{
+    Smp_Cpu *cpu = arg;
+    uint64_t executed = 0;
+
+    do
+    {
+        uint64_t slice = cpu->_budget ? cpu->_budget - executed : SMP_SLICE;
+        cpu->_result = run(&cpu->_mach, slice);
+        executed += cpu->_result._executed;
+    } while(cpu->_result._status == RUN_BUDGET && !cpu->_budget);
+
+    cpu->_result._executed = executed;
+    return NULL;
+}
+
+void smp_run(Smp_Machine *psmp, uint64_t budget)
+{
+    unsigned started = 1;
+
+    for(unsigned i = 0; i < psmp->_ncpus; ++i)
+        psmp->_cpus[i]->_budget = budget;
+
+    // Le processeur 0 s'exécute sur le thread appelant
+    for(; started < psmp->_ncpus; ++started)
+        if(pthread_create(&psmp->_cpus[started]->_thread, NULL, cpu_thread,
+                    psmp->_cpus[started]) != 0)
+            break;
+
+    cpu_thread(psmp->_cpus[0]);
+
+    // Processeurs sans thread (ressources épuisées) : exécutés à la suite
+    for(unsigned i = started; i < psmp->_ncpus; ++i)
+        cpu_thread(psmp->_cpus[i]);
+
+    for(unsigned i = 1; i < started; ++i)
+        pthread_join(psmp->_cpus[i]->_thread, NULL);
+}
+
+void smp_destroy(Smp_Machine *psmp)
+{
+    if(psmp->_cpus)
+        for(unsigned i = 0; i < psmp->_ncpus; ++i)
+            if(psmp->_cpus[i])
+            {
+                free(psmp->_cpus[i]->_mach._breakpoints);
+                sink_release(&psmp->_cpus[i]->_messages);
+                free(psmp->_cpus[i]);
+            }
+
+    free(psmp->_cpus);
+    if(psmp->_data)
+        guard_release(psmp->_data + psmp->_datasize, psmp->_datasize);
+    memset(psmp, 0, sizeof(*psmp));
+}
@@ -0,0 +1,105 @@
+#ifndef _SMP_H_
+#define _SMP_H_
+
+/*!
+ * \file smp.h
+ * \brief Machine multiprocesseur à segment de données partagé.
+ *
+ * Une machine SMP comporte \e N processeurs qui exécutent le même segment de
+ * texte et partagent le même segment de données. Chaque processeur a son
+ * propre compteur ordinal, son code condition, ses registres, ses compteurs
+ * de performance et sa propre zone de pile ; il s'exécute sur son propre
+ * thread de l'hôte.
+ *
+ * Disposition du segment de données (la taille de pile \e S est celle du
+ * programme chargé, \c _datasize - \c _dataend) :
+ *
+ * \verbatim
+ *   0          dataend      dataend+S         ...      dataend+N*S
+ *   | statiques | pile CPU N-1 | pile CPU N-2 | ... | pile CPU 0 |
+ * \endverbatim
+ *
+ * Le processeur 0 a donc la même disposition qu'une machine simple. Au
+ * départ, \c R00 contient le numéro du processeur ; les autres registres
+ * sont nuls et SP est au sommet de la zone de pile du processeur. Pour
+ * chaque processeur, \c _dataend est la base de sa zone de pile : un
+ * empilement qui déborde sur la zone voisine provoque l'avertissement
+ * \c WARN_PUSH_STATIC.
+ *
+ * <b>Modèle mémoire.</b> Les lectures et écritures ordinaires (\c LOAD,
+ * \c STORE, \c ADD, \c PUSH...) portent sur des mots de 32 bits alignés et
+ * sont atomiques mais \e relâchées : un processeur voit ses propres accès
+ * dans l'ordre du programme, mais l'ordre dans lequel les autres
+ * processeurs les observent n'est pas garanti. L'instruction \c XCHG
+ * échange atomiquement un registre et un mot de données et agit comme une
+ * barrière complète (cohérence séquentielle) : les accès qui la précèdent
+ * sont visibles de tous avant ceux qui la suivent. Un verrou se programme
+ * donc ainsi :
+ *
+ * \code
+ * lock    LOAD R01, #1
+ *         XCHG R01, mutex     // CC selon l'ancienne valeur
+ *         BRANCH NE, lock
+ *         ...                 // section critique
+ *         LOAD R01, #0
+ *         XCHG R01, mutex     // libération (barrière)
+ * \endcode
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Processeur d'une machine SMP
+typedef struct
+{
+    Machine _mach;              //!< État du processeur (segments partagés)
+    Run_Result _result;         //!< Compte rendu de son exécution
+    pthread_t _thread;          //!< Thread de l'hôte
+    uint64_t _budget;           //!< Instructions restantes (0 : illimité)
+    Sink _messages;             //!< Messages du processeur (en mémoire)
+} Smp_Cpu;
+
+//! Machine multiprocesseur
+typedef struct
+{
+    unsigned _ncpus;            //!< Nombre de processeurs
+    Smp_Cpu **_cpus;            //!< Processeurs (alloués séparément)
+    Word *_data;                //!< Segment de données partagé
+    unsigned _datasize;         //!< Taille du segment de données
+    unsigned _stacksize;        //!< Taille de la zone de pile d'un processeur
+} Smp_Machine;
+
+//! Création d'une machine SMP
+/*!
+ * Le segment de texte de \a pmach est partagé (non copié) ; son segment de
+ * données est recopié dans un nouveau segment partagé, la zone de pile
+ * initiale étant dupliquée pour chaque processeur. Les messages de chaque
+ * processeur (avertissements) sont accumulés dans son puits \c _messages,
+ * à lire après smp_run().
+ *
+ * \param psmp la machine SMP à initialiser
+ * \param pmach une machine dans laquelle le programme a été chargé
+ * \param ncpus le nombre de processeurs (au moins 1)
+ * \return faux si la mémoire manque
+ */
+bool smp_create(Smp_Machine *psmp, const Machine *pmach, unsigned ncpus);
+
+//! Exécution parallèle
+/*!
+ * Chaque processeur s'exécute sur son thread jusqu'à \c HALT, une erreur
+ * ou l'épuisement de \a budget instructions ; les erreurs d'un processeur
+ * n'arrêtent pas les autres. Le compte rendu de chaque processeur est dans
+ * \c _result.
+ *
+ * \param psmp la machine SMP
+ * \param budget le nombre maximal d'instructions par processeur (0 :
+ * illimité)
+ */
+void smp_run(Smp_Machine *psmp, uint64_t budget);
+
+//! Destruction d'une machine SMP (le segment de texte n'est pas libéré)
+void smp_destroy(Smp_Machine *psmp);
+
+#endif
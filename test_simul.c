@@ -3,11 +3,25 @@
  * \brief Test du simulateur
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "machine.h"
+#include "cfg.h"
 #include "debug.h"
+#include "disasm.h"
+#include "livelock.h"
+#include "memo.h"
+#include "native.h"
+#include "pool.h"
+#include "port.h"
+#include "profile.h"
+#include "sched.h"
+#include "server.h"
+#include "smp.h"
+#include "text.h"
 
 //! Segment de texte
 extern Instruction text[];
@@ -24,6 +38,264 @@ extern const unsigned dataend;
 //! Taille utile du segment de données
 extern const unsigned datasize;  
 
+//! Machine simulée (globale pour l'export des compteurs à la sortie)
+static Machine *mach;
+
+//! Fichier des compteurs de performance (\c - pour la sortie standard)
+static const char *countersfile = "counters.json";
+
+//! Export des compteurs de performance
+/*!
+ * Enregistrée par atexit() : elle est aussi appelée quand le programme
+ * simulé s'arrête sur une erreur.
+ */
+static void write_counters(void)
+{
+    FILE *out = countersfile[0] == '-' && !countersfile[1] ? stdout
+        : fopen(countersfile, "w");
+
+    if (!out)
+    {
+        fprintf(stderr, "Cannot write counters to %s\n", countersfile);
+        return;
+    }
+
+    counters_write_json(out, &mach->_counters, mach->_datasize);
+    if (out != stdout)
+        fclose(out);
+}
+
+//! Canal du port de sortie (option \c -o)
+static Sink port;
+
+//! Transmission des derniers mots du port de sortie
+/*!
+ * Enregistrée par atexit() quand l'option \c -o est donnée.
+ */
+static void close_port(void)
+{
+    sink_release(&port);
+    if (port._file != stdout)
+        fclose(port._file);
+}
+
+//! Table des symboles (option \c -s), ou NULL
+static Symbol_Map *symbols = NULL;
+
+//! Écriture du profil (histogramme et piles repliées)
+/*!
+ * Enregistrée par atexit() quand l'option \c -P est donnée.
+ */
+static void write_profile(void)
+{
+    FILE *out;
+
+    profile_stop();
+
+    if ((out = fopen("profile.txt", "w")))
+    {
+        profile_write_histogram(out, mach->_text, symbols);
+        fclose(out);
+    }
+    else
+        fprintf(stderr, "Cannot write profile.txt\n");
+
+    if ((out = fopen("profile.folded", "w")))
+    {
+        profile_write_folded(out, symbols);
+        fclose(out);
+    }
+    else
+        fprintf(stderr, "Cannot write profile.folded\n");
+}
+
+//! Écriture du graphe de flot de contrôle (option \c -G)
+/*!
+ * \param cfgfile le fichier : format Graphviz si son nom se termine par
+ * \c .dot, JSON sinon
+ * \param cfg le graphe
+ */
+static void write_cfg(const char *cfgfile, const Cfg *cfg)
+{
+    size_t len = strlen(cfgfile);
+    FILE *out = fopen(cfgfile, "w");
+
+    if (!out)
+    {
+        fprintf(stderr, "Cannot write control-flow graph to %s\n", cfgfile);
+        return;
+    }
+
+    if (len >= 4 && !strcmp(cfgfile + len - 4, ".dot"))
+        cfg_write_dot(out, cfg, symbols);
+    else
+        cfg_write_json(out, cfg, symbols);
+    fclose(out);
+}
+
+//! Séquences fusionnées et boucles à compteur du flot prédécodé (voir
+//! exec_predecode() et loop_analyze())
+static void print_fusions(void)
+{
+    if (!mach->_shared || !mach->_shared->_stream)
+        return;
+
+    Fusion_Stats f = mach->_shared->_fusions;
+    printf("Fused sequences: %u LOAD/ADD/STORE, %u SUB/BRANCH, "
+            "%u PUSH/CALL, %u RET/POP\n", f._load_add_store,
+            f._sub_branch, f._push_call, f._ret_pop);
+    printf("Counted loops: %u\n\n", mach->_shared->_nloops);
+}
+
+//! Table des symboles incluse dans un fichier binaire (<tt>sasm -g</tt>)
+/*!
+ * \param programfile le fichier binaire
+ * \return la table, ou NULL s'il n'y en a pas
+ */
+static Symbol_Map *embedded_symbols(const char *programfile)
+{
+    FILE *file = fopen(programfile, "r");
+    Program_Header hdr;
+    Symbol_Map *map = NULL;
+    char *text;
+
+    if (!file)
+        return NULL;
+
+    if (read_program_header(file, &hdr)
+            && (text = read_program_symbols(file, &hdr)))
+    {
+        map = symbol_map_parse(text);
+        free(text);
+    }
+
+    fclose(file);
+    return map;
+}
+
+//! Travail du mode par lots (option \c -B)
+typedef struct
+{
+    char *_name;                //!< Le fichier binaire
+    Sched_Job *_job;            //!< Le travail ordonnancé
+} Batch_Entry;
+
+//! Comparaison de deux travaux par rang de fin (pour qsort())
+static int by_finish(const void *a, const void *b)
+{
+    unsigned fa = ((const Batch_Entry *)a)->_job->_finished;
+    unsigned fb = ((const Batch_Entry *)b)->_job->_finished;
+
+    return fa < fb ? -1 : fa > fb;
+}
+
+//! Mode par lots : exécution par l'ordonnanceur des programmes d'une liste
+/*!
+ * Chaque ligne de la liste donne un fichier binaire, suivi de sa priorité
+ * et de son quota d'instructions (0 ou absents : priorité nulle, quota
+ * illimité) ; les lignes vides ou commençant par \c # sont ignorées. Les
+ * travaux sont affichés dans l'ordre où ils se sont terminés.
+ *
+ * \param listfile la liste
+ * \param nthreads le nombre de threads d'exécution
+ * \param policy la politique d'ordonnancement
+ * \param cap le plafond global d'instructions (0 : illimité)
+ * \param watch vrai pour détecter les boucles sans progrès
+ * \param period leur période de vérification (0 : valeur par défaut)
+ * \return le code de retour : succès si tous les programmes ont atteint HALT
+ */
+static int run_batch(const char *listfile, unsigned nthreads,
+        Sched_Policy policy, unsigned long long cap, bool watch,
+        unsigned long long period)
+{
+    FILE *list = fopen(listfile, "r");
+    Scheduler *sched = sched_create(nthreads, policy, 0, cap);
+    Batch_Entry *entries = NULL;
+    unsigned nentries = 0, lineno = 0;
+    char line[CACHE_MAXPATH + 64];
+    int status = EXIT_SUCCESS;
+
+    if (!list)
+    {
+        fprintf(stderr, "Cannot read batch %s: %s\n", listfile,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (!sched)
+    {
+        fprintf(stderr, "Cannot create the scheduler\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(line, sizeof(line), list))
+    {
+        char name[CACHE_MAXPATH];
+        unsigned priority = 0;
+        unsigned long long quota = 0;
+        Machine *pmach;
+        Batch_Entry *entry;
+
+        ++lineno;
+        if (sscanf(line, "%4095s %u %llu", name, &priority, &quota) < 1
+                || name[0] == '#')
+            continue;
+
+        if (!(pmach = machine_create(NULL)) || !machine_read(pmach, name))
+        {
+            fprintf(stderr, "%s:%u: cannot read program %s: %s\n",
+                    listfile, lineno, name,
+                    pmach ? program_format_error() : strerror(ENOMEM));
+            exit(EXIT_FAILURE);
+        }
+
+        if (!(entry = realloc(entries, (nentries + 1) * sizeof(Batch_Entry)))
+                || (watch && !livelock_enable(pmach, period)))
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        entries = entry;
+        entry = &entries[nentries++];
+        if (!(entry->_job = sched_submit(sched, pmach, priority, quota))
+                || !(entry->_name = malloc(strlen(name) + 1)))
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        strcpy(entry->_name, name);
+    }
+    fclose(list);
+
+    printf("*** Batch execution (%s, %u thread%s) ***\n\n",
+            policy == SCHED_PRIORITY ? "priority" : "round robin",
+            nthreads, nthreads > 1 ? "s" : "");
+    unsigned long long executed = sched_run(sched);
+
+    qsort(entries, nentries, sizeof(Batch_Entry), by_finish);
+    for (unsigned i = 0; i < nentries; ++i)
+    {
+        Sched_Job *job = entries[i]._job;
+
+        printf("%u %s %s %llu", job->_finished, entries[i]._name,
+                job_state_names[job->_state],
+                (unsigned long long)job->_executed);
+        if (job->_state == JOB_FAULTED)
+            printf(" %s 0x%04x", error_names[job->_result._error],
+                    job->_result._address);
+        printf("\n");
+
+        if (job->_state != JOB_HALTED)
+            status = EXIT_FAILURE;
+        machine_destroy(job->_machine);
+        free(entries[i]._name);
+    }
+    printf("\nTotal: %llu instructions\n", executed);
+
+    free(entries);
+    sched_destroy(sched);
+    return status;
+}
+
 //! Help message.
 /*!
  * Printed with option \c -h.
@@ -35,6 +307,36 @@ static void usage()
             "\t-d\tDebug mode (interactive execution)\n"
             "\t-b\tA binary file is provided\n"
             "\t-l\tDo not execute; just display the listing\n"
+            "\t-s file\tSymbol table (as written by sasm -s) for the listing\n"
+            "\t\t(default: the table included by sasm -g, if any)\n"
+            "\t-x\tExecute natively (translated program, no trace);\n"
+            "\t\tignored with -n\n"
+            "\t-C dir\tCache directory for translated programs\n"
+            "\t\t(default: $SIMUL_CACHE, or ~/.cache/simul)\n"
+            "\t-n N\tExecute at most N instructions (no trace); the result\n"
+            "\t\tis kept in the cache directory and reused\n"
+            "\t-R\tBypass the result cache\n"
+            "\t\t($SIMUL_VERIFY=N: one cached result in N is executed\n"
+            "\t\tagain and checked; default 64, 0: never)\n"
+            "\t-p N\tExecute on N processors sharing the data (no trace)\n"
+            "\t-w N\tWith -n or -B, stop when the machine state repeats;\n"
+            "\t\tchecked every N instructions (0: default)\n"
+            "\t-B file\tBatch mode: execute with the scheduler the binary files\n"
+            "\t\tlisted in file (one per line, followed by an optional\n"
+            "\t\tpriority and instruction quota); -n sets a global cap\n"
+            "\t-T N\tWith -B, number of execution threads (default: 1)\n"
+            "\t-Q\tWith -B, strict priorities (default: round robin)\n"
+            "\t-S path\tServe simulation requests on the Unix socket path\n"
+            "\t\t(see sclient); -x enables native execution\n"
+            "\t-P hz\tSample the simulated PC hz times per second (0: default);\n"
+            "\t\tprofile written at exit to profile.txt and profile.folded\n"
+            "\t-G file\tControl-flow graph written to file (Graphviz if it ends\n"
+            "\t\twith .dot, JSON otherwise); with -n, weighted by the\n"
+            "\t\texecution (instruction by instruction)\n"
+            "\t-o file\tWords stored at the output port written to file\n"
+            "\t\t(binary; - for standard output)\n"
+            "\t-j file\tPerformance counters (JSON) written at exit\n"
+            "\t\t(default: counters.json; - for standard output)\n"
             "\t-h\tprint this help message\n"
             "If -b is given, the next argument must be a file name containing\n"
             "a valid program in binary format. Otherwise an internally defined\n"
@@ -61,6 +363,21 @@ int main(int argc, char *argv[])
     bool binfile = false;
     bool no_exec = false;
     char *programfile = NULL;
+    bool native = false;
+    unsigned long long limit = 0;
+    unsigned ncpus = 0;
+    const char *cachedir = getenv("SIMUL_CACHE");
+    bool profiling = false;
+    unsigned hz = 0;
+    bool watch = false;
+    unsigned long long period = 0;
+    const char *socketpath = NULL;
+    bool bypass = false;
+    const char *portfile = NULL;
+    const char *cfgfile = NULL;
+    const char *batchfile = NULL;
+    unsigned nthreads = 1;
+    Sched_Policy policy = SCHED_ROUND_ROBIN;
 
     if (argc > 1) 
     {
@@ -78,6 +395,113 @@ int main(int argc, char *argv[])
                     case 'l': 
                         no_exec = true;
                         break;
+                    case 's':
+                        if (iarg + 1 >= argc 
+                                || !(symbols = symbol_map_read(argv[++iarg])))
+                        {
+                            fprintf(stderr, "Cannot read symbol table\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        break;
+                    case 'x':
+                        native = true;
+                        break;
+                    case 'C':
+                        if (iarg + 1 >= argc)
+                        {
+                            fprintf(stderr, "Missing cache directory\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        cachedir = argv[++iarg];
+                        break;
+                    case 'n':
+                        if (iarg + 1 >= argc
+                                || (limit = strtoull(argv[++iarg], NULL, 0)) == 0)
+                        {
+                            fprintf(stderr, "Bad instruction limit\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        break;
+                    case 'R':
+                        bypass = true;
+                        break;
+                    case 'w':
+                        if (iarg + 1 >= argc)
+                        {
+                            fprintf(stderr, "Missing livelock check period\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        period = strtoull(argv[++iarg], NULL, 0);
+                        watch = true;
+                        break;
+                    case 'p':
+                        if (iarg + 1 >= argc
+                                || (ncpus = strtoul(argv[++iarg], NULL, 0)) == 0)
+                        {
+                            fprintf(stderr, "Bad number of processors\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        break;
+                    case 'B':
+                        if (iarg + 1 >= argc)
+                        {
+                            fprintf(stderr, "Missing batch file\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        batchfile = argv[++iarg];
+                        break;
+                    case 'T':
+                        if (iarg + 1 >= argc
+                                || (nthreads = strtoul(argv[++iarg], NULL, 0)) == 0)
+                        {
+                            fprintf(stderr, "Bad number of threads\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        break;
+                    case 'Q':
+                        policy = SCHED_PRIORITY;
+                        break;
+                    case 'S':
+                        if (iarg + 1 >= argc)
+                        {
+                            fprintf(stderr, "Missing socket path\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        socketpath = argv[++iarg];
+                        break;
+                    case 'P':
+                        if (iarg + 1 >= argc)
+                        {
+                            fprintf(stderr, "Missing sampling frequency\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        profiling = true;
+                        hz = strtoul(argv[++iarg], NULL, 0);
+                        break;
+                    case 'G':
+                        if (iarg + 1 >= argc)
+                        {
+                            fprintf(stderr, "Missing graph file\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        cfgfile = argv[++iarg];
+                        break;
+                    case 'o':
+                        if (iarg + 1 >= argc)
+                        {
+                            fprintf(stderr, "Missing output file\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        portfile = argv[++iarg];
+                        break;
+                    case 'j':
+                        if (iarg + 1 >= argc)
+                        {
+                            fprintf(stderr, "Missing counters file\n");
+                            exit(EXIT_FAILURE);
+                        }
+                        countersfile = argv[++iarg];
+                        break;
                     case 'h':
                         usage();
                         exit(EXIT_SUCCESS);
@@ -93,30 +517,236 @@ int main(int argc, char *argv[])
         }
     }
 
-    Machine mach;
+    // Le cache des traductions est dans le répertoire de l'utilisateur par
+    // défaut
+    char defaultdir[CACHE_MAXPATH];
+    if (!cachedir)
+    {
+        snprintf(defaultdir, sizeof(defaultdir), "%s/.cache/simul",
+                getenv("HOME") ? getenv("HOME") : "/tmp");
+        cachedir = defaultdir;
+    }
+
+    // Mode serveur : ni programme local ni dump
+    if (socketpath)
+        return server_run(socketpath, 0, cachedir,
+                (native ? SERVER_NATIVE : 0) | (bypass ? 0 : SERVER_MEMO))
+            ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // Mode par lots : les programmes de la liste, sans dump
+    if (batchfile)
+        return run_batch(batchfile, nthreads, policy, limit, watch, period);
+
+    if (!(mach = machine_create(NULL)))
+    {
+        fprintf(stderr, "Cannot create machine\n");
+        exit(EXIT_FAILURE);
+    }
 
     if (!binfile) 
-        load_program(&mach, textsize, text, datasize, data, dataend);
-    else 
-        read_program(&mach, programfile);   
+        machine_load(mach, textsize, text, datasize, datasize, data, dataend);
+    else if (!machine_read(mach, programfile))
+    {
+        FILE *file = fopen(programfile, "r");
+
+        fprintf(stderr, "Cannot read program %s: %s\n", programfile,
+                file ? program_format_error() : strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    else if (!symbols)
+        symbols = embedded_symbols(programfile);
 
     printf("\n*** Sauvegarde des programmes et données initiales en format binaire ***\n\n");
-    dump_memory(&mach);
+    dump_memory(mach);
 
     printf("\n*** Machine state before execution ***\n");
-    print_program(&mach);
-    print_data(&mach);
-    print_cpu(&mach);
+    if (symbols)
+    {
+        printf("\n*** PROGRAM (size: %i) ***\n", mach->_textsize);
+        print_listing(sink_stdout(), mach->_text, mach->_textsize, symbols);
+        printf("\n");
+    }
+    else
+        print_program(mach);
+    print_data(mach);
+    print_cpu(mach);
+
+    // Graphe pondéré par une exécution bornée, sinon écrit avant l'exécution
+    Cfg *cfg = NULL;
+    bool weighted = limit && !debug && !ncpus;
+    if (cfgfile)
+    {
+        if (!(cfg = cfg_build(mach->_text, mach->_textsize)))
+        {
+            fprintf(stderr, "Cannot build the control-flow graph\n");
+            exit(EXIT_FAILURE);
+        }
+        if (!weighted || no_exec)
+            write_cfg(cfgfile, cfg);
+    }
 
     if (no_exec) 
         return 0;
 
-    printf("\n*** Execution trace ***\n\n");
-    simul(&mach, debug);
+    atexit(write_counters);
+
+    // Sortie au fil de l'exécution : chaque lot est écrit sans tampon
+    if (portfile)
+    {
+        FILE *out = portfile[0] == '-' && !portfile[1] ? stdout
+            : fopen(portfile, "w");
+
+        if (!out)
+        {
+            fprintf(stderr, "Cannot write output to %s\n", portfile);
+            exit(EXIT_FAILURE);
+        }
+        setvbuf(out, NULL, _IONBF, 0);
+        sink_file(&port, out, PORT_BATCH);
+        mach->_port = &port;
+        atexit(close_port);
+    }
+
+    if (profiling)
+    {
+        if (!profile_start(hz, mach->_textsize))
+        {
+            fprintf(stderr, "Cannot start the profiler\n");
+            exit(EXIT_FAILURE);
+        }
+        atexit(write_profile);
+    }
+
+    if (ncpus && !debug)
+    {
+        Smp_Machine smp;
+
+        if (!smp_create(&smp, mach, ncpus))
+        {
+            fprintf(stderr, "Cannot create %u processors\n", ncpus);
+            exit(EXIT_FAILURE);
+        }
+
+        printf("\n*** Parallel execution on %u processors ***\n\n", ncpus);
+        print_fusions();
+        smp_run(&smp, limit);
+
+        int status = EXIT_SUCCESS;
+        counters_reset(&mach->_counters, mach->_sp);
+        for (unsigned i = 0; i < ncpus; ++i)
+        {
+            Smp_Cpu *cpu = smp._cpus[i];
+
+            printf("\n*** CPU %u: %s after %llu instructions ***\n", i,
+                    run_status_names[cpu->_result._status],
+                    (unsigned long long)cpu->_result._executed);
+            fflush(stdout);
+            sink_write(sink_stderr(), sink_contents(&cpu->_messages),
+                    cpu->_messages._length);
+            if (cpu->_result._status == RUN_FAULTED)
+                error_report(cpu->_result._error, cpu->_result._address);
+            if (cpu->_result._status != RUN_HALTED)
+                status = EXIT_FAILURE;
+            print_cpu(&cpu->_mach);
+            counters_add(&mach->_counters, &cpu->_mach._counters);
+        }
+
+        printf("\n*** Shared data after execution ***\n");
+        print_data(&smp._cpus[0]->_mach);
+        smp_destroy(&smp);
+
+        return status;
+    }
+
+    int status = EXIT_SUCCESS;
+    Translated_Func translated = NULL;
+    // Le code traduit s'exécute jusqu'au bout : avec -n, on interprète
+    if (native && !debug && !limit)
+    {
+        Cache cache;
+        bool hit;
+
+        if (!cache_open(&cache, cachedir, 0))
+            fprintf(stderr, "Cannot open cache directory %s\n", cachedir);
+        else if ((translated = native_load(mach, &cache, &hit)))
+            fprintf(stderr, "Translation %s\n", hit ? "cached" : "compiled");
+    }
+
+    if (translated)
+    {
+        printf("\n*** Native execution ***\n\n");
+        Machine *previous = machine_enter(mach);
+        counters_start(&mach->_counters);
+        translated(mach);
+        counters_stop(&mach->_counters);
+        machine_leave(previous);
+    }
+    else if (limit && !debug)
+    {
+        // L'état final est affiché même après une erreur
+        printf("\n*** Bounded execution ***\n\n");
+        print_fusions();
+        if (watch && !livelock_enable(mach, period))
+        {
+            fprintf(stderr, "Cannot watch for livelocks\n");
+            exit(EXIT_FAILURE);
+        }
+
+        // Résultat d'une exécution précédente (le profilage, la sortie sur
+        // le port et le graphe pondéré exigent une exécution réelle) ; les
+        // avertissements sont enregistrés avec lui
+        Memo memo;
+        Hash key;
+        Memo_Lookup found = MEMO_MISS;
+        Run_Result res;
+        Sink messages;
+        bool memoize = !bypass && !profiling && !portfile && !cfg;
+        if (memoize && !(memoize = memo_open(&memo, cachedir, 0)))
+            fprintf(stderr, "Cannot open cache directory %s\n", cachedir);
+
+        sink_buffer(&messages);
+        if (memoize)
+        {
+            memo_key(mach, limit, &key);
+            found = memo_lookup(&memo, &key, mach, true, &res, &messages);
+        }
+
+        if (found == MEMO_HIT)
+            fprintf(stderr, "Result cached\n");
+        else
+        {
+            mach->_messages = &messages;
+            res = cfg ? cfg_run(cfg, mach, limit) : run(mach, limit);
+            mach->_messages = NULL;
+            if (memoize)
+                memo_store(&memo, &key, mach, &res, sink_contents(&messages),
+                        messages._length, true);
+        }
+        sink_write(sink_stderr(), sink_contents(&messages), messages._length);
+        sink_release(&messages);
+        if (cfg)
+            write_cfg(cfgfile, cfg);
+
+        if (res._status == RUN_FAULTED)
+            error_report(res._error, res._address);
+        if (res._status == RUN_LIVELOCK)
+            fprintf(stderr, "Livelock: state repeats every %llu instructions "
+                    "in 0x%04x-0x%04x\n", (unsigned long long)res._cycle,
+                    res._first, res._last);
+        if (res._status == RUN_BUDGET)
+            fprintf(stderr, "Instruction limit reached (%llu)\n", limit);
+        if (res._status != RUN_HALTED)
+            status = EXIT_FAILURE;
+    }
+    else
+    {
+        printf("\n*** Execution trace ***\n\n");
+        simul(mach, debug);
+    }
 
     printf("\n*** Machine state after execution ***\n");
-    print_cpu(&mach);
-    print_data(&mach);
+    print_cpu(mach);
+    print_data(mach);
 
-    return 0; 
+    return status;
 }
@@ -0,0 +1,53 @@
+//-----------------
+// Opérations arithmétiques et logiques : MUL, DIV, MOD (troncature vers
+// zéro, INT32_MIN / -1), AND, OR, XOR, décalages (nombre réduit à 5 bits,
+// SHR logique et SAR arithmétique), puis division par zéro (ERR_DIVIDE, le
+// registre n'est pas modifié).
+//-----------------
+        TEXT 40
+
+        LOAD R01, #7
+        MUL R01, @six           // -42
+        LOAD R02, #-43
+        DIV R02, #5             // -8
+        LOAD R03, #-43
+        MOD R03, #5             // -3
+
+        // INT32_MIN / -1 et INT32_MIN mod -1
+        LOAD R04, #1
+        SHL R04, #31
+        LOAD R05, R04
+        LOAD R14, #-1
+        DIV R04, R14            // INT32_MIN
+        MOD R05, R14            // 0
+
+        LOAD R06, #0xF0F
+        AND R06, #0x0FF         // 0x00F
+        LOAD R07, #0xF00
+        OR R07, #0x0F0          // 0xFF0
+        LOAD R08, #0xFF
+        XOR R08, #0x0F          // 0x0F0
+
+        // Décalages : le nombre est pris modulo 32
+        LOAD R09, #1
+        SHL R09, #33            // 2
+        LOAD R10, #-16
+        SHR R10, #2             // 0x3FFFFFFC
+        LOAD R11, #-16
+        SAR R11, #2             // -4
+        LOAD R12, #-16
+        SAR R12, #36            // -1
+        LOAD R14, #35
+        LOAD R13, #1
+        SHL R13, R14            // 8
+
+        STORE R01, @result
+        LOAD R14, #0
+        DIV R01, R14            // ERR_DIVIDE
+        HALT
+        END
+
+        DATA 10
+six     WORD -6
+result  WORD 0
+        END
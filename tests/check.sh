@@ -0,0 +1,420 @@
+#!/bin/sh
+#-------------------------------------------------------------------
+# Tests de non-régression (make check)
+#-------------------------------------------------------------------
+#
+# Chaque test est exécuté par test_simul en mode borné (-n), avec détection
+# des boucles sans progrès (-w) et un cache des résultats vide (le temps
+# mesuré est celui d'une vraie exécution), en parallèle, puis son résultat est
+# comparé au fichier de référence tests/NOM.expected : code de retour,
+# erreurs, avertissements et cycles, PC, CC et registres finaux, empreinte
+# (cksum) du segment de données et compteurs de performance (sauf les
+# temps). Le test est ensuite repris deux fois du cache (memo.h), dont une
+# avec vérification : le résultat doit être le même.
+#
+# Les tests sont :
+#   - tests/NOM.bin : programme binaire ;
+#   - tests/NOM.asm sans NOM.bin : source assemblé par sasm ;
+#   - tests/NOM.c : programme prédéfini lié avec test_simul (tests/NOM.run,
+#     construit par make).
+#
+# Pour un programme NOM.bin ou NOM.asm accompagné de tests/NOM.graph.expected,
+# le graphe de flot de contrôle (option -G), statique et pondéré, est
+# également comparé à ce fichier ; accompagné de tests/NOM.smp.expected, le
+# programme est aussi exécuté sur CHECK_CPUS processeurs (option -p, 4 par
+# défaut).
+#
+# Les programmes de tests/sched.batch sont aussi exécutés ensemble par
+# l'ordonnanceur (test_simul -B), avec différentes options : résultats
+# comparés à tests/sched_*.expected. Le serveur d'exécution (test_simul -S)
+# est interrogé par sclient : réponses comparées à tests/server.expected.
+#
+# Enfin, bench -m crée CHECK_MACHINES machines simultanées (20000 par
+# défaut) pour vérifier que leurs segments gardés (guard.h) tiennent dans
+# l'espace d'adressage.
+#
+# Le temps processeur de chaque simulation (compteur cpu_time) est écrit
+# dans check.log ; la version précédente est conservée dans check.log.old
+# et les tests devenus plus de CHECK_SLOWDOWN fois plus lents (2 par
+# défaut) sont signalés, s'ils duraient au moins 5 ms (en deçà, la mesure
+# n'est pas significative).
+#
+# Usage : sh tests/check.sh [-u]
+#   -u  réécrit les fichiers de référence au lieu de les comparer
+#
+# Variables : SIMUL, SASM, SCLIENT, BENCH (exécutables), CHECK_JOBS (tests
+# simultanés), CHECK_LIMIT (instructions par test), CHECK_SLOWDOWN,
+# CHECK_MACHINES, CHECK_CPUS.
+#-------------------------------------------------------------------
+
+SIMUL=${SIMUL:-./test_simul}
+SASM=${SASM:-./sasm}
+SCLIENT=${SCLIENT:-./sclient}
+BENCH=${BENCH:-./bench}
+CHECK_LIMIT=${CHECK_LIMIT:-10000000}
+CHECK_SLOWDOWN=${CHECK_SLOWDOWN:-2}
+CHECK_MACHINES=${CHECK_MACHINES:-20000}
+CHECK_CPUS=${CHECK_CPUS:-4}
+
+# Résultat normalisé d'une exécution
+#   $1 code de retour, $2 sortie standard, $3 sortie d'erreur, $4 compteurs
+normalize()
+{
+    echo "exit: $1"
+    grep -E '^(ERROR|WARNING|Instruction limit|Livelock)' "$3"
+    sed -n '/^\*\*\* Machine state after execution/,$p' "$2" \
+        | grep -E '^(PC:|R[0-9][0-9]:)'
+    printf 'data: '
+    sed -n '/^\*\*\* Machine state after execution/,$p' "$2" \
+        | grep '^0x' | cksum
+    echo "counters:"
+    grep -v -E '"(wall|cpu)_time"' "$4" | sed 's/,$//'
+}
+
+# Binaire d'un test .bin ou .asm (assemblé dans $2) ; échoue, le diagnostic
+# de sasm dans $2/diff, si le source est invalide
+#   $1 nom du test, $2 répertoire de travail
+binary()
+{
+    if [ -f "tests/$1.bin" ]; then
+        echo "$TOP/tests/$1.bin"
+    elif "$SASM" -o "$2/$1.bin" "tests/$1.asm" > "$2/diff" 2>&1; then
+        echo "$2/$1.bin"
+    else
+        return 1
+    fi
+}
+
+# Comparaison (ou mise à jour) de $WORK/$1$2/actual avec tests/$1$2.expected :
+# écrit $WORK/$1$2.result ("ok"/"FAIL", nom, temps $3)
+compare()
+{
+    if [ -n "$UPDATE" ]; then
+        cp "$WORK/$1$2/actual" "tests/$1$2.expected"
+        echo "ok $1$2 ${3:--}" > "$WORK/$1$2.result"
+    elif diff -u "tests/$1$2.expected" "$WORK/$1$2/actual" \
+        > "$WORK/$1$2/diff" 2>&1
+    then
+        echo "ok $1$2 ${3:--}" > "$WORK/$1$2.result"
+    else
+        echo "FAIL $1$2 ${3:--}" > "$WORK/$1$2.result"
+    fi
+}
+
+# Exécution d'un test : écrit $WORK/NOM.result ("ok"/"FAIL", nom, temps)
+run_one()
+{
+    name=$1
+    dir=$WORK/$name
+    mkdir -p "$dir"
+
+    if [ -f "tests/$name.c" ]; then
+        set -- "$TOP/tests/$name.run"
+    elif bin=$(binary "$name" "$dir"); then
+        set -- "$SIMUL" -b "$bin"
+    else
+        echo "FAIL $name -" > "$WORK/$name.result"
+        return
+    fi
+
+    # Dans son propre répertoire : test_simul y écrit dump.bin ; le cache
+    # des résultats, vide, est le sien
+    (cd "$dir" && "$@" -n "$CHECK_LIMIT" -w 0 -C cache -j counters.json \
+        > out 2> err < /dev/null)
+    status=$?
+
+    normalize $status "$dir/out" "$dir/err" "$dir/counters.json" \
+        > "$dir/actual"
+    time=$(sed -n 's/.*"cpu_time": *\([0-9.e+-]*\).*/\1/p' \
+        "$dir/counters.json")
+
+    compare "$name" "" "$time"
+    if ! cached "$@" > "$dir/cached" 2>&1; then
+        echo "FAIL $name ${time:--}" > "$WORK/$name.result"
+        cat "$dir/cached" >> "$dir/diff"
+    fi
+}
+
+# Deux nouvelles exécutions d'un test (run_one) avec son cache : un succès
+# (SIMUL_VERIFY=0), puis un succès tiré pour vérification (SIMUL_VERIFY=1),
+# réexécuté et comparé à l'enregistrement. Leurs résultats doivent être ceux
+# de la première exécution ; les différences sont écrites sur la sortie.
+#   $@ la commande du test
+cached()
+{
+    for verify in 0 1; do
+        (cd "$dir" && SIMUL_VERIFY=$verify "$@" -n "$CHECK_LIMIT" -w 0 \
+            -C cache -j counters.json > out 2> err < /dev/null)
+        status=$?
+
+        normalize $status "$dir/out" "$dir/err" "$dir/counters.json" \
+            > "$dir/again"
+        if [ $verify = 0 ] && ! grep -q '^Result cached' "$dir/err"; then
+            echo "result not cached"
+            return 1
+        fi
+        grep 'Result cache mismatch' "$dir/err" && return 1
+        diff -u --label miss --label "hit (SIMUL_VERIFY=$verify)" \
+            "$dir/actual" "$dir/again" || return 1
+    done
+}
+
+# Graphe de flot de contrôle d'un test (-G) : statique (-l) et pondéré par
+# une exécution bornée, aux formats Graphviz et JSON, comparés ensemble à
+# tests/NOM.graph.expected
+run_graph()
+{
+    name=$1
+    dir=$WORK/$name.graph
+    mkdir -p "$dir"
+
+    if ! bin=$(binary "$name" "$dir"); then
+        echo "FAIL $name.graph -" > "$WORK/$name.graph.result"
+        return
+    fi
+
+    (cd "$dir" && "$SIMUL" -b "$bin" -l -G static.dot \
+        && "$SIMUL" -b "$bin" -l -G static.json \
+        && "$SIMUL" -b "$bin" -n "$CHECK_LIMIT" -R -G weighted.dot \
+        && "$SIMUL" -b "$bin" -n "$CHECK_LIMIT" -R -G weighted.json) \
+        > /dev/null 2>&1 < /dev/null
+    for graph in static.dot static.json weighted.dot weighted.json; do
+        echo "== $graph"
+        cat "$dir/$graph"
+    done > "$dir/actual" 2>&1
+
+    compare "$name" .graph
+}
+
+# Exécution de tests/sched.batch par l'ordonnanceur (test_simul -B) :
+# écrit $WORK/NOM.result
+#   $1 nom du test (référence tests/NOM.expected), puis options de test_simul
+run_batch()
+{
+    name=$1
+    dir=$WORK/$name
+    mkdir -p "$dir"
+    shift
+
+    for program in $(sed -e 's/#.*//' tests/sched.batch | awk '{ print $1 }')
+    do
+        if ! bin=$(binary "${program%.bin}" "$dir"); then
+            echo "FAIL $name -" > "$WORK/$name.result"
+            return
+        fi
+        [ "$bin" = "$dir/$program" ] || cp "$bin" "$dir/$program"
+    done
+    cp tests/sched.batch "$dir"
+
+    (cd "$dir" && "$SIMUL" -B sched.batch "$@" > out 2> err < /dev/null)
+    status=$?
+
+    # Avec plusieurs threads, l'ordre de fin des travaux n'est pas fixé
+    {
+        echo "exit: $status"
+        case " $* " in
+            *" -T 1 "*) cat "$dir/out" ;;
+            *) grep -v '^[0-9]' "$dir/out"
+               grep '^[0-9]' "$dir/out" | cut -d ' ' -f 2- | sort ;;
+        esac
+    } > "$dir/actual"
+
+    compare "$name" ""
+}
+
+# Exécution d'un test sur CHECK_CPUS processeurs (-p), comparée à
+# tests/NOM.smp.expected : code de retour, état, PC, CC et registres de
+# chaque processeur, premiers mots et empreinte des données partagées. Le
+# nombre d'instructions de chaque processeur dépend de l'entrelacement : il
+# n'est pas comparé, pas plus que les compteurs.
+run_smp()
+{
+    name=$1
+    dir=$WORK/$name.smp
+    mkdir -p "$dir"
+
+    if ! bin=$(binary "$name" "$dir"); then
+        echo "FAIL $name.smp -" > "$WORK/$name.smp.result"
+        return
+    fi
+
+    (cd "$dir" && "$SIMUL" -b "$bin" -p "$CHECK_CPUS" -n "$CHECK_LIMIT" \
+        -j counters.json > out 2> err < /dev/null)
+    status=$?
+
+    {
+        echo "exit: $status"
+        grep -E '^(ERROR|WARNING|Instruction limit)' "$dir/err" | sort
+        sed -n '/^\*\*\* CPU [0-9]/,/^\*\*\* Shared data/p' "$dir/out" \
+            | grep -E '^(\*\*\* CPU [0-9]|PC:|R[0-9][0-9]:)' \
+            | sed 's/ after [0-9]* instructions//'
+        sed -n '/^\*\*\* Shared data/,$p' "$dir/out" > "$dir/data"
+        grep '^0x0000:' "$dir/data"
+        printf 'data: '
+        grep '^0x' "$dir/data" | cksum
+    } > "$dir/actual"
+
+    compare "$name" .smp
+}
+
+# Réponses du serveur triées par identifiant, sans les durées
+#   $1 sortie de sclient
+responses()
+{
+    grep -v -E '"(wall|cpu)_time"' "$1" | awk '
+        /^RESULT / { id = $2; ids[id] = 1 }
+        id != "" { block[id] = block[id] $0 "\n" }
+        /^END / { id = "" }
+        END { for (i = 0; i in ids; ++i) printf "%s", block[i] }'
+}
+
+# Serveur d'exécution (test_simul -S) et son client : des programmes de
+# test soumis deux fois (la seconde, les réponses viennent du cache des
+# résultats et doivent être les mêmes), une image trop grande, puis l'arrêt
+# du serveur. Résultat comparé à tests/server.expected.
+run_server()
+{
+    name=server
+    dir=$WORK/$name
+    mkdir -p "$dir"
+    sock=$dir/sock
+
+    set --
+    for program in fib_rec halt loops livelock; do
+        if ! bin=$(binary "$program" "$dir"); then
+            echo "FAIL $name -" > "$WORK/$name.result"
+            return
+        fi
+        set -- "$@" "$bin"
+    done
+    # Fichier creux : l'image n'est lue que par le serveur, sans être gardée
+    dd if=/dev/zero of="$dir/big.bin" bs=1 count=0 seek=67108865 2> /dev/null
+
+    SIMUL_VERIFY=0 "$SIMUL" -S "$sock" -C "$dir/cache" > "$dir/log" 2>&1 \
+        < /dev/null &
+    server=$!
+    tries=0
+    while [ ! -S "$sock" ] && [ $tries -lt 100 ]; do
+        sleep 0.1
+        tries=$((tries + 1))
+    done
+
+    {
+        "$SCLIENT" -c -n "$CHECK_LIMIT" -w 0 "$sock" "$@" > "$dir/miss"
+        echo "exit: $?"
+        responses "$dir/miss" | tee "$dir/miss.sorted"
+        "$SCLIENT" -c -n "$CHECK_LIMIT" -w 0 "$sock" "$@" > "$dir/hit"
+        echo "exit: $?"
+        responses "$dir/hit" | diff -u --label miss --label hit \
+            "$dir/miss.sorted" -
+        "$SCLIENT" -s "$sock" | grep -o 'result_hits=[0-9]*'
+        echo "== image too large"
+        "$SCLIENT" "$sock" "$dir/big.bin"
+        echo "exit: $?"
+        echo "== shutdown"
+        "$SCLIENT" -q "$sock"
+        wait $server
+        echo "server exit: $?"
+    } > "$dir/actual" 2>&1
+
+    compare "$name" ""
+}
+
+# Appel récursif pour un test (depuis xargs)
+if [ "$1" = "--one" ]; then
+    case $2 in
+        *.graph) run_graph "${2%.graph}" ;;
+        *.smp) run_smp "${2%.smp}" ;;
+        *) run_one "$2" ;;
+    esac
+    exit 0
+fi
+
+[ "$1" = "-u" ] && UPDATE=1
+
+TOP=$(pwd)
+case $SIMUL in /*) ;; *) SIMUL=$TOP/$SIMUL ;; esac
+case $SASM in /*) ;; *) SASM=$TOP/$SASM ;; esac
+case $SCLIENT in /*) ;; *) SCLIENT=$TOP/$SCLIENT ;; esac
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/check.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+export SIMUL SASM CHECK_LIMIT CHECK_CPUS TOP WORK UPDATE
+
+CHECK_JOBS=${CHECK_JOBS:-$(nproc 2> /dev/null || echo 4)}
+
+tests=$(for f in tests/*.bin tests/*.asm tests/*.c; do
+            [ -f "$f" ] && basename "$f" | sed 's/\.[a-z]*$//'
+        done | sort -u
+        for f in tests/*.graph.expected tests/*.smp.expected; do
+            [ -f "$f" ] && basename "$f" .expected
+        done)
+
+printf '%s\n' $tests | xargs -P "$CHECK_JOBS" -n 1 sh "$0" --one
+
+[ -f check.log ] && mv check.log check.log.old
+passed=0
+failed=0
+for name in $tests; do
+    set -- $(cat "$WORK/$name.result")
+    printf '%-4s %-20s %s\n' "$1" "$2" "$3" >> check.log
+    if [ "$1" = ok ]; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+        echo "FAIL: $name"
+        cat "$WORK/$name/diff"
+    fi
+done
+
+# Serveur d'exécution
+run_server
+set -- $(cat "$WORK/server.result")
+printf '%-4s %-20s %s\n' "$1" "$2" "$3" >> check.log
+if [ "$1" = ok ]; then
+    passed=$((passed + 1))
+else
+    failed=$((failed + 1))
+    echo "FAIL: server"
+    cat "$WORK/server/diff"
+fi
+
+# Ordonnanceur : à tour de rôle, par priorité, avec un plafond global et
+# sur plusieurs threads
+while read name options; do
+    run_batch $name $options
+    set -- $(cat "$WORK/$name.result")
+    printf '%-4s %-20s %s\n' "$1" "$2" "$3" >> check.log
+    if [ "$1" = ok ]; then
+        passed=$((passed + 1))
+    else
+        failed=$((failed + 1))
+        echo "FAIL: $name"
+        cat "$WORK/$name/diff"
+    fi
+done <<EOF
+sched_rr -T 1
+sched_prio -T 1 -Q
+sched_cap -T 1 -n 500000
+sched_threads -T 4
+EOF
+
+# Machines simultanées
+if "$BENCH" -m "$CHECK_MACHINES" > "$WORK/machines" 2>&1; then
+    passed=$((passed + 1))
+else
+    failed=$((failed + 1))
+    echo "FAIL: $CHECK_MACHINES machines"
+    cat "$WORK/machines"
+fi
+
+# Ralentissements par rapport à l'exécution précédente
+if [ -f check.log.old ]; then
+    awk -v k="$CHECK_SLOWDOWN" '
+        NR == FNR { old[$2] = $3; next }
+        ($2 in old) && old[$2] >= 0.005 && $3 > k * old[$2] {
+            printf "SLOWER: %s %ss (was %ss)\n", $2, $3, old[$2]
+        }' check.log.old check.log
+fi
+
+echo "$passed passed, $failed failed (times in check.log)"
+[ "$failed" -eq 0 ]
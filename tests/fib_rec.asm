@@ -0,0 +1,39 @@
+//-----------------
+// Fibonacci récursif : fib(24) dans result
+// (appels, retours et pile ; sert aussi de mesure de performance)
+//-----------------
+        TEXT 30
+
+        // Programme principal
+main    EQU *
+        LOAD R00, #24
+        CALL NC, @fib
+        STORE R00, @result
+        HALT
+
+        // R00 <- fib(R00)
+fib     EQU *
+        CMP R00, #2
+        BRANCH LT, @done
+        PUSH R00
+        SUB R00, #1
+        CALL NC, @fib
+        LOAD R01, 1[R15]
+        STORE R00, 1[R15]
+        LOAD R00, R01
+        SUB R00, #2
+        CALL NC, @fib
+        ADD R00, 1[R15]
+        ADD R15, #1
+done    RET
+
+        END
+
+//-----------------
+// Données et pile
+//-----------------
+        DATA 100
+
+result  WORD 0
+
+        END
@@ -0,0 +1,61 @@
+//-----------------
+// Séquences fusionnées (exec_predecode) : LOAD/ADD/STORE, SUB/BRANCH,
+// PUSH/CALL, POP au retour, saut indexé au milieu d'une séquence, puis
+// erreur au milieu d'une séquence (état attendu : celui de l'exécution
+// instruction par instruction)
+//-----------------
+        TEXT 60
+
+main    EQU *
+        LOAD R03, #50
+        LOAD R05, #slot
+loop    EQU *
+        LOAD R01, @count
+        ADD R01, #1
+        STORE R01, @count
+        LOAD R02, 0[R05]
+        ADD R02, R03
+        STORE R02, 0[R05]
+        PUSH R03
+        CALL NC, @twice
+        POP @popped
+        SUB R03, #1
+        BRANCH GT, @loop
+
+        // Entrée indexée à l'intérieur d'une séquence
+        LOAD R06, #inner
+        BRANCH NC, 0[R06]
+        LOAD R01, @count
+inner   ADD R01, #1000
+        STORE R01, @count
+
+        // Erreur sur l'ADD d'une séquence
+        LOAD R07, #5000
+        LOAD R01, @count
+        ADD R01, 0[R07]
+        STORE R01, @count
+        HALT
+
+        // Double le sommet de pile (appelant), cumul dans total
+twice   EQU *
+        LOAD R04, 2[R15]
+        ADD R04, 2[R15]
+        STORE R04, 2[R15]
+        LOAD R04, @total
+        ADD R04, 2[R15]
+        STORE R04, @total
+        RET
+
+        END
+
+//-----------------
+// Données et pile
+//-----------------
+        DATA 100
+
+count   WORD 0
+slot    WORD 0
+popped  WORD 0
+total   WORD 0
+
+        END
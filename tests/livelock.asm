@@ -0,0 +1,19 @@
+//-----------------
+// Boucle sans progrès : x bascule entre 0 et 1 par la pile, l'état se
+// répète toutes les deux itérations (test_simul -w arrête l'exécution)
+//-----------------
+        TEXT 20
+        LOAD R02, #7
+loop    LOAD R01, @x
+        XOR R01, #1
+        STORE R01, @x
+        PUSH R01
+        POP @y
+        ADD R02, #0
+        BRANCH NE, @loop
+        HALT
+        END
+        DATA 5000
+x       WORD 0
+y       WORD 0
+        END
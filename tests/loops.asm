@@ -0,0 +1,60 @@
+//-----------------
+// Boucles à compteur (loop.h) : chaque boucle est sautée en O(1) ; l'état
+// et les compteurs doivent être ceux de l'exécution pas à pas. La dernière
+// boucle ne s'arrête pas avant la limite d'instructions.
+//-----------------
+        TEXT 60
+
+        // Décompte : le test porte sur le dernier SUB
+        LOAD R01, #1000
+count   ADD R02, #3
+        SUB R01, #1
+        BRANCH NE, @count
+
+        // Comparaison après l'écriture
+cmp     ADD R03, #7
+        CMP R03, #5000
+        BRANCH LT, @cmp
+
+        // Comparaison à un registre invariant
+        LOAD R05, #301
+invar   ADD R04, #2
+        NOP
+        CMP R04, R05
+        BRANCH LE, @invar
+
+        // Jusqu'au débordement
+        LOAD R06, #1
+wrap    ADD R06, #100000
+        BRANCH GT, @wrap
+
+        // Affectation constante
+set     LOAD R07, #0
+        ADD R08, #1
+        CMP R08, #10
+        BRANCH NE, @set
+
+        // Sortie immédiate
+        LOAD R09, #0
+once    ADD R09, #0
+        BRANCH NE, @once
+
+        // Pas négatif lu dans un registre
+        LOAD R10, #-3
+        LOAD R11, #500
+neg     ADD R09, R10
+        SUB R11, #1
+        BRANCH GT, @neg
+
+        // Sans fin (jusqu'à la limite)
+        LOAD R12, #1
+forever ADD R13, #5
+        ADD R12, #1
+        BRANCH NE, @forever
+        HALT
+
+        END
+
+        DATA 10
+x       WORD 0
+        END
@@ -0,0 +1,28 @@
+//-----------------
+// Port de sortie (port.h) : les STORE aux adresses du port ne touchent pas
+// le segment de données et ne provoquent pas d'erreur, même sans canal.
+//-----------------
+        TEXT 20
+
+out     EQU 1048574
+flush   EQU 1048575
+
+        LOAD R01, #10
+        LOAD R02, #0
+next    ADD R02, R01
+        STORE R02, @out
+        SUB R01, #1
+        BRANCH NE, @next
+
+        // Adresses indexées
+        LOAD R03, #524287
+        ADD R03, R03
+        STORE R03, 0[R03]
+        STORE R00, 1[R03]
+        STORE R02, @flush
+        HALT
+        END
+
+        DATA 10
+x       WORD 0
+        END
@@ -0,0 +1,27 @@
+//-----------------
+// Verrou tournant (smp.h) : chaque processeur incrémente 20000 fois le
+// compteur partagé sous un verrou pris par XCHG. Exécuté aussi sur 4
+// processeurs (spinlock.smp.expected) : le compteur doit valoir 80000 et
+// R00 donne le numéro de chaque processeur.
+//-----------------
+        TEXT 30
+
+        LOAD R03, #20000
+loop    LOAD R01, #1
+lock    XCHG R01, @mutex        // CC selon l'ancienne valeur
+        BRANCH NE, @lock
+        LOAD R02, @count
+        ADD R02, #1
+        STORE R02, @count
+        LOAD R02, #0            // aucune trace de l'entrelacement
+        LOAD R01, #0
+        XCHG R01, @mutex        // libération
+        SUB R03, #1
+        BRANCH NE, @loop
+        HALT
+        END
+
+        DATA 10
+mutex   WORD 0
+count   WORD 0
+        END
@@ -0,0 +1,12 @@
+        TEXT 8
+
+// SP chargé hors du segment : le PUSH suivant tombe sur la page de garde
+main    EQU *
+        LOAD R15, #100000
+        PUSH #1
+        HALT
+        END
+
+        DATA 20
+        WORD 0
+        END
@@ -0,0 +1,187 @@
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "text.h"
+
+/*!
+ * \file text.c
+ * \brief Implémentation de text.h. Table des segments de texte partagés.
+ *
+ * La table est une table de hachage à chaînage ; l'entrée d'un segment est
+ * donnée par les premiers octets de son empreinte.
+ */
+
+//! Nombre d'entrées de la table
+#define TEXT_BUCKETS 256
+
+//! Table des segments internés
+static Shared_Text *table[TEXT_BUCKETS];
+
+//! Statistiques
+static Text_Stats stats;
+
+//! Verrou de la table
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void text_key(const Instruction *text, unsigned size, Hash *key)
+{
+    Hash_Context ctx;
+
+    hash_init(&ctx);
+    hash_update(&ctx, &size, sizeof(size));
+    hash_update(&ctx, text, size * sizeof(Instruction));
+    hash_final(&ctx, key);
+}
+
+//! Entrée de la table d'une empreinte
+static Shared_Text **bucket(const Hash *key)
+{
+    return &table[(key->_bytes[0] | key->_bytes[1] << 8) % TEXT_BUCKETS];
+}
+
+//! Recherche d'un segment interné (verrou pris) et nouvelle référence
+static Shared_Text *find(const Hash *key, unsigned size)
+{
+    Shared_Text *shared;
+
+    for(shared = *bucket(key); shared; shared = shared->_next)
+        if(shared->_size == size && !memcmp(&shared->_key, key, sizeof(*key)))
+        {
+            ++shared->_refs;
+            ++stats._refs;
+            ++stats._hits;
+            break;
+        }
+
+    return shared;
+}
+
+//! Libération d'une copie (hors table)
+static void destroy(Shared_Text *shared)
+{
+    if(shared->_library)
+        dlclose(shared->_library);
+    free(shared->_stream);
+    free(shared->_loops);
+    free(shared);
+}
+
+Shared_Text *text_intern(const Instruction *text, unsigned size)
+{
+    Hash key;
+    Shared_Text *shared;
+
+    // L'empreinte est calculée hors verrou
+    text_key(text, size, &key);
+
+    pthread_mutex_lock(&table_lock);
+    shared = find(&key, size);
+    pthread_mutex_unlock(&table_lock);
+
+    if(shared)
+        return shared;
+
+    // Nouvelle copie, prédécodée hors verrou
+    if(!(shared = malloc(sizeof(Shared_Text) + size * sizeof(Instruction))))
+        return NULL;
+
+    shared->_key = key;
+    shared->_size = size;
+    shared->_refs = 1;
+    shared->_native = NULL;
+    shared->_library = NULL;
+    memcpy(shared->_text, text, size * sizeof(Instruction));
+    // Sans flot prédécodé, les machines exécutent instruction par
+    // instruction
+    shared->_stream = exec_predecode(shared->_text, size, &shared->_fusions);
+    shared->_loops = NULL;
+    shared->_nloops = 0;
+    if(shared->_stream)
+        shared->_loops = loop_analyze(shared->_text, size, &shared->_nloops);
+    for(unsigned i = 0; i < shared->_nloops && i + 1 < 1u << 24; ++i)
+        shared->_stream[shared->_loops[i]._head]._loop = i + 1;
+
+    // Un autre thread a pu interner le même segment entre-temps
+    pthread_mutex_lock(&table_lock);
+    Shared_Text *other = find(&key, size);
+    if(!other)
+    {
+        Shared_Text **head = bucket(&key);
+        shared->_next = *head;
+        *head = shared;
+        ++stats._texts;
+        ++stats._refs;
+        stats._bytes += sizeof(Shared_Text) + size * sizeof(Instruction);
+    }
+    pthread_mutex_unlock(&table_lock);
+
+    if(other)
+    {
+        destroy(shared);
+        shared = other;
+    }
+
+    return shared;
+}
+
+Shared_Text *text_retain(Shared_Text *shared)
+{
+    pthread_mutex_lock(&table_lock);
+    ++shared->_refs;
+    ++stats._refs;
+    pthread_mutex_unlock(&table_lock);
+
+    return shared;
+}
+
+void text_release(Shared_Text *shared)
+{
+    if(!shared)
+        return;
+
+    pthread_mutex_lock(&table_lock);
+    --stats._refs;
+    if(--shared->_refs == 0)
+    {
+        Shared_Text **p = bucket(&shared->_key);
+        while(*p != shared)
+            p = &(*p)->_next;
+        *p = shared->_next;
+
+        --stats._texts;
+        stats._bytes -= sizeof(Shared_Text) + shared->_size * sizeof(Instruction);
+    }
+    else
+        shared = NULL;
+    pthread_mutex_unlock(&table_lock);
+
+    if(shared)
+        destroy(shared);
+}
+
+bool text_attach_native(Shared_Text *shared, void *native, void *library)
+{
+    bool attached = false;
+
+    pthread_mutex_lock(&table_lock);
+    if(!shared->_native)
+    {
+        shared->_library = library;
+        __atomic_store_n(&shared->_native, native, __ATOMIC_RELEASE);
+        attached = true;
+    }
+    pthread_mutex_unlock(&table_lock);
+
+    return attached;
+}
+
+Text_Stats text_stats(void)
+{
+    pthread_mutex_lock(&table_lock);
+    Text_Stats s = stats;
+    pthread_mutex_unlock(&table_lock);
+
+    return s;
+}
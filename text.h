@@ -0,0 +1,95 @@
+#ifndef _TEXT_H_
+#define _TEXT_H_
+
+/*!
+ * \file text.h
+ * \brief Segments de texte partagés entre machines.
+ *
+ * Les segments de texte sont \e internés dans une table globale au
+ * processus, indexée par l'empreinte SHA-256 (hash.h) de leur contenu :
+ * toutes les machines qui exécutent le même programme désignent la même
+ * copie, qui n'est jamais modifiée. Une copie est libérée quand la dernière
+ * machine qui l'utilise la rend.
+ *
+ * Les formes dérivées du texte (le flot d'exécution prédécodé et ses
+ * boucles à compteur, construits à l'internement, et le code natif obtenu par native_load()) sont
+ * rattachées à la copie partagée : elles ne sont calculées qu'une fois pour
+ * toutes les machines.
+ *
+ * Les fonctions peuvent être appelées depuis plusieurs threads ; la table
+ * est protégée par un verrou, pris seulement pour consulter et modifier la
+ * table : le flot prédécodé d'un nouveau segment est construit hors verrou.
+ */
+
+#include "exec.h"
+#include "hash.h"
+#include "loop.h"
+#include "instruction.h"
+
+//! Segment de texte partagé
+typedef struct Shared_Text
+{
+    Hash _key;                  //!< Empreinte du contenu
+    unsigned _size;             //!< Nombre d'instructions
+    unsigned _refs;             //!< Nombre d'utilisateurs
+    void *_native;              //!< Code natif (\c Translated_Func) ou NULL
+    void *_library;             //!< Bibliothèque (dlopen()) contenant \c _native
+    Exec_Slot *_stream;         //!< Flot prédécodé (exec_predecode()) ou NULL
+    Fusion_Stats _fusions;      //!< Séquences fusionnées dans \c _stream
+    Loop *_loops;               //!< Boucles à compteur (têtes marquées dans \c _stream)
+    unsigned _nloops;           //!< Nombre de boucles à compteur
+    struct Shared_Text *_next;  //!< Suivant dans la même entrée de la table
+    Instruction _text[];        //!< Les instructions (non modifiables)
+} Shared_Text;
+
+//! Statistiques de la table
+typedef struct
+{
+    unsigned _texts;            //!< Segments internés
+    unsigned long _refs;        //!< Références (somme des utilisateurs)
+    unsigned long _hits;        //!< Segments trouvés déjà internés
+    size_t _bytes;              //!< Mémoire occupée par les segments
+} Text_Stats;
+
+//! Empreinte d'un segment de texte
+/*!
+ * \param text les instructions
+ * \param size leur nombre
+ * \param key l'empreinte obtenue
+ */
+void text_key(const Instruction *text, unsigned size, Hash *key);
+
+//! Obtention de la copie partagée d'un segment de texte
+/*!
+ * Si un segment de même contenu est déjà interné, sa référence est
+ * augmentée et \a text n'est pas copié.
+ *
+ * \param text les instructions
+ * \param size leur nombre
+ * \return la copie partagée, ou NULL si la mémoire manque
+ */
+Shared_Text *text_intern(const Instruction *text, unsigned size);
+
+//! Nouvelle référence à une copie partagée
+Shared_Text *text_retain(Shared_Text *shared);
+
+//! Abandon d'une référence (la dernière libère la copie)
+/*!
+ * La dernière référence ferme aussi la bibliothèque du code natif.
+ */
+void text_release(Shared_Text *shared);
+
+//! Rattachement du code natif à une copie partagée
+/*!
+ * \param shared la copie partagée
+ * \param native le code natif (\c Translated_Func)
+ * \param library la bibliothèque qui le contient, fermée avec la copie
+ * \return faux si un code natif est déjà rattaché (chargé par un autre
+ * thread) : \a library reste alors à fermer par l'appelant
+ */
+bool text_attach_native(Shared_Text *shared, void *native, void *library);
+
+//! Statistiques de la table
+Text_Stats text_stats(void);
+
+#endif
@@ -0,0 +1,450 @@
+#include <stdlib.h>
+
+#include "error.h"
+#include "translate.h"
+
+/*!
+ * \file translate.c
+ * \brief Implémentation de translate.h. Traduction en C.
+ */
+
+//! Prologue commun à tout code traduit
+static const char prologue[] =
+    "#include <stdbool.h>\n"
+    "\n"
+    "#include \"machine.h\"\n"
+    "#include \"error.h\"\n"
+    "#include \"port.h\"\n"
+    "\n"
+    "#define R pmach->_registers\n"
+    "#define D pmach->_data\n"
+    "#define C pmach->_counters\n"
+    "\n"
+    "static inline void set_cc(Machine *pmach, int res)\n"
+    "{\n"
+    "    pmach->_cc = res < 0 ? CC_N : res == 0 ? CC_Z : CC_P;\n"
+    "}\n"
+    "\n"
+    "static inline Word divide(Word a, Word b, bool mod, unsigned addr)\n"
+    "{\n"
+    "    if(b == 0) error(ERR_DIVIDE, addr);\n"
+    "    if((int32_t)b == -1) return mod ? 0 : -a;\n"
+    "    return mod ? (Word)((int32_t)a % (int32_t)b)\n"
+    "        : (Word)((int32_t)a / (int32_t)b);\n"
+    "}\n"
+    "\n";
+
+//! Expression C du test d'une condition
+static const char *condition_tests[] =
+{
+    "true",
+    "pmach->_cc == CC_Z",
+    "pmach->_cc != CC_Z",
+    "pmach->_cc == CC_P",
+    "pmach->_cc == CC_P || pmach->_cc == CC_Z",
+    "pmach->_cc == CC_N",
+    "pmach->_cc == CC_N || pmach->_cc == CC_Z",
+};
+
+//! Écrit le calcul de l'adresse de l'opérande dans la variable \c a, sans
+//! vérification
+static void emit_address(FILE *out, Instruction instr)
+{
+    if(instr.instr_generic._indexed)
+        fprintf(out, "        unsigned a = R[%u] + %d;\n",
+                instr.instr_indexed._rindex, instr.instr_indexed._offset);
+    else
+        fprintf(out, "        unsigned a = %uu;\n",
+                instr.instr_absolute._address);
+}
+
+//! Écrit le calcul de l'adresse de l'opérande dans la variable \c a
+/*!
+ * L'adresse est vérifiée par rapport à la taille du segment de données.
+ *
+ * \param out le flot de sortie
+ * \param instr l'instruction
+ * \param addr son adresse
+ */
+static void emit_data_address(FILE *out, Instruction instr, unsigned addr)
+{
+    emit_address(out, instr);
+    fprintf(out, "        if(a >= pmach->_datasize) error(ERR_SEGDATA, %u);\n",
+            addr);
+}
+
+//! Écrit l'expression de la valeur de l'opérande (après emit_data_address())
+static const char *value_expression(Instruction instr)
+{
+    return instr.instr_generic._immediate ? "v" : "D[a]";
+}
+
+//! Écrit la lecture de l'opérande (comptée si elle est en mémoire)
+static void emit_read(FILE *out, Instruction instr, unsigned addr)
+{
+    emit_data_address(out, instr, addr);
+    fprintf(out, "        ++C._reads;\n");
+}
+
+//! Écrit l'effet d'une instruction arithmétique ou logique sur son registre
+/*!
+ * \param out le flot de sortie
+ * \param op le code opération
+ * \param r le numéro du registre
+ * \param v l'expression C de la valeur de l'opérande
+ * \param addr l'adresse de l'instruction
+ */
+static void emit_arith(FILE *out, Code_Op op, unsigned r, const char *v,
+        unsigned addr)
+{
+    switch(op)
+    {
+        case LOAD: fprintf(out, "        R[%u] = %s;\n", r, v); break;
+        case ADD: fprintf(out, "        R[%u] += %s;\n", r, v); break;
+        case SUB: fprintf(out, "        R[%u] -= %s;\n", r, v); break;
+        case MUL: fprintf(out, "        R[%u] *= %s;\n", r, v); break;
+        case AND: fprintf(out, "        R[%u] &= %s;\n", r, v); break;
+        case OR: fprintf(out, "        R[%u] |= %s;\n", r, v); break;
+        case XOR: fprintf(out, "        R[%u] ^= %s;\n", r, v); break;
+        case SHL: fprintf(out, "        R[%u] <<= %s & 31;\n", r, v); break;
+        case SHR: fprintf(out, "        R[%u] >>= %s & 31;\n", r, v); break;
+
+        case SAR:
+            fprintf(out, "        R[%u] = (Word)((int32_t)R[%u] >> (%s & 31));\n",
+                    r, r, v);
+            break;
+
+        case CMP:
+            fprintf(out, "        set_cc(pmach, R[%u] - %s);\n", r, v);
+            return;
+
+        case DIV:
+        case MOD:
+            fprintf(out, "        R[%u] = divide(R[%u], %s, %s, %u);\n",
+                    r, r, v, op == MOD ? "true" : "false", addr);
+            break;
+
+        default:
+            break;
+    }
+
+    fprintf(out, "        set_cc(pmach, R[%u]);\n", r);
+}
+
+//! Écrit le comptage d'une instruction exécutée
+static void emit_retired(FILE *out, Instruction instr, const char *indent)
+{
+    fprintf(out, "%s++C._retired[%u];\n", indent, instr.instr_generic._cop);
+}
+
+//! Écrit le saut vers une adresse de texte
+/*!
+ * La cible est calculée avant \a epilogue, comme dans exec.c (le
+ * dépilement de \c CALL suit le calcul de l'adresse).
+ *
+ * \param out le flot de sortie
+ * \param instr l'instruction de branchement
+ * \param textsize la taille du segment de texte
+ * \param epilogue instruction C à exécuter avant le saut
+ */
+static void emit_jump(FILE *out, Instruction instr, unsigned textsize,
+        const char *epilogue)
+{
+    if(instr.instr_generic._indexed)
+        fprintf(out, "            pmach->_pc = R[%u] + %d;\n"
+                "            %s\n"
+                "            goto dispatch;\n",
+                instr.instr_indexed._rindex, instr.instr_indexed._offset,
+                epilogue);
+    else if(instr.instr_absolute._address < textsize)
+        fprintf(out, "            %s\n"
+                "            goto L_%u;\n", epilogue,
+                instr.instr_absolute._address);
+    else
+        fprintf(out, "            pmach->_pc = %u;\n"
+                "            %s\n"
+                "            error(ERR_SEGTEXT, %u);\n",
+                instr.instr_absolute._address, epilogue,
+                instr.instr_absolute._address);
+}
+
+//! Traduction d'une instruction
+/*!
+ * \param out le flot de sortie
+ * \param instr l'instruction
+ * \param addr son adresse
+ * \param textsize la taille du segment de texte
+ */
+static void translate_instruction(FILE *out, Instruction instr, unsigned addr,
+        unsigned textsize)
+{
+    unsigned r = instr.instr_generic._regcond;
+    bool imm = instr.instr_generic._immediate;
+
+    fprintf(out, "        pmach->_pc = %u;\n", addr + 1);
+
+    switch(instr.instr_generic._cop)
+    {
+        case NOP:
+            break;
+
+        case LOAD:
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+        case MOD:
+        case AND:
+        case OR:
+        case XOR:
+        case SHL:
+        case SHR:
+        case SAR:
+        case CMP:
+        case PUSH:
+            if(instruction_mode(instr) == MODE_REGISTER)
+                fprintf(out, "        Word v = R[%u];\n",
+                        instr.instr_register._rsource);
+            else if(imm)
+                fprintf(out, "        Word v = %d;\n",
+                        instr.instr_immediate._value);
+
+            // La pile n'est pas vérifiée : le segment de données est gardé
+            // (guard.h). Elle est touchée avant la lecture d'un opérande en
+            // mémoire pour que ERR_SEGSTACK précède ERR_SEGDATA.
+            if(instr.instr_generic._cop == PUSH)
+            {
+                fprintf(out, "        if(pmach->_sp < pmach->_dataend) "
+                        "warning(WARN_PUSH_STATIC, %u);\n", addr);
+                if(!imm)
+                {
+                    fprintf(out, "        (void)*(volatile Word *)"
+                            "&D[stack_slot(pmach)];\n");
+                    emit_read(out, instr, addr);
+                }
+                fprintf(out, "        D[stack_slot(pmach)] = %s;\n"
+                        "        --pmach->_sp;\n"
+                        "        ++C._pushes;\n"
+                        "        counters_sp(&C, pmach->_sp);\n",
+                        value_expression(instr));
+                break;
+            }
+
+            if(!imm)
+                emit_read(out, instr, addr);
+            emit_arith(out, instr.instr_generic._cop, r,
+                    value_expression(instr), addr);
+            break;
+
+        case STORE:
+            if(imm)
+                fprintf(out, "        error(ERR_IMMEDIATE, %u);\n", addr);
+            else
+            {
+                // Hors du segment : port de sortie (port.h) ou erreur
+                emit_address(out, instr);
+                fprintf(out, "        if(a < pmach->_datasize) D[a] = R[%u];\n"
+                        "        else port_store(pmach, a, R[%u], %u);\n"
+                        "        ++C._writes;\n", r, r, addr);
+            }
+            break;
+
+        case XCHG:
+            if(imm)
+                fprintf(out, "        error(ERR_IMMEDIATE, %u);\n", addr);
+            else
+            {
+                emit_data_address(out, instr, addr);
+                fprintf(out, "        R[%u] = __atomic_exchange_n(&D[a], R[%u], "
+                        "__ATOMIC_SEQ_CST);\n"
+                        "        set_cc(pmach, R[%u]);\n"
+                        "        ++C._reads;\n"
+                        "        ++C._writes;\n", r, r, r);
+            }
+            break;
+
+        case BRANCH:
+        case CALL:
+            if(imm)
+            {
+                fprintf(out, "        error(ERR_IMMEDIATE, %u);\n", addr);
+                break;
+            }
+
+            if(r > LAST_CONDITION)
+            {
+                fprintf(out, "        error(ERR_CONDITION, %u);\n", addr);
+                break;
+            }
+
+            if(r != NC)
+                fprintf(out, "        if(pmach->_cc == CC_U) "
+                        "error(ERR_CONDITION, %u);\n", addr);
+
+            fprintf(out, "        bool jump = %s;\n"
+                    "        C._taken += jump;\n"
+                    "        C._not_taken += !jump;\n"
+                    "        if(jump)\n        {\n", condition_tests[r]);
+            if(instr.instr_generic._cop == CALL)
+            {
+                fprintf(out, "            D[stack_slot(pmach)] = %u;\n"
+                        "            ++C._pushes;\n", addr + 1);
+                emit_retired(out, instr, "            ");
+
+                // La cible indexée est déjà dans le compteur ordinal
+                char epilogue[128];
+                if(instr.instr_generic._indexed)
+                    snprintf(epilogue, sizeof(epilogue), "--pmach->_sp; "
+                            "counters_sp(&C, pmach->_sp); "
+                            "shadow_call(pmach, pmach->_pc);");
+                else
+                    snprintf(epilogue, sizeof(epilogue), "--pmach->_sp; "
+                            "counters_sp(&C, pmach->_sp); "
+                            "shadow_call(pmach, %u);",
+                            instr.instr_absolute._address);
+                emit_jump(out, instr, textsize, epilogue);
+            }
+            else
+            {
+                emit_retired(out, instr, "            ");
+                emit_jump(out, instr, textsize, ";");
+            }
+            fprintf(out, "        }\n");
+            break;
+
+        case RET:
+            fprintf(out, "        ++pmach->_sp;\n"
+                    "        pmach->_pc = D[stack_slot(pmach)];\n"
+                    "        shadow_return(pmach);\n"
+                    "        ++C._pops;\n"
+                    "        ++C._retired[RET];\n"
+                    "        goto dispatch;\n");
+            break;
+
+        case POP:
+            fprintf(out, "        ++pmach->_sp;\n");
+            if(imm)
+            {
+                fprintf(out, "        error(ERR_IMMEDIATE, %u);\n", addr);
+                break;
+            }
+            fprintf(out, "        Word v = D[stack_slot(pmach)];\n");
+            emit_data_address(out, instr, addr);
+            fprintf(out, "        D[a] = v;\n"
+                    "        ++C._pops;\n"
+                    "        ++C._writes;\n");
+            break;
+
+        case HALT:
+            fprintf(out, "        warning(WARN_HALT, %u);\n"
+                    "        ++C._retired[HALT];\n"
+                    "        return true;\n", addr);
+            break;
+
+        default:    // ILLOP et codes inconnus
+            fprintf(out, "        error(ERR_ILLEGAL, %u);\n", addr);
+            break;
+    }
+
+    // Instruction terminée sans saut
+    emit_retired(out, instr, "        ");
+}
+
+//! Marque les cibles des branchements à adresse absolue
+/*!
+ * \param pmach la machine contenant le programme
+ * \return un tableau de \c _textsize booléens (à libérer)
+ */
+static bool *branch_targets(Machine *pmach)
+{
+    bool *targets = calloc(pmach->_textsize + 1, sizeof(bool));
+
+    if(!targets)
+    {
+        fprintf(stderr, "Mémoire insuffisante.\n");
+        exit(1);
+    }
+
+    for(unsigned i = 0; i < pmach->_textsize; ++i)
+    {
+        Instruction instr = pmach->_text[i];
+        Code_Op op = instr.instr_generic._cop;
+
+        if((op == BRANCH || op == CALL) && !instr.instr_generic._immediate
+                && !instr.instr_generic._indexed
+                && instr.instr_absolute._address < pmach->_textsize)
+            targets[instr.instr_absolute._address] = true;
+    }
+
+    return targets;
+}
+
+//! Écriture d'un tableau de mots
+static void emit_words(FILE *out, const char *decl, const Word *words,
+        unsigned n)
+{
+    fprintf(out, "%s[%u] =\n{", decl, n > 0 ? n : 1);
+    for(unsigned i = 0; i < n; ++i)
+        fprintf(out, "%s0x%08x,", i % 6 == 0 ? "\n    " : " ", words[i]);
+    fprintf(out, "\n};\n\n");
+}
+
+void translate_program(FILE *out, Machine *pmach, bool standalone)
+{
+    bool *targets = branch_targets(pmach);
+
+    fprintf(out, "// Traduction d'un programme de %u instructions "
+            "(traducteur version %d)\n\n", pmach->_textsize,
+            TRANSLATOR_VERSION);
+    fputs(prologue, out);
+
+    fprintf(out, "bool " TRANSLATED_ENTRY "(Machine *pmach)\n{\n"
+            "    goto dispatch;\n"
+            "dispatch:\n"
+            "    switch(pmach->_pc)\n"
+            "    {\n"
+            "    default:\n"
+            "        error(ERR_SEGTEXT, pmach->_pc);\n");
+
+    for(unsigned i = 0; i < pmach->_textsize; ++i)
+    {
+        fprintf(out, "    case %u:%s\n", i, targets[i] ? "" : " {");
+        if(targets[i])
+            fprintf(out, "    L_%u: {\n", i);
+        translate_instruction(out, pmach->_text[i], i, pmach->_textsize);
+        fprintf(out, "    }\n");
+    }
+
+    fprintf(out, "    }\n"
+            "    pmach->_pc = %u;\n"
+            "    error(ERR_SEGTEXT, %u);\n"
+            "}\n", pmach->_textsize, pmach->_textsize);
+
+    if(standalone)
+    {
+        fprintf(out, "\n#include <stdio.h>\n"
+                "#include <string.h>\n\n"
+                "#include \"guard.h\"\n\n");
+        emit_words(out, "static Word text_words", &pmach->_text->_raw,
+                pmach->_textsize);
+        emit_words(out, "static Word data", pmach->_data, pmach->_datasize);
+        fprintf(out, "int main(void)\n{\n"
+                "    Machine mach;\n"
+                "    Word *end = guard_reserve(%u);\n\n"
+                "    if(!end)\n"
+                "        return 1;\n"
+                "    memcpy(end - %u, data, sizeof(data));\n"
+                "    load_program(&mach, %u, (Instruction *)text_words, "
+                "%u, end - %u, %u);\n"
+                "    machine_enter(&mach);\n"
+                "    " TRANSLATED_ENTRY "(&mach);\n\n"
+                "    printf(\"\\n*** Machine state after execution ***\\n\");\n"
+                "    print_cpu(&mach);\n"
+                "    print_data(&mach);\n\n"
+                "    return 0;\n}\n",
+                pmach->_datasize, pmach->_datasize, pmach->_textsize,
+                pmach->_datasize, pmach->_datasize, pmach->_dataend);
+    }
+
+    free(targets);
+}
@@ -0,0 +1,48 @@
+#ifndef _TRANSLATE_H_
+#define _TRANSLATE_H_
+
+/*!
+ * \file translate.h
+ * \brief Traduction d'un programme simulé en source C.
+ *
+ * Chaque instruction du segment de texte devient une instruction C
+ * étiquetée. Les branchements à adresse absolue deviennent des \c goto ; les
+ * branchements calculés (mode indexé, \c RET) passent par un \c switch sur le
+ * compteur ordinal. Les erreurs (\c ERR_*) et avertissements (\c WARN_*) sont
+ * signalés aux mêmes adresses que par simul().
+ *
+ * Le source produit définit la fonction
+ * \code
+ * bool translated_run(Machine *pmach);
+ * \endcode
+ * qui exécute le programme à partir de \c pmach->_pc jusqu'au \c HALT. Il
+ * dépend seulement de machine.h et error.h.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "machine.h"
+
+//! Version du traducteur (le code produit change avec elle)
+#define TRANSLATOR_VERSION 11
+
+//! Nom de la fonction d'entrée du code traduit
+#define TRANSLATED_ENTRY "translated_run"
+
+//! Type de la fonction d'entrée du code traduit
+typedef bool (*Translated_Func)(Machine *pmach);
+
+//! Traduction d'un programme en C
+/*!
+ * Si \a standalone est vrai, le source contient aussi le segment de
+ * données initial et une fonction main() qui exécute le programme puis
+ * affiche l'état final de la machine comme \c test_simul.
+ *
+ * \param out le flot de sortie
+ * \param pmach la machine contenant le programme (et les données)
+ * \param standalone produire un programme complet ?
+ */
+void translate_program(FILE *out, Machine *pmach, bool standalone);
+
+#endif